@@ -0,0 +1,82 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <utility>
+#include "ColumnStore.h"
+
+void ValidityBitmap::Resize(size_t n_s, bool valid)
+{
+	n = n_s;
+	words.assign((n + 63) / 64, valid ? ~(boost::uint64_t) 0 : 0);
+	ClearTail();
+}
+
+void ValidityBitmap::SetAll(bool valid)
+{
+	std::fill(words.begin(), words.end(), valid ? ~(boost::uint64_t) 0 : 0);
+	ClearTail();
+}
+
+/** Keep the bits past the last row zero so that Count can add whole
+ words. */
+void ValidityBitmap::ClearTail()
+{
+	if (n & 63) words.back() &= ((boost::uint64_t) 1 << (n & 63)) - 1;
+}
+
+size_t ValidityBitmap::Count() const
+{
+	size_t cnt = 0;
+	for (size_t w=0, sz=words.size(); w<sz; w++) {
+		boost::uint64_t x = words[w];
+		// popcount without compiler builtins
+		x = x - ((x >> 1) & 0x5555555555555555ULL);
+		x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+		x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+		cnt += (size_t) ((x * 0x0101010101010101ULL) >> 56);
+	}
+	return cnt;
+}
+
+StringDictionary::StringDictionary()
+{
+	Encode("");
+}
+
+void StringDictionary::Resize(size_t n)
+{
+	codes.assign(n, 0);
+}
+
+void StringDictionary::Set(size_t row, const char* val)
+{
+	codes[row] = Encode(val);
+}
+
+int StringDictionary::Encode(const char* val)
+{
+	std::string s(val ? val : "");
+	std::map<std::string, int>::iterator it = index.find(s);
+	if (it != index.end()) return it->second;
+	int code = (int) values.size();
+	it = index.insert(std::make_pair(s, code)).first;
+	values.push_back(&it->first);
+	return code;
+}
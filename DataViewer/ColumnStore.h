@@ -0,0 +1,119 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_COLUMN_STORE_H__
+#define __GEODA_CENTER_COLUMN_STORE_H__
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+/**
+ * Read-only view of the contiguous values of a table column.  It does not
+ * own the values: it is only valid until the column is modified, deleted
+ * or the table is closed.  An empty span means the column is not stored
+ * with the requested type.
+ */
+template <class T>
+class ColumnSpan
+{
+public:
+	ColumnSpan() : ptr(0), n(0) {}
+	ColumnSpan(const T* ptr_s, size_t n_s) : ptr(ptr_s), n(n_s) {}
+
+	const T* data() const { return ptr; }
+	size_t size() const { return n; }
+	bool empty() const { return n == 0; }
+	const T& operator[](size_t i) const { return ptr[i]; }
+	const T* begin() const { return ptr; }
+	const T* end() const { return ptr + n; }
+
+private:
+	const T* ptr;
+	size_t n;
+};
+
+/**
+ * One bit per row, set when the cell holds a value.  Replaces a bool per
+ * row and makes counting and bulk setting word-wise.
+ */
+class ValidityBitmap
+{
+public:
+	ValidityBitmap() : n(0) {}
+
+	void Resize(size_t n, bool valid);
+	void SetAll(bool valid);
+	size_t GetSize() const { return n; }
+	bool IsEmpty() const { return n == 0; }
+
+	bool Get(size_t i) const {
+		return (words[i >> 6] >> (i & 63)) & 1;
+	}
+	void Set(size_t i, bool valid) {
+		if (valid) words[i >> 6] |= (boost::uint64_t) 1 << (i & 63);
+		else words[i >> 6] &= ~((boost::uint64_t) 1 << (i & 63));
+	}
+	/** Number of valid cells */
+	size_t Count() const;
+
+private:
+	void ClearTail();
+
+	std::vector<boost::uint64_t> words;
+	size_t n;
+};
+
+/**
+ * Dictionary encoded strings: each row keeps the code of its value and
+ * every distinct value is stored once.  Values are kept as the raw bytes
+ * of the data source, so that they can be decoded with the table encoding
+ * when displayed.  Values no longer referenced by any row are not removed.
+ */
+class StringDictionary
+{
+public:
+	StringDictionary();
+
+	/** n rows, all set to the empty string */
+	void Resize(size_t n);
+	size_t GetSize() const { return codes.size(); }
+	/** Number of distinct values, including the empty string */
+	size_t GetNumValues() const { return values.size(); }
+
+	const std::string& Get(size_t row) const { return *values[codes[row]]; }
+	void Set(size_t row, const char* val);
+	int GetCode(size_t row) const { return codes[row]; }
+	const std::string& GetValue(int code) const { return *values[code]; }
+
+private:
+	// values point into index, so a copy would dangle
+	StringDictionary(const StringDictionary&);
+	StringDictionary& operator=(const StringDictionary&);
+	int Encode(const char* val);
+
+	std::vector<int> codes;
+	// values point to the keys of index, so each value is stored once
+	std::vector<const std::string*> values;
+	std::map<std::string, int> index;
+};
+
+#endif
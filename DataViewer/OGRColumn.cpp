@@ -35,14 +35,14 @@
 using namespace std;
 
 OGRColumn::OGRColumn(wxString name, int field_length, int decimals, int n_rows)
-: name(name), length(field_length), decimals(decimals), is_new(true), is_deleted(false), rows(n_rows)
+: name(name), length(field_length), decimals(decimals), is_new(true), is_deleted(false), rows(n_rows), ogr_layer(NULL), is_loaded(true)
 {
 }
 
 OGRColumn::OGRColumn(OGRLayerProxy* _ogr_layer,
                      wxString name, int field_length,int decimals)
 : name(name), ogr_layer(_ogr_layer), length(field_length), decimals(decimals),
-is_new(true), is_deleted(false)
+is_new(true), is_deleted(false), is_loaded(true)
 {
     rows = ogr_layer->GetNumRecords();
 }
@@ -55,6 +55,8 @@ OGRColumn::OGRColumn(OGRLayerProxy* _ogr_layer, int idx)
     // the column name.
     is_new = false;
     is_deleted = false;
+    // values are read from the OGRFeatures on first access
+    is_loaded = false;
     ogr_layer = _ogr_layer;
     rows = ogr_layer->GetNumRecords();
     name = ogr_layer->GetFieldName(idx);
@@ -116,15 +118,17 @@ void OGRColumn::UpdateOGRLayer(OGRLayerProxy* new_ogr_layer)
 
 bool OGRColumn::IsCellUpdated(int row)
 {
-    if (!set_markers.empty()) {
-        return set_markers[row];
+    EnsureLoaded();
+    if (!validity.IsEmpty()) {
+        return validity.Get(row);
     }
 	return false;
 }
 
 bool OGRColumn::IsUndefined(int row)
 {
-    return !set_markers[row];
+    EnsureLoaded();
+    return !validity.Get(row);
 }
 
 void OGRColumn::UpdateData(const vector<double> &data)
@@ -175,12 +179,8 @@ OGRColumnInteger::OGRColumnInteger(wxString name, int field_length, int decimals
 {
     // a new in-memory integer column
     is_new = true;
-    new_data.resize(rows);
-    set_markers.resize(rows);
-    for (int i=0; i<rows; ++i) {
-        new_data[i] = 0;
-        set_markers[i] = false;
-    }
+    col_data.assign(rows, 0);
+    validity.Resize(rows, false);
 }
 
 OGRColumnInteger::OGRColumnInteger(OGRLayerProxy* ogr_layer, wxString name,
@@ -189,133 +189,114 @@ OGRColumnInteger::OGRColumnInteger(OGRLayerProxy* ogr_layer, wxString name,
 {
     // a new integer column
     is_new = true;
-    new_data.resize(rows);
-    set_markers.resize(rows);
-    for (int i=0; i<rows; ++i) {
-        new_data[i] = 0;
-        set_markers[i] = false;
-    }
+    col_data.assign(rows, 0);
+    validity.Resize(rows, false);
 }
 
 OGRColumnInteger::OGRColumnInteger(OGRLayerProxy* ogr_layer, int idx)
 :OGRColumn(ogr_layer, idx)
 {
-    // a integer column from OGRLayer
+    // a integer column from OGRLayer, read by LoadData()
     is_new = false;
-    set_markers.resize(rows);
+}
+
+OGRColumnInteger::~OGRColumnInteger()
+{
+}
+
+void OGRColumnInteger::LoadData()
+{
+    int col_idx = GetColIndex();
+    col_data.resize(rows);
+    validity.Resize(rows, false);
     for (int i=0; i<rows; ++i) {
+        OGRFeature* feature = ogr_layer->data[i];
         // for non-undefined value
-        if ( ogr_layer->data[i]->IsFieldSet(idx) )
-            set_markers[i] = true;
-        else
-            set_markers[i] = false;
+        validity.Set(i, feature->IsFieldSet(col_idx));
+        col_data[i] = (wxInt64)feature->GetFieldAsInteger64(col_idx);
     }
 }
 
-OGRColumnInteger::~OGRColumnInteger()
+ColumnSpan<wxInt64> OGRColumnInteger::GetIntegerSpan()
 {
-    if (new_data.size() > 0 ) new_data.clear();
-    if (set_markers.size() > 0) set_markers.clear();
+    EnsureLoaded();
+    if (col_data.empty()) return ColumnSpan<wxInt64>();
+    return ColumnSpan<wxInt64>(&col_data[0], col_data.size());
 }
 
 void OGRColumnInteger::FillData(vector<wxInt64> &data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = new_data[i];
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i]=(wxInt64)ogr_layer->data[i]->GetFieldAsInteger64(col_idx);
-        }
-    }
+    EnsureLoaded();
+    data.assign(col_data.begin(), col_data.end());
 }
 
 
 void OGRColumnInteger::FillData(vector<double> &data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = (double)new_data[i];
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i] = (double)ogr_layer->data[i]->GetFieldAsInteger64(col_idx);
-        }
+    EnsureLoaded();
+    data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        data[i] = (double)col_data[i];
     }
 }
 
 void OGRColumnInteger::FillData(vector<wxString> &data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = wxString::Format(wxT("%")  wxT(wxLongLongFmtSpec)  wxT("d"), new_data[i]);
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i] = wxString::Format(wxT("%") wxT(wxLongLongFmtSpec) wxT("d"),
-                ogr_layer->data[i]->GetFieldAsInteger64(col_idx));
-        }
+    EnsureLoaded();
+    data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        data[i] = wxString::Format(wxT("%")  wxT(wxLongLongFmtSpec)  wxT("d"), col_data[i]);
     }
 }
 
 void OGRColumnInteger::UpdateData(const vector<wxInt64>& data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            new_data[i] = data[i];
-            set_markers[i] = true;
-        }
-    } else {
+    // every row is overwritten, so nothing needs to be read first
+    col_data.assign(data.begin(), data.begin() + rows);
+    validity.Resize(rows, true);
+    is_loaded = true;
+    if (!is_new) {
         int col_idx = GetColIndex();
         for (int i=0; i<rows; ++i) {
             ogr_layer->data[i]->SetField(col_idx, (GIntBig)data[i]);
-            set_markers[i] = true;
         }
     }
 }
 
 void OGRColumnInteger::UpdateData(const vector<double>& data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            new_data[i] = (int)data[i];
-            set_markers[i] = true;
-        }
-    } else {
+    col_data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        col_data[i] = (wxInt64)data[i];
+    }
+    validity.Resize(rows, true);
+    is_loaded = true;
+    if (!is_new) {
         int col_idx = GetColIndex();
         for (int i=0; i<rows; ++i) {
             ogr_layer->data[i]->SetField(col_idx, (GIntBig)data[i]);
-            set_markers[i] = true;
         }
     }
 }
 
 void OGRColumnInteger::GetCellValue(int row, wxInt64& val)
 {
-    if (is_new) {
-        val = new_data[row];
-    } else {
-        int col_idx = GetColIndex();
-        val = (wxInt64)ogr_layer->data[row]->GetFieldAsInteger64(col_idx);
-    }
+    EnsureLoaded();
+    val = col_data[row];
 }
 
 wxString OGRColumnInteger::GetValueAt(int row_idx, int disp_decimals,
                                       wxCSConv* m_wx_encoding)
 {
+    EnsureLoaded();
     if (is_new) {
-        if (set_markers[row_idx] == false )
+        if (validity.Get(row_idx) == false )
             return wxEmptyString;
-        return wxString::Format("%lld",new_data[row_idx]);
+        return wxString::Format("%lld",col_data[row_idx]);
     } else {
         int col_idx = GetColIndex();
         if (col_idx == -1) return wxEmptyString;
-        //const char* val = ogr_layer->data[row_idx]->GetFieldAsString(col_idx);
-        wxLongLong val(ogr_layer->data[row_idx]->GetFieldAsInteger64(col_idx));
+        wxLongLong val(col_data[row_idx]);
         
         return val.ToString();
     }
@@ -326,13 +307,13 @@ void OGRColumnInteger::SetValueAt(int row_idx, const wxString &value)
     wxInt64 l_val;
     if (GenUtils::validInt(value)) {
         GenUtils::strToInt64(value, &l_val);
-        if (is_new) {
-            new_data[row_idx] = l_val;
-        } else {
+        EnsureLoaded();
+        col_data[row_idx] = l_val;
+        if (!is_new) {
             int col_idx = GetColIndex();
             ogr_layer->data[row_idx]->SetField(col_idx, (GIntBig)l_val);
         }
-        set_markers[row_idx] = true;
+        validity.Set(row_idx, true);
     }
 }
 
@@ -344,12 +325,8 @@ OGRColumnDouble::OGRColumnDouble(wxString name, int field_length, int decimals,
     // a new in-memory integer column
     if ( decimals < 0) decimals = GdaConst::default_dbf_double_decimals;
     is_new = true;
-    new_data.resize(rows);
-    set_markers.resize(rows);
-    for (int i=0; i<rows; ++i) {
-        new_data[i] = 0.0;
-        set_markers[i] = false;
-    }
+    col_data.assign(rows, 0.0);
+    validity.Resize(rows, false);
 }
 OGRColumnDouble::OGRColumnDouble(OGRLayerProxy* ogr_layer, wxString name,
                                  int field_length, int decimals)
@@ -358,119 +335,99 @@ OGRColumnDouble::OGRColumnDouble(OGRLayerProxy* ogr_layer, wxString name,
     // a new double column
     if ( decimals < 0) decimals = GdaConst::default_dbf_double_decimals;
     is_new = true;
-    new_data.resize(rows);
-    set_markers.resize(rows);
-    for (int i=0; i<rows; ++i) {
-        new_data[i] = 0.0;
-        set_markers[i] = false;
-    }
+    col_data.assign(rows, 0.0);
+    validity.Resize(rows, false);
 }
 
 OGRColumnDouble::OGRColumnDouble(OGRLayerProxy* ogr_layer, int idx)
 :OGRColumn(ogr_layer, idx)
 {
-    // a double column from OGRLayer
+    // a double column from OGRLayer, read by LoadData()
     if ( decimals < 0) decimals = GdaConst::default_dbf_double_decimals;
     is_new = false;
-    set_markers.resize(rows);
+}
+
+OGRColumnDouble::~OGRColumnDouble()
+{
+}
+
+void OGRColumnDouble::LoadData()
+{
+    int col_idx = GetColIndex();
+    col_data.resize(rows);
+    validity.Resize(rows, false);
     for (int i=0; i<rows; ++i) {
+        OGRFeature* feature = ogr_layer->data[i];
         // for non-undefined value
-        if ( ogr_layer->data[i]->IsFieldSet(idx) )
-            set_markers[i] = true;
-        else
-            set_markers[i] = false;
+        validity.Set(i, feature->IsFieldSet(col_idx));
+        col_data[i] = feature->GetFieldAsDouble(col_idx);
     }
 }
 
-OGRColumnDouble::~OGRColumnDouble()
+ColumnSpan<double> OGRColumnDouble::GetDoubleSpan()
 {
-    if (new_data.size() > 0 ) new_data.clear();
-    if (set_markers.size() > 0) set_markers.clear();
+    EnsureLoaded();
+    if (col_data.empty()) return ColumnSpan<double>();
+    return ColumnSpan<double>(&col_data[0], col_data.size());
 }
 
-
 void OGRColumnDouble::FillData(vector<wxInt64> &data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = (wxInt64)new_data[i];
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i] = (wxInt64)ogr_layer->data[i]->GetFieldAsDouble(col_idx);
-        }
+    EnsureLoaded();
+    data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        data[i] = (wxInt64)col_data[i];
     }
 }
 
 void OGRColumnDouble::FillData(vector<double> &data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = new_data[i];
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i] = ogr_layer->data[i]->GetFieldAsDouble(col_idx);
-        }
-    }
+    EnsureLoaded();
+    data.assign(col_data.begin(), col_data.end());
 }
 
 void OGRColumnDouble::FillData(vector<wxString> &data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = wxString::Format("%f", new_data[i]);
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i] = wxString::Format("%f",
-                ogr_layer->data[i]->GetFieldAsDouble(col_idx));
-        }
+    EnsureLoaded();
+    data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        data[i] = wxString::Format("%f", col_data[i]);
     }
 }
 
 void OGRColumnDouble::UpdateData(const vector<double>& data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            new_data[i] = data[i];
-            set_markers[i] = true;
-        }
-    } else {
+    // every row is overwritten, so nothing needs to be read first
+    col_data.assign(data.begin(), data.begin() + rows);
+    validity.Resize(rows, true);
+    is_loaded = true;
+    if (!is_new) {
         int col_idx = GetColIndex();
         for (int i=0; i<rows; ++i) {
             ogr_layer->data[i]->SetField(col_idx, data[i]);
-            set_markers[i] = true;
         }
     }
 }
 
 void OGRColumnDouble::UpdateData(const vector<wxInt64>& data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            new_data[i] = (double)data[i];
-            set_markers[i] = true;
-        }
-    } else {
+    col_data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        col_data[i] = (double)data[i];
+    }
+    validity.Resize(rows, true);
+    is_loaded = true;
+    if (!is_new) {
         int col_idx = GetColIndex();
         for (int i=0; i<rows; ++i) {
             ogr_layer->data[i]->SetField(col_idx, (double)data[i]);
-            set_markers[i] = true;
         }
     }
 }
 void OGRColumnDouble::GetCellValue(int row, double& val)
 {
-    if (is_new) {
-        val = new_data[row];
-    } else {
-        int col_idx = GetColIndex();
-        val = ogr_layer->data[row]->GetFieldAsDouble(col_idx);
-    }
+    EnsureLoaded();
+    val = col_data[row];
 }
 
 wxString OGRColumnDouble::GetValueAt(int row_idx, int disp_decimals,
@@ -479,26 +436,23 @@ wxString OGRColumnDouble::GetValueAt(int row_idx, int disp_decimals,
     disp_decimals = 0;
     double val;
     if (is_new) {
-        if (set_markers[row_idx]== false)
+        if (validity.Get(row_idx)== false)
             return wxEmptyString;
-        val = new_data[row_idx];
+        val = col_data[row_idx];
         wxString rst = wxString::Format("%f", val);
         return rst;
     } else {
         int col_idx = GetColIndex();
         if (col_idx == -1) return wxEmptyString;
-        const char* tmp = ogr_layer->data[row_idx]->GetFieldAsString(col_idx);
-        if (*tmp == '\0' ) {
+        EnsureLoaded();
+        if (validity.Get(row_idx) == false)
             return wxEmptyString;
-        } else {
-            // return raw values if no display decimals setup
-            if ( disp_decimals <=0 ) {
-                return wxString(tmp);
-            }
-        }
-        val = ogr_layer->data[row_idx]->GetFieldAsDouble(col_idx);
-        wxString rst = wxString::Format("%.*f", disp_decimals, val);
-        return rst;
+        val = col_data[row_idx];
+        // same text as OGRFeature::GetFieldAsString: fixed decimals for a
+        // field with a width, shortest round trip otherwise
+        if (length != 0)
+            return wxString::Format("%.*f", decimals, val);
+        return wxString::Format("%.15g", val);
     }
 }
 
@@ -506,13 +460,13 @@ void OGRColumnDouble::SetValueAt(int row_idx, const wxString &value)
 {
     double d_val;
     if (value.ToDouble(&d_val)) {
-        if (is_new) {
-            new_data[row_idx] = d_val;
-        } else {
+        EnsureLoaded();
+        col_data[row_idx] = d_val;
+        if (!is_new) {
             int col_idx = GetColIndex();
             ogr_layer->data[row_idx]->SetField(col_idx, d_val);
         }
-        set_markers[row_idx] = true;
+        validity.Set(row_idx, true);
     }
 }
 
@@ -525,11 +479,7 @@ OGRColumnString::OGRColumnString(wxString name, int field_length, int decimals,
     // a new in-memory string column
     is_new = true;
     new_data.resize(rows);
-    set_markers.resize(rows);
-    for (int i=0; i<rows; ++i) {
-        new_data[i] = wxEmptyString;
-        set_markers[i] = false;
-    }
+    validity.Resize(rows, false);
 }
 OGRColumnString::OGRColumnString(OGRLayerProxy* ogr_layer, wxString name,
                                  int field_length, int decimals)
@@ -538,35 +488,35 @@ OGRColumnString::OGRColumnString(OGRLayerProxy* ogr_layer, wxString name,
     // a new string column
     is_new = true;
     new_data.resize(rows);
-    set_markers.resize(rows);
-    for (int i=0; i<rows; ++i) {
-        new_data[i] = wxEmptyString;
-        set_markers[i] = false;
-    }
+    validity.Resize(rows, false);
 }
 
 OGRColumnString::OGRColumnString(OGRLayerProxy* ogr_layer, int idx)
 :OGRColumn(ogr_layer, idx)
 {
-    // a string column from OGRLayer
+    // a string column from OGRLayer, read by LoadData()
     is_new = false;
-    set_markers.resize(rows);
-    for (int i=0; i<rows; ++i) {
-        if ( ogr_layer->data[i]->IsFieldSet(idx) )
-            set_markers[i] = true;
-        else
-            set_markers[i] = false;
-    }
 }
 
 OGRColumnString::~OGRColumnString()
 {
-    if (new_data.size() > 0 ) new_data.clear();
-    if (set_markers.size() > 0) set_markers.clear();
+}
+
+void OGRColumnString::LoadData()
+{
+    int col_idx = GetColIndex();
+    ogr_data.Resize(rows);
+    validity.Resize(rows, false);
+    for (int i=0; i<rows; ++i) {
+        OGRFeature* feature = ogr_layer->data[i];
+        validity.Set(i, feature->IsFieldSet(col_idx));
+        ogr_data.Set(i, feature->GetFieldAsString(col_idx));
+    }
 }
 
 void OGRColumnString::FillData(vector<double> &data)
 {
+    data.resize(rows);
     if (is_new) {
         for (int i=0; i<rows; ++i) {
             double val;
@@ -580,13 +530,13 @@ void OGRColumnString::FillData(vector<double> &data)
             data[i] = val;
         }
     } else {
-        int col_idx = GetColIndex();
+        EnsureLoaded();
         bool conv_success = true;
         wxString tmp;
         
         // default C locale
         for (int i=0; i<rows; ++i) {
-            tmp=wxString(ogr_layer->data[i]->GetFieldAsString(col_idx));
+            tmp=GetOGRString(i);
             double val;
             if (!tmp.ToDouble(&val)) {
                 conv_success = false;
@@ -601,7 +551,7 @@ void OGRColumnString::FillData(vector<double> &data)
             wxString thousands_sep = CPLGetConfigOption("GDAL_LOCALE_SEPARATOR", "");
             if (thousands_sep == ",") {
                 for (int i=0; i<rows; ++i) {
-                    tmp=wxString(ogr_layer->data[i]->GetFieldAsString(col_idx));
+                    tmp=GetOGRString(i);
                     tmp.Replace(thousands_sep, "");
                     double val;
                     if (!tmp.ToDouble(&val)) {
@@ -614,7 +564,7 @@ void OGRColumnString::FillData(vector<double> &data)
                 // try comma as decimal point
                 setlocale(LC_NUMERIC, "de_DE");
                 for (int i=0; i<rows; ++i) {
-                    tmp=wxString(ogr_layer->data[i]->GetFieldAsString(col_idx));
+                    tmp=GetOGRString(i);
                     double val;
                     if (!tmp.ToDouble(&val)) {
                         conv_success = false;
@@ -637,6 +587,7 @@ void OGRColumnString::FillData(vector<double> &data)
 
 void OGRColumnString::FillData(vector<wxInt64> &data)
 {
+    data.resize(rows);
     if (is_new) {
         for (int i=0; i<rows; ++i) {
             wxInt64 val;
@@ -649,13 +600,13 @@ void OGRColumnString::FillData(vector<wxInt64> &data)
             data[i] = val;
         }
     } else {
-        int col_idx = GetColIndex();
+        EnsureLoaded();
         bool conv_success = true;
         wxString tmp;
         
         // default C locale
         for (int i=0; i<rows; ++i) {
-            wxString tmp=wxString(ogr_layer->data[i]->GetFieldAsString(col_idx));
+            wxString tmp=GetOGRString(i);
             wxInt64 val;
             if (!tmp.ToLongLong(&val)) {
                 conv_success = false;
@@ -670,7 +621,7 @@ void OGRColumnString::FillData(vector<wxInt64> &data)
             wxString thousands_sep = CPLGetConfigOption("GDAL_LOCALE_SEPARATOR", "");
             if (thousands_sep == ",") {
                 for (int i=0; i<rows; ++i) {
-                    tmp=wxString(ogr_layer->data[i]->GetFieldAsString(col_idx));
+                    tmp=GetOGRString(i);
                     tmp.Replace(thousands_sep, "");
                     wxInt64 val;
                     if (!tmp.ToLongLong(&val)) {
@@ -683,7 +634,7 @@ void OGRColumnString::FillData(vector<wxInt64> &data)
                 // try comma as decimal point
                 setlocale(LC_NUMERIC, "de_DE");
                 for (int i=0; i<rows; ++i) {
-                    tmp=wxString(ogr_layer->data[i]->GetFieldAsString(col_idx));
+                    tmp=GetOGRString(i);
                     wxInt64 val;
                     if (!tmp.ToLongLong(&val)) {
                         conv_success = false;
@@ -706,14 +657,15 @@ void OGRColumnString::FillData(vector<wxInt64> &data)
 
 void OGRColumnString::FillData(vector<wxString> &data)
 {
+    data.resize(rows);
     if (is_new) {
         for (int i=0; i<rows; ++i) {
             data[i] = new_data[i];
         }
     } else {
-        int col_idx = GetColIndex();
+        EnsureLoaded();
         for (int i=0; i<rows; ++i) {
-            data[i] = wxString(ogr_layer->data[i]->GetFieldAsString(col_idx));
+            data[i] = GetOGRString(i);
         }
     }
 }
@@ -723,55 +675,37 @@ void OGRColumnString::UpdateData(const vector<wxString>& data)
     if (is_new) {
         for (int i=0; i<rows; ++i) {
             new_data[i] = data[i];
-            set_markers[i] = true;
         }
     } else {
         int col_idx = GetColIndex();
+        // every row is overwritten, so nothing needs to be read first
+        ogr_data.Resize(rows);
         for (int i=0; i<rows; ++i) {
-            ogr_layer->data[i]->SetField(col_idx, data[i].c_str());
-            set_markers[i] = true;
+            OGRFeature* feature = ogr_layer->data[i];
+            feature->SetField(col_idx, data[i].c_str());
+            ogr_data.Set(i, feature->GetFieldAsString(col_idx));
         }
+        is_loaded = true;
     }
+    validity.Resize(rows, true);
 }
 
 void OGRColumnString::UpdateData(const vector<wxInt64>& data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            wxString tmp;
-            tmp << data[i];
-            new_data[i] = tmp.c_str();
-            set_markers[i] = true;
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            wxString tmp;
-            tmp << data[i];
-            ogr_layer->data[i]->SetField(col_idx, tmp.c_str());
-            set_markers[i] = true;
-        }
+    vector<wxString> s_data(rows);
+    for (int i=0; i<rows; ++i) {
+        s_data[i] << data[i];
     }
+    UpdateData(s_data);
 }
 
 void OGRColumnString::UpdateData(const vector<double>& data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            wxString tmp;
-            tmp << data[i];
-            new_data[i] = tmp.c_str();
-            set_markers[i] = true;
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            wxString tmp;
-            tmp << data[i];
-            ogr_layer->data[i]->SetField(col_idx, tmp.c_str());
-            set_markers[i] = true;
-        }
+    vector<wxString> s_data(rows);
+    for (int i=0; i<rows; ++i) {
+        s_data[i] << data[i];
     }
+    UpdateData(s_data);
 }
 
 void OGRColumnString::GetCellValue(int row, wxString& val)
@@ -779,9 +713,8 @@ void OGRColumnString::GetCellValue(int row, wxString& val)
     if (is_new) {
         val = new_data[row];
     } else {
-        int col_idx = GetColIndex();
-        const char* val = ogr_layer->data[row]->GetFieldAsString(col_idx);
-        val = wxString(val);
+        EnsureLoaded();
+        val = GetOGRString(row);
     }
 }
 
@@ -789,13 +722,14 @@ wxString OGRColumnString::GetValueAt(int row_idx, int disp_decimals,
                                      wxCSConv* m_wx_encoding)
 {
     if (is_new) {
-        if (set_markers[row_idx] == false )
+        if (validity.Get(row_idx) == false )
             return wxEmptyString;
         return new_data[row_idx];
     } else {
         int col_idx = GetColIndex();
         if (col_idx == -1) return wxEmptyString;
-        const char* val = ogr_layer->data[row_idx]->GetFieldAsString(col_idx);
+        EnsureLoaded();
+        const char* val = ogr_data.Get(row_idx).c_str();
         if (m_wx_encoding == NULL) return wxString(val);
         else return wxString(val,*m_wx_encoding);
     }
@@ -803,13 +737,16 @@ wxString OGRColumnString::GetValueAt(int row_idx, int disp_decimals,
 
 void OGRColumnString::SetValueAt(int row_idx, const wxString &value)
 {
+    EnsureLoaded();
     if (is_new) {
         new_data[row_idx] = value;
     } else {
         int col_idx = GetColIndex();
-        ogr_layer->data[row_idx]->SetField(col_idx, value.c_str());
+        OGRFeature* feature = ogr_layer->data[row_idx];
+        feature->SetField(col_idx, value.c_str());
+        ogr_data.Set(row_idx, feature->GetFieldAsString(col_idx));
     }
-    set_markers[row_idx] = true;
+    validity.Set(row_idx, true);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -823,7 +760,32 @@ OGRColumnDate::OGRColumnDate(OGRLayerProxy* ogr_layer, int idx)
 
 OGRColumnDate::~OGRColumnDate()
 {
-    if (new_data.size() > 0 ) new_data.clear();
+}
+
+wxInt64 OGRColumnDate::ReadDate(int row, int col_idx)
+{
+    int year=0;
+    int month=0;
+    int day=0;
+    int hour=0;
+    int minute = 0;
+    int seconds = 0;
+    int tzflag = 0;
+    ogr_layer->data[row]->GetFieldAsDateTime(col_idx, &year, &month,
+                                             &day,&hour,&minute,
+                                             &seconds, &tzflag);
+    return year* 10000 + month*100 + day;
+}
+
+void OGRColumnDate::LoadData()
+{
+    int col_idx = GetColIndex();
+    col_data.resize(rows);
+    validity.Resize(rows, false);
+    for (int i=0; i<rows; ++i) {
+        validity.Set(i, ogr_layer->data[i]->IsFieldSet(col_idx));
+        col_data[i] = ReadDate(i, col_idx);
+    }
 }
 
 void OGRColumnDate::FillData(vector<wxInt64> &data)
@@ -832,22 +794,8 @@ void OGRColumnDate::FillData(vector<wxInt64> &data)
         wxString msg = "Internal error: GeoDa doesn't support new date column.";
         throw GdaException(msg.mb_str());
     } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            int col_idx = GetColIndex();
-            int year=0;
-            int month=0;
-            int day=0;
-            int hour=0;
-            int minute = 0;
-            int seconds = 0;
-            int tzflag = 0;
-            ogr_layer->data[i]->GetFieldAsDateTime(col_idx, &year, &month,
-                                                     &day,&hour,&minute,
-                                                     &seconds, &tzflag);
-            wxInt64 val = year* 10000 + month*100 + day;
-            data[i] = val;
-        }
+        EnsureLoaded();
+        data.assign(col_data.begin(), col_data.end());
     }
 }
 
@@ -865,42 +813,18 @@ void OGRColumnDate::FillData(vector<wxString> &data)
         wxString msg = "Internal error: GeoDa doesn't support new date column.";
         throw GdaException(msg.mb_str());
     } else {
-        int col_idx = GetColIndex();
+        EnsureLoaded();
+        data.resize(rows);
         for (int i=0; i<rows; ++i) {
-            int year=0;
-            int month=0;
-            int day=0;
-            int hour=0;
-            int minute = 0;
-            int seconds = 0;
-            int tzflag = 0;
-            ogr_layer->data[i]->GetFieldAsDateTime(col_idx, &year, &month,
-                                               &day,&hour,&minute,
-                                               &seconds, &tzflag);
-            wxInt64 val = year* 10000 + month*100 + day;
-            data[i] = wxString::Format("%i", val);
+            data[i] = wxString::Format("%i", col_data[i]);
         }
     }
 }
 
 void OGRColumnDate::GetCellValue(int row, wxInt64& val)
 {
-    if (new_data.empty()) {
-        int col_idx = GetColIndex();
-        int year=0;
-        int month=0;
-        int day=0;
-        int hour=0;
-        int minute = 0;
-        int seconds = 0;
-        int tzflag = 0;
-        ogr_layer->data[row]->GetFieldAsDateTime(col_idx, &year, &month,
-                                                     &day,&hour,&minute,
-                                                     &seconds, &tzflag);
-        val = year* 10000 + month*100 + day;
-    } else {
-        val = new_data[row];
-    }
+    EnsureLoaded();
+    val = col_data[row];
 }
 
 wxString OGRColumnDate::GetValueAt(int row_idx, int disp_decimals,
@@ -925,5 +849,9 @@ void OGRColumnDate::SetValueAt(int row_idx, const wxString &value)
         int col_idx = GetColIndex();
         ogr_layer->data[row_idx]->SetField(col_idx, n_year, n_month, n_day);
         //modifed_features.push_back(feature);
+        if (is_loaded) {
+            col_data[row_idx] = ReadDate(row_idx, col_idx);
+            validity.Set(row_idx, true);
+        }
     }
 }
\ No newline at end of file
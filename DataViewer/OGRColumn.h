@@ -24,6 +24,7 @@
 #include <map>
 
 #include "../GdaConst.h"
+#include "../DataViewer/ColumnStore.h"
 #include "../DataViewer/VarOrderPtree.h"
 #include "../DataViewer/VarOrderMapper.h"
 #include "../ShapeOperations/OGRLayerProxy.h"
@@ -31,7 +32,12 @@
 using namespace std;
 
 /**
- *
+ * A table column stored column-wise: the values are kept in a contiguous
+ * typed array (strings dictionary encoded) with a validity bitmap.  For a
+ * column of an OGR layer the values are copied out of the OGRFeatures on
+ * first access only, so opening a wide layer does not touch every cell.
+ * Edits of such a column are written both to the array and to the
+ * OGRFeatures, which are still used to save and export.
  */
 class OGRColumn
 {
@@ -43,8 +49,15 @@ protected:
     bool is_deleted;
     int  rows;
     OGRLayerProxy* ogr_layer;
-    // markers for a new column if the cell has ben assigned a value
-    vector<bool> set_markers;
+    // for a new column, set when the cell has been assigned a value; for a
+    // column of an OGR layer, set when the field is set in the OGRFeature
+    ValidityBitmap validity;
+    // false until LoadData() has copied the values of a column of an OGR
+    // layer.  New columns are always loaded.
+    bool is_loaded;
+    
+    void EnsureLoaded() { if (!is_loaded) { LoadData(); is_loaded = true; } }
+    virtual void LoadData() {}
 public:
     // Constructor for in-memory column
     OGRColumn(wxString name, int field_length, int decimals, int n_rows);
@@ -67,6 +80,12 @@ public:
     int GetDecimals();
     void SetDecimals(int new_decimals);
     int GetNumRows() { return rows; }
+    const ValidityBitmap& GetValidity() { EnsureLoaded(); return validity; }
+    /** Zero-copy access to the values, see ColumnSpan.  Empty if the
+     column is not stored with that type. */
+    virtual ColumnSpan<double> GetDoubleSpan() { return ColumnSpan<double>(); }
+    virtual ColumnSpan<wxInt64> GetIntegerSpan()
+        { return ColumnSpan<wxInt64>(); }
     // only for adding new column, and rollback() operation
     //void SetColIndex(int idx) { col_idx = idx;}
     // virtual functions that need to be overwritten
@@ -93,8 +112,8 @@ public:
 class OGRColumnInteger : public OGRColumn
 {
 private:
-    vector<wxInt64> new_data;
-    void InitMemoryData();
+    vector<wxInt64> col_data;
+    virtual void LoadData();
     
 public:
     OGRColumnInteger(wxString name, int field_length, int decimals, int n_rows);
@@ -104,6 +123,7 @@ public:
     ~OGRColumnInteger();
     
     virtual GdaConst::FieldType GetType() {return GdaConst::long64_type;}
+    virtual ColumnSpan<wxInt64> GetIntegerSpan();
     virtual void FillData(vector<double>& data);
     virtual void FillData(vector<wxInt64>& data);
     virtual void FillData(vector<wxString>& data);
@@ -121,8 +141,8 @@ public:
 class OGRColumnDouble : public OGRColumn
 {
 private:
-    vector<double> new_data;
-    void InitMemoryData();
+    vector<double> col_data;
+    virtual void LoadData();
     
 public:
     OGRColumnDouble(wxString name, int field_length, int decimals, int n_rows);
@@ -132,6 +152,7 @@ public:
     ~OGRColumnDouble();
     
     virtual GdaConst::FieldType GetType() {return GdaConst::double_type;}
+    virtual ColumnSpan<double> GetDoubleSpan();
     virtual void FillData(vector<double>& data);
     virtual void FillData(vector<wxInt64>& data);
     virtual void FillData(vector<wxString>& data);
@@ -149,8 +170,14 @@ public:
 class OGRColumnString : public OGRColumn
 {
 private:
+    // values of a new column
     vector<wxString> new_data;
-    void InitMemoryData();
+    // raw values of a column of an OGR layer, decoded when displayed
+    StringDictionary ogr_data;
+    virtual void LoadData();
+    // value at row as returned by OGR, decoded with the default encoding
+    wxString GetOGRString(int row)
+        { return wxString(ogr_data.Get(row).c_str()); }
     
 public:
     OGRColumnString(wxString name, int field_length, int decimals, int n_rows);
@@ -178,8 +205,9 @@ public:
 class OGRColumnDate: public OGRColumn
 {
 private:
-    vector<wxInt64> new_data;
-    void InitMemoryData();
+    vector<wxInt64> col_data;
+    virtual void LoadData();
+    wxInt64 ReadDate(int row, int col_idx);
     
 public:
     // XXX: don't support add new date column yet
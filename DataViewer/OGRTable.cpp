@@ -627,11 +627,18 @@ void OGRTable::GetColData(int col, GdaFlexValue& data)
 	for (size_t t=0; t<tms; ++t) {
 		if (ftr_c[t] != -1) {
             int col_idx = ftr_c[t];
-            std::vector<double> data(rows, quiet_nan);
-            columns[col_idx]->FillData(data);
-			for (size_t i=0; i<rows; ++i) {
-				v_tmp[i] = data[i];
-			}
+            ColumnSpan<double> span = columns[col_idx]->GetDoubleSpan();
+            if (span.empty()) {
+                std::vector<double> data(rows, quiet_nan);
+                columns[col_idx]->FillData(data);
+                for (size_t i=0; i<rows; ++i) {
+                    v_tmp[i] = data[i];
+                }
+            } else {
+                for (size_t i=0; i<rows; ++i) {
+                    v_tmp[i] = span[i];
+                }
+            }
 			V[std::slice(t,rows,tms)] = v_tmp;
 		} else {
 			V[std::slice(t,rows,tms)] = quiet_nan;
@@ -660,11 +667,14 @@ void OGRTable::GetColData(int col, d_array_type& data)
 	for (size_t t=0; t<tms; ++t) {
 		if (ftr_c[t] != -1) {
             int col_idx = ftr_c[t];
-            std::vector<double> d(rows, 0);
-            columns[col_idx]->FillData(d);
-			for (size_t i=0; i<rows; ++i) {
-				data[t][i] = d[i];
-			}
+            ColumnSpan<double> span = columns[col_idx]->GetDoubleSpan();
+            if (span.empty()) {
+                std::vector<double> d(rows, 0);
+                columns[col_idx]->FillData(d);
+                std::copy(d.begin(), d.end(), data[t].begin());
+            } else {
+                std::copy(span.begin(), span.end(), data[t].begin());
+            }
 		} else {
 			for (size_t i=0; i<rows; ++i) data[t][i] = 0;
 		}
@@ -689,11 +699,14 @@ void OGRTable::GetColData(int col, l_array_type& data)
 	for (size_t t=0; t<tms; ++t) {
 		if (ftr_c[t] != -1) {
             int col_idx = ftr_c[t];
-            std::vector<wxInt64> d(rows, 0);
-            columns[col_idx]->FillData(d);
-			for (size_t i=0; i<rows; ++i) {
-				data[t][i] = d[i];
-			}
+            ColumnSpan<wxInt64> span = columns[col_idx]->GetIntegerSpan();
+            if (span.empty()) {
+                std::vector<wxInt64> d(rows, 0);
+                columns[col_idx]->FillData(d);
+                std::copy(d.begin(), d.end(), data[t].begin());
+            } else {
+                std::copy(span.begin(), span.end(), data[t].begin());
+            }
 		} else {
 			for (size_t i=0; i<rows; ++i) data[t][i] = 0;
 		}
@@ -763,7 +776,8 @@ void OGRTable::GetColData(int col, int time, std::vector<wxString>& data)
 /**
  * OGR doesn't preserve undefined data.  For now, everything will be
  * reported as defined.  In the future, we might store undefined in
- * meta-data.
+ * meta-data.  Whether a field is set in the data source is available
+ * separately from GetColValidity.
  */
 void OGRTable::GetColUndefined(int col, b_array_type& undefined)
 {
@@ -791,6 +805,27 @@ void OGRTable::GetColUndefined(int col, int time, std::vector<bool>& undefined)
 	for (int i=0; i<rows; ++i) undefined[i] = false;
 }
 
+ColumnSpan<double> OGRTable::GetColDoubleSpan(int col, int time)
+{
+	OGRColumn* ogr_col = FindOGRColumn(col, time);
+	if (ogr_col == NULL) return ColumnSpan<double>();
+	return ogr_col->GetDoubleSpan();
+}
+
+ColumnSpan<wxInt64> OGRTable::GetColIntegerSpan(int col, int time)
+{
+	OGRColumn* ogr_col = FindOGRColumn(col, time);
+	if (ogr_col == NULL) return ColumnSpan<wxInt64>();
+	return ogr_col->GetIntegerSpan();
+}
+
+const ValidityBitmap* OGRTable::GetColValidity(int col, int time)
+{
+	OGRColumn* ogr_col = FindOGRColumn(col, time);
+	if (ogr_col == NULL) return NULL;
+	return &ogr_col->GetValidity();
+}
+
 /**
  * min_vals, max_vals: the values of same column at different time steps
  *
@@ -814,8 +849,13 @@ void OGRTable::GetMinMaxVals(int col, vector<double>& min_vals,
 	for (size_t t=0; t<times; ++t) {
 		int col_idx = vars[t].IsEmpty() ? -1 : FindOGRColId(vars[t]);
 		if (col_idx != -1) {
-            vector<double> data(rows, 0);
-            columns[col_idx]->FillData(data);
+            vector<double> copy;
+            ColumnSpan<double> data = columns[col_idx]->GetDoubleSpan();
+            if (data.empty()) {
+                copy.resize(rows, 0);
+                columns[col_idx]->FillData(copy);
+                data = ColumnSpan<double>(&copy[0], copy.size());
+            }
             tmp_min_val = data[0];
             tmp_max_val = data[0];
             
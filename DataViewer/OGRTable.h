@@ -140,6 +140,9 @@ public:
 	virtual void GetColUndefined(int col, b_array_type& undefined);
 	virtual void GetColUndefined(int col, int time,
 								 std::vector<bool>& undefined);
+	virtual ColumnSpan<double> GetColDoubleSpan(int col, int time);
+	virtual ColumnSpan<wxInt64> GetColIntegerSpan(int col, int time);
+	virtual const ValidityBitmap* GetColValidity(int col, int time);
 	virtual void GetMinMaxVals(int col, std::vector<double>& min_vals,
 							   std::vector<double>& max_vals);
 	virtual void GetMinMaxVals(int col, int time,
@@ -274,9 +274,7 @@ OGRTableOpUpdateCell::OGRTableOpUpdateCell(OGRColumn* col, int row_idx,
 {
     // this if for adding new Double column
     this->row_idx = row_idx;
-    wxString col_name = ogr_col->GetName();
-    int col_idx = ogr_layer->GetFieldPos(col_name);
-    d_old_value = ogr_layer->data[row_idx]->GetFieldAsDouble(col_idx);
+    ogr_col->GetCellValue(row_idx, d_old_value);
     d_new_value = new_val;
 }
 
@@ -286,9 +284,7 @@ OGRTableOpUpdateCell::OGRTableOpUpdateCell(OGRColumn* col, int row_idx,
 {
     // this if for adding new Integer column
     this->row_idx = row_idx;
-    wxString col_name = ogr_col->GetName();
-    int col_idx = ogr_layer->GetFieldPos(col_name);
-    l_old_value = (wxInt64)ogr_layer->data[row_idx]->GetFieldAsInteger64(col_idx);
+    ogr_col->GetCellValue(row_idx, l_old_value);
     l_new_value = new_val;
 }
 
@@ -321,18 +317,17 @@ void OGRTableOpUpdateCell::GetOriginalCellValue()
         if (col_idx < 0)
             l_old_value = 0;
         else
-            l_old_value = ogr_layer->data[row_idx]->GetFieldAsInteger64(col_idx);
+            ogr_col->GetCellValue(row_idx, l_old_value);
     } else if (type == GdaConst::double_type) {
         if (col_idx < 0)
             d_old_value = 0.0;
         else
-            d_old_value = ogr_layer->data[row_idx]->GetFieldAsDouble(col_idx);
+            ogr_col->GetCellValue(row_idx, d_old_value);
     } else if (type == GdaConst::string_type) {
         if (col_idx < 0)
             s_old_value = wxEmptyString;
         else
-            s_old_value =
-                wxString(ogr_layer->data[row_idx]->GetFieldAsString(col_idx));
+            ogr_col->GetCellValue(row_idx, s_old_value);
     }
 }
 
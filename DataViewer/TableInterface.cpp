@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include "../GenUtils.h"
 #include "../logger.h"
 #include "TableInterface.h"
@@ -57,6 +58,38 @@ int TableInterface::GetTimeInt(const wxString& tm_str)
 	return 0;
 }
 
+ColumnSpan<double> TableInterface::GetColDoubleSpan(int col, int time)
+{
+	return ColumnSpan<double>();
+}
+
+ColumnSpan<wxInt64> TableInterface::GetColIntegerSpan(int col, int time)
+{
+	return ColumnSpan<wxInt64>();
+}
+
+const ValidityBitmap* TableInterface::GetColValidity(int col, int time)
+{
+	return NULL;
+}
+
+void TableInterface::CopyColData(int col, int time, double* out)
+{
+	ColumnSpan<double> d_span = GetColDoubleSpan(col, time);
+	if (!d_span.empty()) {
+		std::copy(d_span.begin(), d_span.end(), out);
+		return;
+	}
+	ColumnSpan<wxInt64> l_span = GetColIntegerSpan(col, time);
+	if (!l_span.empty()) {
+		for (size_t i=0; i<l_span.size(); ++i) out[i] = (double) l_span[i];
+		return;
+	}
+	std::vector<double> vec(GetNumberRows(), 0);
+	GetColData(col, time, vec);
+	std::copy(vec.begin(), vec.end(), out);
+}
+
 bool TableInterface::ChangedSinceLastSave()
 {
 	return changed_since_last_save;
@@ -31,6 +31,7 @@
 
 #include "../GdaConst.h"
 #include "../VarCalc/GdaFlexValue.h"
+#include "ColumnStore.h"
 
 class TimeState;
 class VarOrderPtree;
@@ -150,6 +151,17 @@ public:
 	virtual void GetColUndefined(int col, b_array_type& undefined) = 0;
 	virtual void GetColUndefined(int col, int time,
 								 std::vector<bool>& undefined) = 0;
+	/** Zero-copy access to the values of a simple column, see ColumnSpan.
+	 The default implementation returns an empty span, in which case the
+	 caller falls back to GetColData. */
+	virtual ColumnSpan<double> GetColDoubleSpan(int col, int time);
+	virtual ColumnSpan<wxInt64> GetColIntegerSpan(int col, int time);
+	/** Cells of a simple column that hold a value in the data source, or
+	 NULL if not tracked. */
+	virtual const ValidityBitmap* GetColValidity(int col, int time);
+	/** Copies GetNumberRows() values of a numeric column into out, from
+	 the column span when there is one.  Cells without a value are 0. */
+	void CopyColData(int col, int time, double* out);
 	virtual void GetMinMaxVals(int col, std::vector<double>& min_vals,
 							   std::vector<double>& max_vals) = 0;
 	virtual void GetMinMaxVals(int col, int time,
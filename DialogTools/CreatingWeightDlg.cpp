@@ -369,6 +369,7 @@ void CreatingWeightDlg::OnCreateClick( wxCommandEvent& event )
 			} else {
 				wmi.SetToQueen(id, m_ooC, m_check1);
 			}
+			project->WaitGeometries();
 			if (project->main_data.header.shape_type == Shapefile::POINT_TYP) {
 				if (project->IsPointDuplicates()) {
 					project->DisplayPointDupsWarning();
@@ -401,7 +402,7 @@ void CreatingWeightDlg::OnCreateClick( wxCommandEvent& event )
 						precision_threshold = 0.0;
 					}
 				}
-				gal = PolysToContigWeights(project->main_data, !is_rook, precision_threshold);
+				gal = PolysToContigWeights(project->GetPolygonBuffer(), !is_rook, precision_threshold);
 			}
 		
             bool empty_w = true;
@@ -485,6 +485,7 @@ ExportDataDlg::CreateOGRLayer(wxString& ds_name,
     vector<int> selected_rows;
     
     if ( project_p != NULL && geometries.empty() && !is_save_centroids ) {
+        project_p->WaitGeometries();
         shape_type = Shapefile::NULL_SHAPE;
         int num_obs = project_p->main_data.records.size();
         if (num_obs == 0) num_obs = project_p->GetNumRecords();
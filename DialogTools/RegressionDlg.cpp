@@ -48,6 +48,7 @@
 #include "../Regression/mix.h"
 #include "../Regression/ML_im.h"
 #include "../Regression/smile.h"
+#include "../Regression/TraceEstimator.h"
 #include "RegressionDlg.h"
 #include "RegressionReportDlg.h"
 
@@ -55,16 +56,22 @@ bool classicalRegression(GalElement *g, int num_obs, double * Y,
 						 int dim, double ** X, 
 						 int expl, DiagnosticReport *dr, bool InclConstant,
 						 bool m_moranz, wxGauge* gauge,
-						 bool do_white_test);
+						 bool do_white_test, LogDetCache* cache = 0);
 
 bool spatialLagRegression(GalElement *g, int num_obs, double * Y,
 						  int dim, double ** X, int deps, DiagnosticReport *dr,
-						  bool InclConstant, wxGauge* p_bar = 0) ;
+						  bool InclConstant, wxGauge* p_bar = 0,
+						  TraceEstimator::Method trace_method =
+						  TraceEstimator::auto_method,
+						  LogDetCache* cache = 0);
 
 bool spatialErrorRegression(GalElement *g, int num_obs, double * Y,
 							int dim, double ** XX, int deps,
 							DiagnosticReport *rr, 
-							bool InclConstant, wxGauge* p_bar = 0);
+							bool InclConstant, wxGauge* p_bar = 0,
+							TraceEstimator::Method trace_method =
+							TraceEstimator::auto_method,
+							LogDetCache* cache = 0);
 
 BEGIN_EVENT_TABLE( RegressionDlg, wxDialog )
     EVT_BUTTON( XRCID("ID_RUN"), RegressionDlg::OnRunClick )
@@ -173,6 +180,7 @@ bool RegressionDlg::Create(wxWindow* parent, wxWindowID id,
     m_gauge = NULL;
 	m_gauge_text = NULL;
 	m_white_test_cb = NULL;
+	m_trace_method_choice = NULL;
 
     SetParent(parent);
     CreateControls();
@@ -205,6 +213,9 @@ void RegressionDlg::CreateControls()
 	m_coef_var_matrix_cb = XRCCTRL(*this, "ID_COEF_VAR_MATRIX_CB", wxCheckBox);
 	m_white_test_cb = XRCCTRL(*this, "ID_WHITE_TEST_CB", wxCheckBox);
 	m_white_test_cb->SetValue(false);
+	m_trace_method_choice = XRCCTRL(*this, "ID_TRACE_METHOD_CHOICE", wxChoice);
+	m_trace_method_choice->SetSelection(0);
+	m_trace_method_choice->Enable(false);
 	
 	m_gauge = XRCCTRL(*this, "IDC_GAUGE", wxGauge);
 	m_gauge->SetRange(200);
@@ -309,7 +320,6 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 	// m_Yname to the end
 	// NOTE: We need to close this gapping memory leak!d  It looks like
 	// dt and x is allocated, but never freed!
-	std::vector<double> vec(m_obs);
 	for (i=0; i < m_independentlist->GetCount(); i++) {
 		wxString nm = name_to_nm[m_independentlist->GetString(i)];
 		int col = table_int->FindColId(nm);
@@ -323,8 +333,7 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 			return;
 		}
 		int tm = name_to_tm_id[m_independentlist->GetString(i)];
-		table_int->GetColData(col, tm, vec);
-		for (int j=0; j<m_obs; j++) dt[i][j] = vec[j];
+		table_int->CopyColData(col, tm, dt[i]);
 	}
 	int y_col_id = table_int->FindColId(name_to_nm[m_Yname]);
 	if (y_col_id == wxNOT_FOUND) {
@@ -336,8 +345,7 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 		dlg.ShowModal();
 		return;
 	}
-	table_int->GetColData(y_col_id, name_to_tm_id[m_Yname], vec);
-	for (int j=0; j<m_obs; j++) dt[sz][j] = vec[j];
+	table_int->CopyColData(y_col_id, name_to_tm_id[m_Yname], dt[sz]);
 		
 	for (i = 0; i < sz + 1; i++) {
 		x[i + ix] = dt[i];
@@ -398,6 +406,8 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 		boost::uuids::uuid id = GetWeightsId();
 		GalWeight* gw = w_man_int->GetGal(id);
 		GalElement* gal_weight = gw ? gw->gal : NULL;
+		// eigenvalues and traces kept from earlier runs with these weights
+		LogDetCache* logdet_cache = w_man_int->GetLogDetCache(id);
 		
         bool isAuto = false;
         if (RegressModel == 4) {
@@ -410,7 +420,7 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
             if (gal_weight &&
 				!classicalRegression(gal_weight, m_obs, y, n, x, nX, &m_DR,
 									 m_constant_term, true, m_gauge,
-									 do_white_test)) 
+									 do_white_test, logdet_cache)) 
             {
                 wxMessageBox("Error: the inverse matrix is ill-conditioned");
                 m_OpenDump = false;
@@ -483,7 +493,7 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 			if (gal_weight &&
 				!classicalRegression(gal_weight, m_obs, y, n, x, nX, &m_DR,
 									 m_constant_term, true, m_gauge,
-									 do_white_test)) {
+									 do_white_test, logdet_cache)) {
 				wxMessageBox("Error: the inverse matrix is ill-conditioned");
 				m_OpenDump = false;
 				OnCResetClick(event);
@@ -534,7 +544,9 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 
 			if (gal_weight && !spatialLagRegression(gal_weight, m_obs,
 													y, n, x, nX, &m_DR, true,
-													m_gauge)) {
+													m_gauge,
+													GetTraceMethod(),
+													logdet_cache)) {
 				wxMessageBox("Error: the inverse matrix is ill-conditioned.");
 				m_OpenDump = false;
 				OnCResetClick(event);
@@ -585,7 +597,9 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 
 			if (gal_weight && !spatialErrorRegression(gal_weight, m_obs,
 													  y, n, x, nX,
-													  &m_DR, true, m_gauge)) {
+													  &m_DR, true, m_gauge,
+													  GetTraceMethod(),
+													  logdet_cache)) {
 				wxMessageBox("Error: the inverse matrix is ill-conditioned.");
 				m_OpenDump = false;
 				OnCResetClick(event);
@@ -801,6 +815,8 @@ void RegressionDlg::OnCResetClick( wxCommandEvent& event )
 	RegressModel = 1;
 	m_white_test_cb->SetValue(false);
 	m_white_test_cb->Enable(true);
+	m_trace_method_choice->SetSelection(0);
+	m_trace_method_choice->Enable(false);
 	
 	m_gauge->SetValue(0);
 
@@ -1308,6 +1324,7 @@ void RegressionDlg::printAndShowLagResults(const wxString& datasetname,
 	slog << wxString::Format(f, r->GetSDevY(), Obs-nX-1);
 	f = "Lag coeff.   (Rho)  :%12.6g\n"; cnt++;
 	slog << wxString::Format(f, r->GetCoefficient(0));
+	printTraceMethod(r, slog, cnt);
 	slog << "\n"; cnt++;
 	
 	f = "R-squared           :%12.6f  Log likelihood        :%12.6g\n"; cnt++;
@@ -1437,6 +1454,7 @@ void RegressionDlg::printAndShowErrorResults(const wxString& datasetname,
 	slog << wxString::Format(f, r->GetSDevY(), Obs-nX);
 	f = "Lag coeff. (Lambda) :%12.6f\n"; cnt++;
 	slog << wxString::Format(f, r->GetCoefficient(nX));
+	printTraceMethod(r, slog, cnt);
 	
 	slog << "\n"; cnt++;
 	f = "R-squared           :%12.6f  R-squared (BUSE)      : - \n"; cnt++;
@@ -1535,6 +1553,27 @@ void RegressionDlg::printAndShowErrorResults(const wxString& datasetname,
 
 
 
+/** One report line for the method behind the tr(W(I-rW)^-1) terms of the
+ ML models, with its error bound when it is not exact. */
+void RegressionDlg::printTraceMethod(DiagnosticReport *r, wxString& slog,
+									 int& cnt)
+{
+	if (r->GetTraceMethod().IsEmpty()) return;
+	slog << "Trace approximation : " << r->GetTraceMethod();
+	if (r->GetTraceErrBound() > 0) {
+		slog << wxString::Format(", 95%% error bound %.4g",
+								 r->GetTraceErrBound());
+	}
+	slog << "\n"; cnt++;
+}
+
+TraceEstimator::Method RegressionDlg::GetTraceMethod()
+{
+	int sel = m_trace_method_choice->GetSelection();
+	if (sel < 0 || sel > TraceEstimator::stochastic_method) sel = 0;
+	return (TraceEstimator::Method) sel;
+}
+
 void RegressionDlg::OnCRadio1Selected( wxCommandEvent& event )
 {
 	m_Run = false;
@@ -1542,6 +1581,7 @@ void RegressionDlg::OnCRadio1Selected( wxCommandEvent& event )
 	UpdateMessageBox(" ");
     EnablingItems();
 	m_white_test_cb->Enable(true);
+	m_trace_method_choice->Enable(false);
 	m_gauge->SetValue(0);
 }
 
@@ -1552,6 +1592,7 @@ void RegressionDlg::OnCRadio2Selected( wxCommandEvent& event )
 	UpdateMessageBox(" ");
     EnablingItems();
 	m_white_test_cb->Enable(false);
+	m_trace_method_choice->Enable(true);
 	m_gauge->SetValue(0);
 }
 
@@ -1562,6 +1603,7 @@ void RegressionDlg::OnCRadio3Selected( wxCommandEvent& event )
 	UpdateMessageBox(" ");
     EnablingItems();
 	m_white_test_cb->Enable(false);
+	m_trace_method_choice->Enable(true);
 	m_gauge->SetValue(0);
 }
 
@@ -31,6 +31,7 @@
 #include "../FramesManagerObserver.h"
 #include "../DataViewer/TableStateObserver.h"
 #include "../ShapeOperations/WeightsManStateObserver.h"
+#include "../Regression/TraceEstimator.h"
 #include "RegressionReportDlg.h"
 
 class FramesManager;
@@ -127,6 +128,7 @@ public:
 	wxCheckBox* m_pred_val_cb;
 	wxCheckBox* m_coef_var_matrix_cb;
 	wxCheckBox* m_white_test_cb;
+	wxChoice* m_trace_method_choice;
 	int			lastSelection;
 	int			nVarName;
 	double		*m_resid1, *m_yhat1;
@@ -164,6 +166,8 @@ public:
 	void printAndShowErrorResults(const wxString& datasetname,
 								  const wxString& wname,
 								  DiagnosticReport *r, int Obs, int nX);
+	void printTraceMethod(DiagnosticReport *r, wxString& slog, int& cnt);
+	TraceEstimator::Method GetTraceMethod();
 	
     void SetupXNames(bool m_constant_term);
     
@@ -28,7 +28,7 @@
 
 #include "../ShapeOperations/OGRDataAdapter.h"
 #include "Basemap.h"
-#include "curl/curl.h"
+#include "BasemapCache.h"
 //#include "MapNewView.h"
 
 using namespace std;
@@ -60,8 +60,9 @@ Basemap::Basemap(Screen* _screen,
     urlSuffix = "";
     
 
-    bDownload = false;
-    downloadThread = NULL;
+    std::ostringstream cacheDirBuf;
+    cacheDirBuf << cachePath << "basemap_cache" << separator();
+    tile_cache = new BasemapCache(cacheDirBuf.str());
     isPan = false;
     panX = 0;
     panY = 0;
@@ -94,29 +95,18 @@ Basemap::~Basemap() {
         delete poCT;
         poCT = 0;
     }
-    if (bDownload && downloadThread) {
-        bDownload = false;
-		downloadThread->join();
-        delete downloadThread;
-        downloadThread = NULL;
+    if (tile_cache) {
+        delete tile_cache;
+        tile_cache = 0;
     }
 }
 
 void Basemap::CleanCache()
 {
-    std::ostringstream filepathBuf;
-    filepathBuf << cachePath << "basemap_cache"<< separator();
-    wxString filename = filepathBuf.str();
-    wxDir dir(filename);
-    if (dir.IsOpened() ) {
-        wxString file;
-        bool cont = dir.GetFirst(&file);
-        while ( cont ) {
-            file = filename + wxFileName::GetPathSeparator()+ file;
-            if(wxFileName::FileExists(file)) wxRemoveFile(file);
-            cont = dir.GetNext(&file);
-        }
-    }
+    tile_cache->Clean();
+    isTileDrawn = false;
+    isTileReady = false;
+    RequestTiles();
 }
 
 void Basemap::SetupMapType(int map_type)
@@ -445,17 +435,7 @@ void Basemap::GetTiles()
     offsetX = offsetX - panX;
     offsetY = offsetY - panY;
   
-    if (bDownload && downloadThread) {
-        bDownload = false;
-		downloadThread->join();
-        delete downloadThread;
-        downloadThread = NULL;
-    }
-    
-    if (downloadThread == NULL) {
-        bDownload = true;
-        downloadThread = new boost::thread(boost::bind(&Basemap::_GetTiles,this, startX, startY, endX, endY));
-    }
+    RequestTiles();
 
     delete topleft;
     delete bottomright;
@@ -466,109 +446,48 @@ bool Basemap::IsReady()
     return isTileReady;
 }
 
-void Basemap::_GetTiles(int start_x, int start_y, int end_x, int end_y)
+/** Queues the visible tiles, then the ring of tiles around them and the
+ tiles of the next zoom level under them, so that panning and zooming in
+ find their tiles on disk. */
+void Basemap::RequestTiles()
 {
-    boost::thread_group threadPool;
-    for (int i=start_x; i<=end_x; i++) {
-        if (bDownload == false) {
-            return;
-        }
-        int start_i = i > nn ? nn - i : i;
-            
-        boost::thread* worker = new boost::thread(boost::bind(&Basemap::_GetTiles,this, start_i, startY, endY));
-        threadPool.add_thread(worker);
-    }
-    threadPool.join_all();
-    isTileReady = true;
-}
-
-
-void Basemap::_GetTiles(int i, int start_y, int end_y)
-{
-    for (int j=start_y; j<=end_y; j++) {
-        if (bDownload == false) {
-            return;
+    vector<TileRequest> visible, prefetch;
+    vector<pair<int, int> > visible_xy;
+    for (int i=startX-1; i<=endX+1; i++) {
+        for (int j=startY-1; j<=endY+1; j++) {
+            int idx_x = i;
+            if (i >= nn)
+                idx_x = i - nn;
+            else if (i < 0)
+                idx_x = nn + i;
+            int idx_y = j < 0 ? nn + j : j;
+            if (idx_x < 0 || idx_x >= nn || idx_y < 0 || idx_y >= nn)
+                continue;
+            TileRequest r(GetTileKey(idx_x, idx_y, zoom),
+                          GetTileUrl(idx_x, idx_y, zoom));
+            if (i >= startX && i <= endX && j >= startY && j <= endY) {
+                visible.push_back(r);
+                visible_xy.push_back(make_pair(idx_x, idx_y));
+            } else {
+                prefetch.push_back(r);
+            }
         }
-        int idx_x = i < 0 ? nn + i : i;
-        int idx_y = j < 0 ? nn + j : j;
-        if (idx_x > nn)
-            idx_x = idx_x - nn;
-        DownloadTile(idx_x, idx_y);
-    }
-}
-
-size_t curlCallback(void *ptr, size_t size, size_t nmemb, void* userdata)
-{
-    FILE* stream = (FILE*)userdata;
-    if (!stream)
-    {
-        printf("!!! No stream\n");
-        return 0;
     }
-    
-    size_t written = fwrite((FILE*)ptr, size, nmemb, stream);
-    return written;
-}
-
-void Basemap::DownloadTile(int x, int y)
-{
-    // detect if file exists in temp/ directory
-    std::string filepathStr = GetTilePath(x, y);
-    char* filepath = new char[filepathStr.length() + 1];
-    std::strcpy(filepath, filepathStr.c_str());
-
-    if (!is_file_exist(filepath)) {
-        // otherwise, download the image
-        std::string urlStr = GetTileUrl(x, y);
-        char* url = new char[urlStr.length() + 1];
-        std::strcpy(url, urlStr.c_str());
-        
-        FILE* fp;
-        CURL* image;
-        CURLcode imgResult;
-
-        image = curl_easy_init();
-        if (image) {
-            fp = fopen(filepath, "wb");
-            if (fp)
-            {
-                curl_easy_setopt(image, CURLOPT_URL, url); 
-                curl_easy_setopt(image, CURLOPT_WRITEFUNCTION, curlCallback);
-                curl_easy_setopt(image, CURLOPT_WRITEDATA, fp);
-                //curl_easy_setopt(image, CURLOPT_FOLLOWLOCATION, 1);
-                curl_easy_setopt(image, CURLOPT_CONNECTTIMEOUT, 10L);
-                curl_easy_setopt(image, CURLOPT_NOSIGNAL, 1L);
-            
-                // Grab image 
-                imgResult = curl_easy_perform(image); 
-           
-		/* 
-		if( imgResult ){ 
-                  cout << "Cannot grab the image!\n"; 
-                } 
-            
-            	int res_code = 0;
-            	curl_easy_getinfo(image, CURLINFO_RESPONSE_CODE, &res_code);
-            	if (!((res_code == 200 || res_code == 201) && imgResult != CURLE_ABORTED_BY_CALLBACK))
-            	{
-                	printf("!!! Response code: %d\n", res_code);
-            	}
-		*/
-		// Clean up the resources 
-                curl_easy_cleanup(image);
-                fclose(fp);
+    if (zoom < 18) {
+        for (size_t k=0; k<visible_xy.size(); k++) {
+            int x = visible_xy[k].first, y = visible_xy[k].second;
+            for (int dx=0; dx<2; dx++) {
+                for (int dy=0; dy<2; dy++) {
+                    prefetch.push_back(
+                        TileRequest(GetTileKey(2*x+dx, 2*y+dy, zoom+1),
+                                    GetTileUrl(2*x+dx, 2*y+dy, zoom+1)));
+                }
             }
         }
-                
-        delete[] url;
-        
     }
-    isTileReady = false; // notice template_canvas to draw
-    //canvas->Refresh(true);
-    delete[] filepath;
+    tile_cache->Request(visible, prefetch);
 }
 
-
 LatLng* Basemap::XYToLatLng(XY &xy, bool isLL)
 {
     double x = xy.x;
@@ -622,40 +541,28 @@ void Basemap::LatLngToXY(double lng, double lat, int &x, int &y)
     }
 }
 
-std::string Basemap::GetTileUrl(int x, int y)
+std::string Basemap::GetTileUrl(int x, int y, int z)
 {
 	std::ostringstream urlBuf;
 	urlBuf << basemapUrl;
-	urlBuf << zoom << "/" << x << "/" << y << urlSuffix;
+	urlBuf << z << "/" << x << "/" << y << urlSuffix;
 	std::string urlStr = urlBuf.str();
 	return urlStr;
 }
 
-std::string Basemap::GetTilePath(int x, int y)
+std::string Basemap::GetTileKey(int x, int y, int z)
 {
-    std::ostringstream filepathBuf;
-    filepathBuf << cachePath << "basemap_cache"<< separator();
-    filepathBuf << mapType << "-";
-    filepathBuf << zoom << "-" << x <<  "-" << y << imageSuffix; 
-    std::string filepathStr = filepathBuf.str();
-	std::string newpath;  
-	for (int i = 0; i < filepathStr.length() ;i++)
-	{
-		if(filepathStr[i] == '\\')
-		{
-			newpath += filepathStr[i];
-			newpath += filepathStr[i];
-		}
-		else
-			newpath += filepathStr[i];
-	}
-    return newpath;
+    std::ostringstream keyBuf;
+    keyBuf << mapType << "-" << z << "-" << x << "-" << y << imageSuffix;
+    return keyBuf.str();
 }
+
 bool Basemap::Draw(wxBitmap* buffer)
 {
 	// when tiles pngs are ready, draw them on a buffer
 	wxMemoryDC dc(*buffer);
     dc.Clear();
+    bool ready = true;
    
     int x0 = startX;
     int x1 = endX;
@@ -671,23 +578,19 @@ bool Basemap::Draw(wxBitmap* buffer)
                 idx_x = nn + i;
             
             int idx_y = j < 0 ? nn + j : j;
-            std::string filepathStr = GetTilePath(idx_x, idx_y);
-            wxString wxFilePath(filepathStr);
-            wxFileName fp(wxFilePath);
 			wxBitmap bmp;
-            if (imageSuffix == ".png") {
-                bmp.LoadFile(wxFilePath, wxBITMAP_TYPE_PNG);
-            } else if (imageSuffix == ".jpeg" || imageSuffix == ".jpg" ) {
-                wxImageHandler * jpegLoader = new wxJPEGHandler();
-                wxImage::AddHandler(jpegLoader);
-                bmp.LoadFile(wxFilePath, wxBITMAP_TYPE_JPEG);
-            }
-            bool bmpOK = bmp.IsOk();
-            if (bmpOK) dc.DrawBitmap(bmp, pos_x, pos_y, true);
+            BasemapCache::TileState state;
+            state = tile_cache->Lookup(GetTileKey(idx_x, idx_y, zoom), bmp);
+            if (state == BasemapCache::tile_ready)
+                dc.DrawBitmap(bmp, pos_x, pos_y, true);
+            else if (state == BasemapCache::tile_pending)
+                ready = false;
             //dc.DrawRectangle((i-startX) * 256 - offsetX, (j-startY) * 256 - offsetY, 256, 256);
 		}
 	}
     
     isTileDrawn = true;
+    // redrawn on idle until every visible tile is fetched or has failed
+    isTileReady = ready;
     return isTileReady;
 }
@@ -30,6 +30,8 @@ using namespace std;
 
 namespace GDA {
 
+class BasemapCache;
+
 inline char separator()
 {
 #ifdef __WIN32__
@@ -257,9 +259,6 @@ public:
     LatLng* XYToLatLng(XY &xy, bool isLL=false);
 	void LatLngToXY(double lng, double lat, int &x, int &y);
     
-	std::string GetTileUrl(int x, int y);
-    std::string GetTilePath(int x, int y);
-
 	bool Draw(wxBitmap* buffer);
 	
     void ResizeScreen(int _width, int _height);
@@ -282,9 +281,7 @@ protected:
     
     int nn; // pow(2.0, zoom)
     
-    bool bDownload;
-    boost::thread* downloadThread;
-    boost::thread* downloadThread1;
+    BasemapCache* tile_cache;
     
     int GetOptimalZoomLevel(double paddingFactor=1.2);
     int GetEasyZoomLevel();
@@ -292,10 +289,10 @@ protected:
     XY* LatLngToRawXY(LatLng &latlng);
     
     void GetTiles();
-    void _GetTiles(int start_x, int start_y, int end_x, int end_y);
-    void _GetTiles(int x, int start_y, int end_y);
-    
-    void DownloadTile(int x, int y);
+    void RequestTiles();
+    /** File name of tile x, y at zoom level z in the cache */
+    std::string GetTileKey(int x, int y, int z);
+    std::string GetTileUrl(int x, int y, int z);
     
     bool _HasInternet();
 };
@@ -0,0 +1,418 @@
+//
+//  BasemapCache.cpp
+//  GeoDa
+//
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdio.h>
+#include <boost/bind.hpp>
+
+#include <wx/dir.h>
+#include <wx/filefn.h>
+#include <wx/filename.h>
+
+#include "../GdaConst.h"
+#include "BasemapCache.h"
+#include "curl/curl.h"
+
+using namespace std;
+using namespace GDA;
+
+static const char* index_name = "index.txt";
+
+static size_t writeCallback(void* ptr, size_t size, size_t nmemb,
+                            void* userdata)
+{
+    return fwrite(ptr, size, nmemb, (FILE*) userdata);
+}
+
+/** Aborts downloads when the cache is destroyed */
+static int progressCallback(void* clientp, double, double, double, double)
+{
+    return ((BasemapCache*) clientp)->IsStopping() ? 1 : 0;
+}
+
+static bool endsWith(const std::string& s, const std::string& suffix)
+{
+    return s.size() >= suffix.size() &&
+        s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+BasemapCache::BasemapCache(const std::string& dir_s)
+: dir(dir_s), stopping(false), disk_total(0), use_clock(0), min_bitmaps(0)
+{
+    if (!wxDirExists(dir)) {
+        wxFileName::Mkdir(dir, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+    }
+    if (!wxImage::FindHandler(wxBITMAP_TYPE_JPEG)) {
+        wxImage::AddHandler(new wxJPEGHandler);
+    }
+    LoadIndex();
+    for (int i=0; i<GdaConst::basemap_fetch_threads; i++) {
+        workers.create_thread(boost::bind(&BasemapCache::Run, this));
+    }
+}
+
+BasemapCache::~BasemapCache()
+{
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        stopping = true;
+    }
+    cond.notify_all();
+    workers.join_all();
+    std::map<std::string, wxImage*>::iterator it;
+    for (it=decoded.begin(); it!=decoded.end(); it++) delete it->second;
+    SaveIndex();
+}
+
+bool BasemapCache::IsStopping()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return stopping;
+}
+
+void BasemapCache::Request(const std::vector<TileRequest>& visible,
+                           const std::vector<TileRequest>& prefetch)
+{
+    min_bitmaps = visible.size();
+    boost::mutex::scoped_lock lock(mutex);
+    visible_jobs.clear();
+    prefetch_jobs.clear();
+    wanted.clear();
+
+    std::set<std::string> visible_keys;
+    for (size_t i=0; i<visible.size(); i++) visible_keys.insert(visible[i].key);
+    std::map<std::string, wxImage*>::iterator it = decoded.begin();
+    while (it != decoded.end()) {
+        if (visible_keys.count(it->first)) {
+            it++;
+        } else {
+            delete it->second;
+            decoded.erase(it++);
+        }
+    }
+
+    for (size_t i=0; i<visible.size(); i++) {
+        const std::string& key = visible[i].key;
+        if (bitmap_index.count(key) || decoded.count(key)) continue;
+        if (!wanted.insert(key).second) continue;
+        std::map<std::string, bool>::iterator f = in_flight.find(key);
+        if (f != in_flight.end()) {
+            f->second = true;
+        } else {
+            visible_jobs.push_back(Job(visible[i], true));
+        }
+    }
+    for (size_t i=0; i<prefetch.size(); i++) {
+        if (visible_jobs.size() + prefetch_jobs.size() >=
+            (size_t) GdaConst::basemap_max_queued) break;
+        const std::string& key = prefetch[i].key;
+        if (bitmap_index.count(key) || disk.count(key) ||
+            in_flight.count(key)) continue;
+        prefetch_jobs.push_back(Job(prefetch[i], false));
+    }
+    cond.notify_all();
+}
+
+BasemapCache::TileState BasemapCache::Lookup(const std::string& key,
+                                             wxBitmap& bmp)
+{
+    std::map<std::string, BitmapList::iterator>::iterator bi;
+    bi = bitmap_index.find(key);
+    if (bi != bitmap_index.end()) {
+        bitmaps.splice(bitmaps.begin(), bitmaps, bi->second);
+        bmp = bi->second->second;
+        return tile_ready;
+    }
+
+    wxImage* img = 0;
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        std::map<std::string, wxImage*>::iterator it = decoded.find(key);
+        if (it != decoded.end()) {
+            img = it->second;
+            decoded.erase(it);
+        } else if (wanted.count(key)) {
+            return tile_pending;
+        }
+    }
+    if (!img) return tile_missing;
+
+    bmp = wxBitmap(*img);
+    delete img;
+    if (!bmp.IsOk()) return tile_missing;
+    bitmaps.push_front(std::make_pair(key, bmp));
+    bitmap_index[key] = bitmaps.begin();
+    // never drop a visible tile, or it would be missing until the next pan
+    size_t max_bitmaps = std::max(min_bitmaps,
+                                  (size_t) GdaConst::basemap_mem_tiles);
+    while (bitmaps.size() > max_bitmaps) {
+        bitmap_index.erase(bitmaps.back().first);
+        bitmaps.pop_back();
+    }
+    return tile_ready;
+}
+
+void BasemapCache::Clean()
+{
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        visible_jobs.clear();
+        prefetch_jobs.clear();
+        wanted.clear();
+        std::map<std::string, wxImage*>::iterator it;
+        for (it=decoded.begin(); it!=decoded.end(); it++) delete it->second;
+        decoded.clear();
+        disk.clear();
+        disk_total = 0;
+    }
+    bitmaps.clear();
+    bitmap_index.clear();
+
+    wxDir d(dir);
+    if (d.IsOpened()) {
+        std::vector<wxString> files;
+        wxString file;
+        bool cont = d.GetFirst(&file, wxEmptyString, wxDIR_FILES);
+        while (cont) {
+            files.push_back(file);
+            cont = d.GetNext(&file);
+        }
+        for (size_t i=0; i<files.size(); i++) {
+            wxRemoveFile(wxString(dir) + files[i]);
+        }
+    }
+}
+
+/** Worker thread loop: visible tiles first, then prefetch tiles.  Runs on
+ a worker thread, so no logging here. */
+void BasemapCache::Run()
+{
+    for (;;) {
+        Job job;
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            while (!stopping && visible_jobs.empty() && prefetch_jobs.empty()) {
+                cond.wait(lock);
+            }
+            if (stopping) return;
+            if (!visible_jobs.empty()) {
+                job = visible_jobs.front();
+                visible_jobs.pop_front();
+            } else {
+                job = prefetch_jobs.front();
+                prefetch_jobs.pop_front();
+            }
+            std::map<std::string, bool>::iterator f = in_flight.find(job.key);
+            if (f != in_flight.end()) {
+                if (job.decode) f->second = true;
+                continue;
+            }
+            in_flight[job.key] = job.decode;
+        }
+
+        bool on_disk = FetchToDisk(job);
+        bool decode;
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            decode = in_flight[job.key];
+        }
+        wxImage* img = 0;
+        if (on_disk && decode) {
+            std::string path = dir + job.key;
+            img = new wxImage();
+            if (!img->LoadFile(wxString(path), GetType(job.key))) {
+                delete img;
+                img = 0;
+                // a broken file is fetched again next time
+                {
+                    boost::mutex::scoped_lock lock(mutex);
+                    std::map<std::string, DiskEntry>::iterator it;
+                    it = disk.find(job.key);
+                    if (it != disk.end()) {
+                        disk_total -= it->second.size;
+                        disk.erase(it);
+                    }
+                }
+                wxRemoveFile(path);
+            }
+        }
+
+        boost::mutex::scoped_lock lock(mutex);
+        bool now_decode = in_flight[job.key];
+        in_flight.erase(job.key);
+        if (img) {
+            if (wanted.erase(job.key)) {
+                std::map<std::string, wxImage*>::iterator it;
+                it = decoded.find(job.key);
+                if (it != decoded.end()) delete it->second;
+                decoded[job.key] = img;
+            } else {
+                delete img;
+            }
+        } else if (now_decode && !decode && on_disk) {
+            // became visible while it was being prefetched
+            job.decode = true;
+            visible_jobs.push_front(job);
+            cond.notify_one();
+        } else if (now_decode) {
+            wanted.erase(job.key);
+        }
+    }
+}
+
+/** Makes sure the tile is in the cache directory, downloading it if
+ needed.  Returns false if the tile could not be fetched. */
+bool BasemapCache::FetchToDisk(const Job& job)
+{
+    std::string path = dir + job.key;
+    bool known = false;
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        std::map<std::string, DiskEntry>::iterator it = disk.find(job.key);
+        if (it != disk.end()) {
+            known = true;
+            it->second.last_use = ++use_clock;
+        }
+    }
+    if (known && wxFileExists(path)) return true;
+    if (!Download(job.url, path)) return false;
+
+    wxUint64 size = wxFileName::GetSize(path).GetValue();
+    std::vector<std::string> victims;
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        DiskEntry& e = disk[job.key];
+        disk_total -= e.size;
+        e.size = size;
+        e.last_use = ++use_clock;
+        disk_total += size;
+        Evict(victims);
+    }
+    for (size_t i=0; i<victims.size(); i++) wxRemoveFile(dir + victims[i]);
+    return true;
+}
+
+/** Downloads url to a temporary file which is renamed to path only if the
+ whole tile was received, so that a failed or aborted download never
+ leaves a partial tile in the cache. */
+bool BasemapCache::Download(const std::string& url, const std::string& path)
+{
+    std::ostringstream part_buf;
+    part_buf << path << "." << boost::this_thread::get_id() << ".part";
+    std::string part = part_buf.str();
+
+    FILE* fp = fopen(part.c_str(), "wb");
+    if (!fp) return false;
+    CURL* curl = curl_easy_init();
+    if (!curl) {
+        fclose(fp);
+        wxRemoveFile(part);
+        return false;
+    }
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 60L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, progressCallback);
+    curl_easy_setopt(curl, CURLOPT_PROGRESSDATA, this);
+    CURLcode res = curl_easy_perform(curl);
+    long res_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &res_code);
+    curl_easy_cleanup(curl);
+    long written = ftell(fp);
+    fclose(fp);
+
+    // file:// urls have no response code
+    bool ok = (res == CURLE_OK && (res_code == 0 || res_code == 200) &&
+               written > 0);
+    if (ok) ok = wxRenameFile(part, path, true);
+    if (!ok) wxRemoveFile(part);
+    return ok;
+}
+
+wxBitmapType BasemapCache::GetType(const std::string& key) const
+{
+    if (endsWith(key, ".jpg") || endsWith(key, ".jpeg")) {
+        return wxBITMAP_TYPE_JPEG;
+    }
+    return wxBITMAP_TYPE_PNG;
+}
+
+/** Removes the least recently used files until the cache is below 90% of
+ its cap.  Tiles being fetched are kept. */
+void BasemapCache::Evict(std::vector<std::string>& victims)
+{
+    wxUint64 cap = (wxUint64) GdaConst::basemap_disk_cache_mb * 1024 * 1024;
+    if (disk_total <= cap) return;
+    std::vector<std::pair<wxUint64, std::string> > order;
+    std::map<std::string, DiskEntry>::iterator it;
+    for (it=disk.begin(); it!=disk.end(); it++) {
+        if (in_flight.count(it->first)) continue;
+        order.push_back(std::make_pair(it->second.last_use, it->first));
+    }
+    std::sort(order.begin(), order.end());
+    for (size_t i=0; i<order.size() && disk_total > cap/10*9; i++) {
+        it = disk.find(order[i].second);
+        disk_total -= it->second.size;
+        disk.erase(it);
+        victims.push_back(order[i].second);
+    }
+}
+
+/** The files in the directory are the cache; the index only keeps when
+ each was last used.  Leftover partial downloads are removed. */
+void BasemapCache::LoadIndex()
+{
+    wxDir d(dir);
+    if (!d.IsOpened()) return;
+    std::vector<std::string> files;
+    wxString file;
+    bool cont = d.GetFirst(&file, wxEmptyString, wxDIR_FILES);
+    while (cont) {
+        files.push_back(std::string(file.mb_str()));
+        cont = d.GetNext(&file);
+    }
+    for (size_t i=0; i<files.size(); i++) {
+        const std::string& f = files[i];
+        if (f == index_name || endsWith(f, ".tmp")) continue;
+        if (endsWith(f, ".part")) {
+            wxRemoveFile(dir + f);
+            continue;
+        }
+        DiskEntry& e = disk[f];
+        e.size = wxFileName::GetSize(dir + f).GetValue();
+        disk_total += e.size;
+    }
+
+    std::ifstream in((dir + index_name).c_str());
+    std::string key;
+    wxUint64 last_use;
+    while (in >> key >> last_use) {
+        std::map<std::string, DiskEntry>::iterator it = disk.find(key);
+        if (it == disk.end()) continue;
+        it->second.last_use = last_use;
+        use_clock = std::max(use_clock, last_use);
+    }
+}
+
+void BasemapCache::SaveIndex()
+{
+    std::string tmp = dir + index_name + ".tmp";
+    {
+        std::ofstream out(tmp.c_str());
+        if (!out) return;
+        std::map<std::string, DiskEntry>::iterator it;
+        for (it=disk.begin(); it!=disk.end(); it++) {
+            out << it->first << " " << it->second.last_use << "\n";
+        }
+    }
+    wxRenameFile(tmp, dir + index_name, true);
+}
@@ -0,0 +1,121 @@
+//
+//  BasemapCache.h
+//  GeoDa
+//
+
+#ifndef GeoDa_BasemapCache_h
+#define GeoDa_BasemapCache_h
+
+#include <deque>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include <wx/bitmap.h>
+#include <wx/image.h>
+
+namespace GDA {
+
+/** A tile to fetch.  key is the file name of the tile in the cache
+ directory and identifies it everywhere else. */
+struct TileRequest {
+    TileRequest() {}
+    TileRequest(const std::string& key_s, const std::string& url_s)
+    : key(key_s), url(url_s) {}
+    std::string key;
+    std::string url;
+};
+
+/**
+ Basemap tiles fetched by a fixed pool of worker threads.  Tiles are kept
+ at three levels:
+
+ - on disk in dir, with an index of their sizes and last use so that the
+   least recently used files are removed once the cache grows past its cap;
+ - decoded wxImages handed over by the workers, since wxBitmap may only be
+   created on the main thread;
+ - an LRU of wxBitmaps ready to draw.
+
+ Request replaces the tiles wanted: the visible tiles are fetched and
+ decoded first, and the prefetch tiles are only downloaded to disk when no
+ visible tile is waiting, so the next pan or zoom finds them there.  Tiles
+ are fetched with curl from their url, so a file:// url or a server on the
+ loopback interface works as well as a tile server.
+
+ Several maps can share dir.  The index is only used to order the removal
+ of files, and files that are missing or not in the index are handled, so
+ it does not matter which cache saves the index last.
+ */
+class BasemapCache {
+public:
+    /** dir ends with a path separator */
+    BasemapCache(const std::string& dir);
+    virtual ~BasemapCache();
+
+    enum TileState { tile_ready, tile_pending, tile_missing };
+
+    /** Called on the main thread for every pan or zoom.  Tiles in the
+     queues that are no longer wanted are dropped. */
+    void Request(const std::vector<TileRequest>& visible,
+                 const std::vector<TileRequest>& prefetch);
+    /** Called on the main thread.  Sets bmp if the tile is ready, else
+     tells whether it is still being fetched. */
+    TileState Lookup(const std::string& key, wxBitmap& bmp);
+    /** Removes every tile from memory and from disk */
+    void Clean();
+    /** True once the cache is being destroyed */
+    bool IsStopping();
+
+private:
+    BasemapCache(const BasemapCache&);
+    BasemapCache& operator=(const BasemapCache&);
+
+    struct Job {
+        Job() : decode(false) {}
+        Job(const TileRequest& r, bool d)
+        : key(r.key), url(r.url), decode(d) {}
+        std::string key;
+        std::string url;
+        bool decode;
+    };
+    struct DiskEntry {
+        DiskEntry() : size(0), last_use(0) {}
+        wxUint64 size;
+        wxUint64 last_use;
+    };
+    typedef std::list<std::pair<std::string, wxBitmap> > BitmapList;
+
+    void Run();
+    bool FetchToDisk(const Job& job);
+    bool Download(const std::string& url, const std::string& path);
+    wxBitmapType GetType(const std::string& key) const;
+    void LoadIndex();
+    void SaveIndex();
+    /** Called with mutex locked.  Returns the files to remove. */
+    void Evict(std::vector<std::string>& victims);
+
+    std::string dir;
+    boost::thread_group workers;
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    // guarded by mutex
+    bool stopping;
+    std::deque<Job> visible_jobs;
+    std::deque<Job> prefetch_jobs;
+    std::set<std::string> wanted; // visible tiles not yet decoded
+    std::map<std::string, bool> in_flight; // key, decode
+    std::map<std::string, wxImage*> decoded;
+    std::map<std::string, DiskEntry> disk;
+    wxUint64 disk_total;
+    wxUint64 use_clock;
+    // main thread only
+    BitmapList bitmaps; // most recently used first
+    std::map<std::string, BitmapList::iterator> bitmap_index;
+    size_t min_bitmaps; // number of visible tiles
+};
+
+}
+
+#endif
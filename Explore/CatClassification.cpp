@@ -21,11 +21,9 @@
 #include <iomanip>
 #include <float.h>
 #include <set>
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
-#include <boost/random.hpp>
-#include <boost/random/uniform_01.hpp>
-#include <boost/random/normal_distribution.hpp>
-#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/thread.hpp>
 #include <wx/msgdlg.h>
 #include "../DataViewer/TableInterface.h"
 #include "../DialogTools/NumCategoriesDlg.h"
@@ -58,25 +56,6 @@ void create_unique_val_mapping(std::vector<UniqueValElem>& uv_mapping,
 	}
 }
 
-/** Assume that b.size() <= N-1 */
-void pick_rand_breaks(std::vector<int>& b, int N)
-{
-	int num_breaks = b.size();
-	if (num_breaks > N-1) return;
-	// Mersenne Twister random number generator, randomly seeded
-	// with current time in seconds since Jan 1 1970.
-	static boost::mt19937 rng(std::time(0));
-	static boost::uniform_01<boost::mt19937> X(rng);
-	
-	std::set<int> s;
-	while (s.size() != num_breaks) s.insert(1 + (N-1)*X());
-	int cnt=0;
-	for (std::set<int>::iterator it=s.begin(); it != s.end(); it++) {
-		b[cnt++] = *it;
-	}
-	std::sort(b.begin(), b.end());
-}
-
 // translate unique value breaks into normal breaks given unique value mapping
 void unique_to_normal_breaks(const std::vector<int>& u_val_breaks,
 							 const std::vector<UniqueValElem>& u_val_mapping,
@@ -90,31 +69,129 @@ void unique_to_normal_breaks(const std::vector<int>& u_val_breaks,
 	}	
 }
 
-/** Assume input b and v is sorted.  If not, can sort
- with std::sort(v.begin(), v.end())
- We assume that b and v are sorted in ascending order and are
- valid (ie, no break indicies out of range and all categories
- have at least one value.
- gssd is the global sum of squared differences from the mean */
-double calc_gvf(const std::vector<int>& b, const std::vector<double>& v,
-				double gssd)
-{
-	int N = v.size();
-	int num_cats = b.size()+1;
-	double tssd=0; // total sum of local sums of squared differences
-	for (int i=0; i<num_cats; i++) {
-		int s = (i == 0) ? 0 : b[i-1];
-		int t = (i == num_cats-1) ? N : b[i];
-		
-		double m=0; // local mean
-		double ssd=0; // local sum of squared differences (variance)
-		for (int j=s; j<t; j++) m += v[j];
-		m /= ((double) t-s);
-		for (int j=s; j<t; j++) ssd += (v[j]-m)*(v[j]-m);
-		tssd += ssd;
+/** Fisher-Jenks optimal classification of sorted values into contiguous
+ classes minimizing the total within-class sum of squared differences.
+ Works on the unique values of v, each weighted by its number of
+ occurrences, so that equal values always fall into the same class.
+ Within-class sums come from prefix sums of the count, sum and sum of
+ squares (of values shifted by the mean, for accuracy) in O(1).  Each of
+ the num_cats rows of the dynamic program is filled by divide and conquer,
+ using the fact that the optimal start of the last class is monotone in
+ its end, for O(num_cats * U log U) time on U unique values. */
+struct JenksOptimizer {
+	JenksOptimizer(const std::vector<double>& v,
+				   const std::vector<UniqueValElem>& uv_mapping)
+	{
+		int N = v.size();
+		U = uv_mapping.size();
+		double mean = 0;
+		for (int i=0; i<N; i++) mean += v[i];
+		mean /= (double) N;
+		cw.resize(U+1, 0);
+		cs.resize(U+1, 0);
+		css.resize(U+1, 0);
+		for (int u=0; u<U; u++) {
+			int last = (u == U-1) ? N-1 : uv_mapping[u+1].first-1;
+			double w = last - uv_mapping[u].first + 1;
+			double x = uv_mapping[u].val - mean;
+			cw[u+1] = cw[u] + w;
+			cs[u+1] = cs[u] + w*x;
+			css[u+1] = css[u] + w*x*x;
+		}
 	}
 	
-	return 1-(tssd/gssd);
+	/** sum of squared differences of unique values [i, j] */
+	double ssd(int i, int j) const {
+		double w = cw[j+1]-cw[i];
+		double s = cs[j+1]-cs[i];
+		double d = (css[j+1]-css[i]) - s*s/w;
+		return d > 0 ? d : 0;
+	}
+	
+	/** cur[j] = min over i in [i_lo, min(j, i_hi)] of prev[i-1]+ssd(i, j)
+	 for all j in [j_lo, j_hi], recording the minimizing i in arg. */
+	void FillRow(int j_lo, int j_hi, int i_lo, int i_hi,
+				 const std::vector<double>& prev, std::vector<double>& cur,
+				 int* arg) const
+	{
+		if (j_lo > j_hi) return;
+		int j = (j_lo + j_hi) / 2;
+		int best_i = i_lo;
+		double best = DBL_MAX;
+		for (int i=i_lo, iend=GenUtils::min<int>(j, i_hi); i<=iend; i++) {
+			double d = prev[i-1] + ssd(i, j);
+			if (d < best) {
+				best = d;
+				best_i = i;
+			}
+		}
+		cur[j] = best;
+		arg[j] = best_i;
+		FillRow(j_lo, j-1, i_lo, best_i, prev, cur, arg);
+		FillRow(j+1, j_hi, best_i, i_hi, prev, cur, arg);
+	}
+	
+	/** Fills u_breaks with the num_cats-1 first unique value indices of
+	 classes 2..num_cats.  Requires 1 <= num_cats <= U. */
+	void Run(int num_cats, std::vector<int>& u_breaks) const
+	{
+		u_breaks.resize(num_cats-1);
+		if (num_cats <= 1) return;
+		std::vector<double> prev(U), cur(U);
+		for (int j=0; j<U; j++) prev[j] = ssd(0, j);
+		// arg[(k-1)*U + j]: first unique value of the last of k+1 classes
+		// covering unique values [0, j]
+		std::vector<int> arg((size_t) (num_cats-1) * U, 0);
+		for (int k=1; k<num_cats; k++) {
+			FillRow(k, U-1, k, U-1, prev, cur, &arg[(size_t) (k-1) * U]);
+			prev.swap(cur);
+		}
+		int j = U-1;
+		for (int k=num_cats-1; k>=1; k--) {
+			int i = arg[(size_t) (k-1) * U + j];
+			u_breaks[k-1] = i;
+			j = i-1;
+		}
+	}
+	
+	int U;
+	std::vector<double> cw; // prefix counts
+	std::vector<double> cs; // prefix sums
+	std::vector<double> css; // prefix sums of squares
+};
+
+/** Optimal natural breaks of sorted v into at most num_cats categories.
+ Returned breaks are indices into v of the first element of categories
+ 2 and up. */
+void find_jenks_breaks(const std::vector<double>& v, int num_cats,
+					   std::vector<int>& breaks)
+{
+	breaks.clear();
+	if (v.empty()) return;
+	std::vector<UniqueValElem> uv_mapping;
+	create_unique_val_mapping(uv_mapping, v);
+	int t_cats = GenUtils::min<int>(uv_mapping.size(), num_cats);
+	if (t_cats <= 1) return;
+	JenksOptimizer jenks(v, uv_mapping);
+	std::vector<int> u_breaks;
+	jenks.Run(t_cats, u_breaks);
+	unique_to_normal_breaks(u_breaks, uv_mapping, breaks);
+}
+
+/** Compute the breaks of time periods [t_start, t_end) for
+ SetNaturalBreaksCats. */
+void find_jenks_breaks_range(const std::vector<Gda::dbl_int_pair_vec_type>* var,
+							 const std::vector<bool>* cats_valid,
+							 int num_cats, int t_start, int t_end,
+							 std::vector<std::vector<int> >* breaks)
+{
+	for (int t=t_start; t<t_end; t++) {
+		if (!(*cats_valid)[t]) continue;
+		const Gda::dbl_int_pair_vec_type& var_t = (*var)[t];
+		std::vector<double> v(var_t.size());
+		for (int i=0, iend=v.size(); i<iend; i++) v[i] = var_t[i].first;
+		find_jenks_breaks(v, num_cats, (*breaks)[t]);
+	}
 }
 
 void CatClassification::CatLabelsFromBreaks(const std::vector<double>& breaks,
@@ -1192,44 +1269,9 @@ void CatClassification::FindNaturalBreaks(int num_cats,
 	// if there are fewer unique values than number of categories,
 	// we will automatically reduce the number of categories to the
 	// number of unique values.
+	std::vector<int> best_breaks;
+	find_jenks_breaks(v, num_cats, best_breaks);
 	
-	std::vector<UniqueValElem> uv_mapping;
-	create_unique_val_mapping(uv_mapping, v);
-	int num_unique_vals = uv_mapping.size();
-	int t_cats = GenUtils::min<int>(num_unique_vals, num_cats);
-	
-	double mean = 0;
-	for (int i=0; i<num_obs; i++) mean += v[i];
-	mean /= (double) num_obs;
-	double gssd = 0;
-	for (int i=0; i<num_obs; i++) gssd += (v[i]-mean)*(v[i]-mean);			
-	
-	std::vector<int> rand_b(t_cats-1);
-	std::vector<int> best_breaks(t_cats-1);
-	std::vector<int> uv_rand_b(t_cats-1);
-	double max_gvf_found = 0;
-	int max_gvf_ind = 0;
-	// for 5000 permutations, 2200 obs, and 4 time periods, slow enough
-	// make sure permutations is such that this total is not exceeded.
-	double c = 5000*2200*4;
-	int perms = c / ((double) num_obs);
-	if (perms < 10) perms = 10;
-	if (perms > 10000) perms = 10000;
-	
-	for (int i=0; i<perms; i++) {
-		pick_rand_breaks(uv_rand_b, num_unique_vals);
-		// translate uv_rand_b into normal breaks
-		unique_to_normal_breaks(uv_rand_b, uv_mapping, rand_b);
-		double new_gvf = calc_gvf(rand_b, v, gssd);
-		if (new_gvf > max_gvf_found) {
-			max_gvf_found = new_gvf;
-			max_gvf_ind = i;
-			best_breaks = rand_b;
-		}
-	}
-	LOG(perms);
-	LOG(max_gvf_ind);
-	LOG(max_gvf_found);
 	nat_breaks.resize(best_breaks.size());
 	for (int i=0, iend=best_breaks.size(); i<iend; i++) {
 		nat_breaks[i] = var[best_breaks[i]].first;
@@ -1249,53 +1291,38 @@ void CatClassification::SetNaturalBreaksCats(int num_cats,
 	// we will automatically reduce the number of categories to the
 	// number of unique values.
 	
-	std::vector<double> v(num_obs);
+	// time periods are independent, so compute their breaks in parallel
+	std::vector<std::vector<int> > breaks(num_time_vals);
+	int nCPUs = boost::thread::hardware_concurrency();
+	if (nCPUs > num_time_vals) nCPUs = num_time_vals;
+	if (nCPUs <= 1) {
+		find_jenks_breaks_range(&var, &cats_valid, num_cats, 0,
+								num_time_vals, &breaks);
+	} else {
+		boost::thread_group threadPool;
+		int quotient = num_time_vals / nCPUs;
+		int remainder = num_time_vals % nCPUs;
+		int t_start = 0;
+		for (int i=0; i<nCPUs; i++) {
+			int t_end = t_start + quotient + (i < remainder ? 1 : 0);
+			threadPool.create_thread(boost::bind(&find_jenks_breaks_range,
+												 &var, &cats_valid, num_cats,
+												 t_start, t_end, &breaks));
+			t_start = t_end;
+		}
+		threadPool.join_all();
+	}
+	
 	for (int t=0; t<num_time_vals; t++) {
-		for (int i=0; i<num_obs; i++) v[i] = var[t][i].first;
 		if (!cats_valid[t]) continue;
-		std::vector<UniqueValElem> uv_mapping;
-		create_unique_val_mapping(uv_mapping, v);
-		int num_unique_vals = uv_mapping.size();
-		int t_cats = GenUtils::min<int>(num_unique_vals, num_cats);
-		
-		double mean = 0;
-		for (int i=0; i<num_obs; i++) mean += v[i];
-		mean /= (double) num_obs;
-		double gssd = 0;
-		for (int i=0; i<num_obs; i++) gssd += (v[i]-mean)*(v[i]-mean);			
-		
-		std::vector<int> rand_b(t_cats-1);
-		std::vector<int> best_breaks(t_cats-1);
-		std::vector<int> uv_rand_b(t_cats-1);
-		double max_gvf_found = 0;
-		int max_gvf_ind = 0;
-		// for 5000 permutations, 2200 obs, and 4 time periods, slow enough
-		// make sure permutations is such that this total is not exceeded.
-		double c = 5000*2200*4;
-		int perms = c / ((double) num_time_vals * (double) num_obs);
-		if (perms < 10) perms = 10;
-		if (perms > 10000) perms = 10000;
-		
-		for (int i=0; i<perms; i++) {
-			pick_rand_breaks(uv_rand_b, num_unique_vals);
-			// translate uv_rand_b into normal breaks
-			unique_to_normal_breaks(uv_rand_b, uv_mapping, rand_b);
-			double new_gvf = calc_gvf(rand_b, v, gssd);
-			if (new_gvf > max_gvf_found) {
-				max_gvf_found = new_gvf;
-				max_gvf_ind = i;
-				best_breaks = rand_b;
-			}
-		}
-		LOG(perms);
-		LOG(max_gvf_ind);
-		LOG(max_gvf_found);
+		const std::vector<int>& best_breaks = breaks[t];
+		int t_cats = best_breaks.size()+1;
 		
 		cat_data.SetCategoryBrushesAtCanvasTm(coltype, t_cats, false, t);
 		
 		for (int i=0, nb=best_breaks.size(); i<=nb; i++) {
 			int ss = (i == 0) ? 0 : best_breaks[i-1];
-			int tt = (i == nb) ? v.size() : best_breaks[i];
+			int tt = (i == nb) ? num_obs : best_breaks[i];
 			for (int j=ss; j<tt; j++) {
 				cat_data.AppendIdToCategory(t, i, var[t][j].second);
 			}
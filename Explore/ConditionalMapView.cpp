@@ -1176,6 +1176,7 @@ void ConditionalMapCanvas::PopulateCanvas()
 
 	if (map_valid[canvas_ts]) {
 		if (full_map_redraw_needed) {
+			project->WaitGeometries();
 			CreateSelShpsFromProj(selectable_shps, project);
 			BOOST_FOREACH( GdaShape* shp, selectable_shps ) {
 				shp->setPen(bin_bg_map_pen);
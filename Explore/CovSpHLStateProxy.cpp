@@ -24,11 +24,13 @@
 #include "CovSpHLStateProxy.h"
 
 CovSpHLStateProxy::CovSpHLStateProxy(HighlightState* hl_state,
-																		 const pairs_bimap_type& pairsBiMap)
-: pbm(pairsBiMap)
+																		 const PairsIndexer& pairs_s)
+: pairs(pairs_s)
 {
 	delete_self_when_empty = false;
 	highlight_state = hl_state;
+	epoch = 0;
+	delta_sparse = false;
 	
 	Init();
 	
@@ -90,6 +92,7 @@ void CovSpHLStateProxy::notifyObservers()
 {
 	ApplyChanges();
 	if (event_type == empty) return;
+	epoch++;
 	//LOG_MSG("In CovSpHLStateProxy::notifyObservers");
 	//LOG(observers.size());
 	// See section 18.4.4.2 of Stroustrup
@@ -103,6 +106,7 @@ void CovSpHLStateProxy::notifyObservers(HighlightStateObserver* exclude)
 {
 	ApplyChanges();
 	if (event_type == empty) return;
+	epoch++;
 	for (std::list<HighlightStateObserver*>::iterator i=observers.begin();
 			 i != observers.end(); ++i)
 	{
@@ -129,30 +133,33 @@ void CovSpHLStateProxy::update(HLStateInt* o)
 	} else if (o->GetEventType() == HLStateInt::delta ||
 						 o->GetEventType() == HLStateInt::invert)
 	{
-		// For each pair (i,j) in pbm, if either i or j is sel in orig_hs,
+		// For each pair (i,j) in pairs, if either i or j is sel in orig_hs,
 		// then pair is now selected.
 		const std::vector<bool>& orig_hs = highlight_state->GetHighlight();
-		for (pairs_bimap_type::const_iterator iter = pbm.begin(), iend = pbm.end();
-				iter != iend; ++iter)
-		{
-			// iter->left  : data : int
-			// iter->right : data : UnOrdIntPair
-			bool new_sel = orig_hs[iter->right.i] || orig_hs[iter->right.j];
-			if (new_sel && !highlight[iter->left]) {
-				highlight[iter->left] = true;
-				newly_highlighted[total_newly_highlighted++] = iter->left;
+		int i, j;
+		for (int k=0, kend=pairs.size(); k<kend; ++k) {
+			pairs.GetPair(k, i, j);
+			bool new_sel = orig_hs[i] || orig_hs[j];
+			if (new_sel && !highlight[k]) {
+				highlight[k] = true;
+				newly_highlighted[total_newly_highlighted++] = k;
 				++total_highlighted;
-			} else if (!new_sel && highlight[iter->left]) {
-				highlight[iter->left] = false;
-				newly_unhighlighted[total_newly_unhighlighted++] = iter->left;
+			} else if (!new_sel && highlight[k]) {
+				highlight[k] = false;
+				newly_unhighlighted[total_newly_unhighlighted++] = k;
 				--total_highlighted;
 			}
 		}
 		if (total_newly_highlighted > 0 || total_newly_unhighlighted > 0) {
 			event_type = HLStateInt::delta;
 		}
+		// every pair was visited, so count afresh rather than trust the
+		// running total
+		if (o->GetEventType() != HLStateInt::delta) RecountHighlighted();
 	}
+	SetDeltaSparse();
 	if (event_type != HLStateInt::empty) {
+		epoch++;
 		using namespace std;
 		for_each(observers.begin(), observers.end(),
 						 bind2nd(mem_fun(&HighlightStateObserver::update), this));
@@ -177,14 +184,12 @@ void CovSpHLStateProxy::notifyHighlightState()
 		// are selected in the (n-1) pairs, then i is considered selected.
 		// otherwise, i is considered unselected.
 		vector<bool> any_hl(hs.size(), false);
-		for (pairs_bimap_type::const_iterator iter = pbm.begin(), iend = pbm.end();
-				 iter != iend; ++iter)
-		{
-			// iter->left  : data : int
-			// iter->right : data : UnOrdIntPair
-			if (highlight[iter->left]) {
-				any_hl[iter->right.i] = true;
-				any_hl[iter->right.j] = true;
+		int i, j;
+		for (int k=0, kend=pairs.size(); k<kend; ++k) {
+			if (highlight[k]) {
+				pairs.GetPair(k, i, j);
+				any_hl[i] = true;
+				any_hl[j] = true;
 			}
 		}
 		for (size_t i=0, sz=hs.size(); i<sz; ++i) {
@@ -208,7 +213,7 @@ void CovSpHLStateProxy::notifyHighlightState()
 
 void CovSpHLStateProxy::Init()
 {
-	size_t n = pbm.size();
+	size_t n = pairs.size();
 	total_highlighted = 0;
 	highlight.resize(n);
 	newly_highlighted.resize(n);
@@ -217,37 +222,38 @@ void CovSpHLStateProxy::Init()
 	
 	for ( it=highlight.begin(); it != highlight.end(); it++ ) (*it) = false;
 	
-	// For each pair (i,j) in pbm, if either i or j is sel in orig_hs,
+	// For each pair (i,j) in pairs, if either i or j is sel in orig_hs,
 	// then pair is selected.
 	const std::vector<bool>& orig_hs = highlight_state->GetHighlight();
-	for (pairs_bimap_type::const_iterator iter = pbm.begin(), iend = pbm.end();
-			 iter != iend; ++iter)
-	{
-		// iter->left  : data : int
-		// iter->right : data : UnOrdIntPair
-		bool is_sel = orig_hs[iter->right.i] || orig_hs[iter->right.j];
-		highlight[iter->left] = is_sel;
+	int i, j;
+	for (size_t k=0; k<n; ++k) {
+		pairs.GetPair(k, i, j);
+		bool is_sel = orig_hs[i] || orig_hs[j];
+		highlight[k] = is_sel;
 		if (is_sel) ++total_highlighted;
 	}
 }
 
 void CovSpHLStateProxy::ApplyChanges()
 {
+	SetDeltaSparse();
 	switch (event_type) {
 		case delta:
 		{
+			// only count entries that actually change, so that repeated or
+			// stale ids in the change sets do not skew the total
 			for (int i=0; i<total_newly_highlighted; i++) {
 				if (!highlight[newly_highlighted[i]]) {
 					highlight[newly_highlighted[i]] = true;
+					++total_highlighted;
 				}
 			}
 			for (int i=0; i<total_newly_unhighlighted; i++) {
 				if (highlight[newly_unhighlighted[i]]) {
 					highlight[newly_unhighlighted[i]] = false;
+					--total_highlighted;
 				}
 			}
-			total_highlighted += total_newly_highlighted;
-			total_highlighted -= total_newly_unhighlighted;
 		}
 			break;
 		case unhighlight_all:
@@ -275,7 +281,7 @@ void CovSpHLStateProxy::ApplyChanges()
 					highlight[i] = true;
 				}
 			}
-			total_highlighted = highlight.size() - total_highlighted;
+			total_highlighted = t_nh;
 			total_newly_highlighted = t_nh;
 			total_newly_unhighlighted = t_nuh;
 		}
@@ -284,3 +290,19 @@ void CovSpHLStateProxy::ApplyChanges()
 			break;
 	}
 }
+
+void CovSpHLStateProxy::RecountHighlighted()
+{
+	total_highlighted = 0;
+	for (size_t i=0, sz=highlight.size(); i<sz; ++i) {
+		if (highlight[i]) ++total_highlighted;
+	}
+}
+
+void CovSpHLStateProxy::SetDeltaSparse()
+{
+	int n = highlight.size();
+	delta_sparse = (event_type == delta &&
+					total_newly_highlighted + total_newly_unhighlighted
+					<= n/16 + 16);
+}
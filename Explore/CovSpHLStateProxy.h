@@ -34,16 +34,18 @@ class HighlightState;
  - For a Project with N observations, highlight_state has a vector of
    N ids (booleans) 0, 1, ..., N-1.
  - Assuming we're interested in distances between all pairs of observations,
-   CovSpHLStateProxy has a vector of N(N-1)/2 ids (booleans).  Each of these
-   ids corresponds to 1 id in highlight_state, and each id in highlight_state
-   corresponds to N ids in this class.
+   CovSpHLStateProxy has a vector of N(N-1)/2 ids (booleans), one per pair
+   of the shared PairsIndexer.  For large N the indexer only holds a random
+   sample of the pairs, and there is one id per sampled pair.  Each of these
+   ids corresponds to 2 ids in highlight_state, and each id in
+   highlight_state corresponds to up to N-1 ids in this class.
  - In this way, TemplateCanvas only needs to use the HLStateInt interface
  */
 
 class CovSpHLStateProxy : public HLStateInt, public HighlightStateObserver {
 public:
 	CovSpHLStateProxy(HighlightState* hl_state,
-										const pairs_bimap_type& pairsBiMap);
+										const PairsIndexer& pairs);
 	virtual ~CovSpHLStateProxy();
 	
 	/** Signal that CovSpHLStateProxy should be closed, but wait until
@@ -64,6 +66,8 @@ public:
 	virtual wxString GetEventTypeStr();
 	virtual void SetEventType( EventType e ) { event_type = e; }
 	virtual int GetTotalHighlighted() { return total_highlighted; }
+	virtual unsigned long GetEpoch() { return epoch; }
+	virtual bool IsDeltaSparse() { return delta_sparse; }
 	
 	virtual void registerObserver(HighlightStateObserver* o);
 	virtual void removeObserver(HighlightStateObserver* o);
@@ -74,13 +78,13 @@ public:
 	/** Implement HighlightStateObserver interface */
 	virtual void update(HLStateInt* o);
 	
-	const pairs_bimap_type& GetBiMap() const { return pbm; }
+	const PairsIndexer& GetPairs() const { return pairs; }
 	
 private:
 	void notifyHighlightState();
 	void Init();
 	HighlightState* highlight_state;
-	const pairs_bimap_type& pbm;
+	const PairsIndexer& pairs;
 	
 	/** The list of registered HighlightStateObserver objects. */
 	std::list<HighlightStateObserver*> observers;
@@ -104,7 +108,15 @@ private:
 	 valid entries on the #newly_unhighlighted 'stack'. */
 	int total_newly_unhighlighted;
 	EventType event_type;
+	/** Number of non-empty events sent to observers so far. */
+	unsigned long epoch;
+	/** true when the current delta event is small enough that observers
+	 can apply it incrementally */
+	bool delta_sparse;
 	void ApplyChanges(); // called by notifyObservers to update highlight vec
+	void SetDeltaSparse();
+	/** Set total_highlighted from the highlight vector. */
+	void RecountHighlighted();
 	
 	/** When this is set to true and the list of observers is empty, the
 	 class instance will automatically delete itself. */
@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <utility> // std::pair
 #include <boost/foreach.hpp>
 #include <wx/xrc/xmlres.h>
@@ -52,20 +53,11 @@ panel_v_szr(0), bag_szr(0), top_h_sizer(0),
 show_regimes(false), show_outside_titles(true), show_linear_smoother(false),
 show_lowess_smoother(true), show_slope_values(false),
 scatt_plot(0), vert_label(0), horiz_label(0),
-too_many_obs(project->GetNumRecords() > 1000)
+too_few_obs(project->GetNumRecords() < 2)
 {
-	if (!too_many_obs) {
+	if (!too_few_obs) {
 		pairs_hl_state = project->GetPairsHLState();
-		project->FillDistances(D, dist_metric, dist_units);
-		D_min = D[0];
-		D_max = D[0];
-		for (size_t i=0, sz=D.size(); i<sz; ++i) {
-			if (D[i] < D_min) {
-				D_min = D[i];
-			} else if (D[i] > D_max) {
-				D_max = D[i];
-			}
-		}
+		project->FillDistances(D, D_min, D_max, dist_metric, dist_units);
 		UpdateDataFromVarMan();
 		SetGetStatusBarStringFromFrame(true);
 	}
@@ -104,7 +96,7 @@ too_many_obs(project->GetNumRecords() > 1000)
 	top_h_sizer->Add(panel, 1, wxEXPAND|wxALL, 8);
 	
 	SetSizer(top_h_sizer);
-	DisplayStatusBar(!too_many_obs);
+	DisplayStatusBar(!too_few_obs);
 
 	UpdatePanel();
 	
@@ -190,6 +182,12 @@ void CovSpFrame::UpdateTitle()
 {
 	wxString s("Nonparametric Spatial Autocorrelation");
 	if (var_man.GetVarsCount() > 0) s << " - " << var_man.GetNameWithTime(0);
+	if (!too_few_obs && project->GetSharedPairs().IsSample()) {
+		const PairsIndexer& pairs = project->GetSharedPairs();
+		s << " (random sample of " << (long) pairs.size() << " of ";
+		s << wxString::Format("%llu", (unsigned long long)
+							  pairs.GetTotalPairs()) << " pairs)";
+	}
 	SetTitle(s);
 }
 
@@ -197,14 +195,12 @@ wxString CovSpFrame::GetUpdateStatusBarString(const std::vector<int>& hover_obs,
 																							int total_hover_obs)
 {
 	wxString s;
-	const pairs_bimap_type& bimap = project->GetSharedPairsBimap();
+	const PairsIndexer& pairs = project->GetSharedPairs();
 	int last = GenUtils::min<int>(total_hover_obs, hover_obs.size(), 2);
 	size_t t = var_man.GetTime(0);
-	typedef pairs_bimap_type::left_map::const_iterator left_const_iterator;
 	for (int h=0; h<last; ++h) {
-		left_const_iterator p = bimap.left.find(hover_obs[h]);
-		int i = p->second.i;
-		int j = p->second.j;
+		int i, j;
+		pairs.GetPair(hover_obs[h], i, j);
 		//s << "sz(Z)=" << Z[t].size() << ", sz(D)=" << D.size(); 
 		//s << ", hover_obs[" << h << "]=" << hover_obs[h];
 		s << "dist(" << i+1 << "," << j+1 << ")=" << D[hover_obs[h]];
@@ -224,7 +220,7 @@ wxString CovSpFrame::GetUpdateStatusBarString(const std::vector<int>& hover_obs,
 void CovSpFrame::OnViewLinearSmoother(wxCommandEvent& event)
 {
 	LOG_MSG("In CovSpFrame::OnViewLinearSmoother");
-	if (too_many_obs) return;
+	if (too_few_obs) return;
 	show_linear_smoother = !show_linear_smoother;
 	scatt_plot->ShowLinearSmoother(show_linear_smoother);
 	UpdateOptionMenuItems();
@@ -233,7 +229,7 @@ void CovSpFrame::OnViewLinearSmoother(wxCommandEvent& event)
 void CovSpFrame::OnViewLowessSmoother(wxCommandEvent& event)
 {
 	LOG_MSG("In CovSpFrame::OnViewLowessSmoother");
-	if (too_many_obs) return;
+	if (too_few_obs) return;
 	show_lowess_smoother = !show_lowess_smoother;
 	scatt_plot->ShowLowessSmoother(show_lowess_smoother);
 	UpdateOptionMenuItems();
@@ -242,7 +238,7 @@ void CovSpFrame::OnViewLowessSmoother(wxCommandEvent& event)
 void CovSpFrame::OnEditLowessParams(wxCommandEvent& event)
 {
 	LOG_MSG("In CovSpFrame::OnEditLowessParams");
-	if (too_many_obs) return;
+	if (too_few_obs) return;
 	if (lowess_param_frame) {
 		lowess_param_frame->Iconize(false);
 		lowess_param_frame->Raise();
@@ -259,7 +255,7 @@ void CovSpFrame::OnEditLowessParams(wxCommandEvent& event)
 void CovSpFrame::OnShowVarsChooser(wxCommandEvent& event)
 {
 	LOG_MSG("In CovSpFrame::OnShowVarsChooser");
-	if (too_many_obs) return;
+	if (too_few_obs) return;
 	VariableSettingsDlg VS(project, VariableSettingsDlg::univariate,
 												 false, true, "Variable Choice", "Variable");
 	if (VS.ShowModal() != wxID_OK) return;
@@ -283,16 +279,7 @@ void CovSpFrame::OnShowVarsChooser(wxCommandEvent& event)
 		}
 	}
 	if (change) {
-		project->FillDistances(D, dist_metric, dist_units);
-		D_min = D[0];
-		D_max = D[0];
-		for (size_t i=0, sz=D.size(); i<sz; ++i) {
-			if (D[i] < D_min) {
-				D_min = D[i];
-			} else if (D[i] > D_max) {
-				D_max = D[i];
-			}
-		}
+		project->FillDistances(D, D_min, D_max, dist_metric, dist_units);
 	}
 	UpdateDataFromVarMan();
 	UpdatePanel();
@@ -301,7 +288,7 @@ void CovSpFrame::OnShowVarsChooser(wxCommandEvent& event)
 void CovSpFrame::OnViewRegimesRegression(wxCommandEvent& event)
 {
 	LOG_MSG("In CovSpFrame::OnViewRegimesRegression");
-	if (too_many_obs) return;
+	if (too_few_obs) return;
 	show_regimes = !show_regimes;
 	scatt_plot->ShowRegimes(show_regimes);
 	UpdateOptionMenuItems();
@@ -310,7 +297,7 @@ void CovSpFrame::OnViewRegimesRegression(wxCommandEvent& event)
 void CovSpFrame::OnDisplayStatistics(wxCommandEvent& event)
 {
 	LOG_MSG("In CovSpFrame::OnDisplayStatistics");
-	if (too_many_obs) return;
+	if (too_few_obs) return;
 	// should be managed here or by shared manager
 	//CovSpCanvas* t = (CovSpCanvas*) template_canvas;
 	//t->DisplayStatistics(!t->IsDisplayStats());
@@ -320,7 +307,7 @@ void CovSpFrame::OnDisplayStatistics(wxCommandEvent& event)
 void CovSpFrame::OnDisplaySlopeValues(wxCommandEvent& event)
 {
 	LOG_MSG("In CovSpFrame::OnDisplaySlopeValues");
-	if (too_many_obs) return;
+	if (too_few_obs) return;
 	show_slope_values = !show_slope_values;
 	scatt_plot->ShowSlopeValues(show_slope_values);
 	UpdateOptionMenuItems();
@@ -388,14 +375,14 @@ void CovSpFrame::UpdatePanel()
 	if (horiz_label) horiz_label->Destroy();
 	horiz_label = 0;
 	wxString z_err_msg;
-	if (!too_many_obs) {
+	if (!too_few_obs) {
 		if (var_man.GetVarsCount() > 0) z_err_msg = Z_error_msg[var_man.GetTime(0)];
 	}
 	bool z_var_good = false;
-	if (!too_many_obs) {
+	if (!too_few_obs) {
 		z_var_good = (var_man.GetVarsCount() > 0 && z_err_msg.IsEmpty());
 	}
-	if (too_many_obs || var_man.GetVarsCount() <= 0 || !z_var_good) {
+	if (too_few_obs || var_man.GetVarsCount() <= 0 || !z_var_good) {
 		message_win = new wxHtmlWindow(panel, wxID_ANY, wxDefaultPosition,
 																	 wxSize(200,-1));
 		message_win->Bind(wxEVT_MOTION, &CovSpFrame::OnMouseEvent, this);
@@ -521,14 +508,10 @@ void CovSpFrame::UpdateMessageWin()
 	s << "<center><p>";
 	s << "<font face=\"verdana,arial,sans-serif\" color=\"black\" size=\"5\">";
 	
-	if (too_many_obs) {
-		long n_obs = project->GetNumRecords();
-		long n_pairs = (n_obs*(n_obs-1))/2;
-		s << "This view currently supports data with at most 1000 observations. ";
+	if (too_few_obs) {
 		s << "The Nonparametric Spatial Autocorrelation Scatterplot plots ";
-		s << "distances between all pairs of observations. ";
-		s << "The current data set has " << n_obs << " observations and ";
-		s << n_pairs << " unordered pairs of observations.";
+		s << "distances between pairs of observations, which requires ";
+		s << "at least two observations.";
 	} else {
 		int count = var_man.GetVarsCount();
 		if (count == 0) {
@@ -554,7 +537,7 @@ void CovSpFrame::UpdateDataFromVarMan()
 	LOG_MSG("Entering CovSpFrame::UpdateDataMapFromVarMan");
 	using namespace std;
 	TableInterface* table_int = project->GetTableInt();
-	const pairs_bimap_type& bimap = project->GetSharedPairsBimap();
+	const PairsIndexer& pairs = project->GetSharedPairs();
 	
 	if (var_man.GetVarsCount() == 0) return;
 	wxString z_name = var_man.GetName(0);
@@ -575,13 +558,10 @@ void CovSpFrame::UpdateDataFromVarMan()
 	for (size_t t=0; t<tms; ++t) {
 		if (Z[t].size() != num_obs) {
 			Z[t].resize(num_obs);
-			Zprod[t].resize(bimap.size());
+			Zprod[t].resize(pairs.size());
 		}
 		if (GdaConst::placeholder_type == table_int->GetColType(c_id, t)) {
-			for (pairs_bimap_type::const_iterator e=bimap.begin();
-					 e!=bimap.end(); ++e) {
-				Zprod[t][e->left] = 0;
-			}
+			std::fill(Zprod[t].begin(), Zprod[t].end(), 0);
 			wxString s;
 			s << "Variable " << z_name;
 			if (tm_variant) s << " at time " << table_int->GetTimeString(t);
@@ -617,17 +597,8 @@ void CovSpFrame::UpdateDataFromVarMan()
 			LOG_MSG(s);
 		} else {
 			Z_error_msg[t] = "";
-			Zprod_min[t] = std::numeric_limits<double>::max();
-			Zprod_max[t] = std::numeric_limits<double>::min();
-			for (pairs_bimap_type::const_iterator e=bimap.begin();
-					 e!=bimap.end(); ++e) {
-				//double p = Z[t][e->right.i]*Z[t][e->right.j];
-				double p = (Z[t][e->right.i]-smpl_mn)*(Z[t][e->right.j]-smpl_mn);
-				p = p/smpl_var;
-				Zprod[t][e->left] = p;
-				if (p < Zprod_min[t]) Zprod_min[t] = p;
-				if (p > Zprod_max[t]) Zprod_max[t] = p;
-			}
+			DistancesCalc::PairProducts(pairs, Z[t], smpl_mn, smpl_var,
+										Zprod[t], Zprod_min[t], Zprod_max[t]);
 		}
 	}
 	
@@ -134,10 +134,10 @@ protected:
 	GdaVarTools::Manager var_man;
 	vec_vec_dbl_type Z; // size tms*n
 	std::vector<wxString> Z_error_msg; // size tms
-	vec_vec_dbl_type Zprod; // size tms*n*(n-1)/2
+	vec_vec_dbl_type Zprod; // size tms*pairs, see Project::GetSharedPairs
 	std::vector<double> Zprod_min;
 	std::vector<double> Zprod_max;
-	std::vector<double> D; // size n*(n-1)/2
+	std::vector<double> D; // size pairs, see Project::GetSharedPairs
 	double D_min;
 	double D_max;
 	std::vector<double> MeanZ;
@@ -165,7 +165,7 @@ protected:
 	WeightsMetaInfo::DistanceMetricEnum dist_metric;
 	WeightsMetaInfo::DistanceUnitsEnum dist_units;
 	
-	bool too_many_obs;
+	bool too_few_obs;
 	
 	DECLARE_EVENT_TABLE()
 };
@@ -17,6 +17,13 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <limits>
+#include <math.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include "../GenGeomAlgs.h"
+#include "../GenUtils.h"
 #include "DistancesCalc.h"
 
 UnOrdIntPair::UnOrdIntPair()
@@ -59,3 +66,195 @@ wxString UnOrdIntPair::toStr()
 	s << "(" << i << "," << j << ")";
 	return s;
 }
+
+PairsIndexer::PairsIndexer()
+: num_obs(0), total_pairs(0), num_pairs(0)
+{
+}
+
+PairsIndexer::PairsIndexer(int num_obs_s, size_t max_pairs, uint64_t seed)
+: num_obs(num_obs_s < 0 ? 0 : num_obs_s)
+{
+	total_pairs = ((uint64_t) num_obs * (num_obs-1))/2;
+	if (num_obs < 2) total_pairs = 0;
+	if (total_pairs <= max_pairs) {
+		num_pairs = (size_t) total_pairs;
+		return;
+	}
+	// Draw max_pairs ranks with replacement, drop duplicates and draw again
+	// for the shortfall until there are exactly max_pairs distinct ranks.
+	// Every subset of that size is equally likely.
+	num_pairs = max_pairs;
+	ranks.reserve(max_pairs);
+	uint64_t s = seed;
+	while (ranks.size() < max_pairs) {
+		for (size_t k=ranks.size(); k<max_pairs; ++k) {
+			uint64_t r = (uint64_t) (Gda::ThomasWangHashDouble(s++) *
+									 (double) total_pairs);
+			if (r >= total_pairs) r = total_pairs-1;
+			ranks.push_back(r);
+		}
+		std::sort(ranks.begin(), ranks.end());
+		ranks.erase(std::unique(ranks.begin(), ranks.end()), ranks.end());
+	}
+}
+
+void PairsIndexer::Unrank(int n, uint64_t r, int& i, int& j)
+{
+	// row i starts at rank i*(2n-i-1)/2, solve for the last row start <= r
+	double b = 2.0*n - 1.0;
+	double disc = b*b - 8.0*(double) r;
+	int ii = (int) ((b - sqrt(disc < 0 ? 0 : disc))/2.0);
+	if (ii < 0) ii = 0;
+	if (ii > n-2) ii = n-2;
+	// correct floating point rounding
+	while (ii > 0 && Rank(n, ii, ii+1) > r) --ii;
+	while (ii < n-2 && Rank(n, ii+1, ii+2) <= r) ++ii;
+	i = ii;
+	j = (int) (r - Rank(n, ii, ii+1)) + ii + 1;
+}
+
+namespace {
+	/** Calls op(k, i, j) for pairs k in [start, end) of pairs.  When all
+	 pairs are indexed, (i,j) is advanced in place instead of unranked. */
+	template <class Op>
+	void ForPairs(const PairsIndexer& pairs, size_t start, size_t end, Op& op)
+	{
+		if (start >= end) return;
+		if (pairs.IsSample()) {
+			int i, j;
+			for (size_t k=start; k<end; ++k) {
+				pairs.GetPair(k, i, j);
+				op(k, i, j);
+			}
+			return;
+		}
+		const int n = pairs.GetNumObs();
+		int i, j;
+		pairs.GetPair(start, i, j);
+		for (size_t k=start; k<end; ++k) {
+			op(k, i, j);
+			if (++j == n) {
+				++i;
+				j = i+1;
+			}
+		}
+	}
+	
+	/** Runs one copy of Op per thread over a contiguous tile of pairs, then
+	 lets the first copy absorb the others with Op::Merge. */
+	template <class Op>
+	void RunPairTiles(const PairsIndexer& pairs, std::vector<Op>& ops)
+	{
+		const size_t m = pairs.size();
+		int nCPUs = boost::thread::hardware_concurrency();
+		if (nCPUs < 1) nCPUs = 1;
+		if (m < 65536) nCPUs = 1;
+		ops.resize(nCPUs, ops.empty() ? Op() : ops[0]);
+		if (nCPUs == 1) {
+			ForPairs(pairs, 0, m, ops[0]);
+			return;
+		}
+		boost::thread_group threadPool;
+		for (int t=0; t<nCPUs; t++) {
+			size_t start = (m/nCPUs)*t + std::min((size_t) t, m%nCPUs);
+			size_t end = start + m/nCPUs + (t < m%nCPUs ? 1 : 0);
+			threadPool.create_thread(boost::bind(&ForPairs<Op>,
+												 boost::cref(pairs),
+												 start, end,
+												 boost::ref(ops[t])));
+		}
+		threadPool.join_all();
+		for (int t=1; t<nCPUs; t++) ops[0].Merge(ops[t]);
+	}
+	
+	struct PairDistOp {
+		PairDistOp() : x(0), y(0), D(0), is_arc(false), is_mi(false),
+		min(std::numeric_limits<double>::max()),
+		max(-std::numeric_limits<double>::max()) {}
+		void operator()(size_t k, int i, int j) {
+			double d;
+			if (is_arc) {
+				d = GenGeomAlgs::ComputeArcDistRad((*x)[i], (*y)[i],
+												   (*x)[j], (*y)[j]);
+				d = is_mi ? GenGeomAlgs::EarthRadToMi(d) :
+					GenGeomAlgs::EarthRadToKm(d);
+			} else {
+				d = GenGeomAlgs::ComputeEucDist((*x)[i], (*y)[i],
+												(*x)[j], (*y)[j]);
+			}
+			(*D)[k] = d;
+			if (d < min) min = d;
+			if (d > max) max = d;
+		}
+		void Merge(const PairDistOp& o) {
+			if (o.min < min) min = o.min;
+			if (o.max > max) max = o.max;
+		}
+		const std::vector<double>* x;
+		const std::vector<double>* y;
+		std::vector<double>* D;
+		bool is_arc;
+		bool is_mi;
+		double min;
+		double max;
+	};
+	
+	struct PairProdOp {
+		PairProdOp() : z(0), P(0), mean(0), var(1),
+		min(std::numeric_limits<double>::max()),
+		max(-std::numeric_limits<double>::max()) {}
+		void operator()(size_t k, int i, int j) {
+			double p = ((*z)[i]-mean)*((*z)[j]-mean)/var;
+			(*P)[k] = p;
+			if (p < min) min = p;
+			if (p > max) max = p;
+		}
+		void Merge(const PairProdOp& o) {
+			if (o.min < min) min = o.min;
+			if (o.max > max) max = o.max;
+		}
+		const std::vector<double>* z;
+		std::vector<double>* P;
+		double mean;
+		double var;
+		double min;
+		double max;
+	};
+}
+
+void DistancesCalc::PairDistances(const PairsIndexer& pairs,
+								  const std::vector<double>& x,
+								  const std::vector<double>& y,
+								  bool is_arc, bool is_mi,
+								  std::vector<double>& D,
+								  double& D_min, double& D_max)
+{
+	if (D.size() != pairs.size()) D.resize(pairs.size());
+	std::vector<PairDistOp> ops(1);
+	ops[0].x = &x;
+	ops[0].y = &y;
+	ops[0].D = &D;
+	ops[0].is_arc = is_arc;
+	ops[0].is_mi = is_mi;
+	RunPairTiles(pairs, ops);
+	D_min = pairs.size() > 0 ? ops[0].min : 0;
+	D_max = pairs.size() > 0 ? ops[0].max : 0;
+}
+
+void DistancesCalc::PairProducts(const PairsIndexer& pairs,
+								 const std::vector<double>& z,
+								 double mean, double var,
+								 std::vector<double>& P,
+								 double& P_min, double& P_max)
+{
+	if (P.size() != pairs.size()) P.resize(pairs.size());
+	std::vector<PairProdOp> ops(1);
+	ops[0].z = &z;
+	ops[0].P = &P;
+	ops[0].mean = mean;
+	ops[0].var = var;
+	RunPairTiles(pairs, ops);
+	P_min = pairs.size() > 0 ? ops[0].min : 0;
+	P_max = pairs.size() > 0 ? ops[0].max : 0;
+}
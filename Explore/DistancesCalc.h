@@ -20,8 +20,8 @@
 #ifndef __GEODA_CENTER_DISTANCES_CALC_H__
 #define __GEODA_CENTER_DISTANCES_CALC_H__
 
-#include <map>
-#include <boost/bimap.hpp>
+#include <vector>
+#include <boost/cstdint.hpp>
 #include <wx/string.h>
 
 /** We ultimately need all distance pairs, sorted by distance. */
@@ -36,13 +36,79 @@ struct UnOrdIntPair {
 	wxString toStr();
 };
 
-typedef boost::bimap<int, UnOrdIntPair> pairs_bimap_type;
-typedef std::map<UnOrdIntPair, double> dist_map_type;
+/**
+ Implicit index of the unordered pairs (i,j), i<j, of num_obs observations.
+ Pairs are ranked row by row, (0,1), (0,2), ..., (0,n-1), (1,2), ..., so
+ the rank of a pair and the pair of a rank are both closed form and no
+ per-pair storage is needed.
 
-class DistancesCalc {
+ When there are more than max_pairs pairs, only a uniform random sample
+ of max_pairs of them is indexed, in increasing rank order.  Only the
+ ranks of the sampled pairs are stored in that case.  Index k always runs
+ over [0, size()).
+ */
+class PairsIndexer {
 public:
+	/** All pairs of 1000 observations, the largest data set the
+	 Nonparametric Spatial Autocorrelation view used to accept. */
+	static const size_t default_max_pairs = 499500;
+	
+	PairsIndexer();
+	PairsIndexer(int num_obs, size_t max_pairs = default_max_pairs,
+				 uint64_t seed = 123456789);
+	
+	int GetNumObs() const { return num_obs; }
+	/** Number of pairs of num_obs observations. */
+	uint64_t GetTotalPairs() const { return total_pairs; }
+	/** Number of indexed pairs */
+	size_t size() const { return num_pairs; }
+	bool IsSample() const { return !ranks.empty(); }
+	
+	void GetPair(size_t k, int& i, int& j) const {
+		Unrank(num_obs, ranks.empty() ? (uint64_t) k : ranks[k], i, j);
+	}
+	UnOrdIntPair operator[](size_t k) const {
+		int i, j;
+		GetPair(k, i, j);
+		return UnOrdIntPair(i, j);
+	}
+	
+	/** Rank of pair (i,j), i<j, among all pairs of n observations */
+	static uint64_t Rank(int n, int i, int j) {
+		return (uint64_t) i*(2*(uint64_t) n-i-1)/2 + (j-i-1);
+	}
+	static void Unrank(int n, uint64_t r, int& i, int& j);
 	
+private:
+	int num_obs;
+	uint64_t total_pairs;
+	size_t num_pairs;
+	std::vector<uint64_t> ranks; // sorted, only when sampled
+};
+
+/**
+ Multithreaded kernels over the pairs of a PairsIndexer.  The index range
+ is cut in one contiguous tile per thread and each tile is streamed in
+ rank order, so pairs are never materialized.
+ */
+class DistancesCalc {
+public:
+	/** D[k] = distance between the obs of pair k.  With is_arc, x and y
+	 are longitude and latitude in degrees and D is the arc distance in
+	 miles or kilometers, otherwise D is Euclidean. */
+	static void PairDistances(const PairsIndexer& pairs,
+							  const std::vector<double>& x,
+							  const std::vector<double>& y,
+							  bool is_arc, bool is_mi,
+							  std::vector<double>& D,
+							  double& D_min, double& D_max);
 	
+	/** P[k] = (z[i]-mean)*(z[j]-mean)/var for pair k = (i,j) */
+	static void PairProducts(const PairsIndexer& pairs,
+							 const std::vector<double>& z,
+							 double mean, double var,
+							 std::vector<double>& P,
+							 double& P_min, double& P_max);
 };
 
 #endif
@@ -80,15 +80,12 @@
  */
 
 
-GStatWorkerThread::GStatWorkerThread(int obs_start_s, int obs_end_s,
-									 uint64_t	seed_start_s,
-									 GStatCoordinator* gstat_coord_s,
+GStatWorkerThread::GStatWorkerThread(GStatCoordinator* gstat_coord_s,
 									 wxMutex* worker_list_mutex_s,
 									 wxCondition* worker_list_empty_cond_s,
 									 std::list<wxThread*> *worker_list_s,
 									 int thread_id_s)
 : wxThread(),
-obs_start(obs_start_s), obs_end(obs_end_s), seed_start(seed_start_s),
 gstat_coord(gstat_coord_s),
 worker_list_mutex(worker_list_mutex_s),
 worker_list_empty_cond(worker_list_empty_cond_s),
@@ -105,15 +102,23 @@ wxThread::ExitCode GStatWorkerThread::Entry()
 {
 	LOG_MSG(wxString::Format("GStatWorkerThread %d started", thread_id));
 	
-	// call work for assigned range of observations
-	gstat_coord->CalcPseudoP_range(obs_start, obs_end, seed_start);
+	// keep pulling blocks of observations until the work queue is empty
+	int t = 0;
+	int obs_start = 0;
+	int obs_end = 0;
+	int num_blocks = 0;
+	while (gstat_coord->GetNextBlock(t, obs_start, obs_end)) {
+		gstat_coord->CalcPseudoP_range(t, obs_start, obs_end);
+		num_blocks++;
+	}
 	
 	wxMutexLocker lock(*worker_list_mutex);
 	// remove ourself from the list
 	worker_list->remove(this);
 	// if empty, signal on empty condition since only main thread
 	// should be waiting on this condition
-	LOG_MSG(wxString::Format("GStatWorkerThread %d finished", thread_id));
+	LOG_MSG(wxString::Format("GStatWorkerThread %d finished %d blocks",
+							 thread_id, num_blocks));
 	if (worker_list->empty()) {
 		LOG_MSG("worker_list is empty, so signaling main thread");
 		worker_list_empty_cond->Signal();
@@ -136,15 +141,22 @@ row_standardize(row_standardize_weights),
 permutations(999),
 var_info(var_info_s),
 data(var_info_s.size()),
-last_seed_used(0), reuse_last_seed(false)
+last_seed_used(0), reuse_last_seed(false),
+block_queue_next(0), block_size(1), blocks_per_period(0)
 {
 	GalWeight* gw = w_man_int->GetGal(w_id);
 	W = (gw ? gw->gal : 0);
+	w_csr = (gw ? gw->GetCsr() : 0);
 	weight_name = w_man_int->GetLongDispName(w_id);
 	SetSignificanceFilter(1);
 	TableInterface* table_int = project->GetTableInt();
+	int rows = table_int->GetNumberRows();
 	for (int i=0; i<var_info.size(); i++) {
-		table_int->GetColData(col_ids[i], data[i]);
+		int tms = table_int->GetColTimeSteps(col_ids[i]);
+		data[i].resize(boost::extents[tms][rows]);
+		for (int t=0; t<tms; t++) {
+			table_int->CopyColData(col_ids[i], t, &data[i][t][0]);
+		}
 	}
 	InitFromVarInfo();
 	
@@ -282,7 +294,7 @@ void GStatCoordinator::InitFromVarInfo()
 	for (int t=0; t<num_time_vals; t++) {
 		x = x_vecs[t];
 		for (int i=0; i<num_obs; i++) {
-			if ( W[i].Size() > 0 ) {
+			if ( w_csr->Size(i) > 0 ) {
 				n[t]++;
 				x_star[t] += x[i];
 				x_sstar[t] += x[i] * x[i];
@@ -347,7 +359,7 @@ void GStatCoordinator::FillClusterCats(int canvas_time,
 	
 	c_val.resize(num_obs);
 	for (int i=0; i<num_obs; i++) {
-		if (W[i].Size() == 0) {
+		if (w_csr->Size(i) == 0) {
 			c_val[i] = 3; // isolate
 		} else if (!G_defined_vecs[t][i]) {
 			c_val[i] = 4; // undefined
@@ -385,18 +397,18 @@ void GStatCoordinator::CalcGs()
 
 		double n_expr = sqrt((n[t]-1)*(n[t]-1)*(n[t]-2));
 		for (long i=0; i<num_obs; i++) {
-			const GalElement& elm_i = W[i];
+			const CsrWeight::Row elm_i = w_csr->GetRow(i);
 			if ( elm_i.Size() > 0 ) {
 				double lag = 0;
 				bool self_neighbor = false;
-				for (size_t j=0, sz=W[i].Size(); j<sz; j++) {
+				for (int j=0, sz=elm_i.Size(); j<sz; j++) {
 					if (elm_i[j] != i) {
 						lag += x[elm_i[j]];
 					} else {
 						self_neighbor = true;
 					}
 				}
-				double Wi = self_neighbor ? W[i].Size()-1 : W[i].Size();
+				double Wi = self_neighbor ? elm_i.Size()-1 : elm_i.Size();
 				if (row_standardize) {
 					lag /= elm_i.Size();
 					Wi /= elm_i.Size();
@@ -439,10 +451,10 @@ void GStatCoordinator::CalcGs()
 	
 		if (row_standardize) {
 			for (long i=0; i<num_obs; i++) {
-				const GalElement& elm_i = W[i];
+				const CsrWeight::Row elm_i = w_csr->GetRow(i);
 				double lag = 0;
 				bool self_neighbor = false;
-				int sz_i=W[i].Size();
+				int sz_i=elm_i.Size();
 				for (int j=0; j<sz_i; j++) {
 					if (elm_i[j] == i) self_neighbor = true;
 					lag += x[elm_i[j]];
@@ -454,7 +466,7 @@ void GStatCoordinator::CalcGs()
 		} else { // binary weights
 			double n_expr_mean_x = n[t] * sqrt(n[t]-1) * mean_x[t];
 			for (long i=0; i<num_obs; i++) {
-				const GalElement& elm_i = W[i];
+				const CsrWeight::Row elm_i = w_csr->GetRow(i);
 				double lag = 0;
 				bool self_neighbor = false;
 				for (int j=0, sz=elm_i.Size(); j<sz; j++) {
@@ -463,7 +475,7 @@ void GStatCoordinator::CalcGs()
 				}
 				if (!self_neighbor) lag += x[i];
 				G_star[i] = lag / x_star[t];
-				double Wi = self_neighbor ? W[i].Size() : W[i].Size()+1;
+				double Wi = self_neighbor ? elm_i.Size() : elm_i.Size()+1;
 				// location-specific mean
 				double ExGi_star = Wi/n[t];
 				// location-specific variance
@@ -489,11 +501,9 @@ void GStatCoordinator::CalcPseudoP()
 	wxStopWatch sw;
 	int nCPUs = wxThread::GetCPUCount();
 	
-	// To ensure thread safety, only work on one time slice of data
-	// at a time.  For each time period t:
-	// 1. copy data for time period t into data1 and data2 arrays
-	// 2. Perform multi-threaded computation
-	// 3. copy results into results array
+	// Each call of CalcPseudoP_range reads and writes only the arrays of
+	// its own time period, and the permutation table is read-only, so all
+	// periods and all observations form a single parallel iteration space.
 	
 	if (nCPUs <= 1) {
 		LOG_MSG(wxString::Format("%d threading cores detected "
@@ -503,28 +513,16 @@ void GStatCoordinator::CalcPseudoP()
 								 "running multi-threaded.", nCPUs));
 	}
 	
-	for (int t=0; t<num_time_vals; t++) {
-		LOG_MSG(wxString::Format("Calculating GStat significances for time "
-								 "period %d", t));
-
-		G = G_vecs[t];
-		G_defined = G_defined_vecs[t];
-		G_star = G_star_vecs[t];
-		z = z_vecs[t];
-		p = p_vecs[t];
-		z_star = z_star_vecs[t];
-		p_star = p_star_vecs[t];
-		pseudo_p = pseudo_p_vecs[t];
-		pseudo_p_star = pseudo_p_star_vecs[t];
-		x = x_vecs[t];
-		x_star_t = x_star[t];
-		
-		if (nCPUs <= 1) {
-			if (!reuse_last_seed) last_seed_used = time(0);
-			CalcPseudoP_range(0, num_obs-1, last_seed_used);
-		} else {
-			CalcPseudoP_threaded();
+	// the same permutation table serves every time period
+	if (!reuse_last_seed) last_seed_used = time(0);
+	perm_engine.Init(*w_csr, permutations, last_seed_used);
+	
+	if (nCPUs <= 1) {
+		for (int t=0; t<num_time_vals; t++) {
+			CalcPseudoP_range(t, 0, num_obs-1);
 		}
+	} else {
+		CalcPseudoP_threaded();
 	}
 	{
 		wxString m;
@@ -536,11 +534,31 @@ void GStatCoordinator::CalcPseudoP()
 	LOG_MSG("Exiting GStatCoordinator::CalcPseudoP");
 }
 
+/** Multi-threaded version of CalcPseudoP_range over all time periods and
+ all observations, driven by a shared block queue exactly as in
+ LisaCoordinator::CalcPseudoP_threaded.  The results do not depend on the
+ number of cores or on the order in which blocks are processed. */
 void GStatCoordinator::CalcPseudoP_threaded()
 {
 	LOG_MSG("Entering GStatCoordinator::CalcPseudoP_threaded");
 	int nCPUs = wxThread::GetCPUCount();
 	
+	// Several blocks per worker keeps all cores busy even though
+	// observations with many neighbors cost more than others, while keeping
+	// contention on the queue mutex negligible.
+	const int blocks_per_cpu = 16;
+	block_size = (num_obs * num_time_vals) / (nCPUs * blocks_per_cpu);
+	if (block_size < 1) block_size = 1;
+	if (block_size > 1024) block_size = 1024;
+	if (block_size > num_obs) block_size = num_obs;
+	blocks_per_period = (num_obs + block_size - 1) / block_size;
+	{
+		wxMutexLocker lock(block_queue_mutex);
+		block_queue_next = 0;
+	}
+	int num_blocks = blocks_per_period * num_time_vals;
+	int tot_threads = nCPUs < num_blocks ? nCPUs : num_blocks;
+	
 	// mutext protects access to the worker_list
     wxMutex worker_list_mutex;
 	// signals that worker_list is empty
@@ -551,54 +569,36 @@ void GStatCoordinator::CalcPseudoP_threaded()
 	// terminates, it removes itself from the list.
 	std::list<wxThread*> worker_list;
 	
-	// divide up work according to number of observations
-	// and number of CPUs
-	int work_chunk = num_obs / nCPUs;
-	int obs_start = 0;
-	int obs_end = obs_start + work_chunk;
-	
-	bool is_thread_error = false;
-	int quotient = num_obs / nCPUs;
-	int remainder = num_obs % nCPUs;
-	int tot_threads = (quotient > 0) ? nCPUs : remainder;
-	
-	if (!reuse_last_seed) last_seed_used = time(0);
-	for (int i=0; i<tot_threads && !is_thread_error; i++) {
-		int a=0;
-		int b=0;
-		if (i < remainder) {
-			a = i*(quotient+1);
-			b = a+quotient;
-		} else {
-			a = remainder*(quotient+1) + (i-remainder)*quotient;
-			b = a+quotient-1;
-		}
-		uint64_t seed_start = last_seed_used+a;
-		uint64_t seed_end = seed_start + ((uint64_t) (b-a));
-		int thread_id = i+1;
+	{
 		wxString msg;
-		msg << "thread " << thread_id << ": " << a << "->" << b;
-		msg << ", seed: " << seed_start << "->" << seed_end;
+		msg << "starting " << tot_threads << " workers for " << num_blocks;
+		msg << " blocks of " << block_size << " obs over " << num_time_vals;
+		msg << " time periods, seed: " << last_seed_used;
 		LOG_MSG(msg);
-		
+	}
+	for (int i=0; i<tot_threads; i++) {
+		int thread_id = i+1;
 		GStatWorkerThread* thread =
-			new GStatWorkerThread(a, b, seed_start, this,
+			new GStatWorkerThread(this,
 								  &worker_list_mutex,
 								  &worker_list_empty_cond,
 								  &worker_list, thread_id);
 		if ( thread->Create() != wxTHREAD_NO_ERROR ) {
 			LOG_MSG("Error: Can't create thread!");
 			delete thread;
-			is_thread_error = true;
+			// the remaining workers will drain the whole queue
+			break;
 		} else {
 			worker_list.push_front(thread);
 		}
 	}
-	if (is_thread_error) {
+	if (worker_list.empty()) {
 		LOG_MSG("Error: Could not spawn a worker thread, falling back "
 				"to single-threaded pseudo-p calculation.");
 		// fall back to single thread calculation mode
-		CalcPseudoP_range(0, num_obs-1, last_seed_used);
+		for (int t=0; t<num_time_vals; t++) {
+			CalcPseudoP_range(t, 0, num_obs-1);
+		}
 	} else {
 		LOG_MSG("Starting all worker threads");
 		std::list<wxThread*>::iterator it;
@@ -619,50 +619,63 @@ void GStatCoordinator::CalcPseudoP_threaded()
 	LOG_MSG("Exiting GStatCoordinator::CalcPseudoP_threaded");
 }
 
+bool GStatCoordinator::GetNextBlock(int& time, int& obs_start, int& obs_end)
+{
+	int block = 0;
+	{
+		wxMutexLocker lock(block_queue_mutex);
+		if (block_queue_next >= blocks_per_period * num_time_vals) {
+			return false;
+		}
+		block = block_queue_next++;
+	}
+	time = block / blocks_per_period;
+	obs_start = (block % blocks_per_period) * block_size;
+	obs_end = obs_start + block_size - 1;
+	if (obs_end > num_obs-1) obs_end = num_obs-1;
+	return true;
+}
+
 /** In the code that computes Gi and Gi*, we specifically checked for 
  self-neighbors and handled the situation appropriately.  For the
- permutation code, we will disallow self-neighbors. */
-void GStatCoordinator::CalcPseudoP_range(int obs_start, int obs_end,
-										 uint64_t seed_start)
+ permutation code, we will disallow self-neighbors: perm_engine never
+ returns observation i among its own permuted neighbors.  Only the arrays
+ of time period time are touched, and the lag sums of
+ max_batch_lags/permutations observations are gathered at once. */
+void GStatCoordinator::CalcPseudoP_range(int time, int obs_start, int obs_end)
 {
-	GeoDaSet workPermutation(num_obs);
-	//Randik rng;
-	//const int DBGI = 4;
-	//std::map<int,int> freq;
-	//for (int j=0; j<num_obs; j++) freq[j] = 0;
-	int max_rand = num_obs-1;
-	for (long i=obs_start; i<=obs_end; i++) {
-		const int numNeighsI = W[i].Size();
-		const double numNeighsD = W[i].Size();
-		if ( numNeighsI > 0 && G_defined[i]) { //only compute for non-isolates
+	const double* G = G_vecs[time];
+	const bool* G_defined = G_defined_vecs[time];
+	const double* G_star = G_star_vecs[time];
+	double* pseudo_p = pseudo_p_vecs[time];
+	double* pseudo_p_star = pseudo_p_star_vecs[time];
+	const double* x = x_vecs[time];
+	const double x_star_t = x_star[time];
+	
+	int sub_block = max_batch_lags / permutations;
+	if (sub_block < 1) sub_block = 1;
+	std::vector<double> permutedLags((size_t) sub_block * permutations);
+	PermutationEngine::Scratch scratch;
+	for (int s=obs_start; s<=obs_end; s+=sub_block) {
+		int e = s + sub_block - 1;
+		if (e > obs_end) e = obs_end;
+		// use permutations to compute the lags
+		perm_engine.PermutedLagSums(s, e, *w_csr, x, &permutedLags[0],
+									scratch);
+		for (int i=s; i<=e; i++) {
+			const int numNeighsI = w_csr->Size(i);
+			const double numNeighsD = numNeighsI;
+			//only compute for non-isolates
+			if (numNeighsI == 0 || !G_defined[i]) continue;
 			double xd_i = x_star_t - x[i]; // know != 0 since G_defined[i] true
+			const double* lags = &permutedLags[(size_t) (i-s) * permutations];
 			
 			int countGLarger = 0;
 			int countGStarLarger = 0;
 			double permutedG = 0;
 			double permutedGStar = 0;
 			for (int perm=0; perm<permutations; perm++) {
-				int rand = 0;
-				while (rand < numNeighsI) {
-					// computing 'perfect' permutation of given size
-					//int newRandom = (int) (rng.fValue() * max_rand);
-					int newRandom = (int) (Gda::ThomasWangHashDouble(seed_start++)
-										   * max_rand);
-					//int newRandom = X(rng);
-					if (newRandom != i && !workPermutation.Belongs(newRandom))
-					{
-						//if (i == DBGI) freq[newRandom]++;
-						//if (i == DBGI && perm < 20) m << newRandom << " ";
-						workPermutation.Push(newRandom);
-						rand++;
-					}
-				}
-				
-				double lag_i=0;
-				// use permutation to compute the lags
-				for (int j=0; j<numNeighsI; j++) {
-					lag_i += x[workPermutation.Pop()];
-				}
+				double lag_i = lags[perm];
 				
 				if (row_standardize) {
 					permutedG = lag_i / (numNeighsD * xd_i);
@@ -672,37 +685,19 @@ void GStatCoordinator::CalcPseudoP_range(int obs_start, int obs_end,
 					permutedG = lag_i / xd_i;
 					permutedGStar = (lag_i+x[i]) / x_star_t;
 				}
-				//LOG(G[i]);
-				//LOG(permutedG);
-				//LOG(G_star[i]);
-				//LOG(permutedGStar);
-				
-				//if (i == DBGI && perm < 20) {
-				//	m << "Gi*: " << permutedGStar;
-				//	LOG_MSG(m);
-				//}
-				
 				if (permutedG >= G[i]) countGLarger++;
 				if (permutedGStar >= G_star[i]) countGStarLarger++;
 			}
-			//if (i == DBGI) {
-			//	for (int j=0; j<num_obs; j++) LOG(freq[j]);
-			//	LOG(G_star[i]);
-			//	LOG(countGStarLarger);
-			//	LOG(permutations);
-			//}
 			// pick the smallest
 			if (permutations-countGLarger < countGLarger) { 
 				countGLarger=permutations-countGLarger;
 			}
 			pseudo_p[i] = (countGLarger + 1.0)/(permutations+1.0);
-			//if (i == DBGI) LOG(pseudo_p[i]);
 			
 			if (permutations-countGStarLarger < countGStarLarger) { 
 				countGStarLarger=permutations-countGStarLarger;
 			}
 			pseudo_p_star[i] = (countGStarLarger + 1.0)/(permutations+1.0);
-			//if (i == DBGI) LOG(pseudo_p_star[i]);
 		}
 	}
 }
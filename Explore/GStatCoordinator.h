@@ -39,6 +39,7 @@
 #include "../VarTools.h"
 #include "../ShapeOperations/GalWeight.h"
 #include "../ShapeOperations/WeightsManStateObserver.h"
+#include "PermutationEngine.h"
 
 class GetisOrdMapFrame; // instead of GStatCoordinatorObserver
 class GStatCoordinator;
@@ -46,11 +47,14 @@ class Project;
 class WeightsManState;
 typedef boost::multi_array<double, 2> d_array_type;
 
+/** Member of the pool of workers started by
+ GStatCoordinator::CalcPseudoP_threaded.  Like LisaWorkerThread, each worker
+ pulls (time period, block of observations) pairs from the coordinator's
+ shared queue until it is exhausted. */
 class GStatWorkerThread : public wxThread
 {
 public:
-	GStatWorkerThread(int obs_start, int obs_end, uint64_t seed_start,
-					 GStatCoordinator* gstat_coord,
+	GStatWorkerThread(GStatCoordinator* gstat_coord,
 					 wxMutex* worker_list_mutex,
 					 wxCondition* worker_list_empty_cond,
 					 std::list<wxThread*> *worker_list,
@@ -58,9 +62,6 @@ public:
 	virtual ~GStatWorkerThread();
 	virtual void* Entry();  // thread execution starts here
 
-	int obs_start;
-	int obs_end;
-	uint64_t seed_start;
 	int thread_id;
 	
 	GStatCoordinator* gstat_coord;
@@ -99,7 +100,6 @@ public:
 	
 	std::vector<double> n; // # non-neighborless observations
 	
-	double x_star_t; // temporary x_star for use in worker threads
 	std::vector<double> x_star; // sum of all x_i // threaded
 	std::vector<double> x_sstar; // sum of all (x_i)^2
 		
@@ -149,6 +149,7 @@ public:
 
 	boost::uuids::uuid w_id;
 	const GalElement* W;
+	const CsrWeight* w_csr; // CSR copy of W used by all lag computations
 	wxString weight_name;
 
 	int num_obs; // total # obs including neighborless obs
@@ -176,7 +177,11 @@ public:
 	std::vector<GetisOrdMapFrame*> maps;
 	
 	void CalcPseudoP();
-	void CalcPseudoP_range(int obs_start, int obs_end, uint64_t seed_start);
+	void CalcPseudoP_range(int time, int obs_start, int obs_end);
+	/** Pop the next block of observations of time period time from the
+	 work queue filled by CalcPseudoP_threaded.  Blocks never straddle two
+	 periods.  Returns false once the queue is empty. */
+	bool GetNextBlock(int& time, int& obs_start, int& obs_end);
 	
 	void InitFromVarInfo();
 	void VarInfoAttributeChange();
@@ -194,6 +199,19 @@ protected:
 	bool row_standardize;
 	uint64_t last_seed_used;
 	bool reuse_last_seed;
+	// conditional permutation table drawn from last_seed_used, shared
+	// read-only by all worker threads
+	PermutationEngine perm_engine;
+	/** Upper bound on the permuted lag sums gathered at once by
+	 CalcPseudoP_range, 512 KB. */
+	static const int max_batch_lags = 64*1024;
+	
+	// shared work queue for CalcPseudoP_threaded, see
+	// LisaCoordinator::block_queue_next
+	wxMutex block_queue_mutex;
+	int block_queue_next;
+	int block_size;
+	int blocks_per_period;
 	
 	WeightsManState* w_man_state;
 	WeightsManInterface* w_man_int;
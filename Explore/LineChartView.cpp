@@ -45,11 +45,13 @@
 #include "../VarCalc/WeightsManInterface.h"
 #include "../ShapeOperations/GalWeight.h"
 
+class LogDetCache;
+
 bool classicalRegression(GalElement *g, int num_obs, double * Y,
 						 int dim, double ** X, 
 						 int expl, DiagnosticReport *dr, bool InclConstant,
 						 bool m_moranz, wxGauge* gauge,
-						 bool do_white_test);
+						 bool do_white_test, LogDetCache* cache = 0);
 
 BEGIN_EVENT_TABLE(LineChartFrame, TemplateFrame)
 	EVT_ACTIVATE(LineChartFrame::OnActivate)
@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <math.h>
 #include <time.h>
 #include <wx/filename.h>
 #include <wx/stopwatch.h>
@@ -30,15 +31,12 @@
 #include "LisaCoordinatorObserver.h"
 #include "LisaCoordinator.h"
 
-LisaWorkerThread::LisaWorkerThread(int obs_start_s, int obs_end_s,
-								   uint64_t	seed_start_s,
-								   LisaCoordinator* lisa_coord_s,
+LisaWorkerThread::LisaWorkerThread(LisaCoordinator* lisa_coord_s,
 								   wxMutex* worker_list_mutex_s,
 								   wxCondition* worker_list_empty_cond_s,
 								   std::list<wxThread*> *worker_list_s,
 								   int thread_id_s)
 : wxThread(),
-obs_start(obs_start_s), obs_end(obs_end_s), seed_start(seed_start_s),
 lisa_coord(lisa_coord_s),
 worker_list_mutex(worker_list_mutex_s),
 worker_list_empty_cond(worker_list_empty_cond_s),
@@ -55,15 +53,24 @@ wxThread::ExitCode LisaWorkerThread::Entry()
 {
 	LOG_MSG(wxString::Format("LisaWorkerThread %d started", thread_id));
 
-	// call work for assigned range of observations
-	lisa_coord->CalcPseudoP_range(obs_start, obs_end, seed_start);
+	// keep pulling blocks of observations until the work queue is empty
+	int t = 0;
+	int obs_start = 0;
+	int obs_end = 0;
+	int num_blocks = 0;
+	while (lisa_coord->GetNextBlock(t, obs_start, obs_end)) {
+		lisa_coord->CalcPseudoP_range(lisa_coord->GetPeriodContext(t),
+									  obs_start, obs_end);
+		num_blocks++;
+	}
 	
 	wxMutexLocker lock(*worker_list_mutex);
 	// remove ourself from the list
 	worker_list->remove(this);
 	// if empty, signal on empty condition since only main thread
 	// should be waiting on this condition
-	LOG_MSG(wxString::Format("LisaWorkerThread %d finished", thread_id));
+	LOG_MSG(wxString::Format("LisaWorkerThread %d finished %d blocks",
+							 thread_id, num_blocks));
 	if (worker_list->empty()) {
 		LOG_MSG("worker_list is empty, so signaling main thread");
 		worker_list_empty_cond->Signal();
@@ -116,18 +123,26 @@ isBivariate(lisa_type_s == bivariate),
 var_info(var_info_s),
 data(var_info_s.size()),
 last_seed_used(0), reuse_last_seed(false),
-row_standardize(row_standardize_s)
+sequential_permutation(false), sequential_cutoff(0.05),
+row_standardize(row_standardize_s),
+block_queue_next(0), block_size(1), blocks_per_period(1)
 {
     
     LOG_MSG("Entering LisaCoordinator::LisaCoordinator(..)");
 	GalWeight* gw = w_man_int->GetGal(w_id);
 	W = (gw ? gw->gal : 0);
+	w_csr = (gw ? gw->GetCsr() : 0);
 	weight_name = w_man_int->GetLongDispName(w_id);
 	SetSignificanceFilter(1);
     
 	TableInterface* table_int = project->GetTableInt();
+	int rows = table_int->GetNumberRows();
 	for (int i=0; i<var_info.size(); i++) {
-		table_int->GetColData(col_ids[i], data[i]);
+		int tms = table_int->GetColTimeSteps(col_ids[i]);
+		data[i].resize(boost::extents[tms][rows]);
+		for (int t=0; t<tms; t++) {
+			table_int->CopyColData(col_ids[i], t, &data[i][t][0]);
+		}
 	}
     
 	InitFromVarInfo();
@@ -161,6 +176,10 @@ void LisaCoordinator::DeallocateVectors()
 		if (sig_cat_vecs[i]) delete [] sig_cat_vecs[i];
 	}
 	sig_cat_vecs.clear();
+	for (int i=0; i<perms_used_vecs.size(); i++) {
+		if (perms_used_vecs[i]) delete [] perms_used_vecs[i];
+	}
+	perms_used_vecs.clear();
 	for (int i=0; i<cluster_vecs.size(); i++) {
 		if (cluster_vecs[i]) delete [] cluster_vecs[i];
 	}
@@ -183,6 +202,7 @@ void LisaCoordinator::AllocateVectors()
 	local_moran_vecs.resize(tms);
 	sig_local_moran_vecs.resize(tms);
 	sig_cat_vecs.resize(tms);
+	perms_used_vecs.resize(tms);
 	cluster_vecs.resize(tms);
 	data1_vecs.resize(tms);
 	map_valid.resize(tms);
@@ -195,6 +215,7 @@ void LisaCoordinator::AllocateVectors()
 		if (calc_significances) {
 			sig_local_moran_vecs[i] = new double[num_obs];
 			sig_cat_vecs[i] = new int[num_obs];
+			perms_used_vecs[i] = new int[num_obs];
 		}
 		cluster_vecs[i] = new int[num_obs];
 		data1_vecs[i] = new double[num_obs];
@@ -345,19 +366,41 @@ void LisaCoordinator::StandardizeData()
 	}
 }
 
-/** assumes StandardizeData already called on data1 and data2 */
-void LisaCoordinator::CalcLisa()
+/** Point one LisaPeriodContext per time period into the space-time
+ arrays.  Must be called again whenever the arrays are reallocated. */
+void LisaCoordinator::MakePeriodContexts()
 {
+	period_ctx.resize(num_time_vals);
 	for (int t=0; t<num_time_vals; t++) {
-		data1 = data1_vecs[t];
+		LisaPeriodContext& ctx = period_ctx[t];
+		ctx.data1 = data1_vecs[t];
 		if (isBivariate) {
-			data2 = data2_vecs[0];
-			if (var_info[1].is_time_variant && var_info[1].sync_with_global_time)
-                data2 = data2_vecs[t];
+			ctx.data2 = data2_vecs[0];
+			if (var_info[1].is_time_variant &&
+				var_info[1].sync_with_global_time)
+                ctx.data2 = data2_vecs[t];
+		}
+		ctx.lags = lags_vecs[t];
+		ctx.localMoran = local_moran_vecs[t];
+		ctx.cluster = cluster_vecs[t];
+		if (calc_significances) {
+			ctx.sigLocalMoran = sig_local_moran_vecs[t];
+			ctx.sigCat = sig_cat_vecs[t];
+			ctx.permsUsed = perms_used_vecs[t];
 		}
-		lags = lags_vecs[t];
-		localMoran = local_moran_vecs[t];
-		cluster = cluster_vecs[t];
+	}
+}
+
+/** assumes StandardizeData already called on data1 and data2 */
+void LisaCoordinator::CalcLisa()
+{
+	MakePeriodContexts();
+	for (int t=0; t<num_time_vals; t++) {
+		const LisaPeriodContext& ctx = period_ctx[t];
+		const double* data1 = ctx.data1;
+		double* lags = ctx.lags;
+		double* localMoran = ctx.localMoran;
+		int* cluster = ctx.cluster;
 	
 		has_undefined[t] = false;
 		has_isolates[t] = false;
@@ -365,15 +408,15 @@ void LisaCoordinator::CalcLisa()
 		for (int i=0; i<num_obs; i++) {
 			double Wdata = 0;
 			if (isBivariate) {
-				Wdata = W[i].SpatialLag(data2);
+				Wdata = w_csr->SpatialLag(i, ctx.data2);
 			} else {
-				Wdata = W[i].SpatialLag(data1);
+				Wdata = w_csr->SpatialLag(i, data1);
 			}
 			lags[i] = Wdata;
 			localMoran[i] = data1[i] * Wdata;
 					
 			// assign the cluster
-			if (W[i].Size() > 0) {
+			if (w_csr->Size(i) > 0) {
 				if (data1[i] > 0 && Wdata < 0) cluster[i] = 4;
 				else if (data1[i] < 0 && Wdata > 0) cluster[i] = 3;
 				else if (data1[i] < 0 && Wdata < 0) cluster[i] = 2;
@@ -393,11 +436,9 @@ void LisaCoordinator::CalcPseudoP()
 	wxStopWatch sw;
 	int nCPUs = wxThread::GetCPUCount();
 	
-	// To ensure thread safety, only work on one time slice of data
-	// at a time.  For each time period t:
-	// 1. copy data for time period t into data1 and data2 arrays
-	// 2. Perform multi-threaded computation
-	// 3. copy results into results array
+	// Every time period has its own LisaPeriodContext and the permutation
+	// table is read-only, so all periods and all observations form a
+	// single parallel iteration space.
 	
 	if (nCPUs <= 1) {
 		LOG_MSG(wxString::Format("%d threading cores detected "
@@ -407,29 +448,18 @@ void LisaCoordinator::CalcPseudoP()
 								 "running multi-threaded.", nCPUs));
 	}
 	
-	for (int t=0; t<num_time_vals; t++) {
-		LOG_MSG(wxString::Format("Calculating LISA significances for time "
-								 "period %d", t));
-		
-		data1 = data1_vecs[t];
-		if (isBivariate) {
-			data2 = data2_vecs[0];
-			if (var_info[1].is_time_variant &&
-				var_info[1].sync_with_global_time)
-                data2 = data2_vecs[t];
-		}
-		lags = lags_vecs[t];
-		localMoran = local_moran_vecs[t];
-		sigLocalMoran = sig_local_moran_vecs[t];
-		sigCat = sig_cat_vecs[t];
-		cluster = cluster_vecs[t];
-		
-		if (nCPUs <= 1) {
-			if (!reuse_last_seed) last_seed_used = time(0);
-			CalcPseudoP_range(0, num_obs-1, last_seed_used);
-		} else {
-			CalcPseudoP_threaded();
+	// the same permutation table serves every time period
+	if (!reuse_last_seed) last_seed_used = time(0);
+	perm_engine.Init(*w_csr, permutations, last_seed_used);
+	sequential_cutoff = significance_cutoff;
+	MakePeriodContexts();
+	
+	if (nCPUs <= 1) {
+		for (int t=0; t<num_time_vals; t++) {
+			CalcPseudoP_range(period_ctx[t], 0, num_obs-1);
 		}
+	} else {
+		CalcPseudoP_threaded();
 	}
 	{
 		wxString m;
@@ -438,14 +468,50 @@ void LisaCoordinator::CalcPseudoP()
 		m << sw.Time() << " ms. Last seed used: " << last_seed_used;
 		LOG_MSG(m);
 	}
+	if (sequential_permutation) {
+		double tot_perms = 0;
+		for (int t=0; t<num_time_vals; t++) {
+			for (int i=0; i<num_obs; i++) tot_perms += perms_used_vecs[t][i];
+		}
+		wxString m;
+		m << "Sequential permutation at cutoff " << sequential_cutoff;
+		m << " used " << tot_perms << " of ";
+		m << ((double) permutations) * num_obs * num_time_vals;
+		m << " permutations.";
+		LOG_MSG(m);
+	}
 	LOG_MSG("Exiting LisaCoordinator::CalcPseudoP");
 }
 
+/** Multi-threaded version of CalcPseudoP_range over all time periods and
+ all observations.  A pool of one worker per core is started and every
+ worker pulls (time period, block of observations) pairs from a shared
+ queue (see GetNextBlock) until none are left.  Since all workers read the
+ same permutation table drawn from last_seed_used, the results are
+ identical to calling CalcPseudoP_range(period_ctx[t], 0, num_obs-1) for
+ each period t, regardless of the number of cores or of the order in
+ which blocks are processed. */
 void LisaCoordinator::CalcPseudoP_threaded()
 {
 	LOG_MSG("Entering LisaCoordinator::CalcPseudoP_threaded");
 	int nCPUs = wxThread::GetCPUCount();
 	
+	// Several blocks per worker keeps all cores busy even though
+	// observations with many neighbors cost more than others, while keeping
+	// contention on the queue mutex negligible.
+	const int blocks_per_cpu = 16;
+	block_size = (num_obs * num_time_vals) / (nCPUs * blocks_per_cpu);
+	if (block_size < 1) block_size = 1;
+	if (block_size > 1024) block_size = 1024;
+	if (block_size > num_obs) block_size = num_obs;
+	blocks_per_period = (num_obs + block_size - 1) / block_size;
+	{
+		wxMutexLocker lock(block_queue_mutex);
+		block_queue_next = 0;
+	}
+	int num_blocks = blocks_per_period * num_time_vals;
+	int tot_threads = nCPUs < num_blocks ? nCPUs : num_blocks;
+	
 	// mutext protects access to the worker_list
     wxMutex worker_list_mutex;
 	// signals that worker_list is empty
@@ -456,54 +522,36 @@ void LisaCoordinator::CalcPseudoP_threaded()
 	// terminates, it removes itself from the list.
 	std::list<wxThread*> worker_list;
 	
-	// divide up work according to number of observations
-	// and number of CPUs
-	int work_chunk = num_obs / nCPUs;
-	int obs_start = 0;
-	int obs_end = obs_start + work_chunk;
-	
-	bool is_thread_error = false;
-	int quotient = num_obs / nCPUs;
-	int remainder = num_obs % nCPUs;
-	int tot_threads = (quotient > 0) ? nCPUs : remainder;
-	
-	if (!reuse_last_seed) last_seed_used = time(0);
-	for (int i=0; i<tot_threads && !is_thread_error; i++) {
-		int a=0;
-		int b=0;
-		if (i < remainder) {
-			a = i*(quotient+1);
-			b = a+quotient;
-		} else {
-			a = remainder*(quotient+1) + (i-remainder)*quotient;
-			b = a+quotient-1;
-		}
-		uint64_t seed_start = last_seed_used+a;
-		uint64_t seed_end = seed_start + ((uint64_t) (b-a));
-		int thread_id = i+1;
+	{
 		wxString msg;
-		msg << "thread " << thread_id << ": " << a << "->" << b;
-		msg << ", seed: " << seed_start << "->" << seed_end;
+		msg << "starting " << tot_threads << " workers for " << num_blocks;
+		msg << " blocks of " << block_size << " obs over " << num_time_vals;
+		msg << " time periods, seed: " << last_seed_used;
 		LOG_MSG(msg);
-		
+	}
+	for (int i=0; i<tot_threads; i++) {
+		int thread_id = i+1;
 		LisaWorkerThread* thread =
-			new LisaWorkerThread(a, b, seed_start, this,
+			new LisaWorkerThread(this,
 								 &worker_list_mutex,
 								 &worker_list_empty_cond,
 								 &worker_list, thread_id);
 		if ( thread->Create() != wxTHREAD_NO_ERROR ) {
 			LOG_MSG("Error: Can't create thread!");
 			delete thread;
-			is_thread_error = true;
+			// the remaining workers will drain the whole queue
+			break;
 		} else {
 			worker_list.push_front(thread);
 		}
 	}
-	if (is_thread_error) {
+	if (worker_list.empty()) {
 		LOG_MSG("Error: Could not spawn a worker thread, falling back "
 				"to single-threaded pseudo-p calculation.");
 		// fall back to single thread calculation mode
-		CalcPseudoP_range(0, num_obs-1, last_seed_used);
+		for (int t=0; t<num_time_vals; t++) {
+			CalcPseudoP_range(period_ctx[t], 0, num_obs-1);
+		}
 	} else {
 		LOG_MSG("Starting all worker threads");
 		std::list<wxThread*>::iterator it;
@@ -524,66 +572,164 @@ void LisaCoordinator::CalcPseudoP_threaded()
 	LOG_MSG("Exiting LisaCoordinator::CalcPseudoP_threaded");
 }
 
-void LisaCoordinator::CalcPseudoP_range(int obs_start, int obs_end,
-										uint64_t seed_start)
+bool LisaCoordinator::GetNextBlock(int& time, int& obs_start, int& obs_end)
+{
+	int block = 0;
+	{
+		wxMutexLocker lock(block_queue_mutex);
+		if (block_queue_next >= blocks_per_period * num_time_vals) {
+			return false;
+		}
+		block = block_queue_next++;
+	}
+	time = block / blocks_per_period;
+	obs_start = (block % blocks_per_period) * block_size;
+	obs_end = obs_start + block_size - 1;
+	if (obs_end > num_obs-1) obs_end = num_obs-1;
+	return true;
+}
+
+/** Stopping rule for sequential permutation.  Further draws can only add
+ to the number of permuted values at least as large as the observed one
+ and to the number below it, so once the smaller of the two, count_extreme,
+ reaches floor(cutoff*(permutations+1)) the folded pseudo p-value of the
+ full run is certain to exceed cutoff, and so every finer cutoff as well.
+ No randomness is involved: the observation is reported not significant
+ at exactly the cutoffs where the full run would report it so. */
+static bool IsSequentialStop(uint64_t count_extreme, int permutations,
+							 double cutoff)
+{
+	// the small offset keeps e.g. 0.001*1000 from rounding down to 0
+	uint64_t min_extreme = (uint64_t) floor(cutoff*(permutations+1) + 1e-9);
+	return count_extreme >= min_extreme;
+}
+
+/** Number of folded extreme values among n permuted lag sums of
+ observation obs. */
+uint64_t LisaCoordinator::CountLarger(const LisaPeriodContext& ctx, int obs,
+									  int num_nbrs, const double* lags,
+									  int n) const
+{
+	const double xi = ctx.data1[obs];
+	const double Ii = ctx.localMoran[obs];
+	uint64_t countLarger = 0;
+	for (int perm=0; perm<n; perm++) {
+		double permutedLag = lags[perm];
+		//NOTE: we shouldn't have to row-standardize or
+		// multiply by data1[cnt]
+		if (num_nbrs && row_standardize) permutedLag /= num_nbrs;
+		const double localMoranPermuted = permutedLag * xi;
+		if (localMoranPermuted >= Ii) countLarger++;
+	}
+	return countLarger;
+}
+
+/** Pseudo p-value and significance category of observation obs after
+ perms_done permutations with countLarger values at least as large. */
+void LisaCoordinator::SetPseudoP(const LisaPeriodContext& ctx, int obs,
+								 int num_nbrs, uint64_t countLarger,
+								 int perms_done, bool stopped_early)
+{
+	double* sigLocalMoran = ctx.sigLocalMoran;
+	int* sigCat = ctx.sigCat;
+	ctx.permsUsed[obs] = perms_done;
+	
+	// pick the smallest
+	if (perms_done-countLarger <= countLarger) {
+		countLarger = perms_done-countLarger;
+	}
+	
+	if (stopped_early) {
+		// An estimate only, but like the full run's value it is above
+		// sequential_cutoff.  Categories coarser than sequential_cutoff are
+		// undetermined, so the observation is put in category 0, and
+		// SetSigFilterX reruns CalcPseudoP before they are shown.
+		sigLocalMoran[obs] = (countLarger+1.0)/(perms_done+1);
+		sigCat[obs] = 0;
+	} else {
+		sigLocalMoran[obs] = (countLarger+1.0)/(permutations+1);
+		// 'significance' of local Moran
+		if (sigLocalMoran[obs] <= 0.0001) sigCat[obs] = 4;
+		else if (sigLocalMoran[obs] <= 0.001) sigCat[obs] = 3;
+		else if (sigLocalMoran[obs] <= 0.01) sigCat[obs] = 2;
+		else if (sigLocalMoran[obs] <= 0.05) sigCat[obs]= 1;
+		else sigCat[obs]= 0;
+	}
+	
+	// observations with no neighbors get marked as isolates
+	if (num_nbrs == 0) {
+		sigCat[obs] = 5;
+	}
+}
+
+/** The permuted neighbors of every observation are read from perm_engine,
+ so the result for any observation does not depend on the range it was
+ computed in.  With a fixed number of permutations the lag sums of
+ max_batch_lags/permutations observations are gathered at once, so every
+ permutation row is read once per sub-block instead of once per
+ observation.  In sequential mode permutations are drawn in batches and
+ an observation stops as soon as IsSequentialStop holds, that is as soon
+ as it is certain not to be significant at sequential_cutoff. */
+void LisaCoordinator::CalcPseudoP_range(const LisaPeriodContext& ctx,
+										int obs_start, int obs_end)
 {
-	GeoDaSet workPermutation(num_obs);
-	//Randik rng;
-	int max_rand = num_obs-1;
+	const double* x = isBivariate ? ctx.data2 : ctx.data1;
+	PermutationEngine::Scratch scratch;
+	
+	if (!sequential_permutation) {
+		int sub_block = max_batch_lags / permutations;
+		if (sub_block < 1) sub_block = 1;
+		std::vector<double> permutedLags((size_t) sub_block * permutations);
+		for (int s=obs_start; s<=obs_end; s+=sub_block) {
+			int e = s + sub_block - 1;
+			if (e > obs_end) e = obs_end;
+			perm_engine.PermutedLagSums(s, e, *w_csr, x,
+										&permutedLags[0], scratch);
+			for (int cnt=s; cnt<=e; cnt++) {
+				const int numNeighbors = w_csr->Size(cnt);
+				const double* lags =
+					&permutedLags[(size_t) (cnt-s) * permutations];
+				uint64_t countLarger = CountLarger(ctx, cnt, numNeighbors,
+												   lags, permutations);
+				SetPseudoP(ctx, cnt, numNeighbors, countLarger,
+						   permutations, false);
+			}
+		}
+		return;
+	}
+	
+	const int seq_batch_size = 100;
+	std::vector<double> permutedLags(seq_batch_size);
 	for (int cnt=obs_start; cnt<=obs_end; cnt++) {
-		const int numNeighbors = W[cnt].Size();
+		const int numNeighbors = w_csr->Size(cnt);
 		
 		uint64_t countLarger = 0;
-		for (int perm=0; perm<permutations; perm++) {
-			int rand=0;
-			while (rand < numNeighbors) {
-				// computing 'perfect' permutation of given size
-				//int newRandom = (int) (rng.fValue() * max_rand);
-				int newRandom = (int) (Gda::ThomasWangHashDouble(seed_start++)
-									   * max_rand);
-				//int newRandom = X(rng);
-				if (newRandom != cnt && !workPermutation.Belongs(newRandom))
-				{
-					workPermutation.Push(newRandom);
-					rand++;
-				}
-			}
-			double permutedLag=0;
-			// use permutation to compute the lag
+		int perms_done = 0;
+		bool stopped_early = false;
+		while (perms_done < permutations) {
+			int perm_end = perms_done + seq_batch_size;
+			if (perm_end > permutations) perm_end = permutations;
 			// compute the lag for binary weights
-			if (isBivariate) {
-				for (int cp=0; cp<numNeighbors; cp++) {
-					permutedLag += data2[workPermutation.Pop()];
+			perm_engine.PermutedLagSums(cnt, numNeighbors, x,
+										perms_done, perm_end,
+										&permutedLags[0], scratch);
+			countLarger += CountLarger(ctx, cnt, numNeighbors,
+									   &permutedLags[0], perm_end-perms_done);
+			perms_done = perm_end;
+			if (perms_done < permutations) {
+				uint64_t countExtreme = countLarger;
+				if (perms_done-countLarger < countLarger) {
+					countExtreme = perms_done-countLarger;
 				}
-			} else {
-				for (int cp=0; cp<numNeighbors; cp++) {
-					permutedLag += data1[workPermutation.Pop()];
+				if (IsSequentialStop(countExtreme, permutations,
+									 sequential_cutoff)) {
+					stopped_early = true;
 				}
 			}
-			
-			//NOTE: we shouldn't have to row-standardize or
-			// multiply by data1[cnt]
-			if (numNeighbors && row_standardize) permutedLag /= numNeighbors;
-			const double localMoranPermuted = permutedLag * data1[cnt];
-			if (localMoranPermuted >= localMoran[cnt]) countLarger++;
-		}
-		// pick the smallest
-		if (permutations-countLarger <= countLarger) { 
-			countLarger = permutations-countLarger;
-		}
-		
-		sigLocalMoran[cnt] = (countLarger+1.0)/(permutations+1);
-		// 'significance' of local Moran
-		if (sigLocalMoran[cnt] <= 0.0001) sigCat[cnt] = 4;
-		else if (sigLocalMoran[cnt] <= 0.001) sigCat[cnt] = 3;
-		else if (sigLocalMoran[cnt] <= 0.01) sigCat[cnt] = 2;
-		else if (sigLocalMoran[cnt] <= 0.05) sigCat[cnt]= 1;
-		else sigCat[cnt]= 0;
-		
-		// observations with no neighbors get marked as isolates
-		if (numNeighbors == 0) {
-			sigCat[cnt] = 5;
+			if (stopped_early) break;
 		}
+		SetPseudoP(ctx, cnt, numNeighbors, countLarger, perms_done,
+				   stopped_early);
 	}
 }
 
@@ -28,6 +28,7 @@
 #include "../VarTools.h"
 #include "../ShapeOperations/GalWeight.h"
 #include "../ShapeOperations/WeightsManStateObserver.h"
+#include "PermutationEngine.h"
 
 class LisaCoordinatorObserver;
 class LisaCoordinator;
@@ -35,11 +36,43 @@ class Project;
 class WeightsManState;
 typedef boost::multi_array<double, 2> d_array_type;
 
+/** Pointers into the space-time arrays of LisaCoordinator for a single
+ time period.  The LISA kernels only touch the arrays of the context they
+ are handed, so all time periods can be computed concurrently. */
+struct LisaPeriodContext
+{
+	LisaPeriodContext() : data1(0), data2(0), lags(0), localMoran(0),
+	sigLocalMoran(0), sigCat(0), cluster(0), permsUsed(0) {}
+	
+	const double* data1;
+	const double* data2; // only set for bivariate LISA
+	double* lags;
+	double* localMoran; // The LISA
+	double* sigLocalMoran; // The significances / pseudo p-vals
+	// The significance category, generated from sigLocalMoran and
+	// significance cuttoff values below.  When saving results to Table,
+	// only results below significance_cuttoff are non-zero, but sigCat
+	// results themeslves never change.
+	//0: >0.05 1: 0.05, 2: 0.01, 3: 0.001, 4: 0.0001
+	// With sequential permutation, 0 also marks observations stopped early
+	// as not significant at the cutoff in use.
+	int* sigCat;
+	// not-sig=0 HH=1, LL=2, HL=3, LH=4, isolate=5, undef=6.  Note: value of
+	// 0 never appears in cluster itself, it only appears when
+	// saving results to the Table and indirectly in the map legend
+	int* cluster;
+	int* permsUsed; // number of permutations drawn for each observation
+};
+
+/** Member of the pool of workers started by
+ LisaCoordinator::CalcPseudoP_threaded.  Rather than being handed a single
+ fixed range of observations, each worker repeatedly pulls the next block of
+ observations from the coordinator's shared queue until the queue is
+ exhausted, so that fast workers pick up the slack of slow ones. */
 class LisaWorkerThread : public wxThread
 {
 public:
-	LisaWorkerThread(int obs_start, int obs_end, uint64_t seed_start,
-					 LisaCoordinator* lisa_coord,
+	LisaWorkerThread(LisaCoordinator* lisa_coord,
 					 wxMutex* worker_list_mutex,
 					 wxCondition* worker_list_empty_cond,
 					 std::list<wxThread*> *worker_list,
@@ -47,9 +80,6 @@ public:
 	virtual ~LisaWorkerThread();
 	virtual void* Entry();  // thread execution starts here
 
-	int obs_start;
-	int obs_end;
-	uint64_t seed_start;
 	int thread_id;
 	
 	LisaCoordinator* lisa_coord;
@@ -92,6 +122,22 @@ public:
 	bool IsReuseLastSeed() { return reuse_last_seed; }
     
 	void SetReuseLastSeed(bool reuse) { reuse_last_seed = reuse; }
+	
+	/** When sequential permutation is enabled, CalcPseudoP stops drawing
+	 permutations for an observation as soon as it is certain not to be
+	 significant at significance_cutoff, so the map is the same as with
+	 all permutations.  The number of permutations actually used is
+	 recorded in perms_used_vecs. */
+	bool IsSequentialPermutation() { return sequential_permutation; }
+    
+	void SetSequentialPermutation(bool seq) { sequential_permutation = seq; }
+    
+	/** True if the current pseudo p-values were computed with early
+	 stopping at a stricter cutoff than the current significance filter,
+	 in which case CalcPseudoP must be rerun. */
+	bool IsSequentialCutoffStale() {
+		return (calc_significances && sequential_permutation &&
+				significance_cutoff > sequential_cutoff); }
 
 	/** Implementation of WeightsManStateObserver interface */
 	virtual void update(WeightsManState* o);
@@ -100,36 +146,19 @@ public:
     
 	virtual void closeObserver(boost::uuids::uuid id);
 	
-protected:
-	// The following seven are just temporary pointers into the corresponding
-	// space-time data arrays below
-	double* lags;
-	double*	localMoran;		// The LISA
-	double* sigLocalMoran;	// The significances / pseudo p-vals
-	// The significance category, generated from sigLocalMoran and
-	// significance cuttoff values below.  When saving results to Table,
-	// only results below significance_cuttoff are non-zero, but sigCat
-	// results themeslves never change.
-	//0: >0.05 1: 0.05, 2: 0.01, 3: 0.001, 4: 0.0001
-	int* sigCat;
-	// not-sig=0 HH=1, LL=2, HL=3, LH=4, isolate=5, undef=6.  Note: value of
-	// 0 never appears in cluster itself, it only appears when
-	// saving results to the Table and indirectly in the map legend
-	int* cluster;
-	double* data1;
-	double* data2;
-	
 public:
 	std::vector<double*> lags_vecs;
 	std::vector<double*> local_moran_vecs;
 	std::vector<double*> sig_local_moran_vecs;
 	std::vector<int*> sig_cat_vecs;
 	std::vector<int*> cluster_vecs;
+	std::vector<int*> perms_used_vecs;
 	std::vector<double*> data1_vecs;
 	std::vector<double*> data2_vecs;
 	
 	boost::uuids::uuid w_id;
 	const GalElement* W;
+	const CsrWeight* w_csr; // CSR copy of W used by all lag computations
 	wxString weight_name;
 	bool isBivariate;
 	LisaType lisa_type;
@@ -159,7 +188,18 @@ public:
 	std::list<LisaCoordinatorObserver*> observers;
 	
 	void CalcPseudoP();
-	void CalcPseudoP_range(int obs_start, int obs_end, uint64_t seed_start);
+	void CalcPseudoP_range(const LisaPeriodContext& ctx,
+						   int obs_start, int obs_end);
+	uint64_t CountLarger(const LisaPeriodContext& ctx, int obs, int num_nbrs,
+						 const double* lags, int n) const;
+	void SetPseudoP(const LisaPeriodContext& ctx, int obs, int num_nbrs,
+					uint64_t countLarger, int perms_done, bool stopped_early);
+	/** Pop the next block of observations of time period time from the
+	 work queue filled by CalcPseudoP_threaded.  Blocks never straddle two
+	 periods.  Returns false once the queue is empty. */
+	bool GetNextBlock(int& time, int& obs_start, int& obs_end);
+	const LisaPeriodContext& GetPeriodContext(int time) {
+		return period_ctx[time]; }
 
 	void InitFromVarInfo();
 	void VarInfoAttributeChange();
@@ -177,6 +217,27 @@ protected:
 	bool calc_significances; // if false, then p-vals will never be needed
 	uint64_t last_seed_used;
 	bool reuse_last_seed;
+	bool sequential_permutation;
+	// significance_cutoff used by the last sequential CalcPseudoP
+	double sequential_cutoff;
+	// conditional permutation table drawn from last_seed_used, shared
+	// read-only by all worker threads
+	PermutationEngine perm_engine;
+	/** Upper bound on the permuted lag sums gathered at once by
+	 CalcPseudoP_range, 512 KB. */
+	static const int max_batch_lags = 64*1024;
+	
+	// one context per time period, filled by MakePeriodContexts
+	std::vector<LisaPeriodContext> period_ctx;
+	void MakePeriodContexts();
+	
+	// shared work queue for CalcPseudoP_threaded: the flat space of all
+	// (time period, block of block_size observations) pairs is handed out
+	// in order starting from block_queue_next
+	wxMutex block_queue_mutex;
+	int block_queue_next;
+	int block_size;
+	int blocks_per_period;
 	
 	WeightsManState* w_man_state;
 	WeightsManInterface* w_man_int;
@@ -159,6 +159,8 @@ void LisaMapCanvas::SetCheckMarks(wxMenu* menu)
 	
 	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_USE_SPECIFIED_SEED"),
 								  lisa_coord->IsReuseLastSeed());
+	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_SEQUENTIAL_PERMUTATION"),
+								  lisa_coord->IsSequentialPermutation());
 }
 
 void LisaMapCanvas::TimeChange()
@@ -534,6 +536,15 @@ void LisaMapFrame::OnUseSpecifiedSeed(wxCommandEvent& event)
 	lisa_coord->SetReuseLastSeed(!lisa_coord->IsReuseLastSeed());
 }
 
+void LisaMapFrame::OnSequentialPermutation(wxCommandEvent& event)
+{
+	lisa_coord->SetSequentialPermutation(
+		!lisa_coord->IsSequentialPermutation());
+	lisa_coord->CalcPseudoP();
+	lisa_coord->notifyObservers();
+	UpdateOptionMenuItems();
+}
+
 void LisaMapFrame::OnSpecifySeedDlg(wxCommandEvent& event)
 {
 	uint64_t last_seed = lisa_coord->GetLastUsedSeed();
@@ -569,6 +580,9 @@ void LisaMapFrame::SetSigFilterX(int filter)
 {
 	if (filter == lisa_coord->GetSignificanceFilter()) return;
 	lisa_coord->SetSignificanceFilter(filter);
+	// early stopping at a stricter cutoff cannot tell which observations
+	// are significant at a looser one
+	if (lisa_coord->IsSequentialCutoffStale()) lisa_coord->CalcPseudoP();
 	lisa_coord->notifyObservers();
 	UpdateOptionMenuItems();
 }
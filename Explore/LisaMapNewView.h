@@ -88,6 +88,7 @@ public:
 	
 	void OnUseSpecifiedSeed(wxCommandEvent& event);
 	void OnSpecifySeedDlg(wxCommandEvent& event);
+	void OnSequentialPermutation(wxCommandEvent& event);
 	
 	void SetSigFilterX(int filter);
 	void OnSigFilter05(wxCommandEvent& event);
@@ -22,9 +22,11 @@
 #include <iostream>
 #include <set>
 #include <sstream>
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <wx/wx.h>
 #include <wx/msgdlg.h>
+#include <wx/rawbmp.h>
 #include <wx/splitter.h>
 #include <wx/xrc/xmlres.h>
 #include "CatClassifState.h"
@@ -218,6 +220,9 @@ MapCanvas::~MapCanvas()
 	LOG_MSG("Entering MapCanvas::~MapCanvas");
 	if (highlight_state) highlight_state->removeObserver(this);
 	if (custom_classif_state) custom_classif_state->removeObserver(this);
+	project->RemoveSpatialIndexesCallback(this);
+	project->RemovePolygonLodCallback(this);
+	project->RemoveGeometriesCallback(this);
 	LOG_MSG("Exiting MapCanvas::~MapCanvas");
 }
 
@@ -434,9 +439,30 @@ void MapCanvas::DrawLayer1()
 	if (!draw_sel_shps_by_z_val)
         DrawHighlightedShapes(dc);
     
+	// lets TemplateCanvas::update paint the next sparse delta on top
+	layer1_hl_epoch = highlight_state->GetEpoch();
 	layer1_valid = true;
 }
 
+/** layer1_bm only holds the highlighted shapes here, so r is made
+ transparent again. */
+void MapCanvas::RestoreLayer1Rect(const wxRect& r)
+{
+	wxAlphaPixelData data(*layer1_bm, r.GetTopLeft(), r.GetSize());
+	if (!data) return;
+	wxAlphaPixelData::Iterator row(data);
+	for (int y=0; y<r.height; y++) {
+		wxAlphaPixelData::Iterator p = row;
+		for (int x=0; x<r.width; x++, ++p) {
+			p.Red() = 0;
+			p.Green() = 0;
+			p.Blue() = 0;
+			p.Alpha() = 0;
+		}
+		row.OffsetY(data, 1);
+	}
+}
+
 void MapCanvas::DrawLayer2()
 {
 	//LOG_MSG("In TemplateCanvas::DrawLayer2");
@@ -1015,6 +1041,16 @@ void MapCanvas::PopulateCanvas()
 		if (full_map_redraw_needed) {
 			CreateSelShpsFromProj(selectable_shps, project);
 			full_map_redraw_needed = false;
+			// records the project is still reading are drawn as their
+			// batches come in
+			project->AddGeometriesCallback(this,
+				boost::bind(&MapCanvas::OnGeometriesRead, this, _1, _2));
+			// full resolution polygons are drawn until the simplified ones
+			// are ready
+			if (selectable_shps_type == polygons) {
+				project->AddPolygonLodCallback(this,
+					boost::bind(&MapCanvas::OnPolygonLodBuilt, this));
+			}
 			
 			if (selectable_shps_type == polygons &&
 				(display_mean_centers || display_centroids)) {
@@ -1030,7 +1066,11 @@ void MapCanvas::PopulateCanvas()
 						foreground_shps.push_back(p);
 					}
 				}
-				if (display_centroids) {
+				// rather than wait for the background build, the centroids
+				// are added once it is done
+				if (display_centroids &&
+					!project->AddSpatialIndexesCallback(this,
+						boost::bind(&MapCanvas::OnSpatialIndexesBuilt, this))) {
 					const std::vector<GdaPoint*>& c = project->GetCentroids();
 					for (int i=0; i<num_obs; i++) {
 						p = new GdaPoint(*c[i]);
@@ -1327,6 +1367,27 @@ void MapCanvas::DisplayCentroids()
 	PopulateCanvas();
 }
 
+void MapCanvas::OnSpatialIndexesBuilt()
+{
+	if (!display_centroids) return;
+	full_map_redraw_needed = true;
+	PopulateCanvas();
+}
+
+void MapCanvas::OnPolygonLodBuilt()
+{
+	invalidateBms();
+	Refresh();
+}
+
+void MapCanvas::OnGeometriesRead(int start, int end)
+{
+	// nothing to update while the map shows an error message
+	if ((int) selectable_shps.size() != num_obs) return;
+	UpdateSelShpsFromProj(selectable_shps, project, start, end);
+	ReDraw();
+}
+
 void MapCanvas::DisplayVoronoiDiagram()
 {
 	full_map_redraw_needed = true;
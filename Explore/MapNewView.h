@@ -133,6 +133,7 @@ public:
 	virtual void DrawLayer0();
 	virtual void DrawLayer1();
 	virtual void DrawLayer2();
+	virtual void RestoreLayer1Rect(const wxRect& r);
 	virtual void OnPaint(wxPaintEvent& event);
 #endif
 
@@ -183,6 +184,14 @@ protected:
 	boost::uuids::uuid weights_id;
 	
 	virtual void UpdateStatusBar();
+	/** Draws the centroids that were left out while the spatial indexes
+	 were still being built. */
+	void OnSpatialIndexesBuilt();
+	/** Redraws with the simplified polygons once they are built. */
+	void OnPolygonLodBuilt();
+	/** Draws the records of a batch read by the project in the
+	 background. */
+	void OnGeometriesRead(int start, int end);
 		
 	DECLARE_EVENT_TABLE()
 };
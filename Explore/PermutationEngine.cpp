@@ -0,0 +1,154 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include "../GenUtils.h"
+#include "../ShapeOperations/CsrWeight.h"
+#include "PermutationEngine.h"
+
+PermutationEngine::PermutationEngine()
+: num_obs(0), permutations(0), max_neighbors(0), seed(0)
+{
+}
+
+PermutationEngine::~PermutationEngine()
+{
+}
+
+void PermutationEngine::Init(const CsrWeight& W, int permutations_s,
+							 uint64_t seed_s)
+{
+	num_obs = W.GetNumObs();
+	permutations = permutations_s;
+	seed = seed_s;
+
+	max_neighbors = W.GetMaxNbrs();
+	// observation i itself is excluded, so at most num_obs-1 others
+	const int max_rand = num_obs-1;
+	if (max_neighbors > max_rand) max_neighbors = max_rand;
+
+	std::vector<int>().swap(table);
+	if (max_neighbors <= 0 || permutations <= 0) return;
+	if ((size_t) permutations * max_neighbors > max_table_entries) return;
+	table.resize((size_t) permutations * max_neighbors);
+
+	Scratch scratch;
+	for (int perm=0; perm<permutations; perm++) {
+		DrawRow(perm, max_neighbors, &table[(size_t) perm * max_neighbors],
+				scratch);
+	}
+}
+
+/** Each row has its own stream so that rows are independent, and the
+ first len entries of a row do not depend on len, so a row drawn again
+ with a smaller len is a prefix of the stored one. */
+void PermutationEngine::DrawRow(int perm, int len, int* row,
+								Scratch& scratch) const
+{
+	const int max_rand = num_obs-1;
+	uint64_t s = Gda::ThomasWangHashUInt64(seed + perm);
+	if (max_neighbors * 2 <= max_rand) {
+		// sparse case: rejection sampling of distinct indices
+		std::vector<int>& mark = scratch.mark;
+		if ((int) mark.size() != max_rand || ++scratch.stamp == 0) {
+			mark.assign(max_rand, 0);
+			scratch.stamp = 1;
+		}
+		int rand = 0;
+		while (rand < len) {
+			int newRandom = (int) (Gda::ThomasWangHashDouble(s++) * max_rand);
+			if (newRandom >= max_rand) newRandom = max_rand-1;
+			if (mark[newRandom] != scratch.stamp) {
+				mark[newRandom] = scratch.stamp;
+				row[rand++] = newRandom;
+			}
+		}
+	} else {
+		// dense case: partial Fisher-Yates shuffle, undone afterwards so
+		// that idx is the identity again for the next row
+		std::vector<int>& idx = scratch.idx;
+		if ((int) idx.size() != max_rand) {
+			idx.resize(max_rand);
+			for (int j=0; j<max_rand; j++) idx[j] = j;
+		}
+		scratch.swaps.resize(len);
+		for (int k=0; k<len; k++) {
+			int r = k + (int) (Gda::ThomasWangHashDouble(s++) * (max_rand-k));
+			if (r >= max_rand) r = max_rand-1;
+			std::swap(idx[k], idx[r]);
+			scratch.swaps[k] = r;
+			row[k] = idx[k];
+		}
+		for (int k=len-1; k>=0; k--) std::swap(idx[k], idx[scratch.swaps[k]]);
+	}
+}
+
+const int* PermutationEngine::GetRow(int perm, int len,
+									 Scratch& scratch) const
+{
+	if (!table.empty()) return &table[(size_t) perm * max_neighbors];
+	if ((int) scratch.row.size() < max_neighbors) {
+		scratch.row.resize(max_neighbors);
+	}
+	DrawRow(perm, len, &scratch.row[0], scratch);
+	return &scratch.row[0];
+}
+
+void PermutationEngine::PermutedLagSums(int obs, int num_nbrs,
+										const double* x,
+										int perm_start, int perm_end,
+										double* out, Scratch& scratch) const
+{
+	if (num_nbrs > max_neighbors) num_nbrs = max_neighbors;
+	for (int p=perm_start; p<perm_end; p++) {
+		const int* row = num_nbrs > 0 ? GetRow(p, num_nbrs, scratch) : 0;
+		double lag = 0;
+		for (int k=0; k<num_nbrs; k++) {
+			int j = row[k];
+			lag += x[j + (j >= obs)];
+		}
+		out[p-perm_start] = lag;
+	}
+}
+
+void PermutationEngine::PermutedLagSums(int obs_start, int obs_end,
+										const CsrWeight& W,
+										const double* x, double* out,
+										Scratch& scratch) const
+{
+	const int block = obs_end - obs_start + 1;
+	if (block <= 0) return;
+	int block_nbrs = 0;
+	for (int i=obs_start; i<=obs_end; i++) {
+		block_nbrs = std::max(block_nbrs, std::min(W.Size(i), max_neighbors));
+	}
+	for (int p=0; p<permutations; p++) {
+		const int* row = block_nbrs > 0 ? GetRow(p, block_nbrs, scratch) : 0;
+		for (int i=obs_start; i<=obs_end; i++) {
+			const int num_nbrs = W.Size(i) < max_neighbors ?
+				W.Size(i) : max_neighbors;
+			double lag = 0;
+			for (int k=0; k<num_nbrs; k++) {
+				int j = row[k];
+				lag += x[j + (j >= i)];
+			}
+			out[(size_t) (i-obs_start) * permutations + p] = lag;
+		}
+	}
+}
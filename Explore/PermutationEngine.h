@@ -0,0 +1,109 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_PERMUTATION_ENGINE_H__
+#define __GEODA_CENTER_PERMUTATION_ENGINE_H__
+
+#include <vector>
+#include <boost/cstdint.hpp>
+
+class CsrWeight;
+
+/**
+ Conditional permutation engine shared by the local spatial
+ autocorrelation statistics (LISA, Getis-Ord G).
+
+ For every permutation p, a random sample without replacement of
+ max_neighbors indices from {0, ..., num_obs-2} is drawn once when Init is
+ called.  Since the first k entries of such a sample are themselves a
+ random sample of size k, every observation, whatever its number of
+ neighbors, reuses the same table.  Observation i is conditioned out by
+ mapping every drawn index j >= i to j+1, so i never appears among its
+ own permuted neighbors.
+
+ The table is read-only after Init, so any number of worker threads may
+ share one engine.  A table larger than max_table_entries is not stored:
+ each row is then drawn again whenever it is needed, from the same stream,
+ so the results are the same and memory stays O(num_obs) per thread.
+ */
+class PermutationEngine
+{
+public:
+	/** 64 MB of indices */
+	static const size_t max_table_entries = 16*1024*1024;
+
+	/** Per-thread work space for drawing rows when the table is not
+	 stored.  Allocated on first use. */
+	class Scratch {
+	public:
+		Scratch() : stamp(0) {}
+	private:
+		friend class PermutationEngine;
+		std::vector<int> mark; // mark[j] == stamp if j is in the row
+		int stamp;
+		std::vector<int> idx; // identity permutation between rows
+		std::vector<int> swaps;
+		std::vector<int> row;
+	};
+
+	PermutationEngine();
+	virtual ~PermutationEngine();
+
+	/** Draw the permutation table for the given weights.  max_neighbors is
+	 the largest cardinality in W (capped at num_obs-1).  The table is
+	 fully determined by seed. */
+	void Init(const CsrWeight& W, int permutations, uint64_t seed);
+	bool IsInit() const { return num_obs > 0; }
+	bool IsTableStored() const { return !table.empty(); }
+	int GetNumObs() const { return num_obs; }
+	int GetPermutations() const { return permutations; }
+	int GetMaxNeighbors() const { return max_neighbors; }
+	uint64_t GetSeed() const { return seed; }
+
+	/** Fill out[p], p in [perm_start, perm_end), with the permuted lag
+	 sums of observation obs. out must hold perm_end-perm_start values. */
+	void PermutedLagSums(int obs, int num_nbrs, const double* x,
+						 int perm_start, int perm_end, double* out,
+						 Scratch& scratch) const;
+
+	/** Batch version for all permutations of observations
+	 [obs_start, obs_end].  out[(i-obs_start)*permutations + p] receives
+	 the lag sum of observation i for permutation p.  Each table row is
+	 reused for the whole block of observations while it is hot in cache,
+	 and the inner loop is a plain gather the compiler can vectorize. */
+	void PermutedLagSums(int obs_start, int obs_end, const CsrWeight& W,
+						 const double* x, double* out,
+						 Scratch& scratch) const;
+
+private:
+	/** First len indices of row perm.  Returns a pointer into the table or
+	 into scratch. */
+	const int* GetRow(int perm, int len, Scratch& scratch) const;
+	void DrawRow(int perm, int len, int* row, Scratch& scratch) const;
+
+	int num_obs;
+	int permutations;
+	int max_neighbors;
+	uint64_t seed;
+	// permutations rows of max_neighbors indices in [0, num_obs-2], empty
+	// if larger than max_table_entries
+	std::vector<int> table;
+};
+
+#endif
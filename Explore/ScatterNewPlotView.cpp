@@ -561,17 +561,15 @@ void ScatterNewPlotCanvas::update(HLStateInt* o)
 	LOG_MSG("Entering ScatterNewPlotCanvas::update");
 	
 	if (IsRegressionSelected() || IsRegressionExcluded()) {
-		SmoothingUtils::CalcStatsRegimes(X, Y, statsX, statsY, regressionXY,
-																		 highlight_state->GetHighlight(),
-																		 statsXselected, statsYselected,
-																		 statsXexcluded, statsYexcluded,
-																		 regressionXYselected, regressionXYexcluded,
-																		 sse_sel, sse_unsel);
+		UpdateRegimeStats(o);
 		if (IsRegressionSelected()) UpdateRegSelectedLine();
 		if (IsRegressionExcluded()) UpdateRegExcludedLine();
 		if (IsShowLowessSmoother() && IsShowRegimes()) {
 			UpdateLowessOnRegimes();
 		}
+	} else {
+		// highlight changes are not followed while no regime is shown
+		regime_stats.Clear();
 	}
 	if (IsDisplayStats() && IsShowLinearSmoother()) UpdateDisplayStats();
 	
@@ -1073,12 +1071,8 @@ void ScatterNewPlotCanvas::PopulateCanvas()
 	
 	if (IsRegressionSelected() || IsRegressionExcluded()) {
 		// update both selected and excluded stats
-		SmoothingUtils::CalcStatsRegimes(X, Y, statsX, statsY, regressionXY,
-																		 highlight_state->GetHighlight(),
-																		 statsXselected, statsYselected,
-																		 statsXexcluded, statsYexcluded,
-																		 regressionXYselected, regressionXYexcluded,
-																		 sse_sel, sse_unsel);
+		regime_stats.Init(X, Y, highlight_state->GetHighlight());
+		CalcStatsRegimes();
 	}
 	if (IsRegressionSelected()) UpdateRegSelectedLine();
 	if (IsRegressionExcluded()) UpdateRegExcludedLine();
@@ -1396,12 +1390,8 @@ void ScatterNewPlotCanvas::ViewRegressionSelected(bool display)
 			PopulateCanvas();
 		} else {
 			show_reg_selected = true;
-			SmoothingUtils::CalcStatsRegimes(X, Y, statsX, statsY, regressionXY,
-																			 highlight_state->GetHighlight(),
-																			 statsXselected, statsYselected,
-																			 statsXexcluded, statsYexcluded,
-																			 regressionXYselected, regressionXYexcluded,
-																			 sse_sel, sse_unsel);
+			regime_stats.Init(X, Y, highlight_state->GetHighlight());
+			CalcStatsRegimes();
 			UpdateRegSelectedLine();
 			UpdateDisplayStats();
 			changed = UpdateDisplayLinesAndMargins();
@@ -1465,12 +1455,8 @@ void ScatterNewPlotCanvas::ViewRegressionSelectedExcluded(bool display)
 			changed = UpdateDisplayLinesAndMargins();
 			PopulateCanvas();
 		} else {
-			SmoothingUtils::CalcStatsRegimes(X, Y, statsX, statsY, regressionXY,
-																			 highlight_state->GetHighlight(),
-																			 statsXselected, statsYselected,
-																			 statsXexcluded, statsYexcluded,
-																			 regressionXYselected, regressionXYexcluded,
-																			 sse_sel, sse_unsel);
+			regime_stats.Init(X, Y, highlight_state->GetHighlight());
+			CalcStatsRegimes();
 			show_reg_excluded = true;
 			UpdateRegExcludedLine();
 			UpdateDisplayStats();
@@ -1618,6 +1604,35 @@ void ScatterNewPlotCanvas::UpdateLowessOnRegimes()
 	layer2_valid = false;
 }
 
+/** Brushing only moves the newly highlighted and unhighlighted
+ observations between the regimes, rather than rescanning X and Y. */
+void ScatterNewPlotCanvas::UpdateRegimeStats(HLStateInt* o)
+{
+	std::vector<bool>& hl = highlight_state->GetHighlight();
+	if (o->GetEventType() == HLStateInt::delta) {
+		regime_stats.Update(X, Y, hl,
+							o->GetNewlyHighlighted(),
+							o->GetTotalNewlyHighlighted(),
+							o->GetNewlyUnhighlighted(),
+							o->GetTotalNewlyUnhighlighted());
+	} else if (o->GetEventType() == HLStateInt::invert &&
+			   regime_stats.IsInit()) {
+		regime_stats.Invert();
+	} else {
+		regime_stats.Init(X, Y, hl);
+	}
+	CalcStatsRegimes();
+}
+
+void ScatterNewPlotCanvas::CalcStatsRegimes()
+{
+	regime_stats.CalcStats(statsX, statsY, regressionXY,
+						   statsXselected, statsYselected,
+						   statsXexcluded, statsYexcluded,
+						   regressionXYselected, regressionXYexcluded,
+						   sse_sel, sse_unsel);
+}
+
 void ScatterNewPlotCanvas::ComputeChowTest()
 {
 	LOG_MSG("Entering ScatterNewPlotCanvas::ComputeChowTest");
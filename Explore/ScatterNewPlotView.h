@@ -138,6 +138,8 @@ public:
     double bubble_size_scaler;
     
 protected:
+	void UpdateRegimeStats(HLStateInt* o);
+	void CalcStatsRegimes();
 	void ComputeChowTest();
 	void UpdateRegSelectedLine();
 	void UpdateRegExcludedLine();
@@ -193,6 +195,8 @@ protected:
 	double sse_sel; // err sum of sqrs unconstrained for selected
 	double sse_unsel; // err sum of sqrs unconstrained for unselected
 	// Note: sse_u (unconstrained) is the sum for sse_sel and sse_unsel
+	// sums behind the selected and excluded stats, updated when brushing
+	SmoothingUtils::RegimeStats regime_stats;
 	double chow_ratio; // Chow test or f ratio
 	double chow_pval; // significance of chow_ratio
 	bool chow_valid;
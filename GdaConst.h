@@ -283,6 +283,19 @@ public:
 	static const int shps_max_width = 12000;
 	static const int shps_max_height = 12000;
 	static const int shps_max_area = 50000000; // 50 million
+	// layers with at least this many selectable shapes are drawn by a
+	// TileRenderer on worker threads
+	static const int tile_render_min_shps = 10000;
+	// a highlight change is repainted in the box around the changed shapes
+	// unless the box covers more than this percentage of the canvas
+	static const int highlight_repaint_max_pct = 25;
+	// basemap tiles are fetched by this many threads, at most this many
+	// tiles wait in the queue, this many decoded tiles are kept in memory
+	// and the tile files on disk are kept under this many megabytes
+	static const int basemap_fetch_threads = 4;
+	static const int basemap_max_queued = 256;
+	static const int basemap_mem_tiles = 128;
+	static const int basemap_disk_cache_mb = 200;
 	
 	static const wxColour selectable_outline_color; // black
 	static const wxColour selectable_fill_color; // forest green
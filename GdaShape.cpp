@@ -435,6 +435,66 @@ double GdaShapeAlgs::calculateArea(int n,
 }
 
 
+void GdaShapeAlgs::calculateMeanCenters(const Shapefile::PolygonBuffer& polys,
+										std::vector<double>& x,
+										std::vector<double>& y)
+{
+	int num_recs = polys.GetNumRecords();
+	x.resize(num_recs);
+	y.resize(num_recs);
+	for (int i=0; i<num_recs; i++) {
+		int n = polys.GetNumPoints(i);
+		const wxFloat64* px = polys.GetX(i);
+		const wxFloat64* py = polys.GetY(i);
+		double cx = 0, cy = 0;
+		for (int k=0; k<n; k++) {
+			cx += px[k];
+			cy += py[k];
+		}
+		x[i] = n > 0 ? cx / (double) n : 0;
+		y[i] = n > 0 ? cy / (double) n : 0;
+	}
+}
+
+/** As calculateCentroid for a GdaPolygon, only the first part of each
+ record is used. */
+void GdaShapeAlgs::calculateCentroids(const Shapefile::PolygonBuffer& polys,
+									  std::vector<double>& x,
+									  std::vector<double>& y)
+{
+	int num_recs = polys.GetNumRecords();
+	x.resize(num_recs);
+	y.resize(num_recs);
+	for (int i=0; i<num_recs; i++) {
+		x[i] = 0;
+		y[i] = 0;
+		if (polys.GetNumPoints(i) == 0) continue;
+		const wxFloat64* px = polys.GetX(i);
+		const wxFloat64* py = polys.GetY(i);
+		int n = (polys.GetNumParts(i) > 1 ? polys.GetParts(i)[1] :
+				 polys.GetNumPoints(i));
+		int p = (px[0]==px[n-1] && py[0]==py[n-1]) ? n-1 : n;
+		double a = 0, cx = 0, cy = 0, d;
+		if (n > 2) {
+			for (int j=0, k=1, cnt=0; cnt<p; j=(j+1)%p, k=(k+1)%p, cnt++) {
+				d = (px[j] * py[k]) - (px[k] * py[j]);
+				a += d;
+				cx += (px[j] + px[k])*d;
+				cy += (py[j] + py[k])*d;
+			}
+			a /= 2.0f;
+		}
+		if (a == 0) {
+			x[i] = px[0];
+			y[i] = py[0];
+		} else {
+			x[i] = cx / (a*6.0f);
+			y[i] = cy / (a*6.0f);
+		}
+	}
+}
+
+
 /** num_points is an optional parameter.  If num_points < 4, then a reasonable
  number of points to specify the circle is given depending on the radius.
  The program will either use it's own internal scratch wxPoints pnts_array
@@ -795,7 +855,7 @@ void GdaRectangle::paintSelf(wxGraphicsContext* gc)
 					 upper_right.y - lower_left.y);
 }
 
-GdaPolygon::GdaPolygon() : points(0), points_o(0), count(0)
+GdaPolygon::GdaPolygon() : points(0), points_o(0), count(0), points_scale(0)
 {
 	null_shape = true;
 }
@@ -804,7 +864,8 @@ GdaPolygon::GdaPolygon(const GdaPolygon& s)
 	: GdaShape(s), //region(s.region),
 	n(s.n), pc(s.pc), points_o(s.points_o),
 	n_count(s.n_count), all_points_same(s.all_points_same),
-	bb_ll_o(s.bb_ll_o), bb_ur_o(s.bb_ur_o), count(0)
+	bb_ll_o(s.bb_ll_o), bb_ur_o(s.bb_ur_o), count(0),
+	points_scale(s.points_scale)
 {
 	if (null_shape) return;
 	points = new wxPoint[n];
@@ -830,7 +891,7 @@ GdaPolygon::GdaPolygon(const GdaPolygon& s)
  will be deleted when the constructor is called. */
 GdaPolygon::GdaPolygon(int n_s, wxRealPoint* points_o_s)
 	: n(n_s), points_o(0), pc(0), points(0), n_count(1),
-	all_points_same(false), count(0)
+	all_points_same(false), count(0), points_scale(0)
 {
 	if (points_o_s == 0 || n == 0) {
 		null_shape = true;
@@ -867,7 +928,8 @@ GdaPolygon::GdaPolygon(int n_s, wxRealPoint* points_o_s)
  part might contain holes.  Only a pointer to the original data is
  kept, and this memory is not deleted in the destructor. */
 GdaPolygon::GdaPolygon(Shapefile::PolygonContents* pc_s)
-  : n(0), points_o(0), pc(pc_s), points(0), all_points_same(false), count(0)
+  : n(0), points_o(0), pc(pc_s), points(0), all_points_same(false), count(0),
+	points_scale(0)
 {
 	assert(pc);
 	if (pc->shape_type == 0 || pc->num_points == 0) {
@@ -941,6 +1003,7 @@ void GdaPolygon::applyScaleTrans(const GdaScaleTrans& A)
 {
 	if (null_shape) return;
 	GdaShape::applyScaleTrans(A); // apply affine transform to base class
+	points_scale = GenUtils::max<double>(fabs(A.scale_x), fabs(A.scale_y));
 	all_points_same = true;
 	wxPoint tpt;
 	A.transform(bb_ll_o, &tpt);
@@ -967,6 +1030,7 @@ void GdaPolygon::projectToBasemap(GDA::Basemap* basemap)
         return;
     
 	GdaShape::projectToBasemap(basemap); // apply transform to base class
+	points_scale = 0; // not uniform across the basemap projection
 	all_points_same = true;
 	wxPoint tpt;
     
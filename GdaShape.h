@@ -82,6 +82,12 @@ namespace GdaShapeAlgs {
 								  const std::vector<Shapefile::Point>& pts);
 	double calculateArea(int n, wxRealPoint* pts);
 	double calculateArea(int n, const std::vector<Shapefile::Point>& pts);
+	/** Mean center and centroid of every record of polys, with the same
+	 conventions as for a GdaPolygon.  Null records are given (0,0). */
+	void calculateMeanCenters(const Shapefile::PolygonBuffer& polys,
+							  std::vector<double>& x, std::vector<double>& y);
+	void calculateCentroids(const Shapefile::PolygonBuffer& polys,
+							std::vector<double>& x, std::vector<double>& y);
 	void createCirclePolygon(const wxPoint& center, double radius,
 							 int num_points = 0,
 							 wxPoint* pnts_array = 0,
@@ -254,6 +260,9 @@ public:
 	wxRealPoint* points_o;
 	wxRealPoint bb_ll_o; // bounding box lower left
 	wxRealPoint bb_ur_o; // bounding box upper right
+	// screen pixels per map unit of points, 0 if not known.  Used to
+	// choose a PolygonLod level when drawing.
+	double points_scale;
 	//wxRegion region;
 };
 
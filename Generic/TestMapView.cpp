@@ -78,6 +78,7 @@ TestMapCanvas::TestMapCanvas(wxWindow *parent,
 	
 	// Populate TemplateCanvas::selectable_shps with some shapes
 	
+	project->WaitGeometries();
 	CreateSelShpsFromProj(selectable_shps, project);
 	ResizeSelectableShps();
 	wxBrush t_brush(GdaConst::map_default_fill_colour);
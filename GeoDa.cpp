@@ -721,6 +721,8 @@ EVT_MENU(XRCID("ID_OPTIONS_RANDOMIZATION_OTHER"),
 
 EVT_MENU(XRCID("ID_USE_SPECIFIED_SEED"), GdaFrame::OnUseSpecifiedSeed)
 EVT_MENU(XRCID("ID_SPECIFY_SEED_DLG"), GdaFrame::OnSpecifySeedDlg)
+EVT_MENU(XRCID("ID_SEQUENTIAL_PERMUTATION"),
+		 GdaFrame::OnSequentialPermutation)
 
 EVT_MENU(XRCID("ID_SAVE_MORANI"), GdaFrame::OnSaveMoranI)
 
@@ -3027,6 +3029,7 @@ void GdaFrame::OnGeneratePointShpFile(wxCommandEvent& event)
     int n_rows = xs.size();
     
     // clean p->main_data
+    p->WaitGeometries();
     if (!p->main_data.records.empty()) {
         p->main_data.records.clear();
     }
@@ -5126,6 +5129,15 @@ void GdaFrame::OnUseSpecifiedSeed(wxCommandEvent& event)
 	}
 }
 
+void GdaFrame::OnSequentialPermutation(wxCommandEvent& event)
+{
+	TemplateFrame* t = TemplateFrame::GetActiveFrame();
+	if (!t) return;
+	if (LisaMapFrame* f = dynamic_cast<LisaMapFrame*>(t)) {
+		f->OnSequentialPermutation(event);
+	}
+}
+
 void GdaFrame::OnSpecifySeedDlg(wxCommandEvent& event)
 {
 	TemplateFrame* t = TemplateFrame::GetActiveFrame();
@@ -546,6 +546,7 @@ public:
 	
 	void OnUseSpecifiedSeed(wxCommandEvent& event);
 	void OnSpecifySeedDlg(wxCommandEvent& event);
+	void OnSequentialPermutation(wxCommandEvent& event);
 	
 	void OnSaveMoranI(wxCommandEvent& event);
 	
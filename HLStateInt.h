@@ -63,6 +63,20 @@ public:
 	virtual wxString GetEventTypeStr() = 0;
 	virtual void SetEventType( EventType e ) = 0;
 	virtual int GetTotalHighlighted() = 0;
+	/** Incremented every time observers are notified of a change. */
+	virtual unsigned long GetEpoch() = 0;
+	/** True when the newly highlighted and unhighlighted lists of the
+	 current delta event are complete and small enough that redrawing just
+	 those observations is cheaper than a full repaint. */
+	virtual bool IsDeltaSparse() = 0;
+	
+	/** True when a view whose highlight drawing reflects drawn_epoch can
+	 bring it up to date by redrawing only the newly highlighted and
+	 unhighlighted observations of the current event. */
+	bool IsSparseDeltaFrom(unsigned long drawn_epoch) {
+		return (GetEventType() == delta && IsDeltaSparse() &&
+				drawn_epoch+1 == GetEpoch());
+	}
 	
 	virtual void registerObserver(HighlightStateObserver* o) = 0;
 	virtual void removeObserver(HighlightStateObserver* o) = 0;
@@ -24,6 +24,9 @@
 #include "HighlightState.h"
 
 HighlightState::HighlightState()
+: total_highlighted(0), total_newly_highlighted(0),
+total_newly_unhighlighted(0), event_type(empty), epoch(0),
+delta_sparse(false)
 {
 	delete_self_when_empty = false;
 	LOG_MSG("In HighlightState::HighlightState()");
@@ -50,8 +53,11 @@ void HighlightState::SetSize(int n) {
 	highlight.resize(n);
 	newly_highlighted.resize(n);
 	newly_unhighlighted.resize(n);
+	total_newly_highlighted = 0;
+	total_newly_unhighlighted = 0;
 	std::vector<bool>::iterator it;
 	for ( it=highlight.begin(); it != highlight.end(); it++ ) (*it) = false;
+	notified_highlight.assign(n, false);
 }
 
 
@@ -85,18 +91,25 @@ void HighlightState::removeObserver(HighlightStateObserver* o)
 void HighlightState::notifyObservers()
 {
 	ApplyChanges();
-	if (event_type == empty) return;
+	if (event_type == empty) {
+		EndEvent();
+		return;
+	}
 	//LOG_MSG("In HighlightState::notifyObservers");
 	//LOG(observers.size());
 	// See section 18.4.4.2 of Stroustrup
 	std::for_each(observers.begin(), observers.end(),
 			 std::bind2nd(std::mem_fun(&HighlightStateObserver::update),this));
+	EndEvent();
 }
 
 void HighlightState::notifyObservers(HighlightStateObserver* exclude)
 {
 	ApplyChanges();
-	if (event_type == empty) return;
+	if (event_type == empty) {
+		EndEvent();
+		return;
+	}
 	for (std::list<HighlightStateObserver*>::iterator i=observers.begin();
 		 i != observers.end(); ++i)
 	{
@@ -106,35 +119,73 @@ void HighlightState::notifyObservers(HighlightStateObserver* exclude)
 			(*i)->update(this);
 		}
 	}
+	EndEvent();
+}
+
+/** The newly highlighted and unhighlighted lists are only valid while
+ observers are being notified.  Clearing the totals afterwards tells the
+ next ApplyDelta whether the producer filled the lists itself. */
+void HighlightState::EndEvent()
+{
+	total_newly_highlighted = 0;
+	total_newly_unhighlighted = 0;
+}
+
+/** Producers either record their changes in the newly_highlighted and
+ newly_unhighlighted lists and set the totals, or write to the highlight
+ vector directly and leave the totals at zero.  In the first case only the
+ listed observations are visited, otherwise the highlight vector is diffed
+ against notified_highlight.  Either way the lists end up holding exactly
+ the observations that changed since observers were last notified. */
+void HighlightState::ApplyDelta()
+{
+	int n = highlight.size();
+	int nh = 0;
+	int nuh = 0;
+	if (total_newly_highlighted > 0 || total_newly_unhighlighted > 0) {
+		for (int i=0; i<total_newly_highlighted; i++) {
+			int obs = newly_highlighted[i];
+			highlight[obs] = true;
+			if (!notified_highlight[obs]) {
+				notified_highlight[obs] = true;
+				newly_highlighted[nh++] = obs;
+			}
+		}
+		for (int i=0; i<total_newly_unhighlighted; i++) {
+			int obs = newly_unhighlighted[i];
+			highlight[obs] = false;
+			if (notified_highlight[obs]) {
+				notified_highlight[obs] = false;
+				newly_unhighlighted[nuh++] = obs;
+			}
+		}
+	} else {
+		for (int i=0; i<n; i++) {
+			if (highlight[i] != notified_highlight[i]) {
+				if (highlight[i]) {
+					notified_highlight[i] = true;
+					newly_highlighted[nh++] = i;
+				} else {
+					notified_highlight[i] = false;
+					newly_unhighlighted[nuh++] = i;
+				}
+			}
+		}
+	}
+	total_newly_highlighted = nh;
+	total_newly_unhighlighted = nuh;
+	total_highlighted += nh - nuh;
+	// beyond this many changes a full repaint is cheaper for most views
+	delta_sparse = (nh + nuh <= n/16 + 16);
 }
 
 void HighlightState::ApplyChanges()
 {
+	delta_sparse = false;
 	switch (event_type) {
 		case delta:
 		{
-            /*
-			for (int i=0; i<total_newly_highlighted; i++) {
-				if (!highlight[newly_highlighted[i]]) {
-					highlight[newly_highlighted[i]] = true;
-				}
-			}
-			for (int i=0; i<total_newly_unhighlighted; i++) {
-				if (highlight[newly_unhighlighted[i]]) {
-					highlight[newly_unhighlighted[i]] = false;
-				}
-			}
-			total_highlighted += total_newly_highlighted;
-			total_highlighted -= total_newly_unhighlighted;
-             */
-           
-            total_highlighted = 0;
-            for (int i=0; i<highlight.size(); i++) {
-                if (highlight[i] == true) {
-                    total_highlighted += 1;
-                }
-            }
-            
+			ApplyDelta();
 		}
 			break;
 		case unhighlight_all:
@@ -147,11 +198,11 @@ void HighlightState::ApplyChanges()
 				highlight[i] = false;
 			}
 			total_highlighted = 0;
+			notified_highlight.assign(highlight.size(), false);
 		}
 			break;
 		case invert:
 		{
-            
             total_highlighted = 0;
             for (int i=0; i<highlight.size(); i++) {
                 if (highlight[i] == false) {
@@ -159,25 +210,11 @@ void HighlightState::ApplyChanges()
                 }
                 highlight[i] = !highlight[i];
             }
-            /*
-			int t_nh = 0;
-			int t_nuh = 0;
-			for (int i=0, iend=highlight.size(); i<iend; i++) {
-				if (highlight[i]) {
-					newly_unhighlighted[t_nuh++] = i;
-					highlight[i] = false;
-				} else {
-					newly_highlighted[t_nh++] = i;
-					highlight[i] = true;
-				}
-			}
-			total_highlighted = highlight.size() - total_highlighted;
-			total_newly_highlighted = t_nh;
-			total_newly_unhighlighted = t_nuh;
-             */
+			notified_highlight = highlight;
 		}
 			break;
 		default:
 			break;
 	}
+	if (event_type != empty) epoch++;
 }
@@ -58,6 +58,8 @@ public:
 	virtual wxString GetEventTypeStr();
 	virtual void SetEventType( EventType e ) { event_type = e; }
 	virtual int GetTotalHighlighted() { return total_highlighted; }
+	virtual unsigned long GetEpoch() { return epoch; }
+	virtual bool IsDeltaSparse() { return delta_sparse; }
 	
 	virtual void registerObserver(HighlightStateObserver* o);
 	virtual void removeObserver(HighlightStateObserver* o);
@@ -88,7 +90,16 @@ private:
 	 valid entries on the #newly_unhighlighted 'stack'. */
 	int total_newly_unhighlighted;
 	EventType event_type;
+	/** The highlight state observers were last notified of.  Delta events
+	 are diffed against it to fill the newly (un)highlighted lists. */
+	std::vector<bool> notified_highlight;
+	/** number of non-empty events observers have been notified of */
+	unsigned long epoch;
+	/** see IsDeltaSparse */
+	bool delta_sparse;
 	void ApplyChanges(); // called by notifyObservers to update highlight vec
+	void ApplyDelta();
+	void EndEvent(); // called by notifyObservers once observers are done
 	
 	/** When this is set to true and the list of observers is empty, the
 	 class instance will automatically delete itself. */
@@ -21,6 +21,8 @@
 #include <set>
 #include <sstream>
 #include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <boost/property_tree/exceptions.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
@@ -57,6 +59,7 @@
 #include "SpatialIndAlgs.h"
 #include "PointSetAlgs.h"
 #include "DbfFile.h"
+#include "ShpFileMapped.h"
 #include "ShapeOperations/GalWeight.h"
 #include "ShapeOperations/ShapeUtils.h"
 #include "ShapeOperations/VoronoiUtils.h"
@@ -65,6 +68,7 @@
 #include "ShapeOperations/WeightsManager.h"
 #include "ShapeOperations/WeightsManPtree.h"
 #include "ShapeOperations/OGRDataAdapter.h"
+#include "ShapeOperations/PolygonLod.h"
 #include "Project.h"
 
 // used by TemplateCanvas
@@ -85,6 +89,8 @@ dist_metric(WeightsMetaInfo::DM_euclidean),
 dist_units(WeightsMetaInfo::DU_mile),
 min_1nn_dist_euc(-1), max_1nn_dist_euc(-1), max_dist_euc(-1),
 min_1nn_dist_arc(-1), max_1nn_dist_arc(-1), max_dist_arc(-1),
+geom_thread(0), geom_read_stop(false), geom_installed(0), mapped_shp(0),
+index_thread(0), index_notifier(0), index_built(false), polygon_lod(0),
 sourceSR(NULL)
 {
     
@@ -144,6 +150,8 @@ dist_metric(WeightsMetaInfo::DM_euclidean),
 dist_units(WeightsMetaInfo::DU_mile),
 min_1nn_dist_euc(-1), max_1nn_dist_euc(-1), max_dist_euc(-1),
 min_1nn_dist_arc(-1), max_1nn_dist_arc(-1), max_dist_arc(-1),
+geom_thread(0), geom_read_stop(false), geom_installed(0), mapped_shp(0),
+index_thread(0), index_notifier(0), index_built(false), polygon_lod(0),
 sourceSR(NULL)
 {
 	LOG_MSG("Entering Project::Project (new project)");
@@ -192,6 +200,21 @@ Project::~Project()
 {
 	LOG_MSG("Entering Project::~Project");
 	
+	// the geometry worker reads the OGRFeatures of layer_proxy
+	if (geom_thread) {
+		geom_read_stop = true;
+		geom_thread->join();
+		delete geom_thread;
+		geom_thread = 0;
+	}
+	for (size_t i=0; i<geom_staged.size(); i++) {
+		if (geom_staged[i]) delete geom_staged[i];
+	}
+	if (mapped_shp) delete mapped_shp; mapped_shp = 0;
+	WaitSpatialIndexes();
+	// the polygon_lod worker posts to index_notifier when it is done
+	if (polygon_lod) delete polygon_lod; polygon_lod = 0;
+	if (index_notifier) delete index_notifier; index_notifier = 0;
     if (project_conf) delete project_conf; project_conf=0;
     // datasource* has been deleted in project_conf* layer*
     datasource = 0;
@@ -312,6 +335,7 @@ bool Project::SetWorkingDir(const wxString& path)
 
 Shapefile::ShapeType Project::GetGdaGeometries(vector<GdaShape*>& geometries)
 {
+	WaitGeometries();
 	Shapefile::ShapeType shape_type = Shapefile::NULL_SHAPE;
 	int num_geometries = main_data.records.size();
 	if ( main_data.header.shape_type == Shapefile::POINT_TYP) {
@@ -334,11 +358,318 @@ Shapefile::ShapeType Project::GetGdaGeometries(vector<GdaShape*>& geometries)
 	return shape_type;
 }
 
+/** Delivers the geometry batches and the end of the background spatial
+ index and polygon simplification builds to the main thread.  A notification still pending
+ when the Project is closed is discarded with the notifier. */
+class SpatialIndexNotifier : public wxEvtHandler {
+public:
+	SpatialIndexNotifier(Project* project_s) : project(project_s) {}
+	void Notify() { project->OnSpatialIndexesBuilt(); }
+	void NotifyGeometries(int end) { project->OnGeometriesRead(end); }
+	void NotifyPolygonLod() { project->OnPolygonLodBuilt(); }
+private:
+	Project* project;
+};
+
+/** The geometries of a shapefile are decoded from a mapping of its .shp and
+ .shx files rather than converted from the OGR geometries, as long as the
+ features are the records of the file in order. */
+bool Project::OpenMappedShp(int num_geoms)
+{
+	FileDataSource* fds = dynamic_cast<FileDataSource*>(datasource);
+	if (!fds || fds->GetType() != GdaConst::ds_shapefile) return false;
+	mapped_shp = new Shapefile::MappedMain();
+	bool is_mapped = (mapped_shp->Open(fds->GetFilePath()) &&
+					  mapped_shp->GetNumRecords() == num_geoms &&
+					  mapped_shp->GetShapeType() != Shapefile::POLY_LINE);
+	for (int i=0; i<num_geoms && is_mapped; i++) {
+		if (layer_proxy->data[i]->GetFID() != i) is_mapped = false;
+	}
+	if (!is_mapped) {
+		delete mapped_shp;
+		mapped_shp = 0;
+	}
+	return is_mapped;
+}
+
+/** Reads the first record, which gives the shape type of the layer, and
+ fills main_data with null records of that type for the others.  These
+ are read by StartGeometries. */
+void Project::PrepareGeometries()
+{
+	int num_geoms = layer_proxy->GetNumRecords();
+	Shapefile::RecordContents* rc = 0;
+	if (OpenMappedShp(num_geoms)) {
+		main_data.header = mapped_shp->GetHeader();
+		rc = mapped_shp->NewRecordContents(0);
+	} else {
+		layer_proxy->ReadGeometryHeader(main_data);
+		rc = layer_proxy->ReadGeometry(0);
+	}
+	main_data.records.resize(num_geoms);
+	if (rc == NULL) {
+		open_err_msg << "GeoDa does not support datasource with line data at this time.  Please choose a datasource with either point or polygon data.";
+		throw GdaException(open_err_msg.c_str());
+	}
+	main_data.records[0].contents_p = rc;
+	bool is_point = dynamic_cast<Shapefile::PointContents*>(rc) != 0;
+	main_data.header.shape_type = (is_point ? Shapefile::POINT_TYP :
+								   Shapefile::POLYGON);
+	for (int i=1; i<num_geoms; i++) {
+		if (is_point) {
+			Shapefile::PointContents* pc = new Shapefile::PointContents();
+			pc->shape_type = 0;
+			main_data.records[i].contents_p = pc;
+		} else {
+			main_data.records[i].contents_p = new Shapefile::PolygonContents();
+		}
+	}
+	geom_staged.resize(num_geoms, 0);
+	geom_installed = 1;
+}
+
+/** Reads the remaining records on a worker thread.  The spatial indexes
+ and the polygon simplifications are started once all are read. */
+void Project::StartGeometries()
+{
+	if (geom_installed < (int) geom_staged.size()) {
+		if (!index_notifier) index_notifier = new SpatialIndexNotifier(this);
+		geom_thread = new boost::thread(
+						boost::bind(&Project::ReadStagedGeometries, this,
+									geom_installed));
+	} else {
+		if (mapped_shp) delete mapped_shp; mapped_shp = 0;
+		StartSpatialIndexes();
+		StartPolygonLod();
+	}
+}
+
+/** Runs on the worker thread, so no logging here.  Only the OGRFeatures
+ or the mapped shapefile are read; the records are posted to the main
+ thread in about 16 batches so that maps can draw them as they come in. */
+void Project::ReadStagedGeometries(int start)
+{
+	int num_geoms = geom_staged.size();
+	int batch_size = std::max(num_geoms / 16, 1024);
+	for (int i=start; i<num_geoms && !geom_read_stop; i++) {
+		if (mapped_shp) {
+			geom_staged[i] = mapped_shp->NewRecordContents(i);
+		} else {
+			geom_staged[i] = layer_proxy->ReadGeometry(i);
+		}
+		if ((i+1) % batch_size == 0 && i+1 < num_geoms) {
+			index_notifier->CallAfter(&SpatialIndexNotifier::NotifyGeometries,
+									  i+1);
+		}
+	}
+	if (geom_read_stop) return;
+	if (mapped_shp) {
+		// the files are unmapped before the last batch, so that saving can
+		// replace them
+		if (main_data.header.shape_type == Shapefile::POLYGON) {
+			mapped_shp->FillPolygonBuffer(polygon_buffer);
+		}
+		mapped_shp->Close();
+	}
+	index_notifier->CallAfter(&SpatialIndexNotifier::NotifyGeometries,
+							  num_geoms);
+}
+
+void Project::WaitGeometries()
+{
+	if (!geom_thread) return;
+	geom_thread->join();
+	delete geom_thread;
+	geom_thread = 0;
+	OnGeometriesRead(geom_staged.size());
+}
+
+/** Hands the records read up to end over to main_data.  Batches already
+ handed over by WaitGeometries are ignored. */
+void Project::OnGeometriesRead(int end)
+{
+	if (end <= geom_installed) return;
+	int start = geom_installed;
+	InstallGeometries(start, end);
+	geom_installed = end;
+	// a callback may remove itself
+	std::map<void*, boost::function<void (int, int)> > cbs(geom_callbacks);
+	std::map<void*, boost::function<void (int, int)> >::iterator it;
+	for (it=cbs.begin(); it!=cbs.end(); ++it) it->second(start, end);
+	if (geom_installed < (int) geom_staged.size()) return;
+	
+	LOG_MSG("Project::OnGeometriesRead: all geometries read");
+	if (geom_thread) {
+		geom_thread->join();
+		delete geom_thread;
+		geom_thread = 0;
+	}
+	if (mapped_shp) delete mapped_shp; mapped_shp = 0;
+	geom_staged.clear();
+	geom_callbacks.clear();
+	StartSpatialIndexes();
+	StartPolygonLod();
+}
+
+/** The records are filled in place: the null records may already be
+ referenced by GdaPolygons of the maps.  A record of another type than the
+ first one, or of an unsupported type, stays null. */
+void Project::InstallGeometries(int start, int end)
+{
+	bool is_point = main_data.header.shape_type == Shapefile::POINT_TYP;
+	for (int i=start; i<end; i++) {
+		Shapefile::RecordContents* rc = geom_staged[i];
+		geom_staged[i] = 0;
+		if (rc == NULL) continue;
+		if (is_point) {
+			Shapefile::PointContents* src =
+				dynamic_cast<Shapefile::PointContents*>(rc);
+			if (src) {
+				*((Shapefile::PointContents*) main_data.records[i].contents_p)
+					= *src;
+			}
+		} else {
+			Shapefile::PolygonContents* src =
+				dynamic_cast<Shapefile::PolygonContents*>(rc);
+			Shapefile::PolygonContents* pc =
+				(Shapefile::PolygonContents*) main_data.records[i].contents_p;
+			if (src) {
+				pc->shape_type = src->shape_type;
+				pc->box.swap(src->box);
+				pc->num_parts = src->num_parts;
+				pc->num_points = src->num_points;
+				pc->parts.swap(src->parts);
+				pc->points.swap(src->points);
+			}
+		}
+		delete rc;
+	}
+}
+
+bool Project::AddGeometriesCallback(void* owner,
+									const boost::function<void (int, int)>& cb)
+{
+	if (!geom_thread) return false;
+	geom_callbacks[owner] = cb;
+	return true;
+}
+
+void Project::RemoveGeometriesCallback(void* owner)
+{
+	geom_callbacks.erase(owner);
+}
+
+/** Builds the centroids and the centroid rtrees on a worker thread once
+ the geometries are read.  Every accessor of these waits for the build. */
+void Project::StartSpatialIndexes()
+{
+	if (index_thread || index_built || num_records <= 0) return;
+	if (!index_notifier) index_notifier = new SpatialIndexNotifier(this);
+	index_thread = new boost::thread(boost::bind(&Project::BuildSpatialIndexes,
+												 this));
+}
+
+void Project::WaitSpatialIndexes()
+{
+	WaitGeometries();
+	if (!index_thread) return;
+	index_thread->join();
+	delete index_thread;
+	index_thread = 0;
+	index_built = true;
+}
+
+/** Runs on the worker thread, so no logging here */
+void Project::BuildSpatialIndexes()
+{
+	FillPolygonBuffer();
+	FillCentroids();
+	CalcEucPlaneRtreeStats();
+	// arc distances only make sense for unprojected lon/lat data
+	if (sourceSR && sourceSR->IsGeographic()) CalcUnitSphereRtreeStats();
+	index_notifier->CallAfter(&SpatialIndexNotifier::Notify);
+}
+
+void Project::OnSpatialIndexesBuilt()
+{
+	WaitSpatialIndexes();
+	std::map<void*, boost::function<void ()> > cbs;
+	cbs.swap(index_callbacks);
+	std::map<void*, boost::function<void ()> >::iterator it;
+	for (it=cbs.begin(); it!=cbs.end(); ++it) it->second();
+}
+
+bool Project::AddSpatialIndexesCallback(void* owner,
+										const boost::function<void ()>& cb)
+{
+	// the build starts once the geometries are read
+	if (!index_thread && !geom_thread) return false;
+	index_callbacks[owner] = cb;
+	return true;
+}
+
+void Project::RemoveSpatialIndexesCallback(void* owner)
+{
+	index_callbacks.erase(owner);
+}
+
+/** The simplifications are only used by maps once they are ready, so
+ nothing ever waits for them. */
+void Project::StartPolygonLod()
+{
+	if (polygon_lod || main_data.header.shape_type != Shapefile::POLYGON) {
+		return;
+	}
+	std::vector<Shapefile::PolygonContents*> polys(main_data.records.size());
+	for (size_t i=0; i<polys.size(); i++) {
+		polys[i] = (Shapefile::PolygonContents*) main_data.records[i].contents_p;
+	}
+	if (!index_notifier) index_notifier = new SpatialIndexNotifier(this);
+	polygon_lod = new PolygonLod(polys);
+	polygon_lod->StartBackground(boost::bind(&Project::PostPolygonLodBuilt,
+											 this));
+}
+
+/** Runs on the polygon_lod worker thread */
+void Project::PostPolygonLodBuilt()
+{
+	index_notifier->CallAfter(&SpatialIndexNotifier::NotifyPolygonLod);
+}
+
+void Project::OnPolygonLodBuilt()
+{
+	std::map<void*, boost::function<void ()> > cbs;
+	cbs.swap(lod_callbacks);
+	std::map<void*, boost::function<void ()> >::iterator it;
+	for (it=cbs.begin(); it!=cbs.end(); ++it) it->second();
+}
+
+PolygonLod* Project::GetPolygonLod()
+{
+	if (!polygon_lod || !polygon_lod->IsReady()) return 0;
+	return polygon_lod;
+}
+
+bool Project::AddPolygonLodCallback(void* owner,
+									const boost::function<void ()>& cb)
+{
+	// once ready, GetPolygonLod already returns it.  The build starts once
+	// the geometries are read.
+	if (!geom_thread && (!polygon_lod || polygon_lod->IsReady())) return false;
+	lod_callbacks[owner] = cb;
+	return true;
+}
+
+void Project::RemovePolygonLodCallback(void* owner)
+{
+	lod_callbacks.erase(owner);
+}
+
 void Project::CalcEucPlaneRtreeStats()
 {
 	using namespace std;
 	
-	GetCentroids();
+	FillCentroids();
 	size_t num_obs = centroids.size();
 	std::vector<pt_2d> pts(num_obs);
 	std::vector<double> x(num_obs);
@@ -359,7 +690,7 @@ void Project::CalcEucPlaneRtreeStats()
 void Project::CalcUnitSphereRtreeStats()
 {
 	using namespace std;
-	GetCentroids();
+	FillCentroids();
 	size_t num_obs = centroids.size();
 	std::vector<pt_lonlat> pts_ll(num_obs);
 	std::vector<pt_3d> pts_3d(num_obs);
@@ -408,6 +739,8 @@ OGRSpatialReference* Project::GetSpatialReference()
 
 void Project::SaveOGRDataSource()
 {
+	// the shapefile may still be mapped by the geometry worker
+	WaitGeometries();
 	// This function will only be called to save file or directory (OGR)
 	wxString tmp_prefix = "GdaTmp_";
 	wxArrayString all_tmp_files;
@@ -822,7 +1155,7 @@ CovSpHLStateProxy* Project::GetPairsHLState()
 {
 	if (!pairs_hl_state) {
 		pairs_hl_state = new CovSpHLStateProxy(GetHighlightState(),
-                                               GetSharedPairsBimap());
+                                               GetSharedPairs());
 	}
 	return pairs_hl_state;
 }
@@ -984,6 +1317,7 @@ void Project::AddCentroids()
 
 const std::vector<GdaPoint*>& Project::GetMeanCenters()
 {
+	WaitGeometries();
 	int num_obs = main_data.records.size();
 	if (mean_centers.size() == 0 && num_obs > 0) {
 		if (main_data.header.shape_type == Shapefile::POINT_TYP) {
@@ -999,17 +1333,15 @@ const std::vector<GdaPoint*>& Project::GetMeanCenters()
 				}
 			}
 		} else if (main_data.header.shape_type == Shapefile::POLYGON) {
+			const Shapefile::PolygonBuffer& buf = GetPolygonBuffer();
+			std::vector<double> x, y;
+			GdaShapeAlgs::calculateMeanCenters(buf, x, y);
 			mean_centers.resize(num_obs);
-			Shapefile::PolygonContents* pc;
 			for (int i=0; i<num_obs; i++) {
-				pc = (Shapefile::PolygonContents*)
-				main_data.records[i].contents_p;
-				GdaPolygon poly(pc);
-				if (poly.isNull()) {
+				if (buf.GetNumPoints(i) == 0) {
 					mean_centers[i] = new GdaPoint();
 				} else {
-					mean_centers[i] =
-					new GdaPoint(GdaShapeAlgs::calculateMeanCenter(&poly));
+					mean_centers[i] = new GdaPoint(wxRealPoint(x[i], y[i]));
 				}
 			}
 		}
@@ -1030,6 +1362,12 @@ void Project::GetMeanCenters(std::vector<double>& x, std::vector<double>& y)
 }
 
 const std::vector<GdaPoint*>& Project::GetCentroids()
+{
+	WaitSpatialIndexes();
+	return FillCentroids();
+}
+
+const std::vector<GdaPoint*>& Project::FillCentroids()
 {
 	int num_obs = main_data.records.size();
 	if (centroids.size() == 0 && num_obs > 0) {
@@ -1046,17 +1384,16 @@ const std::vector<GdaPoint*>& Project::GetCentroids()
 				}
 			}
 		} else if (main_data.header.shape_type == Shapefile::POLYGON) {
+			// may run on the index worker, so the buffer is not waited for
+			FillPolygonBuffer();
+			std::vector<double> x, y;
+			GdaShapeAlgs::calculateCentroids(polygon_buffer, x, y);
 			centroids.resize(num_obs);
-			Shapefile::PolygonContents* pc;
 			for (int i=0; i<num_obs; i++) {
-				pc = (Shapefile::PolygonContents*)
-				main_data.records[i].contents_p;
-				GdaPolygon poly(pc);
-				if (poly.isNull()) {
+				if (polygon_buffer.GetNumPoints(i) == 0) {
 					centroids[i] = new GdaPoint();
 				} else {
-					centroids[i] =
-					new GdaPoint(GdaShapeAlgs::calculateCentroid(&poly));
+					centroids[i] = new GdaPoint(wxRealPoint(x[i], y[i]));
 				}
 			}
 		}
@@ -1064,6 +1401,27 @@ const std::vector<GdaPoint*>& Project::GetCentroids()
 	return centroids;	
 }
 
+const Shapefile::PolygonBuffer& Project::GetPolygonBuffer()
+{
+	WaitSpatialIndexes();
+	FillPolygonBuffer();
+	return polygon_buffer;
+}
+
+/** Filled from the mapped shapefile by the geometry worker, otherwise from
+ main_data once it is complete. */
+void Project::FillPolygonBuffer()
+{
+	if (main_data.header.shape_type != Shapefile::POLYGON) {
+		if (polygon_buffer.GetNumRecords() > 0) polygon_buffer.Clear();
+		return;
+	}
+	if (polygon_buffer.GetNumRecords() == (int) main_data.records.size()) {
+		return;
+	}
+	Shapefile::populatePolygonBuffer(main_data, polygon_buffer);
+}
+
 void Project::GetCentroids(std::vector<double>& x, std::vector<double>& y)
 {
 	GetCentroids();
@@ -1116,6 +1474,7 @@ const std::vector<GdaShape*>& Project::GetVoronoiPolygons()
 
 double Project::GetMin1nnDistEuc()
 {
+	WaitSpatialIndexes();
 	if (min_1nn_dist_euc >= 0) return min_1nn_dist_euc;
 	CalcEucPlaneRtreeStats();
 	return min_1nn_dist_euc;
@@ -1123,6 +1482,7 @@ double Project::GetMin1nnDistEuc()
 
 double Project::GetMax1nnDistEuc()
 {
+	WaitSpatialIndexes();
 	if (max_1nn_dist_euc >= 0) return max_1nn_dist_euc;
 	CalcEucPlaneRtreeStats();
 	return max_1nn_dist_euc;
@@ -1130,6 +1490,7 @@ double Project::GetMax1nnDistEuc()
 
 double Project::GetMaxDistEuc()
 {
+	WaitSpatialIndexes();
 	if (max_dist_euc >= 0) return max_dist_euc;
 	CalcEucPlaneRtreeStats();
 	return max_dist_euc;
@@ -1137,6 +1498,7 @@ double Project::GetMaxDistEuc()
 
 double Project::GetMin1nnDistArc()
 {
+	WaitSpatialIndexes();
 	if (min_1nn_dist_arc >= 0) return min_1nn_dist_arc;
 	CalcUnitSphereRtreeStats();
 	return min_1nn_dist_arc;
@@ -1144,6 +1506,7 @@ double Project::GetMin1nnDistArc()
 
 double Project::GetMax1nnDistArc()
 {
+	WaitSpatialIndexes();
 	if (max_1nn_dist_arc >= 0) return max_1nn_dist_arc;
 	CalcUnitSphereRtreeStats();
 	return max_1nn_dist_arc;
@@ -1151,6 +1514,7 @@ double Project::GetMax1nnDistArc()
 
 double Project::GetMaxDistArc()
 {
+	WaitSpatialIndexes();
 	if (max_dist_arc >= 0) return max_dist_arc;
 	CalcUnitSphereRtreeStats();
 	return max_dist_arc;
@@ -1158,11 +1522,13 @@ double Project::GetMaxDistArc()
 
 rtree_pt_2d_t& Project::GetEucPlaneRtree()
 {
+	WaitSpatialIndexes();
 	return rtree_2d;
 }
 
 rtree_pt_3d_t& Project::GetUnitSphereRtree()
 {
+	WaitSpatialIndexes();
 	return rtree_3d;
 }
 
@@ -1242,73 +1608,32 @@ void Project::SetDefaultDistUnits(WeightsMetaInfo::DistanceUnitsEnum du)
 }
 
 void Project::FillDistances(std::vector<double>& D,
+                            double& D_min, double& D_max,
                             WeightsMetaInfo::DistanceMetricEnum dm,
                             WeightsMetaInfo::DistanceUnitsEnum du)
 {
 	const std::vector<GdaPoint*>& c = GetCentroids();
-	const pairs_bimap_type& pbm = GetSharedPairsBimap();
-	typedef pairs_bimap_type::const_iterator pbt_ci;
-	if (D.size() != pbm.size()) D.resize(pbm.size());
-	if (dm == WeightsMetaInfo::DM_arc) {
-		if (pbm.size() > cached_arc_dist.size()) {
-			for (pbt_ci it = pbm.begin(), iend = pbm.end(); it != iend; ++it) {
-				// it->left  : data : int
-				// it->right : data : UnOrdIntPair
-				if (cached_arc_dist.find(it->right) == cached_arc_dist.end()) {
-					size_t i = it->right.i;
-					size_t j = it->right.j;
-					double d = GenGeomAlgs::ComputeArcDistRad(c[i]->GetX(),
-                                                              c[i]->GetY(),
-                                                              c[j]->GetX(),
-                                                              c[j]->GetY());
-					cached_arc_dist[it->right] = d;
-				}
-			}
-			if (du == WeightsMetaInfo::DU_km) {
-				for (pbt_ci it=pbm.begin(), iend=pbm.end(); it != iend; ++it)	{
-					D[it->left] = GenGeomAlgs::EarthRadToKm(cached_arc_dist[it->right]);
-				}
-			} else {
-				for (pbt_ci it = pbm.begin(), iend = pbm.end(); it != iend; ++it)
-				{
-					D[it->left] = GenGeomAlgs::EarthRadToMi(cached_arc_dist[it->right]);
-				}
-			}
-		}
-	} else { // assume DM_euclidean
-		if (pbm.size() > cached_eucl_dist.size()) {
-			for (pbt_ci it = pbm.begin(), iend = pbm.end(); it != iend; ++it) {
-				// it->left  : data : int
-				// it->right : data : UnOrdIntPair
-				if (cached_eucl_dist.find(it->right) == cached_eucl_dist.end()) {
-					size_t i = it->right.i;
-					size_t j = it->right.j;
-					double d = GenGeomAlgs::ComputeEucDist(c[i]->GetX(), c[i]->GetY(),
-                                                           c[j]->GetX(), c[j]->GetY());
-					cached_eucl_dist[it->right] = d;
-				}
-			}
-		}
-		for (pbt_ci it = pbm.begin(), iend = pbm.end(); it != iend; ++it) {
-			D[it->left] = cached_eucl_dist[it->right];
-		}
+	std::vector<double> x(c.size());
+	std::vector<double> y(c.size());
+	for (size_t i=0, sz=c.size(); i<sz; ++i) {
+		x[i] = c[i]->GetX();
+		y[i] = c[i]->GetY();
 	}
+	DistancesCalc::PairDistances(GetSharedPairs(), x, y,
+                                 dm == WeightsMetaInfo::DM_arc,
+                                 du != WeightsMetaInfo::DU_km,
+                                 D, D_min, D_max);
 }
 
-const pairs_bimap_type& Project::GetSharedPairsBimap()
+const PairsIndexer& Project::GetSharedPairs()
 {
-	if (pairs_bimap.size() == 0) {
-		// generate bimap int <--> coord pair
+	if (shared_pairs.GetNumObs() == 0) {
+		// pairs are indexed implicitly, so only a sample of them (beyond
+		// PairsIndexer::default_max_pairs) takes any memory
 		int n_obs = highlight_state->GetHighlight().size();
-		int cnt=0;
-		for (int i=0; i<n_obs; ++i) {
-			for (int j=i+1; j<n_obs; ++j) {
-				pairs_bimap.insert(
-                    pairs_bimap_type::value_type(cnt++, UnOrdIntPair(i,j)));
-			}
-		}
+		shared_pairs = PairsIndexer(n_obs);
 	}
-	return pairs_bimap;
+	return shared_pairs;
 }
 
 void Project::CleanupPairsHLState()
@@ -1391,6 +1716,8 @@ bool Project::CommonProjectInit()
 	save_manager->SetMetaDataSaveNeeded(false);
 	save_manager->SetDbSaveNeeded(false);
 	
+	if (!isTableOnly) StartGeometries();
+	
 	// MMM: SaveButtonManager revisit
 	// MMM: Move this to SaveButtonManager
 	// Enable "Save" only for DBF data sources.  "Save As" is always enabled.
@@ -1595,7 +1922,9 @@ bool Project::InitFromOgrLayer()
 
 	isTableOnly = layer_proxy->IsTableOnly();
 	if (!isTableOnly) {
-		layer_proxy->ReadGeometries(main_data);
+		// the other records are read by StartGeometries, so that the
+		// map opens before they are all read
+		PrepareGeometries();
     } else {
         // prompt user to select X/Y columns to create a geometry layer
 
@@ -28,6 +28,7 @@
 #include <set>
 #include <utility>
 #include <vector>
+#include <boost/function.hpp>
 #include <boost/multi_array.hpp>
 #include <boost/property_tree/ptree_fwd.hpp>
 #include <boost/shared_ptr.hpp>
@@ -66,6 +67,10 @@ class GdaShape;
 class wxGrid;
 class DataSource;
 class CovSpHLStateProxy;
+class SpatialIndexNotifier;
+class PolygonLod;
+namespace Shapefile { class MappedMain; }
+namespace boost { class thread; }
 
 class Project {
 public:
@@ -167,6 +172,40 @@ public:
 	rtree_pt_2d_t& GetEucPlaneRtree();
 	rtree_pt_3d_t& GetUnitSphereRtree();
 	
+	/** Except for the first record, geometries are read on a worker thread
+	 once the table is loaded and handed to main_data in batches.  Records
+	 not handed over yet are null shapes.  This waits for every record. */
+	void WaitGeometries();
+	/** While geometries are being read, cb replaces any callback of owner
+	 and true is returned.  cb is called on the main thread with the range
+	 [start, end) of records of each batch handed to main_data.  Otherwise
+	 false is returned: main_data is complete. */
+	bool AddGeometriesCallback(void* owner,
+							   const boost::function<void (int, int)>& cb);
+	void RemoveGeometriesCallback(void* owner);
+	/** Coordinates of every record of a polygon layer in one flat buffer.
+	 Empty for other layers.  Waits for the spatial indexes, which fill
+	 it. */
+	const Shapefile::PolygonBuffer& GetPolygonBuffer();
+	/** The centroids and centroid rtrees are built on a worker thread once
+	 the project is loaded, and accessors of these wait for the build.
+	 While it runs, cb replaces any callback of owner, is called on the
+	 main thread once the build is done and true is returned.  Otherwise
+	 false is returned and cb is not called: the accessors won't block. */
+	bool AddSpatialIndexesCallback(void* owner,
+								   const boost::function<void ()>& cb);
+	void RemoveSpatialIndexesCallback(void* owner);
+	/** Simplified polygons for drawing, or 0 if this is not a polygon
+	 layer or they are still being built in the background. */
+	PolygonLod* GetPolygonLod();
+	/** Same contract as AddSpatialIndexesCallback, for the background
+	 build of the simplified polygons: while it runs, cb is called on the
+	 main thread once GetPolygonLod becomes non-zero and true is
+	 returned. */
+	bool AddPolygonLodCallback(void* owner,
+							   const boost::function<void ()>& cb);
+	void RemovePolygonLodCallback(void* owner);
+	
 	// default variables
 	wxString GetDefaultVarName(int var);
 	void SetDefaultVarName(int var, const wxString& v_name);
@@ -179,12 +218,12 @@ public:
 	void SetDefaultDistUnits(WeightsMetaInfo::DistanceUnitsEnum du);
 	
 	// Fill Distances according to order specified in shared project
-	// pairs order mapping.
-	void FillDistances(std::vector<double>& D,
+	// pairs indexer, along with their range.
+	void FillDistances(std::vector<double>& D, double& D_min, double& D_max,
                        WeightsMetaInfo::DistanceMetricEnum dm,
                        WeightsMetaInfo::DistanceUnitsEnum du);
 	
-	const pairs_bimap_type& GetSharedPairsBimap();
+	const PairsIndexer& GetSharedPairs();
 	void CleanupPairsHLState();
 	
 	i_array_type* GetSharedCategoryScratch(int num_cats, int num_obs);
@@ -220,8 +259,24 @@ private:
 	void SaveOGRDataSource();
 	void UpdateProjectConf();
 	Shapefile::ShapeType GetGdaGeometries(vector<GdaShape*>& geometries);
+	bool OpenMappedShp(int num_geoms);
+	void PrepareGeometries();
+	void StartGeometries();
+	void ReadStagedGeometries(int start);
+	void OnGeometriesRead(int end);
+	void InstallGeometries(int start, int end);
 	void CalcEucPlaneRtreeStats();
 	void CalcUnitSphereRtreeStats();
+	const std::vector<GdaPoint*>& FillCentroids();
+	void FillPolygonBuffer();
+	void StartSpatialIndexes();
+	void WaitSpatialIndexes();
+	void BuildSpatialIndexes();
+	void OnSpatialIndexesBuilt();
+	void StartPolygonLod();
+	void PostPolygonLodBuilt();
+	void OnPolygonLodBuilt();
+	friend class SpatialIndexNotifier;
     
 	
   // XXX for multi-layer support, ProjectConfiguration is a container for
@@ -277,6 +332,19 @@ private:
 	double max_dist_arc; // radians
 	rtree_pt_2d_t rtree_2d; // 2d Cartesian points
 	rtree_pt_3d_t rtree_3d; // lon/lat points projected to unit sphere
+	boost::thread* geom_thread;
+	bool geom_read_stop;
+	int geom_installed; // records of main_data read so far
+	std::vector<Shapefile::RecordContents*> geom_staged;
+	Shapefile::MappedMain* mapped_shp; // only while geometries are read
+	Shapefile::PolygonBuffer polygon_buffer;
+	std::map<void*, boost::function<void (int, int)> > geom_callbacks;
+	boost::thread* index_thread;
+	SpatialIndexNotifier* index_notifier;
+	bool index_built;
+	std::map<void*, boost::function<void ()> > index_callbacks;
+	PolygonLod* polygon_lod;
+	std::map<void*, boost::function<void ()> > lod_callbacks;
 	
 	/** The following array is not thread safe since it is shared by
 	 every TemplateCanvas instance in a given project. */
@@ -285,10 +353,7 @@ private:
 	WeightsMetaInfo::DistanceMetricEnum dist_metric;
 	WeightsMetaInfo::DistanceUnitsEnum dist_units;
 	
-	pairs_bimap_type pairs_bimap;
-    
-	dist_map_type cached_eucl_dist;
-	dist_map_type cached_arc_dist;
+	PairsIndexer shared_pairs;
     
 };
 
@@ -23,7 +23,8 @@
 
 DiagnosticReport::DiagnosticReport(long obs, int nvar,
 								   bool inclconst, bool w, int m)
-: nObs(obs), nVar(nvar), inclConstant(inclconst), model(m), hasWeight(w)
+: nObs(obs), nVar(nvar), inclConstant(inclconst), model(m), hasWeight(w),
+trace_err_bound(0)
 {
 	if (Allocate()) {
 		SetDiagStatus(false);
@@ -82,6 +82,10 @@ public:
 	double*			GetWaldTest()					{return wald_test;};
 	double			GetMeanY()						{return mean_Y;};
 	double			GetSDevY()						{return sdev_Y;};
+	/// Method used for tr(W(I-rW)^-1) in the ML models, see TraceEstimator
+	wxString		GetTraceMethod()				{return trace_method;};
+	/// Approximate 95% error bound on that trace, 0 if exact
+	double			GetTraceErrBound()				{return trace_err_bound;};
 
 protected:
 	int	 model; // 1:OLS; 2:Lag; 3:Errror
@@ -100,6 +104,8 @@ protected:
 	double *lmlag, *lmerr, *lmlagr, *lmerrr, *lmsarma, *kelrob;
 	double *lr_test, *lm_test, *lrcf_test, *wald_test;
 	double mean_Y, sdev_Y;
+	wxString trace_method;
+	double trace_err_bound;
 
 public:
 	void release_Var();
@@ -143,6 +149,8 @@ public:
 	void SetWaldTest(int i, double coef) { wald_test[i] = coef;};
 	void SetMeanY(double mY) { mean_Y = mY; };
 	void SetSDevY(double sdY) { sdev_Y = sdY; };
+	void SetTraceMethod(const wxString& m) { trace_method = m; };
+	void SetTraceErrBound(double eb) { trace_err_bound = eb; };
 
 private:
 	void SetDiagStatus(bool status);
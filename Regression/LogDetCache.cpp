@@ -0,0 +1,131 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include "../ShapeOperations/CsrWeight.h"
+#include "mix.h"
+#include "SparseMatrix.h"
+#include "LogDetCache.h"
+
+LogDetCache::LogDetCache(const GalElement* gal_s, int num_obs_s)
+: gal(gal_s), num_obs(num_obs_s), worker(0), has_tr_wtw_ww(false),
+tr_wtw_ww(0)
+{
+}
+
+LogDetCache::~LogDetCache()
+{
+	Wait();
+	std::map<int, TraceEstimator*>::iterator it;
+	for (it=estimators.begin(); it!=estimators.end(); ++it) delete it->second;
+}
+
+void LogDetCache::StartBackground()
+{
+	if (worker || !gal || num_obs <= 0) return;
+	// SparseMatrix construction may report bad weights through wx, so the
+	// copies are made here and the worker only gets plain arrays
+	CsrWeight* w = new CsrWeight(gal, num_obs);
+	TraceEstimator::Method m = TraceEstimator::ChooseMethod(num_obs);
+	TraceEstimator* est = NewTraceEstimator(m);
+	estimators[m] = est;
+	worker = new boost::thread(boost::bind(&LogDetCache::Prepare, this,
+										   w, est));
+}
+
+void LogDetCache::Wait()
+{
+	if (!worker) return;
+	worker->join();
+	delete worker;
+	worker = 0;
+}
+
+/** Runs on the worker thread.  est is already in estimators, but nobody
+ reads it before Wait returns. */
+void LogDetCache::Prepare(CsrWeight* w, TraceEstimator* est)
+{
+	double tr = w->TraceWtWPlusWW();
+	delete w;
+	est->Prepare();
+	boost::mutex::scoped_lock lock(mutex);
+	tr_wtw_ww = tr;
+	has_tr_wtw_ww = true;
+}
+
+TraceEstimator* LogDetCache::NewTraceEstimator(TraceEstimator::Method m) const
+{
+	SparseMatrix w(gal, num_obs);
+	w.rowStandardize();
+	w.makeStdSymmetric();
+	return new TraceEstimator(w, m);
+}
+
+bool LogDetCache::GetEigenvalues(std::vector<double>& ev)
+{
+	// not worth a dense decomposition for large matrices
+	if (num_obs > TraceEstimator::eigen_max_obs) return false;
+	TraceEstimator* est = GetTraceEstimator(TraceEstimator::eigen_method);
+	if (!est || est->GetMethod() != TraceEstimator::eigen_method) {
+		return false;
+	}
+	ev = est->GetEigenvalues();
+	return true;
+}
+
+TraceEstimator* LogDetCache::GetTraceEstimator(TraceEstimator::Method m)
+{
+	Wait();
+	if (!gal || num_obs <= 0) return 0;
+	m = TraceEstimator::ResolveMethod(m, num_obs);
+	boost::mutex::scoped_lock lock(mutex);
+	std::map<int, TraceEstimator*>::iterator it = estimators.find(m);
+	if (it != estimators.end()) return it->second;
+	TraceEstimator* est = NewTraceEstimator(m);
+	est->Prepare();
+	estimators[m] = est;
+	return est;
+}
+
+double LogDetCache::GetTraceWtWPlusWW()
+{
+	Wait();
+	boost::mutex::scoped_lock lock(mutex);
+	if (!has_tr_wtw_ww && gal && num_obs > 0) {
+		tr_wtw_ww = CsrWeight(gal, num_obs).TraceWtWPlusWW();
+		has_tr_wtw_ww = true;
+	}
+	return tr_wtw_ww;
+}
+
+bool LogDetCache::GetPoly(int precision, PolyBlocks& blocks)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	std::map<int, PolyBlocks>::const_iterator it = polys.find(precision);
+	if (it == polys.end()) return false;
+	blocks = it->second;
+	return true;
+}
+
+void LogDetCache::SetPoly(int precision, const PolyBlocks& blocks)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	polys[precision] = blocks;
+}
@@ -0,0 +1,95 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_LOG_DET_CACHE_H__
+#define __GEODA_CENTER_LOG_DET_CACHE_H__
+
+#include <map>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include "TraceEstimator.h"
+
+class CsrWeight;
+class GalElement;
+namespace boost { class thread; }
+
+/**
+ Everything the ML spatial lag and error models compute from the weights
+ matrix alone, kept between regression runs so that respecifying the
+ model with the same weights does not redo it:
+
+ - the TraceEstimator for each trace method, including the eigenpairs of
+   the symmetrized W for small n.  Its eigenvalues also give ln|I-rW|
+   directly for the small-dimension likelihood.
+ - the blocks of the characteristic polynomial of W that the large
+   dimension likelihood uses for ln|I-rW|, per requested precision.
+ - tr(W'W + WW), used by the LM diagnostics and Moran's I z-value of
+   classicalRegression.
+
+ WeightsNewManager owns one cache per loaded GAL.  StartBackground copies
+ the weights on the calling thread and leaves only the numeric work, the
+ tr(W'W + WW) kernel and TraceEstimator::Prepare of the default method, to
+ a worker thread; every accessor waits for it.  The cache keeps a pointer
+ to the GalElement array, so it must be deleted before the weights are.
+ */
+class LogDetCache
+{
+public:
+	typedef std::vector<std::vector<double> > PolyBlocks;
+
+	LogDetCache(const GalElement* gal, int num_obs);
+	virtual ~LogDetCache();
+
+	/** Must be called from the GUI thread, like every other member. */
+	void StartBackground();
+	/** Blocks until the background computation, if any, has finished. */
+	void Wait();
+
+	int GetNumObs() const { return num_obs; }
+
+	/** Eigenvalues of the row standardized W in ascending order.  Returns
+	 false when they were not computed (too many observations). */
+	bool GetEigenvalues(std::vector<double>& ev);
+
+	/** Shared estimator for method m, built on first use.  The cache keeps
+	 ownership. */
+	TraceEstimator* GetTraceEstimator(TraceEstimator::Method m);
+
+	/** tr(W'W + WW) of the row standardized W */
+	double GetTraceWtWPlusWW();
+
+	bool GetPoly(int precision, PolyBlocks& blocks);
+	void SetPoly(int precision, const PolyBlocks& blocks);
+
+private:
+	/** Worker thread body.  Owns w.  Touches neither wx nor the logger. */
+	void Prepare(CsrWeight* w, TraceEstimator* est);
+	TraceEstimator* NewTraceEstimator(TraceEstimator::Method m) const;
+
+	const GalElement* gal;
+	int num_obs;
+	boost::thread* worker;
+	boost::mutex mutex;
+	std::map<int, TraceEstimator*> estimators;
+	std::map<int, PolyBlocks> polys;
+	bool has_tr_wtw_ww;
+	double tr_wtw_ww;
+};
+
+#endif
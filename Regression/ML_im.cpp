@@ -35,6 +35,8 @@ The IDE project should also include SLStream.cpp
 #include "PowerLag.h"
 #include "polym.h"
 #include "ML_im.h"
+#include "LogDetCache.h"
+#include "NormalEquations.h"
 #include "../logger.h"
 
 // use __WXMAC__ to call vecLib
@@ -1088,58 +1090,6 @@ double readDouble(ifstream &f)
     return result;
 }
 
-void extract(const SparseVector &v, 
-						 const double *scale, 
-						 const int row, 
-						 double &trace, 
-						 double &trace2, 
-						 double &frobenius)  
-{
-    double t2 = 0, fr = 0, t;
-    double scale2 = 0, ssq2 = 1, scalef = 0, ssqf = 1;
-    for (int cnt = 0; cnt < v.getNzEntries(); ++cnt)  {
-        int ix = v.getIx( cnt );
-        double val = fabs( v.getValue( ix ) );
-        if (scale2 < val)  {
-            t = scale2 / val;
-            ssq2 = 1.0 + ssq2 * t * t;
-            scale2 = val;
-        }  else if (val > 0.0)  {
-            t = val / scale2;
-            ssq2 += t * t;
-        };
-        double vf = val / scale[ix];
-        if (scalef < vf)  {
-            t = scalef / vf;
-            ssqf = 1.0 + ssqf * t * t;
-            scalef = vf;
-        }  else if (vf > 0.0)  {
-            t = vf / scalef;
-            ssqf += t * t;
-        };
-//        t2 += geoda_sqr(val);
-//        fr += geoda_sqr( val / scale[ix] );
-    };
-    t2 = scale2 * scale2 * ssq2;
-    fr = scalef * scalef * ssqf;
-
-    trace += v.getValue(row);
-    trace2 += t2;
-    frobenius += fr * geoda_sqr(scale[row]);
-}
-
-
-void extract(const DenseVector &v, const double *scale, const int row, double &trace, double &trace2, double &frobenius)  {
-    double t2 = 0, fr =0;
-    for (int cnt = 0; cnt < v.getSize(); ++cnt)  {
-        t2 += geoda_sqr(v.getValue(cnt));
-        fr += geoda_sqr(v.getValue(cnt) / scale[cnt]);
-    };
-    trace += v.getValue(row);
-    trace2 += t2;
-    frobenius += fr * geoda_sqr(scale[row]);
-}
-
 // EasyMatInverse  --
 // Inverts any matrix of size 2 by 2 or less. The matrix does not have to be symmetric.
 // Returns false if fails (matrix is not a full rank matrix and true if success.
@@ -1425,6 +1375,21 @@ bool ordinaryLS(DenseVector &y,
 	int row = 0, column = 0;
 	double val = 0.0;
 
+	// Cholesky on the normal equations, accumulated in parallel.  The SVD
+	// below is kept for nearly collinear regressors.
+	{
+		std::vector<const double*> cols(vars);
+		for (row = 0; row < vars; row++) cols[row] = X[row].getThis();
+		ColumnDesignRows rows(&cols[0], obs, vars);
+		NormalEquations ne(rows, y.getThis());
+		if (ne.Factor()) {
+			ne.Inverse(cov);
+			ne.Solve(ols.getThis());
+			ne.Residuals(ols.getThis(), resid);
+			return true;
+		}
+	}
+
 	for (row = 0; row < vars; row++) {
 		for (column = 0; column < vars; column++) {
 			cov[row][column] = 0;
@@ -1591,89 +1556,6 @@ double LcPrime(const DenseVector &v, const double * residW, const SparseMatrix &
     return pp;
 }    
 
-void run1(SparseMatrix &w, const double rr, double &trace, double &trace2,
-		  double &frobenius,
-		  wxGauge* p_bar, double p_bar_min_fraction, double p_bar_max_fraction)
-{
-	LOG_MSG("Entering run1");
-    const int LIMIT = 50;
-    const double EPS = 1.0e-14;
-    const int dim = w.dim();
-    SparseVector	sol( dim ), resid( dim ), p( dim ), d( dim );
-    double rho, beta, rho_lag;
-
-    int its = 0 , nzs = 0;
-    
-    trace = 0, trace2 = 0, frobenius = 0;
-    double s0 = 0, s1 = 0, s2 = 0, sse = 0;
-    double gs0 = 0, gs1 = 0, gs2 = 0;
-	
-	int g_min, g_max, prev_g_val; 
-	int cur_g_val, g_val_init, g_val_final, g_val_range;
-	int loop_min = 0, loop_max = max(0, dim-1);
-	if (p_bar) {
-		g_min = 0;
-		g_max = p_bar->GetRange();
-		g_val_init = p_bar_min_fraction * g_max;
-		g_val_final = p_bar_max_fraction * g_max;
-		g_val_range = g_val_final - g_val_init;
-		prev_g_val = g_val_init;
-		cur_g_val = prev_g_val;
-		p_bar->SetValue(g_val_init);
-		p_bar->Update();
-	}	
-    for (int ix = 0; ix < dim; ++ix) {
-		if (p_bar) {
-			cur_g_val = (ix*g_val_range)/loop_max + g_val_init;
-			if (cur_g_val > prev_g_val) {
-				p_bar->SetValue(cur_g_val);
-				prev_g_val = cur_g_val;
-				p_bar->Update();
-			}
-		}
-		sol.reset();
-        sol.setAt( ix, 1 );
-        w.rowIminusRhoThis( rr, p, sol );			// p = Ax
-        resid.minus( sol, p );			// r = b - Ax
-        rho = resid.norm();			// rho = ss of resid
-        int it = 0;				// iteration counter
-        while (rho > EPS && it < LIMIT) {
-            ++it;
-            if (it == 1) {
-				d.copy(resid);
-            } else {
-                beta = rho / rho_lag;
-                d.timesPlus(resid, beta);
-            }
-            w.rowIminusRhoThis( rr, p, d );			// p = Ad
-            double alpha = rho / d.product( p );	// alpha = rho / d'p
-            sol.addTimes( d, alpha );			// sol = sol + alpha*d
-            resid.addTimes( p, -alpha );		// resid = resid - alpha*p
-            rho_lag = rho;
-            rho = resid.norm();
-            s0 = s1;
-            s1 = s2;
-            s2 = w.getRow(ix).timesColumn(sol);
-        }
-        w.rowMatrix( p, sol );				// p = (Winv(I-rW))i 
-        
-        extract(p, w.getScale(), ix, trace, trace2, frobenius);
-        its += it;
-        nzs += sol.getNzEntries();
-        double se = 0;
-        if (s2-s1 > 1.0e-14)  se = geoda_sqr(s2-s1)/(s2-2.0*s1+s0);
-        sse += s2 - se;
-        gs0 += s0;
-        gs1 += s1;
-        gs2+= s2;
-    }
-	if (p_bar) {
-		p_bar->SetValue(g_val_final);
-		p_bar->Update();
-	}
-    LOG_MSG("Exiting run1");
-}
-
 /*   ECL
 * function to compute log-likelihood function for the spatial lag model
 resid -- vector of residuals in regression y on X;
@@ -1836,7 +1718,8 @@ double SmallSimulationLag(Weights &W,
 						  double* LogLik, bool asym,
 						  wxGauge* p_bar,
 						  double p_bar_min_fraction,
-						  double p_bar_max_fraction)  
+						  double p_bar_max_fraction,
+						  const std::vector<double>* eig)  
 {
     W.Transform(W_MAT);               // makes sure it is properly formated
     const int   dim = W.dim();
@@ -1868,7 +1751,12 @@ double SmallSimulationLag(Weights &W,
     	lag.setAt(cnt, p_lag[cnt]);
 
 	double *s = new double [dim], *wr = new double [dim], *wi = new double [dim];
-	if (!asym)
+	if (!asym && eig && (int) eig->size() == dim)
+	{
+		// eigenvalues of the symmetrized matrix were already computed
+		for (row = 0; row < dim; row++) s[row] = (*eig)[row];
+	}
+	else if (!asym)
 	{
 		// assume real and symmetric matrix
 		// use CLAPACK to compute all eigenvalues
@@ -1965,6 +1853,43 @@ double SmallSimulationLag(Weights &W,
     return rhoEstimate;
 }
 
+/** Copies the characteristic polynomial blocks computed by SparsePoly
+ into the cache. */
+static void StorePoly(LogDetCache& cache, int Precision)
+{
+	LogDetCache::PolyBlocks blocks;
+	for (Iterator<WVector> it = Poly(); it; ++it) {
+		blocks.push_back(std::vector<double>());
+		for (WIterator v = (*it)(); v; ++v) blocks.back().push_back(*v);
+	}
+	cache.SetPoly(Precision, blocks);
+}
+
+/** Refills Poly from the cache instead of calling SparsePoly.  Must be
+ called right after InitPoly.  Returns false if nothing was cached. */
+static bool RestorePoly(LogDetCache& cache, int Precision)
+{
+	LogDetCache::PolyBlocks blocks;
+	if (!cache.GetPoly(Precision, blocks)) return false;
+	if (blocks.size() > Poly.size()) return false;
+	for (size_t b = 0; b < blocks.size(); b++) {
+		(*Poly).alloc(blocks[b].size());
+		for (size_t i = 0; i < blocks[b].size(); i++) *Poly << blocks[b][i];
+		++Poly;
+	}
+	return true;
+}
+
+/** Fills Poly for the symmetrized weights sym, reusing the blocks of an
+ earlier run with the same weights and precision when available. */
+static void CachedSparsePoly(Iterator<WMap> sym, LogDetCache* cache,
+							 int Precision)
+{
+	if (cache && RestorePoly(*cache, Precision)) return;
+	SparsePoly(sym);
+	if (cache) StorePoly(*cache, Precision);
+}
+
 double SimulationLag(const GalElement *weight,
 					 int num_obs,
 					 int Precision, 
@@ -1976,16 +1901,22 @@ double SimulationLag(const GalElement *weight,
 					 double* LogLik,
 					 wxGauge* p_bar,
 					 double p_bar_min_fraction,
-					 double p_bar_max_fraction)
+					 double p_bar_max_fraction,
+					 LogDetCache* cache)
 {
 	LOG_MSG("Entering SimulationLag, GalElement*");
   	Weights  W(weight, num_obs);          // read the weights matrix
+	if (cache && cache->GetNumObs() != W.dim()) cache = 0;
 	
-    if (W.dim() < SMALL_DIM)
+    if (W.dim() < SMALL_DIM) {
+		std::vector<double> eig;
+		bool has_eig = cache && cache->GetEigenvalues(eig);
         return SmallSimulationLag(W, num_obs, rho, my_Y, my_X, deps,
 								  InclConstant, LogLik, false,
 								  p_bar, p_bar_max_fraction,
-								  p_bar_max_fraction);
+								  p_bar_max_fraction,
+								  has_eig ? &eig : 0);
+	}
     
     W.Transform(W_GWT);               // makes sure it is formated
     const int   dim= W.Git().count();
@@ -2017,7 +1948,7 @@ double SimulationLag(const GalElement *weight,
     start= clock();
 
     InitPoly(Precision, dim);
-    SparsePoly(sym());
+    CachedSparsePoly(sym(), cache, Precision);
     // "  --- finished computing polynomial" 
 	double **cov = new double * [deps];
 	double *resid = new double [dim];
@@ -2275,7 +2206,8 @@ double SmallSimulationError(Weights &W,
 							double *LogLik, bool asym,
 							wxGauge* p_bar,
 							double p_bar_min_fraction,
-							double p_bar_max_fraction)  
+							double p_bar_max_fraction,
+							const std::vector<double>* eig)  
 {
     W.Transform(W_MAT);               // makes sure it is formated
     const int   dim = W.dim();
@@ -2331,7 +2263,12 @@ double SmallSimulationError(Weights &W,
     start = clock();
 
 	double *s = new double [dim], *wr = new double [dim], *wi = new double [dim];
-	if (!asym)
+	if (!asym && eig && (int) eig->size() == dim)
+	{
+		// eigenvalues of the symmetrized matrix were already computed
+		for (row = 0; row < dim; row++) s[row] = (*eig)[row];
+	}
+	else if (!asym)
 	{
 		// assume real and symmetric matrix
 		// use CLAPACK to compute all eigenvalues
@@ -2425,15 +2362,21 @@ double SimulationError(const GalElement *my_gal,
 					   double* LogLik,
 					   wxGauge* p_bar,
 					   double p_bar_min_fraction,
-					   double p_bar_max_fraction)  
+					   double p_bar_max_fraction,
+					   LogDetCache* cache)  
 {
     Weights W(my_gal, num_obs);          
     const int   dim = W.dim();
-    if (dim < SMALL_DIM)
+	if (cache && cache->GetNumObs() != dim) cache = 0;
+    if (dim < SMALL_DIM) {
+		std::vector<double> eig;
+		bool has_eig = cache && cache->GetEigenvalues(eig);
         return  SmallSimulationError(W, rho, my_Y, my_X, deps, beta,
 									 InclConstant, LogLik, false,
 									 p_bar, p_bar_min_fraction,
-									 p_bar_max_fraction);
+									 p_bar_max_fraction,
+									 has_eig ? &eig : 0);
+	}
     W.Transform(W_GWT);               // makes sure it is formated
     int			cnt;
     WVector      	y(dim);
@@ -2457,7 +2400,7 @@ double SimulationError(const GalElement *my_gal,
     RowStandardize(W.Git());	// non-symmetric, row-standardized -- used to compute spatial lag
     VALUE lambdaEstimate = 0.0;
     InitPoly(Precision, dim);
-    SparsePoly(sym());
+    CachedSparsePoly(sym(), cache, Precision);
     Destroy(sym());		// don't need that spatial weights anymore
 
     lambdaEstimate = GoldenSectionError(-1, 0, 1, X, y, W.Git(), beta, LogLik);
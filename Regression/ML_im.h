@@ -24,6 +24,8 @@
 #include "DenseVector.h"
 #include "SparseMatrix.h"
 
+class LogDetCache;
+
 const int SMALL_DIM = 500;
 const int ASYM_DIM = 1000;
 
@@ -38,7 +40,8 @@ double SimulationLag(const GalElement* weight,
 					 double* Lik,
 					 wxGauge* p_bar,
 					 double p_bar_min_fraction,
-					 double p_bar_max_fraction);  
+					 double p_bar_max_fraction,
+					 LogDetCache* cache = 0);  
 
 double SimulationError(const GalElement* weight,
 					   int num_obs,
@@ -52,7 +55,8 @@ double SimulationError(const GalElement* weight,
 					   double* Lik,
 					   wxGauge* p_bar,
 					   double p_bar_min_fraction,
-					   double p_bar_max_fraction);
+					   double p_bar_max_fraction,
+					   LogDetCache* cache = 0);
 
 bool OLS(DenseVector &y, DenseVector * X, const bool IncludeConst,
 		 double ** &cov, double *resid, DenseVector &ols);
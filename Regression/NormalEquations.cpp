@@ -0,0 +1,368 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include "NormalEquations.h"
+
+// use __WXMAC__ to call vecLib
+#ifdef __WXMAC__MMM
+    #include <vecLib/vecLib.h>
+#else
+	#include "blaswrap.h"
+	#include "f2c.h"
+
+    extern "C" int dspev_(char *jobz, char *uplo, integer *n, doublereal *ap,
+        doublereal *w, doublereal *z__, integer *ldz, doublereal *work,
+        integer *info);
+    extern "C" int dpotrf_(char *uplo, integer *n, doublereal *a,
+        integer *lda, integer *info);
+    extern "C" int dpotri_(char *uplo, integer *n, doublereal *a,
+        integer *lda, integer *info);
+    extern "C" int dpotrs_(char *uplo, integer *n, integer *nrhs,
+        doublereal *a, integer *lda, doublereal *b, integer *ldb,
+        integer *info);
+    extern "C" int dpocon_(char *uplo, integer *n, doublereal *a,
+        integer *lda, doublereal *anorm, doublereal *rcond, doublereal *work,
+        integer *iwork, integer *info);
+#endif
+
+const double NormalEquations::min_rcond = 1.0e-10;
+
+/** Blocks of observations handed out to the worker threads */
+struct NormalEquations::Job {
+	int block_rows;
+	int next;
+	boost::mutex mutex;
+};
+
+ColumnDesignRows::ColumnDesignRows(const double* const* cols_s, int num_obs_s,
+								   int num_cols)
+: cols(cols_s, cols_s + num_cols), num_obs(num_obs_s)
+{
+}
+
+void ColumnDesignRows::GetRows(int start, int end, double* buf,
+							   int stride) const
+{
+	const int k = (int) cols.size();
+	for (int j=0; j<k; j++) {
+		const double* c = cols[j];
+		double* b = buf + j;
+		for (int i=start; i<end; i++, b += stride) *b = c[i];
+	}
+}
+
+WhiteDesignRows::WhiteDesignRows(const double* const* X, int num_obs_s,
+								 int nvar, bool InclConstant)
+: x(X, X + nvar), num_obs(num_obs_s), first(InclConstant ? 1 : 0)
+{
+	// X[0] is the constant when InclConstant
+	const int m = nvar - first;
+	num_cols = 1 + m + m * (m + 1) / 2;
+}
+
+void WhiteDesignRows::GetRows(int start, int end, double* buf,
+							  int stride) const
+{
+	const int nvar = (int) x.size();
+	double* row = buf;
+	for (int i=start; i<end; i++, row += stride) {
+		int c = 0;
+		row[c++] = 1.0;
+		for (int a=first; a<nvar; a++) row[c++] = x[a][i];
+		for (int a=first; a<nvar; a++) {
+			const double xa = x[a][i];
+			for (int b=a; b<nvar; b++) row[c++] = xa * x[b][i];
+		}
+	}
+}
+
+NormalEquations::NormalEquations(const DesignRows& X_s, const double* y_s)
+: X(X_s), y(y_s), n(X_s.GetNumObs()), k(X_s.GetNumCols()), factored(false)
+{
+	const int cols = k + (y ? 1 : 0);
+	xtx.resize((size_t) k * k, 0);
+	xty.resize(k, 0);
+	if (n <= 0 || k <= 0) return;
+
+	Job job;
+	job.next = 0;
+	// about 128KB of rows per block
+	job.block_rows = 16384 / cols;
+	if (job.block_rows < 16) job.block_rows = 16;
+	const int num_blocks = (n + job.block_rows - 1) / job.block_rows;
+
+	// every thread has its own accumulator; keep them under 256MB in total
+	int nCPUs = boost::thread::hardware_concurrency();
+	if (nCPUs < 1) nCPUs = 1;
+	if (nCPUs > num_blocks) nCPUs = num_blocks;
+	const double acc_bytes = (double) cols * cols * sizeof(double);
+	while (nCPUs > 1 && nCPUs * acc_bytes > 256.0 * 1024 * 1024) nCPUs--;
+
+	std::vector<std::vector<double> > acc(nCPUs);
+	for (int t=0; t<nCPUs; t++) acc[t].resize((size_t) cols * cols, 0);
+	boost::thread_group threadPool;
+	for (int t=1; t<nCPUs; t++) {
+		threadPool.create_thread(boost::bind(&NormalEquations::AccumulateWorker,
+											 this, &job, &acc[t][0]));
+	}
+	AccumulateWorker(&job, &acc[0][0]);
+	threadPool.join_all();
+
+	for (int t=1; t<nCPUs; t++) {
+		for (size_t i=0, sz=acc[0].size(); i<sz; i++) acc[0][i] += acc[t][i];
+	}
+	// only the upper triangle was accumulated
+	const double* a = &acc[0][0];
+	for (int i=0; i<k; i++) {
+		for (int j=i; j<k; j++) {
+			xtx[(size_t) i*k + j] = xtx[(size_t) j*k + i] = a[(size_t) i*cols + j];
+		}
+		if (y) xty[i] = a[(size_t) i*cols + k];
+	}
+}
+
+NormalEquations::~NormalEquations()
+{
+}
+
+void NormalEquations::AccumulateWorker(Job* job, double* acc) const
+{
+	const int cols = k + (y ? 1 : 0);
+	std::vector<double> buf((size_t) job->block_rows * cols);
+	while (true) {
+		int start;
+		{
+			boost::mutex::scoped_lock lock(job->mutex);
+			start = job->next;
+			job->next += job->block_rows;
+		}
+		if (start >= n) break;
+		int end = start + job->block_rows;
+		if (end > n) end = n;
+		X.GetRows(start, end, &buf[0], cols);
+		if (y) {
+			for (int i=start; i<end; i++) buf[(size_t) (i-start)*cols + k] = y[i];
+		}
+		AddBlock(&buf[0], end-start, cols, cols, acc);
+	}
+}
+
+/**
+ acc += buf' * buf on the upper triangle.  The columns are taken in tiles
+ so that a tile of one accumulator row stays in L1 while all rows of the
+ block are added to it.
+ */
+void NormalEquations::AddBlock(const double* buf, int rows, int cols,
+							   int stride, double* acc)
+{
+	const int TILE = 64;
+	double tmp[TILE];
+	for (int jt=0; jt<cols; jt+=TILE) {
+		const int je = jt+TILE < cols ? jt+TILE : cols;
+		for (int i=0; i<je; i++) {
+			const int j0 = i > jt ? i : jt;
+			const int len = je - j0;
+			for (int j=0; j<len; j++) tmp[j] = 0;
+			const double* row = buf;
+			for (int r=0; r<rows; r++, row += stride) {
+				const double a = row[i];
+				if (a == 0) continue;
+				const double* b = row + j0;
+				for (int j=0; j<len; j++) tmp[j] += a * b[j];
+			}
+			double* c = acc + (size_t) i*cols + j0;
+			for (int j=0; j<len; j++) c[j] += tmp[j];
+		}
+	}
+}
+
+bool NormalEquations::Factor()
+{
+	factored = false;
+	if (k <= 0) return false;
+	scale.resize(k);
+	for (int i=0; i<k; i++) {
+		const double d = xtx[(size_t) i*k + i];
+		if (!(d > 0)) return false;
+		scale[i] = 1.0 / sqrt(d);
+	}
+	// X'X scaled to unit diagonal; symmetric, so the row major copy is also
+	// the column major one
+	chol.resize((size_t) k * k);
+	double anorm = 0;
+	for (int j=0; j<k; j++) {
+		double col_sum = 0;
+		for (int i=0; i<k; i++) {
+			const double v = xtx[(size_t) i*k + j] * scale[i] * scale[j];
+			chol[i + (size_t) j*k] = v;
+			col_sum += fabs(v);
+		}
+		if (col_sum > anorm) anorm = col_sum;
+	}
+
+	char uplo = 'U';
+	integer nn = k, lda = k, info = 0;
+	dpotrf_(&uplo, &nn, &chol[0], &lda, &info);
+	if (info != 0) return false;
+
+	double rcond = 0;
+	std::vector<double> work(3 * (size_t) k);
+	std::vector<integer> iwork(k);
+	dpocon_(&uplo, &nn, &chol[0], &lda, &anorm, &rcond, &work[0], &iwork[0],
+			&info);
+	if (info != 0 || rcond < min_rcond) return false;
+
+	factored = true;
+	return true;
+}
+
+void NormalEquations::Solve(double* beta) const
+{
+	if (!factored) return;
+	std::vector<double> z(k);
+	for (int i=0; i<k; i++) z[i] = xty[i] * scale[i];
+	char uplo = 'U';
+	integer nn = k, nrhs = 1, lda = k, ldb = k, info = 0;
+	dpotrs_(&uplo, &nn, &nrhs, const_cast<double*>(&chol[0]), &lda, &z[0],
+			&ldb, &info);
+	for (int i=0; i<k; i++) beta[i] = z[i] * scale[i];
+}
+
+void NormalEquations::Inverse(double** inv) const
+{
+	if (!factored) return;
+	std::vector<double> a(chol);
+	char uplo = 'U';
+	integer nn = k, lda = k, info = 0;
+	dpotri_(&uplo, &nn, &a[0], &lda, &info);
+	for (int j=0; j<k; j++) {
+		for (int i=0; i<=j; i++) {
+			inv[i][j] = inv[j][i] = a[i + (size_t) j*k] * scale[i] * scale[j];
+		}
+	}
+}
+
+void NormalEquations::Residuals(const double* beta, double* resid) const
+{
+	if (!y || n <= 0) return;
+	Job job;
+	job.next = 0;
+	job.block_rows = 16384 / (k + 1);
+	if (job.block_rows < 16) job.block_rows = 16;
+	const int num_blocks = (n + job.block_rows - 1) / job.block_rows;
+
+	int nCPUs = boost::thread::hardware_concurrency();
+	if (nCPUs < 1) nCPUs = 1;
+	if (nCPUs > num_blocks) nCPUs = num_blocks;
+	boost::thread_group threadPool;
+	for (int t=1; t<nCPUs; t++) {
+		threadPool.create_thread(boost::bind(&NormalEquations::ResidualsWorker,
+											 this, &job, beta, resid));
+	}
+	ResidualsWorker(&job, beta, resid);
+	threadPool.join_all();
+}
+
+void NormalEquations::ResidualsWorker(Job* job, const double* beta,
+									  double* resid) const
+{
+	std::vector<double> buf((size_t) job->block_rows * (k > 0 ? k : 1));
+	while (true) {
+		int start;
+		{
+			boost::mutex::scoped_lock lock(job->mutex);
+			start = job->next;
+			job->next += job->block_rows;
+		}
+		if (start >= n) break;
+		int end = start + job->block_rows;
+		if (end > n) end = n;
+		X.GetRows(start, end, &buf[0], k);
+		const double* row = &buf[0];
+		for (int i=start; i<end; i++, row += k) {
+			double s = 0;
+			for (int j=0; j<k; j++) s += row[j] * beta[j];
+			resid[i] = y[i] - s;
+		}
+	}
+}
+
+/** s = 1/sqrt(diag(X'X)), with 0 for empty columns, and a = the upper
+ triangle of diag(s) X'X diag(s), packed as dspev expects */
+void NormalEquations::ScaledXtX(std::vector<double>& s,
+								std::vector<double>& a) const
+{
+	s.resize(k);
+	for (int i=0; i<k; i++) {
+		const double d = xtx[(size_t) i*k + i];
+		s[i] = d > 0 ? 1.0 / sqrt(d) : 0;
+	}
+	a.resize((size_t) k * (k + 1) / 2);
+	for (int j=0; j<k; j++) {
+		for (int i=0; i<=j; i++) {
+			a[i + (size_t) j * (j + 1) / 2] = xtx[(size_t) i*k + j] * s[i] * s[j];
+		}
+	}
+}
+
+bool NormalEquations::SolveMinNorm(double* beta) const
+{
+	if (k <= 0) return false;
+	std::vector<double> s, a;
+	ScaledXtX(s, a);
+	char jobz = 'V', uplo = 'U';
+	integer nn = k, ldz = k, info = 0;
+	std::vector<double> ev(k), z((size_t) k * k), work(3 * (size_t) k);
+	dspev_(&jobz, &uplo, &nn, &a[0], &ev[0], &z[0], &ldz, &work[0], &info);
+	if (info != 0) return false;
+
+	// beta = S V diag(1/ev) V' S X'y over the retained eigenpairs
+	const double cut = ev[k-1] * min_rcond;
+	std::vector<double> sxty(k);
+	for (int i=0; i<k; i++) {
+		sxty[i] = xty[i] * s[i];
+		beta[i] = 0;
+	}
+	for (int m=0; m<k; m++) {
+		if (!(ev[m] > cut)) continue;
+		const double* v = &z[(size_t) m * k];
+		double c = 0;
+		for (int i=0; i<k; i++) c += v[i] * sxty[i];
+		c /= ev[m];
+		for (int i=0; i<k; i++) beta[i] += c * v[i];
+	}
+	for (int i=0; i<k; i++) beta[i] *= s[i];
+	return true;
+}
+
+double NormalEquations::ConditionNumber() const
+{
+	if (k <= 0) return -1;
+	std::vector<double> s, a;
+	ScaledXtX(s, a);
+	char jobz = 'N', uplo = 'U';
+	integer nn = k, ldz = k, info = 0;
+	std::vector<double> ev(k), work(3 * (size_t) k);
+	dspev_(&jobz, &uplo, &nn, &a[0], &ev[0], 0, &ldz, &work[0], &info);
+	if (info != 0) return -1;
+	return sqrt(ev[k-1] / ev[0]);
+}
@@ -0,0 +1,143 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_NORMAL_EQUATIONS_H__
+#define __GEODA_CENTER_NORMAL_EQUATIONS_H__
+
+#include <vector>
+
+/**
+ Row access to a design matrix that is stored by columns or is never
+ stored at all.  GetRows writes observations [start, end) into buf, one
+ row of GetNumCols() values every stride doubles.
+ */
+class DesignRows
+{
+public:
+	virtual ~DesignRows() {}
+	virtual int GetNumObs() const = 0;
+	virtual int GetNumCols() const = 0;
+	virtual void GetRows(int start, int end, double* buf,
+						 int stride) const = 0;
+};
+
+/** The usual double** column arrays */
+class ColumnDesignRows : public DesignRows
+{
+public:
+	ColumnDesignRows(const double* const* cols, int num_obs, int num_cols);
+	virtual ~ColumnDesignRows() {}
+	virtual int GetNumObs() const { return num_obs; }
+	virtual int GetNumCols() const { return (int) cols.size(); }
+	virtual void GetRows(int start, int end, double* buf, int stride) const;
+
+private:
+	std::vector<const double*> cols;
+	int num_obs;
+};
+
+/**
+ Auxiliary regressors of the White test: a constant, the explanatory
+ variables and all their squares and cross products, in the column order
+ WhiteTest has always used.  The cross products are generated on the fly,
+ so the n x O(k^2) matrix is never built.
+ */
+class WhiteDesignRows : public DesignRows
+{
+public:
+	WhiteDesignRows(const double* const* X, int num_obs, int nvar,
+					bool InclConstant);
+	virtual ~WhiteDesignRows() {}
+	virtual int GetNumObs() const { return num_obs; }
+	virtual int GetNumCols() const { return num_cols; }
+	virtual void GetRows(int start, int end, double* buf, int stride) const;
+
+private:
+	std::vector<const double*> x;
+	int num_obs;
+	int first; // first non constant column of x
+	int num_cols;
+};
+
+/**
+ X'X and X'y of a DesignRows, accumulated in one pass over the rows.
+ Rows are copied in blocks into a row-major buffer and multiplied in
+ column tiles, so the inner loops run over contiguous memory and the
+ compiler can vectorize them; blocks are spread over all cores, each with
+ its own accumulator.
+
+ Factor computes the Cholesky factorization of X'X after scaling it to
+ unit diagonal.  Solve, Inverse and Residuals then give what ordinaryLS,
+ BP_Test and WhiteTest need.  Factor returns false when X'X is not
+ positive definite or too badly conditioned for the normal equations
+ (see min_rcond), in which case callers fall back to the SVD.
+ */
+class NormalEquations
+{
+public:
+	/** y may be null when only X'X is wanted. */
+	NormalEquations(const DesignRows& X, const double* y);
+	virtual ~NormalEquations();
+
+	int GetNumCols() const { return k; }
+	/** Element (i,j) of X'X */
+	double GetXtX(int i, int j) const { return xtx[(size_t) i*k + j]; }
+	/** Element i of X'y */
+	double GetXty(int i) const { return xty[i]; }
+
+	bool Factor();
+	/** beta = inv(X'X) X'y.  Requires a successful Factor. */
+	void Solve(double* beta) const;
+	/** Minimum norm least squares solution through the eigenvalues of the
+	 scaled X'X, for when Factor fails.  Directions with eigenvalues below
+	 min_rcond times the largest are dropped, which is the same as leaving
+	 out redundant columns.  Returns false if LAPACK fails. */
+	bool SolveMinNorm(double* beta) const;
+	/** inv = inv(X'X), both triangles.  Requires a successful Factor. */
+	void Inverse(double** inv) const;
+	/** resid = y - X beta, in parallel */
+	void Residuals(const double* beta, double* resid) const;
+	/** sqrt of the ratio of the largest to the smallest eigenvalue of X'X
+	 scaled to unit diagonal, or -1 if LAPACK fails. */
+	double ConditionNumber() const;
+
+	/** Reciprocal condition number of the scaled X'X below which Factor
+	 gives up, i.e. a condition number of X above about 1e5. */
+	static const double min_rcond;
+
+private:
+	struct Job;
+	void AccumulateWorker(Job* job, double* acc) const;
+	void ResidualsWorker(Job* job, const double* beta, double* resid) const;
+	static void AddBlock(const double* buf, int rows, int cols, int stride,
+						 double* acc);
+	void ScaledXtX(std::vector<double>& s, std::vector<double>& a) const;
+
+	const DesignRows& X;
+	const double* y;
+	int n;
+	int k;
+	std::vector<double> xtx; // k x k, row major, both triangles
+	std::vector<double> xty;
+	std::vector<double> scale; // 1/sqrt(diag(X'X))
+	std::vector<double> chol; // factor of the scaled X'X, column major
+	bool factored;
+};
+
+#endif
@@ -0,0 +1,472 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <set>
+#include <utility>
+#include <boost/bind.hpp>
+#include <boost/random.hpp>
+#include <boost/thread.hpp>
+#include <wx/gauge.h>
+#include "../GenUtils.h"
+#include "../logger.h"
+#include "TraceEstimator.h"
+
+// use __WXMAC__ to call vecLib
+#ifdef __WXMAC__MMM
+    #include <vecLib/vecLib.h>
+#else
+	#include "blaswrap.h"
+	#include "f2c.h"
+
+    extern "C" int dspev_(char *jobz, char *uplo, integer *n, doublereal *ap,
+        doublereal *w, doublereal *z__, integer *ldz, doublereal *work,
+        integer *info);
+#endif
+
+// mix.h, which SparseMatrix.h needs, opens namespace std and so has to
+// come after f2c.h.  The standard headers it and SparseMatrix.h use are
+// included above, before the min and max macros of f2c.h.
+#include "mix.h"
+#include "SparseMatrix.h"
+
+const int TraceEstimator::eigen_max_obs;
+const int TraceEstimator::exact_max_obs;
+const int TraceEstimator::default_num_probes;
+
+struct TraceEstimator::BlockJob {
+	Task task;
+	double rho;
+	int num_tasks;
+	int block_size;
+	double* out;
+	int next;
+	int done;
+	boost::mutex mutex;
+};
+
+TraceEstimator::TraceEstimator(const SparseMatrix& w, Method method_s,
+							   int num_probes_s, uint64_t seed_s)
+: num_obs(w.dim()), method(method_s), num_probes(num_probes_s),
+seed(seed_s), err_bound(0), tr_w(0), tr_w2(0), prepared(false),
+eigen_init(false)
+{
+	if (num_probes < 2) num_probes = 2;
+	row_ptr.resize(num_obs+1);
+	scale.resize(num_obs);
+	row_ptr[0] = 0;
+	for (int i=0; i<num_obs; i++) {
+		row_ptr[i+1] = row_ptr[i] + w.getRow(i).getSize();
+		scale[i] = w.getScale()[i];
+	}
+	col_idx.resize(row_ptr[num_obs]);
+	vals.resize(row_ptr[num_obs]);
+	for (int i=0; i<num_obs; i++) {
+		const SparseRow& row = w.getRow(i);
+		size_t k = row_ptr[i];
+		for (int c=0, sz=row.getSize(); c<sz; c++, k++) {
+			col_idx[k] = row.getIx(c);
+			vals[k] = row.getWeight(c);
+			if (col_idx[k] == i) tr_w += vals[k];
+			tr_w2 += vals[k] * vals[k];
+		}
+	}
+
+	method = ResolveMethod(method, num_obs);
+}
+
+void TraceEstimator::Prepare()
+{
+	if (prepared) return;
+	prepared = true;
+	if (method == eigen_method && !InitEigen()) method = exact_method;
+}
+
+TraceEstimator::~TraceEstimator()
+{
+}
+
+TraceEstimator::Method TraceEstimator::ChooseMethod(int num_obs)
+{
+	if (num_obs <= eigen_max_obs) return eigen_method;
+	if (num_obs <= exact_max_obs) return exact_method;
+	return stochastic_method;
+}
+
+TraceEstimator::Method TraceEstimator::ResolveMethod(Method requested,
+													 int num_obs)
+{
+	if (requested == auto_method) return ChooseMethod(num_obs);
+	if (requested == eigen_method && num_obs > eigen_max_obs) {
+		return ChooseMethod(num_obs);
+	}
+	return requested;
+}
+
+wxString TraceEstimator::GetMethodName(Method requested) const
+{
+	wxString name;
+	if (method == eigen_method) {
+		name = "eigenvalues";
+	} else if (method == exact_method) {
+		name = "exact (conjugate gradient)";
+	} else {
+		name = wxString::Format("stochastic (Hutchinson, %d probes)",
+								num_probes);
+	}
+	if (requested == eigen_method && method != eigen_method) {
+		if (num_obs > eigen_max_obs) {
+			name << wxString::Format(", eigenvalues not used above %d obs.",
+									 eigen_max_obs);
+		} else {
+			name << ", eigenvalues failed";
+		}
+	}
+	return name;
+}
+
+void TraceEstimator::Compute(double rho, double& trace, double& trace2,
+							 double& frobenius, wxGauge* p_bar,
+							 double p_bar_min_fraction,
+							 double p_bar_max_fraction)
+{
+	LOG_MSG("Entering TraceEstimator::Compute");
+	Prepare();
+	err_bound = 0;
+	trace = 0, trace2 = 0, frobenius = 0;
+	if (num_obs > 0) {
+		if (method == eigen_method) {
+			ComputeEigen(rho, trace, trace2, frobenius, p_bar,
+						 p_bar_min_fraction, p_bar_max_fraction);
+		} else if (method == exact_method) {
+			ComputeExact(rho, trace, trace2, frobenius, p_bar,
+						 p_bar_min_fraction, p_bar_max_fraction);
+		} else {
+			ComputeStochastic(rho, trace, trace2, frobenius, p_bar,
+							  p_bar_min_fraction, p_bar_max_fraction);
+		}
+	}
+	LOG_MSG("Exiting TraceEstimator::Compute");
+}
+
+bool TraceEstimator::InitEigen()
+{
+	const int n = num_obs;
+	char jobz = 'V', uplo = 'U';
+	integer nn = n, ldz = n, info = 0;
+	std::vector<double> a((size_t) n * (n + 1) / 2, 0);
+	std::vector<double> work(3 * (size_t) n);
+	eig_val.resize(n);
+	eig_vec.resize((size_t) n * n);
+	for (int i=0; i<n; i++) {
+		for (size_t k=row_ptr[i]; k<row_ptr[i+1]; k++) {
+			int j = col_idx[k];
+			if (i <= j) a[i + (size_t) j * (j + 1) / 2] = vals[k];
+		}
+	}
+	dspev_(&jobz, &uplo, &nn, &a[0], &eig_val[0], &eig_vec[0], &ldz,
+		   &work[0], &info);
+	eigen_init = (info == 0);
+	if (!eigen_init) {
+		eig_val.clear();
+		eig_vec.clear();
+	}
+	return eigen_init;
+}
+
+void TraceEstimator::ComputeEigen(double rho, double& trace, double& trace2,
+								  double& frobenius, wxGauge* p_bar,
+								  double p_bar_min_fraction,
+								  double p_bar_max_fraction)
+{
+	// B = V diag(mu) V' with mu = lambda / (1-rho*lambda)
+	for (int k=0; k<num_obs; k++) {
+		double mu = eig_val[k] / (1.0 - rho * eig_val[k]);
+		trace += mu;
+		trace2 += mu * mu;
+	}
+	// the row-standardized norm is not similarity invariant, so it needs
+	// the rows of B
+	std::vector<double> out(num_obs);
+	RunBlocks(&TraceEstimator::EigenRows, rho, num_obs, 16, &out[0],
+			  p_bar, p_bar_min_fraction, p_bar_max_fraction);
+	for (int i=0; i<num_obs; i++) frobenius += out[i];
+}
+
+void TraceEstimator::EigenRows(double rho, int start, int end,
+							   double* out) const
+{
+	const int n = num_obs;
+	std::vector<double> mu(n), t(n), b(n);
+	for (int k=0; k<n; k++) mu[k] = eig_val[k] / (1.0 - rho * eig_val[k]);
+	for (int i=start; i<end; i++) {
+		for (int k=0; k<n; k++) t[k] = eig_vec[i + (size_t) k * n] * mu[k];
+		for (int j=0; j<n; j++) b[j] = 0;
+		for (int k=0; k<n; k++) {
+			const double* v = &eig_vec[(size_t) k * n];
+			const double tk = t[k];
+			for (int j=0; j<n; j++) b[j] += tk * v[j];
+		}
+		double fr = 0;
+		for (int j=0; j<n; j++) {
+			double v = b[j] / scale[j];
+			fr += v * v;
+		}
+		out[i] = fr * scale[i] * scale[i];
+	}
+}
+
+void TraceEstimator::ComputeExact(double rho, double& trace, double& trace2,
+								  double& frobenius, wxGauge* p_bar,
+								  double p_bar_min_fraction,
+								  double p_bar_max_fraction)
+{
+	std::vector<double> out(3 * (size_t) num_obs);
+	RunBlocks(&TraceEstimator::ExactRows, rho, num_obs, 32, &out[0],
+			  p_bar, p_bar_min_fraction, p_bar_max_fraction);
+	for (int i=0; i<num_obs; i++) {
+		trace += out[3*i];
+		trace2 += out[3*i+1];
+		frobenius += out[3*i+2];
+	}
+}
+
+void TraceEstimator::ExactRows(double rho, int start, int end,
+							   double* out) const
+{
+	const int n = num_obs;
+	std::vector<double> e(n, 0), x(n), r(n), d(n), p(n), y(n);
+	for (int i=start; i<end; i++) {
+		// row i of B is W times the i-th column of (I-rho*W)^-1
+		e[i] = 1;
+		Solve(rho, &e[0], &x[0], &r[0], &d[0], &p[0]);
+		e[i] = 0;
+		MultW(&x[0], &y[0]);
+		double t2 = 0, fr = 0;
+		for (int j=0; j<n; j++) {
+			t2 += y[j] * y[j];
+			double v = y[j] / scale[j];
+			fr += v * v;
+		}
+		out[3*i] = y[i];
+		out[3*i+1] = t2;
+		out[3*i+2] = fr * scale[i] * scale[i];
+	}
+}
+
+void TraceEstimator::ComputeStochastic(double rho, double& trace,
+									   double& trace2, double& frobenius,
+									   wxGauge* p_bar,
+									   double p_bar_min_fraction,
+									   double p_bar_max_fraction)
+{
+	const int m = num_probes;
+	std::vector<double> out(4 * (size_t) m);
+	RunBlocks(&TraceEstimator::Probes, rho, m, 1, &out[0],
+			  p_bar, p_bar_min_fraction, p_bar_max_fraction);
+	// z'Bz - z'(W + rho*W^2)z has expectation tr(B) - tr(W) - rho*tr(W^2)
+	double s = 0, ss = 0;
+	for (int p=0; p<m; p++) {
+		double t = out[4*p] - out[4*p+3];
+		s += t;
+		ss += t * t;
+		trace2 += out[4*p+1];
+		frobenius += out[4*p+2];
+	}
+	double mean = s / m;
+	double var = (ss - m * mean * mean) / (m - 1);
+	trace = mean + tr_w + rho * tr_w2;
+	trace2 /= m;
+	frobenius /= m;
+	err_bound = 1.96 * sqrt(var > 0 ? var / m : 0);
+}
+
+void TraceEstimator::Probes(double rho, int start, int end,
+							double* out) const
+{
+	const int n = num_obs;
+	std::vector<double> z(n), wz(n), x(n), r(n), d(n), p(n), y(n);
+	for (int pr=start; pr<end; pr++) {
+		// every probe has its own stream, so results do not depend on
+		// the number of threads
+		boost::mt19937 rng((boost::uint32_t)
+						   Gda::ThomasWangHashUInt64(seed + pr));
+		for (int i=0; i<n; i++) z[i] = (rng() & 1) ? 1.0 : -1.0;
+		MultW(&z[0], &wz[0]);
+		double zwz = 0, wzwz = 0;
+		for (int i=0; i<n; i++) {
+			zwz += z[i] * wz[i];
+			wzwz += wz[i] * wz[i];
+		}
+
+		Solve(rho, &z[0], &x[0], &r[0], &d[0], &p[0]);
+		MultW(&x[0], &y[0]); // y = Bz
+		double zbz = 0, bzbz = 0;
+		for (int i=0; i<n; i++) {
+			zbz += z[i] * y[i];
+			bzbz += y[i] * y[i];
+		}
+
+		// row-standardized B is D^-1 B D with D = diag(scale), so its
+		// norm is probed through D B D^-1 z, which has the same norm
+		for (int i=0; i<n; i++) z[i] /= scale[i];
+		Solve(rho, &z[0], &x[0], &r[0], &d[0], &p[0]);
+		MultW(&x[0], &y[0]);
+		double fr = 0;
+		for (int i=0; i<n; i++) {
+			double v = y[i] * scale[i];
+			fr += v * v;
+		}
+
+		out[4*pr] = zbz;
+		out[4*pr+1] = bzbz;
+		out[4*pr+2] = fr;
+		out[4*pr+3] = zwz + rho * wzwz;
+	}
+}
+
+void TraceEstimator::MultW(const double* x, double* y) const
+{
+	for (int i=0; i<num_obs; i++) {
+		double s = 0;
+		for (size_t k=row_ptr[i], end=row_ptr[i+1]; k<end; k++) {
+			s += vals[k] * x[col_idx[k]];
+		}
+		y[i] = s;
+	}
+}
+
+void TraceEstimator::Solve(double rho, const double* b, double* x,
+						   double* r, double* d, double* p) const
+{
+	const int LIMIT = 100;
+	const double EPS = 1.0e-14;
+	const int n = num_obs;
+
+	MultW(b, p);
+	double bb = 0;
+	for (int i=0; i<n; i++) {
+		x[i] = b[i] + rho * p[i];
+		bb += b[i] * b[i];
+	}
+	MultW(x, p);
+	double rr = 0;
+	for (int i=0; i<n; i++) {
+		r[i] = b[i] - (x[i] - rho * p[i]);
+		d[i] = r[i];
+		rr += r[i] * r[i];
+	}
+	const double tol = EPS * bb;
+	int it = 0;
+	while (rr > tol && it++ < LIMIT) {
+		MultW(d, p);
+		double dp = 0;
+		for (int i=0; i<n; i++) {
+			p[i] = d[i] - rho * p[i]; // p = (I-rho*W)d
+			dp += d[i] * p[i];
+		}
+		if (dp <= 0) break;
+		const double alpha = rr / dp;
+		double rr_new = 0;
+		for (int i=0; i<n; i++) {
+			x[i] += alpha * d[i];
+			r[i] -= alpha * p[i];
+			rr_new += r[i] * r[i];
+		}
+		const double beta = rr_new / rr;
+		for (int i=0; i<n; i++) d[i] = r[i] + beta * d[i];
+		rr = rr_new;
+	}
+}
+
+void TraceEstimator::RunBlocks(Task task, double rho, int num_tasks,
+							   int block_size, double* out, wxGauge* p_bar,
+							   double p_bar_min_fraction,
+							   double p_bar_max_fraction) const
+{
+	BlockJob job;
+	job.task = task;
+	job.rho = rho;
+	job.num_tasks = num_tasks;
+	job.block_size = block_size < 1 ? 1 : block_size;
+	job.out = out;
+	job.next = 0;
+	job.done = 0;
+
+	int g_val_init = 0, g_val_final = 0;
+	if (p_bar) {
+		int g_max = p_bar->GetRange();
+		g_val_init = p_bar_min_fraction * g_max;
+		g_val_final = p_bar_max_fraction * g_max;
+		p_bar->SetValue(g_val_init);
+		p_bar->Update();
+	}
+
+	int nCPUs = boost::thread::hardware_concurrency();
+	if (nCPUs < 1) nCPUs = 1;
+	boost::thread_group threadPool;
+	for (int t=1; t<nCPUs && (t-1)*job.block_size < num_tasks; t++) {
+		threadPool.create_thread(boost::bind(&TraceEstimator::RunBlocksWorker,
+											 this, &job, (wxGauge*) 0,
+											 0, 0));
+	}
+	// the calling thread owns the gauge
+	RunBlocksWorker(&job, p_bar, g_val_init, g_val_final);
+	threadPool.join_all();
+
+	if (p_bar) {
+		p_bar->SetValue(g_val_final);
+		p_bar->Update();
+	}
+}
+
+void TraceEstimator::RunBlocksWorker(BlockJob* job, wxGauge* p_bar,
+									 int g_val_init, int g_val_final) const
+{
+	int prev_g_val = g_val_init;
+	while (true) {
+		int start, done;
+		{
+			boost::mutex::scoped_lock lock(job->mutex);
+			start = job->next;
+			job->next += job->block_size;
+			done = job->done;
+		}
+		if (p_bar && job->num_tasks > 0) {
+			int cur_g_val = g_val_init + (int) (((double) done / job->num_tasks)
+												* (g_val_final-g_val_init));
+			if (cur_g_val > prev_g_val) {
+				p_bar->SetValue(cur_g_val);
+				p_bar->Update();
+				prev_g_val = cur_g_val;
+			}
+		}
+		if (start >= job->num_tasks) break;
+		int end = start + job->block_size;
+		if (end > job->num_tasks) end = job->num_tasks;
+		(this->*(job->task))(job->rho, start, end, job->out);
+		{
+			boost::mutex::scoped_lock lock(job->mutex);
+			job->done += end - start;
+		}
+	}
+}
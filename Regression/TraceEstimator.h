@@ -0,0 +1,170 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_TRACE_ESTIMATOR_H__
+#define __GEODA_CENTER_TRACE_ESTIMATOR_H__
+
+#include <cstddef>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <wx/string.h>
+
+class SparseMatrix;
+class wxGauge;
+
+/**
+ Trace terms of B = W(I-rho*W)^-1 used by the ML spatial lag and error
+ models for the rho/lambda correction and the information matrix:
+
+   trace     : tr(B)
+   trace2    : ||B||_F^2 for the symmetrized W
+   frobenius : ||B||_F^2 for the row-standardized W
+
+ These used to be computed by run1 with one serial conjugate gradient
+ solve per observation.  Three methods are available, all multithreaded
+ over a private CSR copy of the symmetrized weights:
+
+   eigen_method      : all eigenpairs of the symmetrized W are computed once
+                       (LAPACK dspev) and reused for every rho.  Exact.
+   exact_method      : one conjugate gradient solve per observation, rows
+                       spread over all cores.  Exact up to CG tolerance.
+   stochastic_method : Hutchinson estimator with Rademacher probes.  The
+                       first two terms of the Neumann series of tr(B) are
+                       computed exactly and serve as a control variate, so
+                       only the remainder is estimated.  GetErrorBound gives
+                       an approximate 95% bound on the trace.
+
+ auto_method picks eigen_method for small, exact_method for moderate and
+ stochastic_method for large numbers of observations.  eigen_method is not
+ followed for more than eigen_max_obs observations.
+ */
+class TraceEstimator
+{
+public:
+	enum Method {
+		auto_method = 0, eigen_method, exact_method, stochastic_method
+	};
+
+	/** w must be a row standardized matrix in its symmetrized form, i.e.
+	 after SparseMatrix::makeStdSymmetric.  It is copied, so w may be
+	 converted back and forth afterwards.  The expensive setup of the
+	 method is left to Prepare. */
+	TraceEstimator(const SparseMatrix& w, Method method = auto_method,
+				   int num_probes = default_num_probes,
+				   uint64_t seed = 123456789);
+	virtual ~TraceEstimator();
+
+	/** One-off setup of the method: the eigen decomposition for
+	 eigen_method, which falls back to exact_method if it fails.  Touches
+	 neither wx nor the logger, so it may run on a worker thread.  Does
+	 nothing when called again. */
+	void Prepare();
+
+	/** Same outputs as the former run1.  The gauge is advanced from
+	 p_bar_min_fraction to p_bar_max_fraction of its range.  Calls Prepare
+	 first if needed. */
+	void Compute(double rho, double& trace, double& trace2,
+				 double& frobenius, wxGauge* p_bar = 0,
+				 double p_bar_min_fraction = 0,
+				 double p_bar_max_fraction = 1);
+
+	/** The method actually used, never auto_method.  Final only after
+	 Prepare. */
+	Method GetMethod() const { return method; }
+	int GetNumProbes() const { return num_probes; }
+	/** Approximate 95% error bound on the trace of the last Compute call.
+	 Zero for the exact methods. */
+	double GetErrorBound() const { return err_bound; }
+	/** Human readable name of the method used, for reports.  Notes when
+	 requested was not followed. */
+	wxString GetMethodName(Method requested = auto_method) const;
+	/** Eigenvalues of the symmetrized W in ascending order, only filled
+	 for eigen_method */
+	const std::vector<double>& GetEigenvalues() const { return eig_val; }
+
+	static Method ChooseMethod(int num_obs);
+	/** The method used for a request: auto_method is resolved with
+	 ChooseMethod, and so is eigen_method above eigen_max_obs since the
+	 dense decomposition needs O(n^2) memory. */
+	static Method ResolveMethod(Method requested, int num_obs);
+
+	static const int eigen_max_obs = 1000;
+	static const int exact_max_obs = 10000;
+	static const int default_num_probes = 100;
+
+private:
+	bool InitEigen();
+	void ComputeEigen(double rho, double& trace, double& trace2,
+					  double& frobenius, wxGauge* p_bar,
+					  double p_bar_min_fraction, double p_bar_max_fraction);
+	void ComputeExact(double rho, double& trace, double& trace2,
+					  double& frobenius, wxGauge* p_bar,
+					  double p_bar_min_fraction, double p_bar_max_fraction);
+	void ComputeStochastic(double rho, double& trace, double& trace2,
+						   double& frobenius, wxGauge* p_bar,
+						   double p_bar_min_fraction,
+						   double p_bar_max_fraction);
+
+	/** Runs (this->*task)(rho, start, end, out) over [0, num_tasks) in
+	 blocks on all cores.  The calling thread takes part and advances the
+	 gauge between its blocks. */
+	typedef void (TraceEstimator::*Task)(double rho, int start, int end,
+										 double* out) const;
+	struct BlockJob;
+	void RunBlocks(Task task, double rho, int num_tasks, int block_size,
+				   double* out, wxGauge* p_bar, double p_bar_min_fraction,
+				   double p_bar_max_fraction) const;
+	void RunBlocksWorker(BlockJob* job, wxGauge* p_bar, int g_val_init,
+						 int g_val_final) const;
+
+	/** out[i] = frobenius contribution of row i */
+	void EigenRows(double rho, int start, int end, double* out) const;
+	/** out[3*i+{0,1,2}] = trace, trace2 and frobenius contributions of
+	 row i */
+	void ExactRows(double rho, int start, int end, double* out) const;
+	/** out[4*p+{0,1,2,3}] = trace, trace2, frobenius and control variate
+	 samples of probe p */
+	void Probes(double rho, int start, int end, double* out) const;
+
+	void MultW(const double* x, double* y) const;
+	/** Solves (I-rho*W)x = b by conjugate gradients, starting from the
+	 truncated Neumann series x0 = b + rho*W*b. */
+	void Solve(double rho, const double* b, double* x, double* r,
+			   double* d, double* p) const;
+
+	int num_obs;
+	Method method;
+	int num_probes;
+	uint64_t seed;
+	double err_bound;
+
+	std::vector<size_t> row_ptr;
+	std::vector<int> col_idx;
+	std::vector<double> vals;
+	std::vector<double> scale;
+	// tr(W) + rho*tr(W^2) are the control variate terms of the trace
+	double tr_w, tr_w2;
+
+	bool prepared;
+	bool eigen_init;
+	std::vector<double> eig_val;
+	std::vector<double> eig_vec; // column major, num_obs x num_obs
+};
+
+#endif
@@ -26,6 +26,7 @@
 #include "mix.h"
 #include "Lite2.h"
 #include "DenseVector.h"
+#include "NormalEquations.h"
 
 // use __WXMAC__ to call vecLib
 //#ifdef WORDS_BIGENDIAN
@@ -46,12 +47,6 @@
 
 #define geoda_sqr(x) ( (x) * (x) )
 
-extern bool ordinaryLS(DenseVector &y, 
-				 DenseVector * X, 
-				 double ** &cov, 
-				 double * resid, 
-				 DenseVector &ols);
-
 // standard normal cumulative distribution function
 double nc(double x)  
 { 
@@ -593,42 +588,50 @@ double *BP_Test(double *resid, int obs, double** X, int nvar, bool InclConst)
 	for (i = 0; i < nvar; i++)
 		alloc(cov[i], nvar);
 
-	// use SVD to compute inverse(Z'Z)
-	// use dgesvd_
-
-	char jobu = 'S', jobvt = 'S';
-	long int m = obs, n = nvar;
-	long int lda = obs, ldu = obs, ldvt = nvar, lwork = 5 * obs, info = 0;
-	double *a = new double [obs * nvar];
-	double *s = new double [nvar];
-	double *u = new double [ldu * nvar];
-	double *vt = new double [ldvt * nvar];
-	double *work = new double [lwork];
-	for (i = 0; i < obs; i++) {
-		for (j = 0; j < nvar; j++) {
-			a[i + obs * j] = x[j].getValue(i);
+	// inverse(Z'Z) from the normal equations, or by SVD when they are too
+	// ill-conditioned
+	std::vector<const double*> cols(nvar);
+	for (i = 0; i < nvar; i++) cols[i] = x[i].getThis();
+	ColumnDesignRows rows(&cols[0], obs, nvar);
+	NormalEquations ne(rows, 0);
+	if (ne.Factor()) {
+		ne.Inverse(cov);
+	} else {
+		// use dgesvd_
+		char jobu = 'S', jobvt = 'S';
+		long int m = obs, n = nvar;
+		long int lda = obs, ldu = obs, ldvt = nvar, lwork = 5 * obs, info = 0;
+		double *a = new double [obs * nvar];
+		double *s = new double [nvar];
+		double *u = new double [ldu * nvar];
+		double *vt = new double [ldvt * nvar];
+		double *work = new double [lwork];
+		for (i = 0; i < obs; i++) {
+			for (j = 0; j < nvar; j++) {
+				a[i + obs * j] = x[j].getValue(i);
+			}
 		}
-	}
 
-// use __WXMAC__ to call vecLib
-//#ifdef WORDS_BIGENDIAN
+		// use __WXMAC__ to call vecLib
+		//#ifdef WORDS_BIGENDIAN
 #ifdef __WXMAC__MMM
-	dgesvd_(&jobu, &jobvt, &m, &n, a, &lda, s, u, &ldu, vt, &ldvt, work, &lwork, &info);
+		dgesvd_(&jobu, &jobvt, &m, &n, a, &lda, s, u, &ldu, vt, &ldvt, work, &lwork, &info);
 #else
-	dgesvd_(&jobu, &jobvt, (integer*)&m, (integer*)&n, (doublereal*)a, (integer*)&lda, (doublereal*)s, (doublereal*)u, (integer*)&ldu, (doublereal*)vt, (integer*)&ldvt, (doublereal*)work, (integer*)&lwork, (integer*)&info);
+		dgesvd_(&jobu, &jobvt, (integer*)&m, (integer*)&n, (doublereal*)a, (integer*)&lda, (doublereal*)s, (doublereal*)u, (integer*)&ldu, (doublereal*)vt, (integer*)&ldvt, (doublereal*)work, (integer*)&lwork, (integer*)&info);
 #endif
 
-	if (!info) {
-		// (z'z)^(-1) = VW^(-2)V'
-		for (i = 0; i < nvar; i++) {
-			for (j = 0; j < nvar; j++) {
-				for (m = 0; m < nvar; m++) {
-					cov[i][j] += (vt[i * nvar + m] * vt[m + j * nvar]) / (s[m] * s[m]);
+		if (!info) {
+			// (z'z)^(-1) = VW^(-2)V'
+			for (i = 0; i < nvar; i++) {
+				for (j = 0; j < nvar; j++) {
+					for (m = 0; m < nvar; m++) {
+						cov[i][j] += (vt[i * nvar + m] * vt[m + j * nvar]) / (s[m] * s[m]);
+					}
 				}
 			}
+		} else {
+			// do nothing
 		}
-	} else {
-		// do nothing
 	}
 
 	double mse = e.norm() / obs;
@@ -666,60 +669,23 @@ double *BP_Test(double *resid, int obs, double** X, int nvar, bool InclConst)
 
 double MC_Condition_Number(double **X, int dim, int expl)
 {
-	int i = 0, j = 0, row = 0, column = 0; 
-	double xn = 0;
-	DenseVector *x = new DenseVector [dim];
-
-	for (i = 0; i < expl; i++)
-		x[i].absorb(X[i], dim, false);
-
-	for (i = 0; i < expl; i++) {
-		xn = x[i].norm();
-		for (j = 0; j < dim; j++) {
-			x[i].setAt(j, x[i].getValue(j) / sqrt(xn));
-		}
-	}
-
-	// use CLAPACK to compute the largest and the smallest eigenvalues
-	// use dspev_
-
-	char jobz = 'N', uplo = 'U';
-	long int n = expl;
-	long int ldz = expl, lwork = 3 * expl, info = 0;
-	double *a = new double [expl * (expl + 1) / 2];
-	double *s = new double [expl];
-	double *z = NULL;
-	double *work = new double [lwork];
-	for (row = 0; row < expl; row++) {
-		for (column = row + 1; column < expl; column++)
-			a[row + column * (column + 1) / 2] = x[row].product(x[column]);
-			a[row + row * (row + 1) / 2] = x[row].norm();
-	}
-
-// use __WXMAC__ to call vecLib
-//#ifdef WORDS_BIGENDIAN
-#ifdef __WXMAC__MMM
-	dspev_(&jobz, &uplo, &n, a, s, z, &ldz, work, &info);
-#else
-	dspev_(&jobz, &uplo, (integer*)&n, (doublereal*)a, (doublereal*)s, (doublereal*)z, (integer*)&ldz, (doublereal*)work, (integer*)&info);
-#endif
-
-	if (!info) {
-		double max = s[expl - 1], min = s[0];
-		return sqrt(max / min);
-	} else {
+	// largest and smallest eigenvalues of X'X with unit length columns
+	ColumnDesignRows rows(X, dim, expl);
+	NormalEquations ne(rows, 0);
+	double cn = ne.ConditionNumber();
+	if (cn < 0) {
 	//	cerr << "error in computing eigenvalues" << endl;
 		wxMessageBox("error in computing eigenvalues");
 		return -999;
 	}
+	return cn;
 }
 
 
 double* WhiteTest(int obs, int nvar, double* resid, double** X, bool InclConstant)
 {
-	typedef double* double_ptr_type;
 	double *r2 = new double[obs];
-	int i = 0, jj = 0;
+	int i = 0;
 	//	if (!InclConstant) DevFromMean(obs,resid);
 
 	// (1) r2 = Compute e2
@@ -732,74 +698,28 @@ double* WhiteTest(int obs, int nvar, double* resid, double** X, bool InclConstan
 	r2_bar /= obs;
 	
 	
-	// (2) define (n*n + 3n)/2 memory location for w
+	// (2) regress r2 on the constant, X and all squares and cross products
+	// of X, that is (n*n + 3n)/2 regressors.  WhiteDesignRows generates them
+	// row by row, so they are never stored.
 	const int df = InclConstant? (geoda_sqr(nvar-1)+3*(nvar-1))/2 : (geoda_sqr(nvar)+3*nvar)/2;
-	double_ptr_type *w  = new double_ptr_type[df+1];
-
-	for (i=0;i<=df;i++) w[i] = new double[obs];
-
-
-	// (3) keep original X into w[1 .. nvar][]
-	int ix = InclConstant? 0 : 1;
-	int k = nvar+ix;
-
-	for (jj=0;jj<obs;jj++)
-		w[0][jj] = 1.0;
-
-	if (InclConstant)
-	{
-		for (i=1;i<nvar;i++)
-		{
-
-				for (jj=0;jj<obs;jj++)
-					w[i][jj] = X[i][jj];
-		}
-	}
-	else
-	{
-		for (i=0;i<nvar;i++)
-				for (jj=0;jj<obs;jj++)
-					w[i+1][jj] = X[i][jj];
-	}
-
-	// (4) Create cross product of Xs and store them into w[nvar ... df][]
-	for (i=1-ix;i<nvar;i++)
-	{
-		for (int j=i; j<nvar;j++)
-		{
-			for (jj=0;jj<obs;jj++)
-				w[k][jj] = X[i][jj] * X[j][jj];
-			k++;
-		}
-	}
-
-	// (5) Compute OLS, r2 on w
-	DenseVector		yw(r2, obs, false), olsw(k);
-  DenseVector *xw = new DenseVector[k];
-
-  for (int cnt = 0; cnt < k; ++cnt)  
-	{
-
-     xw[cnt].absorb(w[cnt], obs, false);
-	}
-
-
-  double ** cov = new double * [k];
-  double *u = new double[obs];
-	for (i = 0; i < k; i++) {
-		cov[i] = new double [k];
-		for (jj = 0; jj < k; jj++) {
-			cov[i][jj] = 0;
-		}
-	}
 	double *rsl = new double[3];
 	rsl[0] = df;
 	rsl[1] = -99999;
 	rsl[2] = -99999;
-  if (!ordinaryLS(yw, xw, cov, u, olsw))
-	{
+
+	WhiteDesignRows rows(X, obs, nvar, InclConstant);
+	NormalEquations ne(rows, r2);
+	std::vector<double> olsw(rows.GetNumCols());
+	// the square of a dummy variable is the dummy itself, so X'X is often
+	// singular here
+	if (ne.Factor()) {
+		ne.Solve(&olsw[0]);
+	} else if (!ne.SolveMinNorm(&olsw[0])) {
+		delete [] r2;
 		return rsl;
 	}
+	double *u = new double[obs];
+	ne.Residuals(&olsw[0], u);
 
 	double s_u = 0.0;
 	for (i=0;i<obs;i++)
@@ -809,7 +729,8 @@ double* WhiteTest(int obs, int nvar, double* resid, double** X, bool InclConstan
 //	rsl[1]= chicdf(rsl[0],df);
 	rsl[2]= gammp( double (df) / 2.0, rsl[1]/2.0 );
 
-	
+	delete [] u;
+	delete [] r2;
 	return rsl;
 
 }
@@ -17,8 +17,6 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <map>
-#include <boost/unordered_map.hpp>
 #include <wx/wxprec.h>
 
 #ifndef WX_PRECOMP
@@ -27,6 +25,7 @@
 
 #include <wx/gauge.h>
 #include "../logger.h"
+#include "../ShapeOperations/CsrWeight.h"
 #include "../ShapeOperations/GalWeight.h"
 
 #include "mix.h"
@@ -34,6 +33,8 @@
 #include "ML_im.h"
 #include "smile.h"
 #include "../Regression/DiagnosticReport.h"
+#include "TraceEstimator.h"
+#include "LogDetCache.h"
 
 #define geoda_sqr(x) ( (x) * (x) )
 
@@ -48,7 +49,7 @@ void Compute_RSLmError(GalElement* g,
 					   double *resid,
 					   int dim,
 					   double* rst,
-					   const std::vector< std::set<int> >& g_lookup);
+					   double tr_wtw_ww);
 
 void Compute_RSLmErrorRobust(GalElement* g,
 							 double** cov,
@@ -59,7 +60,7 @@ void Compute_RSLmErrorRobust(GalElement* g,
 							 int dim,
 							 int expl,
 							 double* rst,
-							 const std::vector< std::set<int> >& g_lookup);
+							 double tr_wtw_ww);
 
 void Compute_RSLmLag(GalElement* g,
 					 double** cov,
@@ -70,7 +71,7 @@ void Compute_RSLmLag(GalElement* g,
 					 int dim,
 					 int expl,
 					 double* rst,
-					 const std::vector< std::set<int> >& g_lookup);
+					 double tr_wtw_ww);
 
 void Compute_RSLmLagRobust(GalElement* g,
 						   double** cov,
@@ -81,7 +82,7 @@ void Compute_RSLmLagRobust(GalElement* g,
 						   int dim,
 						   int expl,
 						   double* rst,
-						   const std::vector< std::set<int> >& g_lookup);
+						   double tr_wtw_ww);
 
 void Compute_RSLmSarma(GalElement* g,
 					   double** cov,
@@ -92,7 +93,7 @@ void Compute_RSLmSarma(GalElement* g,
 					   int dim,
 					   int expl,
 					   double* rst,
-					   const std::vector< std::set<int> >& g_lookup);
+					   double tr_wtw_ww);
 
 
 bool ordinaryLS(DenseVector &y, 
@@ -117,86 +118,6 @@ void Lag(DenseVector &lag, const DenseVector &x, GalElement *g)
         lag.setAt( cnt, g[cnt].SpatialLag(x.getThis()) );
 }
 
-void MakeFastLookupMat(GalElement *g, int dim,
-					   std::vector< std::set<int> >& g_lookup)
-{
-	using namespace std;
-	g_lookup.resize(dim);
-    for (int cnt = 0; cnt < dim; ++cnt) {
-        for (int cp = 0; cp < g[cnt].Size(); ++cp) {
-			g_lookup[cnt].insert(g[cnt][cp]);
-		}
-	}
-}
-
-// Note: it is expected that input g_lookup was initialized as follows:
-// MakeFastLookupMat(g, dim, g_lookup);
-double T(GalElement *g, int dim,
-		 const std::vector< std::set<int> >& g_lookup)  
-{
-    // tr(W'W+WW)
-    // = tr(W'W) + tr(WW)
-    // = w'_ij*w_ji + w_ij*w_ji
-    
-	using namespace std;
-    double	sum = 0;
-    
-    int i=0, j=0;
-    for (i = 0; i < dim; ++i) {
-        for (j = 0; j < dim; ++j) {
-            //w_ij * w_ji
-            
-                //sum += g[i][j] * g[j][i];
-                sum += g[i].GetRW(j) * g[j].GetRW(i);
-        }
-    }
-    for (i = 0; i < dim; ++i) {
-        for (j = 0; j < dim; ++j) {
-            //w'_ij * w_ji
-                //sum += g[j][i] * g[j][i];
-                sum += g[j].GetRW(i) * g[j].GetRW(i);
-        }
-    }
-    
-    /*
-     // below is also incorrect when handling knn weights matrix
-    int cnt = 0, cp = 0;
-    for (cnt = 0; cnt < dim; ++cnt) {
-        for (cp = 0; cp < g[cnt].Size(); ++cp) {
-            sum += geoda_sqr(1.0/g[cnt].Size());
-        }
-    }
-		
-	for (cnt = 0; cnt < dim; ++cnt) {
-        for (cp = 0; cp < g[cnt].Size(); ++cp) {
-			if (g_lookup[g[cnt][cp]].find(cnt)  != g_lookup[g[cnt][cp]].end()) {
-                // check if transpose element exists (ie, non-zero)
-				sum += (1.0/g[cnt].Size()/g[ g[cnt][cp] ].Size());
-			}
-		}
-	}
-	*/
-    
-    return sum;
-    //return 21.738295484789607;
-}
-
-// This original version of T computes the trace of W'W + WW where W
-// is the row-standardized version of the weights matrix g.  The
-// algorithm is correct of g is symmetric, but incorrect otherwise.
-// The computation for trace WW was the problem, and is corrected with
-// the new version of T above.
-//double T(const GalElement *g, int dim)
-//{
-//   double	sum = 0;
-//    int cnt = 0, cp = 0;
-//    for (cnt = 0; cnt < dim; ++cnt)  
-//        for (cp = 0; cp < g[cnt].Size(); ++cp)
-//            sum += geoda_sqr(1.0/g[cnt].Size()) +
-//				(1.0/g[cnt].Size()/g[ g[cnt].elt(cp) ].Size());
-//    return sum;
-//}
-
 //
 // Performs spatial LAG test specification: computes RS statistic
 //
@@ -209,7 +130,7 @@ void Compute_RSLmLag(GalElement* g,
 					 int dim,
 					 int expl,
 					 double *rst,
-					 const std::vector< std::set<int> >& g_lookup)
+					 double tr_wtw_ww)
 {
     double *Y = y.getThis();
     double const ee = norm(resid, dim);
@@ -235,7 +156,7 @@ void Compute_RSLmLag(GalElement* g,
     z.squareTimesColumn( z2, cov );			// z2 = (X'X)^(-1)X'WXb
     const double xMx = z.product(z2); // (WXb)'X(X'X)^(-1)X'WXb
     // lag.norm : (WXb)'(WXb)
-    double v = (lag.norm() - xMx + T(g, dim, g_lookup) * sigma2) / sigma2;
+    double v = (lag.norm() - xMx + tr_wtw_ww * sigma2) / sigma2;
     RS /= v;
 
     double const RS_stat = gammp( 0.5, RS * 0.5);
@@ -257,7 +178,7 @@ void Compute_RSLmLagRobust(GalElement* g,
 						   int dim,
 						   int expl,
 						   double *rst,
-						   const std::vector< std::set<int> >& g_lookup)
+						   double tr_wtw_ww)
 {
     double *Y = y.getThis();
     double const ee = norm(resid, dim);
@@ -292,7 +213,7 @@ void Compute_RSLmLagRobust(GalElement* g,
     // z.product(z2) : (WXb)'(X(X'X)^(-1)X')(WXb)
     const double T11 = Wy.norm() -  z.product(z2);
     const double T1 = T11 / sigma2;
-    const double T21 = T(g, dim, g_lookup);
+    const double T21 = tr_wtw_ww;
     const double T2 = 1.0 / (T1 + T21);
 
     RS /= (1.0 / T2 - T21);
@@ -385,38 +306,8 @@ double Compute_MoranZ(GalElement* g,
 		matrixB3[i].alloc(k);
 	}
 	
-	double s = 0.0;
-	// Make a sparse, fast lookup version of W using hash tables
-	// Note: following map can be either std::map or boost::unordered_map
-	// unordered map is a hash table but has slower iterator access, while
-	// map is a tree but has a fast iterator.
-	vector< boost::unordered_map<int, double> > W_map(n);   // W
-	vector< boost::unordered_map<int, double> > Wt_map(n);  // W'
-	vector< map<int, bool> > B(n); // union of pattern of non-zeros in W and W'
-	for (int i=0; i<n; i++) {
-		Link *r = W.getRow(i).getNb();
-		for (int nb=0, nb_sz=W.getRow(i).getSize(); nb<nb_sz; nb++) {
-			int j=r[nb].getIx();
-			double Wij = r[nb].getWeight();
-			W_map[i][j] = Wij;
-			Wt_map[j][i] = Wij;
-			B[i][j] = true;
-			B[j][i] = true;
-		}
-	}
-	for (int i=0; i<n; i++) {
-		boost::unordered_map<int, double>::iterator it;
-		for (map<int, bool>::iterator B_it = B[i].begin();
-			 B_it != B[i].end(); ++B_it) {
-			int j = B_it->first;
-			it = W_map[i].find(j);
-			double Wij = (it != W_map[i].end()) ? Wij = it->second : 0;
-			it = W_map[j].find(i);
-			double Wji = (it != W_map[j].end()) ? Wji = it->second : 0;
-			s += geoda_sqr(Wij + Wji);
-		}
-	}
-	s *= 0.5;
+	// 0.5 * sum (Wij + Wji)^2 = tr(W'W + WW), for the binary W above
+	const double s = CsrWeight(g, n).TraceWtWPlusWW(true);
 	
 	// A = (X'X)^-1X'WX 
 	for (int i=0; i<k; i++) {
@@ -490,7 +381,7 @@ double Compute_MoranZ(GalElement* g,
 void Compute_RSLmError(GalElement* g,
 					   double *resid,
 					   int dim, double *rst,
-					   const std::vector< std::set<int> >& g_lookup)
+					   double tr_wtw_ww)
 {
     double const ee = norm(resid, dim);
     double const sigma2	=  ee / (dim);
@@ -505,7 +396,7 @@ void Compute_RSLmError(GalElement* g,
 
     double RS = geoda_sqr(re.product( lag ) / sigma2); // [e'We/sigma2]^2
 
-    double t = T(g, dim, g_lookup); // tr[(W'+W)*W]
+    double t = tr_wtw_ww; // tr[(W'+W)*W]
     RS /= t;
     
 	double const RS_stat = gammp( 0.5, RS * 0.5);
@@ -523,7 +414,7 @@ void Compute_RSLmErrorRobust(GalElement* g,
 							 int dim,
 							 int expl,
 							 double *rst,
-							 const std::vector< std::set<int> >& g_lookup)
+							 double tr_wtw_ww)
 {
     double *Y = y.getThis();
     double const ee = norm(resid, dim);
@@ -556,7 +447,7 @@ void Compute_RSLmErrorRobust(GalElement* g,
     // z.product(z2) : (WXb)'(X(X'X)^(-1)X')(WXb)
     const double T11 = Wy.norm() -  z.product(z2);
     const double T1 = T11 / sigma2;
-    const double T21 = T(g, dim, g_lookup);
+    const double T21 = tr_wtw_ww;
     const double T2 = 1.0 / (T1 + T21);
 
     const double RS = geoda_sqr(RS2 - (RS1 * T2 * T21)) / (T21-(T21*T21*T2));
@@ -576,7 +467,7 @@ void Compute_RSLmSarma(GalElement* g,
 					   int dim,
 					   int expl,
 					   double *rst,
-					   const std::vector< std::set<int> >& g_lookup)
+					   double tr_wtw_ww)
 {
     double *Y = y.getThis();
     double const ee = norm(resid, dim);
@@ -609,7 +500,7 @@ void Compute_RSLmSarma(GalElement* g,
     // z.product(z2) : (WXb)'(X(X'X)^(-1)X')(WXb)
     const double T11 = Wy.norm() -  z.product(z2);
     const double T1 = T11 / sigma2;
-    const double T21 = T(g, dim, g_lookup);
+    const double T21 = tr_wtw_ww;
     const double T2 = 1.0 / (T1 + T21);
 
     const double RS = (geoda_sqr(RS1 - RS2)/ (1.0/T2 - T21)) + (RS2*RS2/T21);
@@ -637,15 +528,6 @@ extern void cg(const SparseMatrix &m,
 							 const DenseVector &rhs, 
 							 DenseVector &sol);
 
-extern void run1(SparseMatrix &w, 
-				 const double rr, 
-				 double &trace, 
-				 double &trace2, 
-				 double &frobenius,
-				 wxGauge* p_bar,
-				 double p_bar_min_fraction,
-				 double p_bar_max_fraction);
-
 bool SymMatInverse(double ** mt, const int dim);
 
 
@@ -674,7 +556,8 @@ bool classicalRegression(GalElement *g,
 						 bool InclConstant,
 						 bool m_moranz,
 						 wxGauge* gauge,
-						 bool do_white_test)
+						 bool do_white_test,
+						 LogDetCache* cache)
 {
 	int g_rng = 100;
 	if (gauge) {
@@ -738,38 +621,38 @@ bool classicalRegression(GalElement *g,
 	// diagnostics for spatial dependence
 	if (g != NULL)
 	{
-		std::vector< std::set<int> > g_lookup;
-		MakeFastLookupMat(g, dim, g_lookup);
+		const double tr_wtw_ww = (cache && cache->GetNumObs() == dim) ?
+			cache->GetTraceWtWPlusWW() : CsrWeight(g, dim).TraceWtWPlusWW();
 		
 		double *rst = new double[2];
 
-		Compute_RSLmError(g, resid, dim, rst, g_lookup);
+		Compute_RSLmError(g, resid, dim, rst, tr_wtw_ww);
 		dr->SetLmError(0, 1.0);
 		dr->SetLmError(1, rst[0]);
 		dr->SetLmError(2, rst[1]);
 
 
 		Compute_RSLmErrorRobust(g, cov, y, x, ols, resid, dim, expl, rst,
-								g_lookup);
+								tr_wtw_ww);
 		dr->SetLmErrRobust(0, 1.0);
 		dr->SetLmErrRobust(1, rst[0]);
 		dr->SetLmErrRobust(2, rst[1]);
 
 
-		Compute_RSLmLag(g, cov, y, x, ols, resid, dim, expl, rst, g_lookup);
+		Compute_RSLmLag(g, cov, y, x, ols, resid, dim, expl, rst, tr_wtw_ww);
 		dr->SetLmLag(0, 1.0);
 		dr->SetLmLag(1, rst[0]);
 		dr->SetLmLag(2, rst[1]);
 
 
 		Compute_RSLmLagRobust(g, cov, y, x, ols, resid, dim, expl, rst,
-							  g_lookup);
+							  tr_wtw_ww);
 		dr->SetLmLagRobust(0, 1.0);
 		dr->SetLmLagRobust(1, rst[0]);
 		dr->SetLmLagRobust(2, rst[1]);
 
 
-		Compute_RSLmSarma(g, cov, y, x, ols, resid, dim, expl, rst, g_lookup);
+		Compute_RSLmSarma(g, cov, y, x, ols, resid, dim, expl, rst, tr_wtw_ww);
 		dr->SetLmSarma(0, 2.0);
 		dr->SetLmSarma(1, rst[0]);
 		dr->SetLmSarma(2, rst[1]);
@@ -901,7 +784,9 @@ bool spatialLagRegression(GalElement *g,
 						  int deps, 
 						  DiagnosticReport *dr, 
 						  bool InclConstant,
-						  wxGauge* p_bar)  
+						  wxGauge* p_bar,
+						  TraceEstimator::Method trace_method,
+						  LogDetCache* cache)  
 {
 	LOG_MSG("Entering spatialLagRegression, GalElement*");
 
@@ -916,7 +801,7 @@ bool spatialLagRegression(GalElement *g,
 	
 	initRho = SimulationLag(g, num_obs, 41, 0.31, Y, X, deps,
 							!InclConstant, &LogLike,
-							p_bar, 0, 0.1);
+							p_bar, 0, 0.1, cache);
 	SparseMatrix	orig(g, dim);
 
 	double **cov = new double * [deps];
@@ -944,13 +829,22 @@ bool spatialLagRegression(GalElement *g,
 	
 	double trace, trace2, fr;
 	
-	run1( orig, initRho, trace, trace2, fr, p_bar, 0.1, 0.55 );
+	TraceEstimator* tr_local = 0;
+	TraceEstimator* tr_est = 0;
+	if (cache && cache->GetNumObs() == n) {
+		tr_est = cache->GetTraceEstimator(trace_method);
+	}
+	if (!tr_est) tr_est = tr_local = new TraceEstimator(orig, trace_method);
+	tr_est->Compute( initRho, trace, trace2, fr, p_bar, 0.1, 0.55 );
 	// correction for rho:  m
 	// final rho: finRho
 	double m = mic(r, rw, initRho, trace, trace2);
 	double finRho = initRho - m;
 	
-	run1( orig, finRho, trace, trace2, fr, p_bar, 0.55, 1 );	
+	tr_est->Compute( finRho, trace, trace2, fr, p_bar, 0.55, 1 );
+	dr->SetTraceMethod(tr_est->GetMethodName(trace_method));
+	dr->SetTraceErrBound(tr_est->GetErrorBound());
+	if (tr_local) delete tr_local;
 	
 	// approximate computational error: m 
 	m = mic(r, rw, finRho, trace, trace2);
@@ -1161,7 +1055,9 @@ bool spatialErrorRegression(GalElement *g,
 							int deps, 
 							DiagnosticReport *rr, 
 							bool InclConstant,
-							wxGauge* p_bar)  
+							wxGauge* p_bar,
+							TraceEstimator::Method trace_method,
+							LogDetCache* cache)  
 {
 	typedef double* double_ptr_type;
 	DenseVector		y(Y, dim, false), *X = new DenseVector[deps];
@@ -1174,7 +1070,8 @@ bool spatialErrorRegression(GalElement *g,
 	
 	double LogLike = 0, initLambda = 0;
 	initLambda = SimulationError(g, num_obs, 100, 0.31, Y, XX, deps, beta,
-								 !InclConstant, &LogLike, p_bar, 0.0, 0.1 );
+								 !InclConstant, &LogLike, p_bar, 0.0, 0.1,
+								 cache);
 	release(&beta);
 	
 	double **cov = new double * [deps], *e_ols = new double [n];
@@ -1206,19 +1103,28 @@ bool spatialErrorRegression(GalElement *g,
 	orig.matrixColumn(lag_resid, resid);
 	double sigma2 = rsd.norm() / dim;
 	
-	orig.makeStdSymmetric();
-	run1( orig, initLambda, trace, trace2, fr, p_bar, 0.1, 0.55 );
-	orig.makeRowStd();
+	TraceEstimator* tr_local = 0;
+	TraceEstimator* tr_est = 0;
+	if (cache && cache->GetNumObs() == n) {
+		tr_est = cache->GetTraceEstimator(trace_method);
+	}
+	if (!tr_est) {
+		orig.makeStdSymmetric();
+		tr_est = tr_local = new TraceEstimator(orig, trace_method);
+		orig.makeRowStd();
+	}
+	tr_est->Compute( initLambda, trace, trace2, fr, p_bar, 0.1, 0.55 );
 	
 	// correction for lambda: m 
 	// final lambda: finLambda 
 	double m = mie(rsd, lag_resid, trace, trace2, y, X, orig, deps, initLambda);
 	const double lambda = initLambda - m;
 	
-	orig.makeStdSymmetric();
-	
-	run1( orig, lambda, trace, trace2, fr, p_bar, 0.55, 1 );
-	orig.makeRowStd();
+	// tr_est keeps its own copy of the symmetrized weights
+	tr_est->Compute( lambda, trace, trace2, fr, p_bar, 0.55, 1 );
+	rr->SetTraceMethod(tr_est->GetMethodName(trace_method));
+	rr->SetTraceErrBound(tr_est->GetErrorBound());
+	if (tr_local) delete tr_local;
 	
 	EGLS(lambda, y, X, orig, egls);
 	residual(y, X, egls, resid);
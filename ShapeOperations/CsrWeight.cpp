@@ -0,0 +1,179 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <utility>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include "GalWeight.h"
+#include "GwtWeight.h"
+#include "CsrWeight.h"
+
+CsrWeight::CsrWeight(const GalElement* gal, int num_obs_s)
+: num_obs(num_obs_s), max_nbrs(0)
+{
+	size_t nnz = 0;
+	for (int i=0; i<num_obs; i++) nnz += gal[i].Size();
+	row_ptr.resize(num_obs+1);
+	col_idx.resize(nnz);
+	weights.resize(nnz);
+	
+	size_t pos = 0;
+	for (int i=0; i<num_obs; i++) {
+		row_ptr[i] = pos;
+		const std::vector<long>& nbrs = gal[i].GetNbrs();
+		const std::vector<double>& w = gal[i].GetNbrWeights();
+		for (size_t j=0, sz=nbrs.size(); j<sz; j++, pos++) {
+			col_idx[pos] = (int) nbrs[j];
+			// GAL files read without weights leave nbrWeight empty
+			weights[pos] = j < w.size() ? w[j] : 1.0;
+		}
+	}
+	row_ptr[num_obs] = pos;
+	Finish();
+}
+
+CsrWeight::CsrWeight(const GwtElement* gwt, int num_obs_s)
+: num_obs(num_obs_s), max_nbrs(0)
+{
+	size_t nnz = 0;
+	for (int i=0; i<num_obs; i++) nnz += gwt[i].Size();
+	row_ptr.resize(num_obs+1);
+	col_idx.resize(nnz);
+	weights.resize(nnz);
+	
+	size_t pos = 0;
+	for (int i=0; i<num_obs; i++) {
+		row_ptr[i] = pos;
+		for (long j=0, sz=gwt[i].Size(); j<sz; j++, pos++) {
+			col_idx[pos] = (int) gwt[i].data[j].nbx;
+			weights[pos] = gwt[i].data[j].weight;
+		}
+	}
+	row_ptr[num_obs] = pos;
+	Finish();
+}
+
+CsrWeight::~CsrWeight()
+{
+}
+
+/** Compute the row sums and the maximum row cardinality once the rows are
+ filled. */
+void CsrWeight::Finish()
+{
+	row_sums.resize(num_obs);
+	for (int i=0; i<num_obs; i++) {
+		double s = 0;
+		for (size_t k=row_ptr[i]; k<row_ptr[i+1]; k++) s += weights[k];
+		row_sums[i] = s;
+		if (Size(i) > max_nbrs) max_nbrs = Size(i);
+	}
+}
+
+void CsrWeight::SpatialLag(const double* x, double* lag) const
+{
+	for (int i=0; i<num_obs; i++) lag[i] = SpatialLag(i, x);
+}
+
+double CsrWeight::TraceWtWPlusWW(bool binary) const
+{
+	// transpose of the row standardized W; filling it row by row leaves
+	// every transposed row sorted
+	std::vector<size_t> t_ptr(num_obs+1, 0);
+	std::vector<int> t_idx(col_idx.size());
+	std::vector<double> t_val(col_idx.size());
+	for (size_t k=0; k<col_idx.size(); k++) t_ptr[col_idx[k]+1]++;
+	for (int j=0; j<num_obs; j++) t_ptr[j+1] += t_ptr[j];
+	std::vector<size_t> pos(t_ptr.begin(), t_ptr.end()-1);
+	for (int i=0; i<num_obs; i++) {
+		if (IsEmptyRow(i, binary)) continue;
+		for (size_t k=row_ptr[i]; k<row_ptr[i+1]; k++) {
+			size_t p = pos[col_idx[k]]++;
+			t_idx[p] = i;
+			t_val[p] = StdWeight(i, k, binary);
+		}
+	}
+	// neighborless rows left gaps at the end of their columns
+	for (int j=0; j<num_obs; j++) {
+		for (size_t p=pos[j]; p<t_ptr[j+1]; p++) {
+			t_idx[p] = num_obs;
+			t_val[p] = 0;
+		}
+	}
+
+	int nCPUs = boost::thread::hardware_concurrency();
+	if (nCPUs < 1) nCPUs = 1;
+	if (num_obs < 1000) nCPUs = 1;
+	std::vector<double> out(nCPUs, 0);
+	boost::thread_group threadPool;
+	for (int t=0; t<nCPUs; t++) {
+		int start = (int) (((long long) num_obs * t) / nCPUs);
+		int end = (int) (((long long) num_obs * (t+1)) / nCPUs);
+		if (t == nCPUs-1) {
+			TraceWorker(start, end, binary, &t_ptr, &t_idx, &t_val, &out[t]);
+		} else {
+			threadPool.create_thread(boost::bind(&CsrWeight::TraceWorker,
+												 this, start, end, binary,
+												 &t_ptr, &t_idx, &t_val,
+												 &out[t]));
+		}
+	}
+	threadPool.join_all();
+	double sum = 0;
+	for (int t=0; t<nCPUs; t++) sum += out[t];
+	return sum;
+}
+
+/** Adds tr(W'W) and tr(WW) over rows [start, end) into out */
+void CsrWeight::TraceWorker(int start, int end, bool binary,
+							const std::vector<size_t>* t_ptr,
+							const std::vector<int>* t_idx,
+							const std::vector<double>* t_val,
+							double* out) const
+{
+	std::vector<std::pair<int, double> > row(max_nbrs);
+	double sum = 0;
+	for (int i=start; i<end; i++) {
+		if (IsEmptyRow(i, binary)) continue;
+		const int sz = Size(i);
+		for (int k=0; k<sz; k++) {
+			const double a = StdWeight(i, row_ptr[i]+k, binary);
+			row[k] = std::make_pair(col_idx[row_ptr[i]+k], a);
+			sum += a * a; // W'W
+		}
+		std::sort(row.begin(), row.begin()+sz);
+		// merge row i of W with row i of W' for sum_j w_ij * w_ji
+		size_t p = (*t_ptr)[i], p_end = (*t_ptr)[i+1];
+		int k = 0;
+		while (k < sz && p < p_end) {
+			const int j = row[k].first, jt = (*t_idx)[p];
+			if (j < jt) {
+				k++;
+			} else if (jt < j) {
+				p++;
+			} else {
+				sum += row[k].second * (*t_val)[p];
+				k++;
+				p++;
+			}
+		}
+	}
+	*out = sum;
+}
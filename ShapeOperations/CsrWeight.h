@@ -0,0 +1,124 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_CSR_WEIGHT_H__
+#define __GEODA_CENTER_CSR_WEIGHT_H__
+
+#include <cstddef>
+#include <vector>
+
+class GalElement;
+class GwtElement;
+
+/**
+ Immutable compressed sparse row (CSR) copy of a spatial weights matrix.
+ The neighbors of all observations are stored in one contiguous int array
+ and their weights in one contiguous double array, with row i occupying
+ [row_ptr[i], row_ptr[i+1]).  Row sums are precomputed so that row
+ standardized lags need no extra pass over the weights.
+
+ Once constructed a CsrWeight is never modified, so it can be shared
+ freely between worker threads.
+ */
+class CsrWeight
+{
+public:
+	/** O(1) view of the neighbors and weights of a single row.  Only valid
+	 as long as the CsrWeight it came from. */
+	struct Row {
+		Row(const int* nbrs_s, const double* weights_s, int size_s,
+			double row_sum_s)
+		: nbrs(nbrs_s), weights(weights_s), size(size_s), row_sum(row_sum_s) {}
+		int Size() const { return size; }
+		int operator[](int k) const { return nbrs[k]; }
+		double Weight(int k) const { return weights[k]; }
+
+		const int* nbrs;
+		const double* weights;
+		int size;
+		double row_sum;
+	};
+
+	CsrWeight(const GalElement* gal, int num_obs);
+	CsrWeight(const GwtElement* gwt, int num_obs);
+	virtual ~CsrWeight();
+
+	int GetNumObs() const { return num_obs; }
+	size_t GetNumNonZero() const { return col_idx.size(); }
+	int GetMaxNbrs() const { return max_nbrs; }
+
+	Row GetRow(int i) const {
+		if (col_idx.empty()) return Row(0, 0, 0, 0);
+		return Row(&col_idx[0] + row_ptr[i], &weights[0] + row_ptr[i],
+				   (int) (row_ptr[i+1]-row_ptr[i]), row_sums[i]);
+	}
+	int Size(int i) const { return (int) (row_ptr[i+1]-row_ptr[i]); }
+	double GetRowSum(int i) const { return row_sums[i]; }
+
+	/** Row standardized spatial lag of observation i, same as
+	 GalElement::SpatialLag.  Returns 0 for neighborless observations. */
+	double SpatialLag(int i, const double* x) const {
+		if (row_sums[i] == 0) return 0;
+		double lag = 0;
+		for (size_t k=row_ptr[i], end=row_ptr[i+1]; k<end; ++k) {
+			lag += x[col_idx[k]] * weights[k];
+		}
+		return lag / row_sums[i];
+	}
+
+	/** Unweighted sum of x over the neighbors of observation i. */
+	double SumNbrs(int i, const double* x) const {
+		double s = 0;
+		for (size_t k=row_ptr[i], end=row_ptr[i+1]; k<end; ++k) {
+			s += x[col_idx[k]];
+		}
+		return s;
+	}
+
+	/** lag[i] = SpatialLag(i, x) for all observations */
+	void SpatialLag(const double* x, double* lag) const;
+
+	/** tr(W'W + WW) for the row standardized W, the variance term of the
+	 LM diagnostics and of Moran's I.  With binary the weights are taken
+	 as 1, as SparseMatrix does.  Each row, sorted, is merge-joined with
+	 the matching row of the transpose; rows are spread over all cores. */
+	double TraceWtWPlusWW(bool binary = false) const;
+
+private:
+	void Finish();
+	double StdWeight(int i, size_t k, bool binary) const {
+		return binary ? 1.0 / Size(i) : weights[k] / row_sums[i];
+	}
+	bool IsEmptyRow(int i, bool binary) const {
+		return binary ? Size(i) == 0 : row_sums[i] == 0;
+	}
+	void TraceWorker(int start, int end, bool binary,
+					 const std::vector<size_t>* t_ptr,
+					 const std::vector<int>* t_idx,
+					 const std::vector<double>* t_val, double* out) const;
+
+	int num_obs;
+	int max_nbrs;
+	std::vector<size_t> row_ptr; // num_obs+1 offsets into col_idx
+	std::vector<int> col_idx;
+	std::vector<double> weights;
+	std::vector<double> row_sums;
+};
+
+#endif
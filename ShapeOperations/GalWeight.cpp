@@ -24,6 +24,8 @@
 #include <map>
 #include <utility>
 #include <boost/uuid/uuid.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 #include <wx/filename.h>
 
 #include "../GenUtils.h"
@@ -200,14 +202,47 @@ double GalElement::SpatialLag(const std::vector<double>& x,
 }
 
 GalWeight::GalWeight(const GalWeight& gw)
-: GeoDaWeight(gw)
+: GeoDaWeight(gw), gal(0), csr(0), csr_gal(0)
 {
 	GalWeight::operator=(gw);
 }
 
+GalWeight::~GalWeight()
+{
+	if (gal) delete [] gal;
+	gal = 0;
+	if (csr) delete csr;
+	csr = 0;
+}
+
+const CsrWeight* GalWeight::GetCsr()
+{
+	wxMutexLocker lock(csr_mutex);
+	if (csr && csr_gal != gal) {
+		delete csr;
+		csr = 0;
+	}
+	if (!csr && gal) {
+		csr = new CsrWeight(gal, num_obs);
+		csr_gal = gal;
+	}
+	return csr;
+}
+
+void GalWeight::InvalidateCsr()
+{
+	wxMutexLocker lock(csr_mutex);
+	if (csr) delete csr;
+	csr = 0;
+	csr_gal = 0;
+}
+
 GalWeight& GalWeight::operator=(const GalWeight& gw)
 {
+	if (this == &gw) return *this;
 	GeoDaWeight::operator=(gw);
+	InvalidateCsr();
+	if (gal) delete [] gal;
 	gal = new GalElement[num_obs];
     
     for (int i=0; i<num_obs; ++i) {
@@ -480,49 +515,112 @@ bool Gda::SaveSpaceTimeGal(const GalElement* g,
 
 
 
+namespace {
+	/** Shared state of the MakeHigherOrdContiguity worker threads.  W is
+	 only read while the workers run; each worker writes the rows of X it
+	 claimed from the block queue. */
+	struct HigherOrdContiguityJob {
+		const GalElement* W;
+		size_t obs;
+		size_t distance;
+		bool cummulative;
+		std::vector<std::vector<long> >* X;
+		size_t block_size;
+		size_t next_obs;
+		boost::mutex next_obs_mutex;
+		
+		bool GetNextBlock(size_t& start, size_t& end) {
+			boost::mutex::scoped_lock lock(next_obs_mutex);
+			if (next_obs >= obs) return false;
+			start = next_obs;
+			end = std::min(obs, next_obs + block_size);
+			next_obs = end;
+			return true;
+		}
+	};
+	
+	/** Breadth-first search from every observation of the claimed blocks.
+	 stamp[v] == i+1 marks v as visited from i, so the visited array is
+	 never cleared between observations. */
+	void HigherOrdContiguityWorker(HigherOrdContiguityJob* job)
+	{
+		using namespace std;
+		const GalElement* W = job->W;
+		vector<size_t> stamp(job->obs, 0);
+		vector<long> frontier;
+		vector<long> next;
+		size_t start, end;
+		while (job->GetNextBlock(start, end)) {
+			for (size_t i=start; i<end; ++i) {
+				const size_t mark = i+1;
+				vector<long>& X_i = (*job->X)[i];
+				stamp[i] = mark;
+				frontier.clear();
+				frontier.push_back(i);
+				for (size_t d=1; d<=job->distance && !frontier.empty(); ++d) {
+					next.clear();
+					for (size_t f=0, fsz=frontier.size(); f<fsz; ++f) {
+						const GalElement& W_f = W[frontier[f]];
+						for (size_t j=0, sz=W_f.Size(); j<sz; ++j) {
+							long nbr = W_f[j];
+							if (stamp[nbr] != mark) {
+								stamp[nbr] = mark;
+								next.push_back(nbr);
+							}
+						}
+					}
+					if (job->cummulative || d == job->distance) {
+						X_i.insert(X_i.end(), next.begin(), next.end());
+					}
+					frontier.swap(next);
+				}
+				sort(X_i.begin(), X_i.end(), greater<long>());
+			}
+		}
+	}
+}
+
 /** Add higher order neighbors up to (and including) distance. 
  If cummulative true, then include lower orders as well.  Otherwise,
- only include elements on frontier. */
+ only include elements on frontier.  Observations are processed by a pool
+ of threads, and W is only updated once all of them have finished. */
 void Gda::MakeHigherOrdContiguity(size_t distance, size_t obs, GalElement* W,
 																	bool cummulative)
 {	
 	using namespace std;
 	if (obs < 1 || distance <=1) return;
 	vector<vector<long> > X(obs);
-	for (size_t i=0; i<obs; ++i) {
-		vector<set<long> > n_at_d(distance+1);
-		n_at_d[0].insert(i);
-		for (size_t j=0, sz=W[i].Size(); j<sz; ++j) {
-			n_at_d[1].insert(W[i][j]);
-		}
-		for (size_t d=2; d<=distance; ++d) {
-			for (set<long>::const_iterator it=n_at_d[d-1].begin();
-					 it!=n_at_d[d-1].end(); ++it)
-			{
-				for (size_t j=0, sz=W[*it].Size(); j<sz; ++j) {
-					long nbr = W[*it][j];
-					if (n_at_d[d-1].find(nbr) == n_at_d[d-1].end() &&
-							n_at_d[d-2].find(nbr) == n_at_d[d-2].end()) {
-						n_at_d[d].insert(nbr);
-					}
-				}
-			}
-		}
-		size_t sz_Xi = 0;
-		for (size_t d=(cummulative ? 1 : distance); d<=distance; ++d) {
-			sz_Xi += n_at_d[d].size();
-		}
-		X[i].resize(sz_Xi);
-		size_t cnt=0;
-		for (size_t d=(cummulative ? 1 : distance); d<=distance; ++d) {
-			for (set<long>::const_iterator it=n_at_d[d].begin();
-					 it!=n_at_d[d].end(); ++it) { X[i][cnt++] = *it; }
+	
+	HigherOrdContiguityJob job;
+	job.W = W;
+	job.obs = obs;
+	job.distance = distance;
+	job.cummulative = cummulative;
+	job.X = &X;
+	job.next_obs = 0;
+	
+	int nCPUs = boost::thread::hardware_concurrency();
+	if (nCPUs < 1) nCPUs = 1;
+	// small blocks keep the threads balanced when neighborhood sizes vary
+	job.block_size = obs / (nCPUs * 16);
+	if (job.block_size < 1) job.block_size = 1;
+	if (job.block_size > 1024) job.block_size = 1024;
+	
+	if (nCPUs == 1 || obs < 1024) {
+		HigherOrdContiguityWorker(&job);
+	} else {
+		boost::thread_group threadPool;
+		for (int t=0; t<nCPUs; t++) {
+			threadPool.create_thread(boost::bind(&HigherOrdContiguityWorker,
+												 &job));
 		}
-		sort(X[i].begin(), X[i].end(), greater<long>());
+		threadPool.join_all();
 	}
+	
 	for (size_t i=0; i<obs; ++i) {
 		W[i].SetSizeNbrs(X[i].size());
 		for (size_t j=0, sz=X[i].size(); j<sz; ++j) W[i].SetNbr(j, X[i][j]);
+		vector<long>().swap(X[i]);
 	}
 }
 
@@ -22,7 +22,9 @@
 
 #include <vector>
 #include <map>
+#include <wx/thread.h>
 #include "GeodaWeight.h"
+#include "CsrWeight.h"
 
 class Project;
 class WeightsManInterface;
@@ -58,9 +60,17 @@ class GalWeight : public GeoDaWeight {
 public:
 	GalElement* gal;
     
-	GalWeight() : gal(0) { weight_type = gal_type; }
+	GalWeight() : gal(0), csr(0), csr_gal(0) { weight_type = gal_type; }
 	GalWeight(const GalWeight& gw);
-	virtual ~GalWeight() { if (gal) delete [] gal; gal = 0; }
+	virtual ~GalWeight();
+    
+	/** Compressed sparse row copy of gal, built on first use.  Safe to call
+	 from several threads at once.  It is rebuilt if gal was replaced since
+	 the last call; code that modifies the elements of gal in place must
+	 call InvalidateCsr afterwards. */
+	const CsrWeight* GetCsr();
+	/** Drop the CSR copy.  Pointers returned by GetCsr become invalid. */
+	void InvalidateCsr();
     
 	static bool HasIsolates(GalElement *gal, int num_obs);
     
@@ -72,6 +82,11 @@ public:
                         std::vector<wxInt64>& stack_ids,
                         const wxString& ofname);
     virtual bool SaveSpaceTimeWeights(const wxString& ofname, WeightsManInterface* wmi, TableInterface* table_int);
+    
+private:
+	wxMutex csr_mutex; // guards csr and csr_gal
+	CsrWeight* csr;
+	const GalElement* csr_gal; // gal that csr was built from
 };
 
 namespace Gda {
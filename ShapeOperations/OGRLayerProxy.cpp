@@ -510,7 +510,9 @@ bool OGRLayerProxy::ReadData()
     }
 	int row_idx = 0;
 	OGRFeature *feature = NULL;
-    map<int, OGRFeature*> feature_dict;
+    // features returned by GetNextFeature() are owned by the caller, so keep
+    // them as they are instead of cloning each one
+    if (n_rows > 0) data.reserve(n_rows);
     layer->ResetReading();
 	while ((feature = layer->GetNextFeature()) != NULL) {
         if (feature == NULL) {
@@ -518,10 +520,11 @@ bool OGRLayerProxy::ReadData()
 		    << "\n\nDetails:"<< CPLGetLastErrorMsg();
             return false;
         }
-		if (stop_reading)
+		if (stop_reading) {
+            OGRFeature::DestroyFeature(feature);
             break;
-        long fid = feature->GetFID();
-        feature_dict[row_idx] = feature;
+        }
+        data.push_back(feature);
         // keep load_progress not 100%, so that it can finish this function
 		load_progress = row_idx++;
 	}
@@ -531,13 +534,7 @@ bool OGRLayerProxy::ReadData()
         return false;
     }
 	n_rows = row_idx;
-    for (int i = 0; i < n_rows; i++) {
-        OGRFeature* my_feature = feature_dict[i]->Clone();
-        data.push_back(my_feature);
-        OGRFeature::DestroyFeature(feature_dict[i]);
-    }
     load_progress = n_rows;
-    feature_dict.clear();
     
 	return true;
 }
@@ -711,7 +708,144 @@ bool OGRLayerProxy::GetExtent(double& minx, double& miny,
     return true;
 }
 
-bool OGRLayerProxy::ReadGeometries(Shapefile::Main& p_main)
+/**
+ * Convert the geometry of one feature.  Features without a geometry give an
+ * empty record of the layer type.  Returns NULL for unsupported (line)
+ * geometries.
+ */
+Shapefile::RecordContents* OGRLayerProxy::ReadGeometry(OGRFeature* feature)
+{
+	OGRGeometry* geometry= feature->GetGeometryRef();
+	OGRwkbGeometryType eType = geometry ? wkbFlatten(geometry->getGeometryType()) : eGType;
+	// sometime OGR can't return correct value from GetGeomType() call
+	if (eGType == wkbUnknown)
+        eGType = eType;
+    
+	if (eType == wkbPoint) {
+		Shapefile::PointContents* pc = new Shapefile::PointContents();
+		pc->shape_type = Shapefile::POINT_TYP;
+        if (geometry) {
+            OGRPoint* p = (OGRPoint *) geometry;
+            pc->x = p->getX();
+            pc->y = p->getY();
+        }
+		return pc;
+		
+	} else if (eType == wkbMultiPoint) {
+		Shapefile::PointContents* pc = new Shapefile::PointContents();
+		pc->shape_type = Shapefile::POINT_TYP;
+		if (geometry) {
+            OGRMultiPoint* mp = (OGRMultiPoint*) geometry;
+			int n_geom = mp->getNumGeometries();
+			for (size_t i = 0; i < n_geom; i++ )
+            {	
+				// only consider first point
+                OGRGeometry* ogrGeom = mp->getGeometryRef(i);
+                OGRPoint* p = static_cast<OGRPoint*>(ogrGeom);
+				pc->x = p->getX();
+				pc->y = p->getY();
+			}
+        }
+		return pc;
+		
+	} else if (eType == wkbPolygon ) {
+		Shapefile::PolygonContents* pc = new Shapefile::PolygonContents();
+		pc->shape_type = Shapefile::POLYGON;
+        if (geometry) {
+            OGRPolygon* p = (OGRPolygon *) geometry;
+            CopyEnvelope(p, pc);
+            OGRLinearRing* pLinearRing = NULL;
+            int numPoints= 0;
+            // interior rings
+            int ni_rings = p->getNumInteriorRings();
+            // resize parts memory, 1 is for exterior ring,
+            pc->num_parts = ni_rings + 1;
+            pc->parts.resize(pc->num_parts);
+            for (size_t j=0; j < pc->num_parts; j++ ) {
+                pLinearRing = j==0 ? 
+                    p->getExteriorRing() : p->getInteriorRing(j-1);
+                pc->parts[j] = numPoints;
+                if (pLinearRing)
+                    numPoints += pLinearRing->getNumPoints();
+            }
+            // resize points memory					
+            pc->num_points = numPoints;
+            pc->points.resize(pc->num_points);
+            // read points
+            int i=0;
+            for (size_t j=0; j < pc->num_parts; j++) {
+                pLinearRing = j==0 ?
+                    p->getExteriorRing() : p->getInteriorRing(j-1);
+                if (pLinearRing)
+                    for (size_t k=0; k < pLinearRing->getNumPoints(); k++){
+                        pc->points[i].x =  pLinearRing->getX(k);
+                        pc->points[i++].y =  pLinearRing->getY(k);
+                    }
+            }
+        }
+		return pc;
+        
+	} else if (eType == wkbMultiPolygon) {
+		Shapefile::PolygonContents* pc = new Shapefile::PolygonContents();
+		pc->shape_type = Shapefile::POLYGON;
+        if (geometry) {
+            OGRMultiPolygon* mpolygon = (OGRMultiPolygon *) geometry;
+            int n_geom = mpolygon->getNumGeometries();
+            // if there is more than one polygon, then we need to count which
+            // part is processing accumulatively
+            int part_idx = 0, numPoints = 0;
+            OGRLinearRing* pLinearRing = NULL;
+            int pidx =0;
+            for (size_t i = 0; i < n_geom; i++ )
+            {	
+                OGRGeometry* ogrGeom = mpolygon->getGeometryRef(i);
+                OGRPolygon* p = static_cast<OGRPolygon*>(ogrGeom);
+                if ( i == 0 ) {
+                    CopyEnvelope(p, pc);
+                } else {
+                    OGREnvelope pBox;
+                    p->getEnvelope(&pBox);
+                    if ( pc->box[0] > pBox.MinX ) pc->box[0] = pBox.MinX;
+                    if ( pc->box[1] > pBox.MinY ) pc->box[1] = pBox.MinY;
+                    if ( pc->box[2] < pBox.MaxX ) pc->box[2] = pBox.MaxX;
+                    if ( pc->box[3] < pBox.MaxY ) pc->box[3] = pBox.MaxY;
+                }
+                // number of interior rings + 1 exterior ring
+                int ni_rings = p->getNumInteriorRings()+1;
+                pc->num_parts += ni_rings;
+                pc->parts.resize(pc->num_parts);
+                
+                for (size_t j=0; j < ni_rings; j++) {
+                    pLinearRing = j==0 ? 
+                        p->getExteriorRing() : p->getInteriorRing(j-1);
+                    pc->parts[part_idx++] = numPoints;
+                    numPoints += pLinearRing->getNumPoints();
+                }
+                // resize points memory					
+                pc->num_points = numPoints;
+                pc->points.resize(pc->num_points);
+                // read points
+                for (size_t j=0; j < ni_rings; j++) {
+                    pLinearRing = j==0 ? 
+                        p->getExteriorRing() : p->getInteriorRing(j-1);
+                    for (int k=0; k < pLinearRing->getNumPoints(); k++) {
+                        pc->points[pidx].x = pLinearRing->getX(k);
+                        pc->points[pidx++].y = pLinearRing->getY(k);
+                    }
+                }
+            }
+        }
+		return pc;
+	}
+	return NULL;
+}
+
+Shapefile::RecordContents* OGRLayerProxy::ReadGeometry(int row_idx)
+{
+	return ReadGeometry(data[row_idx]);
+}
+
+void OGRLayerProxy::ReadGeometryHeader(Shapefile::Main& p_main)
 {
 	// get geometry envelope
 	OGREnvelope pEnvelope;
@@ -726,162 +860,32 @@ bool OGRLayerProxy::ReadGeometries(Shapefile::Main& p_main)
 	p_main.header.bbox_z_max = 0;
 	p_main.header.bbox_m_min = 0;
 	p_main.header.bbox_m_max = 0;
+}
+
+bool OGRLayerProxy::ReadGeometries(Shapefile::Main& p_main)
+{
+	ReadGeometryHeader(p_main);
     
 	// resize geometry records
 	p_main.records.resize(n_rows);
-	bool noExtent = (pEnvelope.MinX == pEnvelope.MaxX) &&
-                    (pEnvelope.MinY == pEnvelope.MaxY);
-    noExtent = false;
     
-	//read OGR geometry features
-	int feature_counter =0;
 	for ( int row_idx=0; row_idx < n_rows; row_idx++ ) {
-		OGRFeature* feature = data[row_idx];
-		OGRGeometry* geometry= feature->GetGeometryRef();
-		OGRwkbGeometryType eType = geometry ? wkbFlatten(geometry->getGeometryType()) : eGType;
-		// sometime OGR can't return correct value from GetGeomType() call
-		if (eGType == wkbUnknown)
-            eGType = eType;
-        
-		if (eType == wkbPoint) {
-			Shapefile::PointContents* pc = new Shapefile::PointContents();
-			pc->shape_type = Shapefile::POINT_TYP;
-            if (geometry) {
-                if (feature_counter==0)
-                    p_main.header.shape_type = Shapefile::POINT_TYP;
-                OGRPoint* p = (OGRPoint *) geometry;
-                pc->x = p->getX();
-                pc->y = p->getY();
-                if (noExtent)
-                    GetExtent(p_main, pc, row_idx);
-            }
-			p_main.records[feature_counter++].contents_p = pc;
-			
-		} else if (eType == wkbMultiPoint) {
-			Shapefile::PointContents* pc = new Shapefile::PointContents();
-			pc->shape_type = Shapefile::POINT_TYP;
-			if (geometry) {
-                if (feature_counter==0)
-                    p_main.header.shape_type = Shapefile::POINT_TYP;
-                OGRMultiPoint* mp = (OGRMultiPoint*) geometry;
-				int n_geom = mp->getNumGeometries();
-				for (size_t i = 0; i < n_geom; i++ )
-                {	
-					// only consider first point
-                    OGRGeometry* ogrGeom = mp->getGeometryRef(i);
-                    OGRPoint* p = static_cast<OGRPoint*>(ogrGeom);
-					pc->x = p->getX();
-					pc->y = p->getY();
-					if (noExtent)
-						GetExtent(p_main, pc, row_idx);
-					
-				}
-            }
-			p_main.records[feature_counter++].contents_p = pc;
-			
-		} else if (eType == wkbPolygon ) {
-			Shapefile::PolygonContents* pc = new Shapefile::PolygonContents();
-			pc->shape_type = Shapefile::POLYGON;
-            if (geometry) {
-                if (feature_counter==0)
-                    p_main.header.shape_type = Shapefile::POLYGON;
-                OGRPolygon* p = (OGRPolygon *) geometry;
-                CopyEnvelope(p, pc);
-                OGRLinearRing* pLinearRing = NULL;
-                int numPoints= 0;
-                // interior rings
-                int ni_rings = p->getNumInteriorRings();
-                // resize parts memory, 1 is for exterior ring,
-                pc->num_parts = ni_rings + 1;
-                pc->parts.resize(pc->num_parts);
-                for (size_t j=0; j < pc->num_parts; j++ ) {
-                    pLinearRing = j==0 ? 
-                        p->getExteriorRing() : p->getInteriorRing(j-1);
-                    pc->parts[j] = numPoints;
-                    if (pLinearRing)
-                        numPoints += pLinearRing->getNumPoints();
-                }
-                // resize points memory					
-                pc->num_points = numPoints;
-                pc->points.resize(pc->num_points);
-                // read points
-                int i=0;
-                for (size_t j=0; j < pc->num_parts; j++) {
-                    pLinearRing = j==0 ?
-                        p->getExteriorRing() : p->getInteriorRing(j-1);
-                    if (pLinearRing)
-                        for (size_t k=0; k < pLinearRing->getNumPoints(); k++){
-                            pc->points[i].x =  pLinearRing->getX(k);
-                            pc->points[i++].y =  pLinearRing->getY(k);
-                        }
-                }
-                if (noExtent)
-                    GetExtent(p_main, pc, row_idx);
-            }
-			p_main.records[feature_counter++].contents_p = pc;
-            
-		} else if (eType == wkbMultiPolygon) {
-			Shapefile::PolygonContents* pc = new Shapefile::PolygonContents();
-			pc->shape_type = Shapefile::POLYGON;
-            if (geometry) {
-                if (feature_counter==0)
-                    p_main.header.shape_type = Shapefile::POLYGON;
-                OGRMultiPolygon* mpolygon = (OGRMultiPolygon *) geometry;
-                int n_geom = mpolygon->getNumGeometries();
-                // if there is more than one polygon, then we need to count which
-                // part is processing accumulatively
-                int part_idx = 0, numPoints = 0;
-                OGRLinearRing* pLinearRing = NULL;
-                int pidx =0;
-                for (size_t i = 0; i < n_geom; i++ )
-                {	
-                    OGRGeometry* ogrGeom = mpolygon->getGeometryRef(i);
-                    OGRPolygon* p = static_cast<OGRPolygon*>(ogrGeom);
-                    if ( i == 0 ) {
-                        CopyEnvelope(p, pc);
-                    } else {
-                        OGREnvelope pBox;
-                        p->getEnvelope(&pBox);
-                        if ( pc->box[0] > pBox.MinX ) pc->box[0] = pBox.MinX;
-                        if ( pc->box[1] > pBox.MinY ) pc->box[1] = pBox.MinY;
-                        if ( pc->box[2] < pBox.MaxX ) pc->box[2] = pBox.MaxX;
-                        if ( pc->box[3] < pBox.MaxY ) pc->box[3] = pBox.MaxY;
-                    }
-                    // number of interior rings + 1 exterior ring
-                    int ni_rings = p->getNumInteriorRings()+1;
-                    pc->num_parts += ni_rings;
-                    pc->parts.resize(pc->num_parts);
-                    
-                    for (size_t j=0; j < ni_rings; j++) {
-                        pLinearRing = j==0 ? 
-                            p->getExteriorRing() : p->getInteriorRing(j-1);
-                        pc->parts[part_idx++] = numPoints;
-                        numPoints += pLinearRing->getNumPoints();
-                    }
-                    // resize points memory					
-                    pc->num_points = numPoints;
-                    pc->points.resize(pc->num_points);
-                    // read points
-                    for (size_t j=0; j < ni_rings; j++) {
-                        pLinearRing = j==0 ? 
-                            p->getExteriorRing() : p->getInteriorRing(j-1);
-                        for (int k=0; k < pLinearRing->getNumPoints(); k++) {
-                            pc->points[pidx].x = pLinearRing->getX(k);
-                            pc->points[pidx++].y = pLinearRing->getY(k);
-                        }
-                    }
-                    if (noExtent)
-                        GetExtent(p_main, pc, row_idx);
-                }
-            }
-			p_main.records[feature_counter++].contents_p = pc;
-            
-        } else {
+        Shapefile::RecordContents* rc = ReadGeometry(data[row_idx]);
+        if (rc == NULL) {
             std::string open_err_msg = "GeoDa does not support datasource with line data at this time.  Please choose a datasource with either point or polygon data.";
             throw GdaException(open_err_msg.c_str());
         }
+		p_main.records[row_idx].contents_p = rc;
 	}
     
+    if (n_rows > 0) {
+        if (dynamic_cast<Shapefile::PointContents*>(
+                                            p_main.records[0].contents_p)) {
+            p_main.header.shape_type = Shapefile::POINT_TYP;
+        } else {
+            p_main.header.shape_type = Shapefile::POLYGON;
+        }
+    }
 	return true;
 }
 
@@ -97,6 +97,8 @@ private:
                    int row_idx);
     
     void CopyEnvelope(OGRPolygon* p, Shapefile::PolygonContents* pc);
+    
+    Shapefile::RecordContents* ReadGeometry(OGRFeature* feature);
 	
     /**
 	 * Read field information and save to OGRFieldProxy array.
@@ -140,6 +142,15 @@ public:
 	 * Read geometries and save to Shapefile::Main data structure.
 	 */
 	bool ReadGeometries(Shapefile::Main& p_main);
+    /**
+     * Set the extent of the layer in the header of p_main.
+     */
+    void ReadGeometryHeader(Shapefile::Main& p_main);
+    /**
+     * Convert the geometry of one row.  Only reads the OGRFeature, so it can
+     * run on a worker thread once the first row has been converted.
+     */
+    Shapefile::RecordContents* ReadGeometry(int row_idx);
     bool AddGeometries(Shapefile::Main& p_main);
 
 	/**
@@ -0,0 +1,240 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <boost/bind.hpp>
+#include "PolygonLod.h"
+
+using namespace Shapefile;
+
+PolygonLod::PolygonLod(const std::vector<PolygonContents*>& polys_s)
+: polys(polys_s), worker(0), ready(false), cancelled(false)
+{
+	for (int k=0; k<num_levels; k++) {
+		tolerances[k] = 0;
+		levels[k].stored = false;
+	}
+}
+
+PolygonLod::~PolygonLod()
+{
+	if (!worker) return;
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		cancelled = true;
+	}
+	worker->join();
+	delete worker;
+}
+
+void PolygonLod::StartBackground(const boost::function<void ()>& on_ready_s)
+{
+	if (worker || polys.empty()) return;
+	on_ready = on_ready_s;
+	worker = new boost::thread(boost::bind(&PolygonLod::Build, this));
+}
+
+bool PolygonLod::IsReady()
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return ready;
+}
+
+int PolygonLod::ChooseLevel(double scale, double max_err) const
+{
+	if (scale <= 0) return -1;
+	for (int k=num_levels-1; k>=0; k--) {
+		if (tolerances[k] * scale <= max_err) {
+			return levels[k].stored ? k : -1;
+		}
+	}
+	return -1;
+}
+
+/** Squared distance from p to the segment [a, b] */
+static double segDist2(const Point& p, const Point& a, const Point& b)
+{
+	double dx = b.x - a.x, dy = b.y - a.y;
+	double len2 = dx*dx + dy*dy;
+	double t = 0;
+	if (len2 > 0) {
+		t = ((p.x - a.x)*dx + (p.y - a.y)*dy) / len2;
+		if (t < 0) t = 0;
+		if (t > 1) t = 1;
+	}
+	double ex = a.x + t*dx - p.x, ey = a.y + t*dy - p.y;
+	return ex*ex + ey*ey;
+}
+
+/** Douglas-Peucker significance of the vertices of the ring [s, t): a
+ vertex is kept for every tolerance whose square is below sig.  A vertex
+ split off a segment can not outlive the vertex that made the segment, so
+ its significance is capped by that of its parent, and keeping the
+ vertices with sig > tol^2 gives exactly the Douglas-Peucker result for
+ tol.  The first and last vertex, the vertex farthest from the first and
+ the most significant of the others are always kept, which leaves at
+ least a triangle. */
+static void ringSignificance(const std::vector<Point>& pts, int s, int t,
+							 std::vector<double>& sig)
+{
+	const double inf = std::numeric_limits<double>::infinity();
+	if (t - s <= 4) {
+		for (int i=s; i<t; i++) sig[i] = inf;
+		return;
+	}
+	for (int i=s; i<t; i++) sig[i] = 0;
+	sig[s] = inf;
+	sig[t-1] = inf;
+	int far = s+1;
+	double far_d = -1;
+	for (int i=s+1; i<t-1; i++) {
+		double dx = pts[i].x - pts[s].x, dy = pts[i].y - pts[s].y;
+		if (dx*dx + dy*dy > far_d) {
+			far_d = dx*dx + dy*dy;
+			far = i;
+		}
+	}
+	sig[far] = inf;
+
+	// segments (a, b) still to split, with the significance of their parent
+	std::vector<std::pair<std::pair<int, int>, double> > stack;
+	stack.push_back(std::make_pair(std::make_pair(s, far), inf));
+	stack.push_back(std::make_pair(std::make_pair(far, t-1), inf));
+	while (!stack.empty()) {
+		int a = stack.back().first.first;
+		int b = stack.back().first.second;
+		double parent = stack.back().second;
+		stack.pop_back();
+		if (b - a < 2) continue;
+		int k = a+1;
+		double d = -1;
+		for (int i=a+1; i<b; i++) {
+			double di = segDist2(pts[i], pts[a], pts[b]);
+			if (di > d) {
+				d = di;
+				k = i;
+			}
+		}
+		sig[k] = std::min(d, parent);
+		stack.push_back(std::make_pair(std::make_pair(a, k), sig[k]));
+		stack.push_back(std::make_pair(std::make_pair(k, b), sig[k]));
+	}
+
+	int best = -1;
+	for (int i=s+1; i<t-1; i++) {
+		if (sig[i] < inf && (best < 0 || sig[i] > sig[best])) best = i;
+	}
+	if (best >= 0) sig[best] = inf;
+}
+
+void PolygonLod::AddRecord(int rec, std::vector<double>& sig)
+{
+	const PolygonContents* pc = polys[rec];
+	bool is_null = !pc || pc->shape_type == 0 || pc->num_points == 0;
+	int num_parts = is_null ? 0 : pc->num_parts;
+	int num_points = is_null ? 0 : (int) pc->points.size();
+	if (num_points > (int) sig.size()) sig.resize(num_points);
+
+	for (int j=0; j<num_parts; j++) {
+		int s = pc->parts[j];
+		int t = j+1 < num_parts ? pc->parts[j+1] : num_points;
+		if (s < 0 || t > num_points || s >= t) continue;
+		ringSignificance(pc->points, s, t, sig);
+	}
+
+	for (int k=0; k<num_levels; k++) {
+		Level& l = levels[k];
+		double tol = tolerances[k];
+		double tol2 = tol*tol;
+		for (int j=0; j<num_parts; j++) {
+			int s = pc->parts[j];
+			int t = j+1 < num_parts ? pc->parts[j+1] : num_points;
+			if (s < 0 || t > num_points || s >= t) continue;
+			if (j > 0) {
+				double x_min = pc->points[s].x, x_max = x_min;
+				double y_min = pc->points[s].y, y_max = y_min;
+				for (int i=s+1; i<t; i++) {
+					x_min = std::min(x_min, pc->points[i].x);
+					x_max = std::max(x_max, pc->points[i].x);
+					y_min = std::min(y_min, pc->points[i].y);
+					y_max = std::max(y_max, pc->points[i].y);
+				}
+				if (x_max - x_min < tol && y_max - y_min < tol) continue;
+			}
+			for (int i=s; i<t; i++) {
+				if (sig[i] > tol2) l.ids.push_back(i);
+			}
+			l.ring_end.push_back(l.ids.size());
+		}
+		l.rec_rings.push_back(l.ring_end.size());
+	}
+}
+
+/** Runs on the worker thread, so no logging here */
+void PolygonLod::Build()
+{
+	int num_recs = polys.size();
+	double x_min = 0, y_min = 0, x_max = 0, y_max = 0;
+	bool first = true;
+	size_t tot_points = 0;
+	for (int i=0; i<num_recs; i++) {
+		const PolygonContents* pc = polys[i];
+		if (!pc || pc->shape_type == 0 || pc->num_points == 0) continue;
+		tot_points += pc->points.size();
+		if (first || pc->box[0] < x_min) x_min = pc->box[0];
+		if (first || pc->box[1] < y_min) y_min = pc->box[1];
+		if (first || pc->box[2] > x_max) x_max = pc->box[2];
+		if (first || pc->box[3] > y_max) y_max = pc->box[3];
+		first = false;
+	}
+	// the coarsest level is fine enough for a 128 pixel wide map
+	double tol = std::max(x_max - x_min, y_max - y_min) / 256;
+	for (int k=num_levels-1; k>=0; k--) {
+		tolerances[k] = tol;
+		tol /= lod_factor;
+		levels[k].rec_rings.push_back(0);
+	}
+
+	std::vector<double> sig;
+	for (int i=0; i<num_recs && tolerances[0] > 0; i++) {
+		if (i % 1024 == 0) {
+			boost::mutex::scoped_lock lock(mutex);
+			if (cancelled) return;
+		}
+		AddRecord(i, sig);
+	}
+
+	for (int k=0; k<num_levels; k++) {
+		Level& l = levels[k];
+		l.stored = (tolerances[0] > 0 && (int) l.rec_rings.size() == num_recs+1
+					&& l.ids.size() <= tot_points/2);
+		if (!l.stored) {
+			std::vector<int>().swap(l.rec_rings);
+			std::vector<int>().swap(l.ring_end);
+			std::vector<int>().swap(l.ids);
+		}
+	}
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		ready = true;
+	}
+	if (on_ready) on_ready();
+}
@@ -0,0 +1,110 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_POLYGON_LOD_H__
+#define __GEODA_CENTER_POLYGON_LOD_H__
+
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include "../ShpFile.h"
+
+/**
+ Douglas-Peucker simplifications of the polygons of a layer at several
+ tolerances, so that maps can draw far fewer vertices when zoomed out.
+ Each level keeps, for every ring, the indices of the vertices that
+ survive, which are also the indices of the screen points of a GdaPolygon
+ built from the same PolygonContents.  Level 0 has the smallest
+ tolerance; each following level has a tolerance lod_factor times larger.
+ A level that would keep more than half of the vertices is not stored,
+ since drawing it would save little.
+
+ Rings narrower than the tolerance of a level are dropped from it, except
+ for the first ring of each polygon, so that no polygon disappears.  The
+ simplification is only for drawing: hit testing uses the full polygons.
+
+ Project owns one cache for a polygon layer.  StartBackground builds it
+ on a worker thread; the cache is not used until IsReady.  It keeps
+ pointers to the PolygonContents, so it must be deleted before them.
+ */
+class PolygonLod
+{
+public:
+	static const int num_levels = 8;
+	static const int lod_factor = 4;
+
+	PolygonLod(const std::vector<Shapefile::PolygonContents*>& polys);
+	virtual ~PolygonLod();
+
+	/** on_ready, if set, is called on the worker thread once the levels
+	 are built, but not when the build is cancelled by the destructor. */
+	void StartBackground(const boost::function<void ()>& on_ready =
+						 boost::function<void ()>());
+	/** True once the levels are built.  Does not block. */
+	bool IsReady();
+
+	int GetNumRecords() const { return polys.size(); }
+	/** True if record rec was built from pc */
+	bool Matches(int rec, const Shapefile::PolygonContents* pc) const {
+		return rec >= 0 && rec < (int) polys.size() && polys[rec] == pc; }
+	double GetTolerance(int level) const { return tolerances[level]; }
+
+	/** Coarsest stored level whose tolerance is at most max_err pixels at
+	 scale pixels per map unit, or -1 if the full polygons should be
+	 drawn. */
+	int ChooseLevel(double scale, double max_err = 0.5) const;
+
+	/** Rings of record rec kept at level.  The point indices of kept ring
+	 j are [RingBegin(level, rec, j), RingEnd(level, rec, j)). */
+	int GetNumRings(int level, int rec) const {
+		return levels[level].rec_rings[rec+1] - levels[level].rec_rings[rec]; }
+	const int* RingBegin(int level, int rec, int j) const {
+		const Level& l = levels[level];
+		int r = l.rec_rings[rec] + j;
+		return &l.ids[0] + (r ? l.ring_end[r-1] : 0); }
+	const int* RingEnd(int level, int rec, int j) const {
+		const Level& l = levels[level];
+		return &l.ids[0] + l.ring_end[l.rec_rings[rec] + j]; }
+
+private:
+	PolygonLod(const PolygonLod&);
+	PolygonLod& operator=(const PolygonLod&);
+
+	struct Level {
+		std::vector<int> rec_rings; // size num records + 1
+		std::vector<int> ring_end; // cumulative sizes of the kept rings
+		std::vector<int> ids; // indices into PolygonContents::points
+		bool stored;
+	};
+
+	void Build();
+	void AddRecord(int rec, std::vector<double>& sig);
+
+	std::vector<Shapefile::PolygonContents*> polys;
+	double tolerances[num_levels];
+	Level levels[num_levels];
+	boost::thread* worker;
+	boost::function<void ()> on_ready;
+	boost::mutex mutex;
+	// guarded by mutex
+	bool ready;
+	bool cancelled;
+};
+
+#endif
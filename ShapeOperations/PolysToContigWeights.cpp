@@ -24,7 +24,12 @@
 #include <iomanip>
 #include <cmath>
 #include <time.h>
+#include <algorithm>
+#include <utility>
 #include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <wx/wxprec.h>
 #ifndef WX_PRECOMP
@@ -192,10 +197,33 @@ class PartitionP : public BasePartition  {
 	}
 };
 
+/**
+ The polygon a PolygonPartition works on, read in place from either a
+ PolygonContents or a record of a PolygonBuffer.  Consecutive coordinates
+ are stride doubles apart: 2 in the x, y pairs of a Shapefile::Point
+ array, 1 in the separate x and y arrays of a PolygonBuffer.
+ */
+struct PolygonView {
+	PolygonView() : x(0), y(0), stride(1), parts(0), num_parts(0),
+	num_points(0), box(0) {}
+	const double* x;
+	const double* y;
+	int stride;
+	const wxInt32* parts;
+	int num_parts;
+	int num_points;
+	const double* box; // min x, min y, max x, max y
+	
+	bool intersect(const PolygonView& p) const {
+		return !(p.box[0] > box[2] || p.box[1] > box[3] ||
+				 p.box[2] < box[0] || p.box[3] < box[1]);
+	}
+};
+
 class PolygonPartition 
 {
 	protected :
-	Shapefile::PolygonContents     *poly;	
+	const PolygonView&  poly;
 	
 	BasePartition       pX;
 	PartitionP          pY;
@@ -216,20 +244,21 @@ class PolygonPartition
 	int                 NumPoints;
 	int                 NumParts;
 	
-	PolygonPartition(Shapefile::PolygonContents* _poly)
-	: pX(), pY(), nbrPoints(NULL) {
-		poly = _poly;
-		NumPoints = poly->num_points;
-		NumParts = poly->num_parts;
+	PolygonPartition(const PolygonView& _poly)
+	: poly(_poly), pX(), pY(), nbrPoints(NULL) {
+		NumPoints = poly.num_points;
+		NumParts = poly.num_parts;
 	}
 	~PolygonPartition();
 	
-	Shapefile::Point* GetPoint(const int i){ return &poly->points[i];}
-	int GetPart(int i){ return (int)poly->parts[i]; }
-	double GetMinX(){ return (double)poly->box[0]; }
-	double GetMinY(){ return (double)poly->box[1]; }
-	double GetMaxX(){ return (double)poly->box[2]; }
-	double GetMaxY(){ return (double)poly->box[3]; }
+	Shapefile::Point GetPoint(const int i) {
+		return Shapefile::Point(poly.x[i*poly.stride], poly.y[i*poly.stride]);
+	}
+	int GetPart(int i){ return (int)poly.parts[i]; }
+	double GetMinX(){ return poly.box[0]; }
+	double GetMinY(){ return poly.box[1]; }
+	double GetMaxX(){ return poly.box[2]; }
+	double GetMaxY(){ return poly.box[3]; }
 	
 	int  MakePartition(int mX= 0, int mY= 0);
 	void MakeSmallPartition(const int mX, const double Start,
@@ -658,21 +687,21 @@ bool PolygonPartition::edge(PolygonPartition &p, const int host,
 	using namespace Shapefile;
 
 	
-	Point* guestPrev = p.GetPoint(p.prev(guest));
+	Point guestPrev = p.GetPoint(p.prev(guest));
 	//BasePoint hostPoint = Points[ succ(host) ];
-	Point* hostPoint = this->GetPoint(succ(host));
+	Point hostPoint = this->GetPoint(succ(host));
 	
-	if (hostPoint->equals(guestPrev, precision_threshold)) return true;
+	if (hostPoint.equals(guestPrev, precision_threshold)) return true;
 	
 	//BasePoint guestSucc= p.Points[ p.succ(guest) ];
-	Point* guestSucc= p.GetPoint(p.succ(guest));
-	if (hostPoint->equals( guestSucc, precision_threshold) ) return true;
+	Point guestSucc= p.GetPoint(p.succ(guest));
+	if (hostPoint.equals( guestSucc, precision_threshold) ) return true;
 	
 	hostPoint= this->GetPoint( prev(host) );
 	
-	if (hostPoint->equals( guestSucc, precision_threshold )) return true;
+	if (hostPoint.equals( guestSucc, precision_threshold )) return true;
 	
-	if (hostPoint->equals( guestPrev, precision_threshold )) return true;
+	if (hostPoint.equals( guestPrev, precision_threshold )) return true;
 	
 	return false;
 }
@@ -687,8 +716,8 @@ int PolygonPartition::MakePartition(int mX, int mY)  {
 	pY.alloc(NumPoints, mY, GetMaxY() - GetMinY());//bBox._max().y - bBox._min().y);
 	double xStart= GetMinX(), yStart= GetMinY();
 	for (int cnt= 0; cnt < NumPoints; ++cnt)  {
-		pX.include(cnt, GetPoint(cnt)->x - xStart);
-		pY.initIx(cnt, GetPoint(cnt)->y - yStart);
+		pX.include(cnt, poly.x[cnt*poly.stride] - xStart);
+		pY.initIx(cnt, poly.y[cnt*poly.stride] - yStart);
 	};
 	MakeNeighbors();
 	return 0;	
@@ -721,8 +750,8 @@ void PolygonPartition::MakeSmallPartition(const int mX, const double Start,
 {
 	pX.alloc(NumPoints, mX, Stop-Start);
 	for (int cnt= 0; cnt < NumPoints; ++cnt) {
-		Shapefile::Point* pt= GetPoint(cnt);
-		if (pt->x >= Start && pt->x <= Stop) pX.include(cnt, pt->x - Start);
+		double x = poly.x[cnt*poly.stride];
+		if (x >= Start && x <= Stop) pX.include(cnt, x - Start);
 	}
 	MakeNeighbors();
 }
@@ -739,7 +768,7 @@ int PolygonPartition::sweep(PolygonPartition & guest, bool is_queen,
 {
 	int       host, dot, cly, cell;
 	double    yStart= GetMinY(), yStop= GetMaxY();
-	Shapefile::Point* pt;
+	Shapefile::Point pt, hostPt;
 	guest.MakeSmallPartition(pX.Cells(), GetMinX(), GetMaxX());
 	for (cell= 0; cell < pX.Cells(); ++cell) {
 		for (host= pX.first(cell); host != GdaConst::EMPTY; host= pX.tail(host))
@@ -747,12 +776,13 @@ int PolygonPartition::sweep(PolygonPartition & guest, bool is_queen,
 		for (dot=guest.pX.first(cell); dot != GdaConst::EMPTY; dot=guest.pX.tail(dot))
         {
 			pt= guest.GetPoint(dot);
-			cly= pY.inTheRange(pt->y - yStart);
+			cly= pY.inTheRange(pt.y - yStart);
 			if (cly != -1) {
 				for (host= pY.first(cly); host != GdaConst::EMPTY;
 					 host= pY.tail(host))
                 {
-					if (pt->equals( GetPoint(host), precision_threshold) )
+					hostPt = GetPoint(host);
+					if (pt.equals( hostPt, precision_threshold) )
                     {
 						if (is_queen || edge(guest, host, dot, precision_threshold)) {
 							pY.cleanup(pX, cell);
@@ -1130,10 +1160,9 @@ static BasePartition  gMinX, gMaxX;
 static PartitionM * gY;
 
 
-GalElement* MakeContiguity(Shapefile::Main& main, bool is_queen,
-                           double precision_threshold=0.0)
+GalElement* MakeContiguity(const std::vector<PolygonView>& polys,
+                           bool is_queen, double precision_threshold=0.0)
 {
-	using namespace Shapefile;
 	int curr;
 	GalElement * gl= new GalElement [ gRecords ];
 	
@@ -1148,8 +1177,7 @@ GalElement* MakeContiguity(Shapefile::Main& main, bool is_queen,
 		// test each element in xmax[step]
 		for (curr= gMaxX.first(step); curr != GdaConst::EMPTY;
 				 curr= gMaxX.tail(curr))  {
-			PolygonContents* ply = dynamic_cast<PolygonContents*> (
-																														 main.records[curr].contents_p);
+			const PolygonView& ply = polys[curr];
 			PolygonPartition testPoly(ply);
 			testPoly.MakePartition();
 			
@@ -1165,9 +1193,8 @@ GalElement* MakeContiguity(Shapefile::Main& main, bool is_queen,
 			// test each potential neighbor
 			for (int nbr = Neighbors.Pop(); nbr != GdaConst::EMPTY;
 					 nbr = Neighbors.Pop()) {
-				PolygonContents* nbr_ply = dynamic_cast<PolygonContents*> (
-																																	 main.records[nbr].contents_p);
-				if (ply->intersect(nbr_ply)) {
+				const PolygonView& nbr_ply = polys[nbr];
+				if (ply.intersect(nbr_ply)) {
 					
 					PolygonPartition nbrPoly(nbr_ply);
 					//shp.seekg(gOffset[nbr]+12, ios::beg);
@@ -1220,17 +1247,389 @@ void MakeFull(GalElement* W, size_t obs)
 }
 
 
+/**
+ Grid of tiles over the extent of the map.  Every vertex belongs to
+ exactly one tile, the one it falls in, and a polygon is listed in every
+ tile its box overlaps.  A vertex shared by several polygons is therefore
+ seen with all of them in one tile, and tiles can be processed
+ independently.
+ */
+struct ContiguityTiles {
+	/** Polygons are listed in the tiles their box grown by margin
+	 overlaps. */
+	ContiguityTiles(const std::vector<PolygonView>& polys,
+					double min_x_s, double min_y_s, double max_x, double max_y,
+					int num_tiles, double margin=0);
+	
+	int TileX(double x) const { return Index(x, min_x, w, nx); }
+	int TileY(double y) const { return Index(y, min_y, h, ny); }
+	int Tile(const Shapefile::Point& p) const {
+		return TileY(p.y)*nx + TileX(p.x); }
+	int NumTiles() const { return nx*ny; }
+	
+	double min_x, min_y, w, h;
+	int nx, ny;
+	// polygons of tile t are poly_ids[tile_start[t]..tile_start[t+1])
+	std::vector<size_t> tile_start;
+	std::vector<int> poly_ids;
+	
+private:
+	static int Index(double v, double start, double len, int n) {
+		if (len <= 0) return 0;
+		double i = floor((v - start) / len);
+		if (i < 0) return 0;
+		if (i >= n) return n-1;
+		return (int) i;
+	}
+};
 
-GalElement* PolysToContigWeights(Shapefile::Main& main, bool is_queen,
-                    double precision_threshold)
+ContiguityTiles::ContiguityTiles(const std::vector<PolygonView>& polys,
+								 double min_x_s, double min_y_s,
+								 double max_x, double max_y, int num_tiles,
+								 double margin)
+: min_x(min_x_s), min_y(min_y_s), nx(1), ny(1)
+{
+	if (num_tiles < 1) num_tiles = 1;
+	nx = ny = (int) ceil(sqrt((double) num_tiles));
+	if (max_x <= min_x) nx = 1;
+	if (max_y <= min_y) ny = 1;
+	w = (max_x - min_x) / nx;
+	h = (max_y - min_y) / ny;
+	
+	int n = polys.size();
+	tile_start.assign(NumTiles()+1, 0);
+	for (int pass=0; pass<2; pass++) {
+		std::vector<size_t> pos(tile_start);
+		for (int i=0; i<n; i++) {
+			const PolygonView& v = polys[i];
+			if (v.num_points == 0) continue;
+			int x0 = TileX(v.box[0]-margin), x1 = TileX(v.box[2]+margin);
+			int y0 = TileY(v.box[1]-margin), y1 = TileY(v.box[3]+margin);
+			for (int ty=y0; ty<=y1; ty++) {
+				for (int tx=x0; tx<=x1; tx++) {
+					if (pass == 0) tile_start[ty*nx+tx+1]++;
+					else poly_ids[pos[ty*nx+tx]++] = i;
+				}
+			}
+		}
+		if (pass == 0) {
+			for (int t=0; t<NumTiles(); t++) tile_start[t+1] += tile_start[t];
+			poly_ids.resize(tile_start[NumTiles()]);
+		}
+	}
+}
+
+/**
+ Polygons sharing a key, a vertex for queen and an edge for rook
+ contiguity.  The polygons of a key are kept in a linked list of entries
+ rather than a vector per key, and as the polygons are added one at a time
+ the key repeating within a polygon is caught by looking at the head of
+ its list only.
+ */
+template <class Key>
+class SharedKeys {
+public:
+	void Add(const Key& k, int poly) {
+		std::pair<typename Map::iterator, bool> r =
+			first.insert(std::make_pair(k, (int) ent_poly.size()));
+		if (!r.second) {
+			int head = r.first->second;
+			if (ent_poly[head] == poly) return;
+			r.first->second = ent_poly.size();
+			ent_next.push_back(head);
+		} else {
+			ent_next.push_back(-1);
+		}
+		ent_poly.push_back(poly);
+	}
+	/** Appends a pair i < j for every two polygons sharing a key */
+	void GetPairs(std::vector<std::pair<int, int> >& pairs) const {
+		for (typename Map::const_iterator it=first.begin(); it!=first.end();
+			 ++it) {
+			for (int a=it->second; a != -1; a=ent_next[a]) {
+				for (int b=ent_next[a]; b != -1; b=ent_next[b]) {
+					int i = ent_poly[a], j = ent_poly[b];
+					pairs.push_back(i < j ? std::make_pair(i, j)
+									: std::make_pair(j, i));
+				}
+			}
+		}
+	}
+	void Clear() { first.clear(); ent_poly.clear(); ent_next.clear(); }
+	
+private:
+	typedef boost::unordered_map<Key, int> Map;
+	Map first; // key -> last entry added for it
+	std::vector<int> ent_poly;
+	std::vector<int> ent_next;
+};
+
+/** Previous and next point of point k on the ring [first, last), skipping
+ the point closing the ring like PolygonPartition::MakeNeighbors. */
+inline int ringPrev(int k, int first, int last) {
+	return (k > first) ? k-1 : std::max(first, last-2);
+}
+inline int ringSucc(int k, int first, int last) {
+	return (k < last-1) ? k+1 : std::min(first+1, last-1);
+}
+
+/**
+ Vertices hashed on a grid of cells as wide as the precision threshold, so
+ that two vertices within the threshold of each other, the
+ Shapefile::Point::equals test, fall in the same or in adjacent cells.
+ Each vertex is only compared with the vertices in its own cell and in
+ four of its eight adjacent cells, which finds every close pair once in a
+ single pass over the vertices.  For rook contiguity the points before and
+ after the two vertices must also match, as in PolygonPartition::edge.
+ */
+class SnapGrid {
+public:
+	SnapGrid(double tol_s) : tol(tol_s) {}
+	
+	/** inside is false for vertices of the margin around a tile: they are
+	 only used to find the pairs of the vertices inside it. */
+	void Add(const PolygonView& v, int poly, int k, int first, int last,
+			 bool inside) {
+		Vertex vx;
+		vx.x = v.x[k*v.stride];
+		vx.y = v.y[k*v.stride];
+		vx.poly = poly;
+		vx.k = k;
+		vx.first = first;
+		vx.last = last;
+		vx.inside = inside;
+		cells.insert(std::make_pair(GetCell(vx.x, vx.y),
+									(int) vertices.size()));
+		vertices.push_back(vx);
+	}
+	void GetPairs(const std::vector<PolygonView>& polys, bool is_queen,
+				  std::vector<std::pair<int, int> >& pairs) const {
+		static const int off[5][2] = { {0,0}, {1,-1}, {1,0}, {1,1}, {0,1} };
+		for (int a=0, sz=vertices.size(); a<sz; a++) {
+			const Vertex& va = vertices[a];
+			Cell c = GetCell(va.x, va.y);
+			for (int o=0; o<5; o++) {
+				Cell nc(c.first + off[o][0], c.second + off[o][1]);
+				std::pair<Map::const_iterator, Map::const_iterator> r =
+					cells.equal_range(nc);
+				for (Map::const_iterator it=r.first; it!=r.second; ++it) {
+					int b = it->second;
+					if (o == 0 && b <= a) continue;
+					const Vertex& vb = vertices[b];
+					if (va.poly == vb.poly || (!va.inside && !vb.inside) ||
+						!Near(va.x, va.y, vb.x, vb.y)) continue;
+					if (!is_queen && !SharesEdge(polys, va, vb)) continue;
+					pairs.push_back(va.poly < vb.poly ?
+									std::make_pair(va.poly, vb.poly) :
+									std::make_pair(vb.poly, va.poly));
+				}
+			}
+		}
+	}
+	void Clear() { cells.clear(); vertices.clear(); }
+	
+private:
+	struct Vertex {
+		double x, y;
+		int poly, k, first, last;
+		bool inside;
+	};
+	typedef std::pair<long long, long long> Cell;
+	typedef boost::unordered_multimap<Cell, int> Map;
+	
+	Cell GetCell(double x, double y) const {
+		return Cell((long long) floor(x/tol), (long long) floor(y/tol));
+	}
+	bool Near(double x1, double y1, double x2, double y2) const {
+		return fabs(x1-x2) <= tol && fabs(y1-y2) <= tol;
+	}
+	bool NearPt(const PolygonView& v1, int k1,
+				const PolygonView& v2, int k2) const {
+		return Near(v1.x[k1*v1.stride], v1.y[k1*v1.stride],
+					v2.x[k2*v2.stride], v2.y[k2*v2.stride]);
+	}
+	bool SharesEdge(const std::vector<PolygonView>& polys,
+					const Vertex& h, const Vertex& g) const {
+		const PolygonView& hv = polys[h.poly];
+		const PolygonView& gv = polys[g.poly];
+		int h_prev = ringPrev(h.k, h.first, h.last);
+		int h_succ = ringSucc(h.k, h.first, h.last);
+		int g_prev = ringPrev(g.k, g.first, g.last);
+		int g_succ = ringSucc(g.k, g.first, g.last);
+		return (NearPt(hv, h_succ, gv, g_prev) ||
+				NearPt(hv, h_succ, gv, g_succ) ||
+				NearPt(hv, h_prev, gv, g_succ) ||
+				NearPt(hv, h_prev, gv, g_prev));
+	}
+	
+	double tol;
+	Map cells;
+	std::vector<Vertex> vertices;
+};
+
+/** Finds the neighbor pairs of the tiles t_start, t_start + t_step, ...
+ and appends them to pairs, sorted and without duplicates per tile.
+ Vertices are matched exactly when tol is 0, and otherwise within tol on a
+ SnapGrid that also holds the vertices up to tol outside the tile. */
+static void ContiguityTileWorker(const std::vector<PolygonView>* polys,
+								 const ContiguityTiles* tiles, bool is_queen,
+								 double tol, int t_start, int t_step,
+								 std::vector<std::pair<int, int> >* pairs)
 {
 	using namespace Shapefile;
+	SharedKeys<Point> vertices;
+	SharedKeys<Edge> edges;
+	SnapGrid grid(tol);
+	std::vector<std::pair<int, int> > tile_pairs;
+	for (int t=t_start; t<tiles->NumTiles(); t+=t_step) {
+		int tx = t % tiles->nx, ty = t / tiles->nx;
+		for (size_t p=tiles->tile_start[t]; p<tiles->tile_start[t+1]; p++) {
+			int id = tiles->poly_ids[p];
+			const PolygonView& v = (*polys)[id];
+			for (int part=0; part<v.num_parts; part++) {
+				int first = v.parts[part];
+				int last = (part+1 < v.num_parts) ? v.parts[part+1] : v.num_points;
+				if (first < 0 || last > v.num_points) continue;
+				for (int k=first; k<last; k++) {
+					Point pt(v.x[k*v.stride], v.y[k*v.stride]);
+					if (tol > 0) {
+						if (tiles->TileX(pt.x-tol) > tx ||
+							tiles->TileX(pt.x+tol) < tx ||
+							tiles->TileY(pt.y-tol) > ty ||
+							tiles->TileY(pt.y+tol) < ty) continue;
+						grid.Add(v, id, k, first, last, tiles->Tile(pt) == t);
+						continue;
+					}
+					if (is_queen) {
+						if (tiles->Tile(pt) == t) vertices.Add(pt, id);
+						continue;
+					}
+					// rings are closed, but close them if they are not
+					int k2 = (k+1 < last) ? k+1 : first;
+					Point pt2(v.x[k2*v.stride], v.y[k2*v.stride]);
+					if (pt == pt2) continue;
+					Edge e(pt, pt2);
+					if (tiles->Tile(e.a) == t) edges.Add(e, id);
+				}
+			}
+		}
+		tile_pairs.clear();
+		if (tol > 0) grid.GetPairs(*polys, is_queen, tile_pairs);
+		else if (is_queen) vertices.GetPairs(tile_pairs);
+		else edges.GetPairs(tile_pairs);
+		vertices.Clear();
+		edges.Clear();
+		grid.Clear();
+		std::sort(tile_pairs.begin(), tile_pairs.end());
+		pairs->insert(pairs->end(), tile_pairs.begin(),
+					  std::unique(tile_pairs.begin(), tile_pairs.end()));
+	}
+}
+
+/** Sorts and sets the neighbors of rows [start, end) from nbrs */
+static void ContiguityRowWorker(int start, int end,
+								const std::vector<size_t>* nbr_start,
+								std::vector<int>* nbrs, GalElement* gl)
+{
+	for (int i=start; i<end; i++) {
+		std::vector<int>::iterator b = nbrs->begin() + (*nbr_start)[i];
+		std::vector<int>::iterator e = nbrs->begin() + (*nbr_start)[i+1];
+		std::sort(b, e);
+		e = std::unique(b, e);
+		if (e == b) continue;
+		gl[i].SetSizeNbrs(e - b);
+		for (size_t j=0; b != e; ++b, ++j) gl[i].SetNbr(j, *b);
+	}
+}
+
+/**
+ Contiguity from vertices (queen) or edges (rook) that are shared, exactly
+ or within precision_threshold.  Instead of sweeping the polygons through
+ the global partitions, the extent is cut into tiles and every tile hashes
+ the vertices or edges falling in it, so that the tiles can be spread over
+ all processors.  The neighbor pairs found by each thread are then merged
+ into symmetric, sorted neighbor lists.
+ */
+static GalElement* MakeContiguityParallel(const std::vector<PolygonView>& polys,
+										  double min_x, double min_y,
+										  double max_x, double max_y,
+										  bool is_queen,
+										  double precision_threshold)
+{
+	double tol = std::max(precision_threshold, 0.0);
+	int num_recs = polys.size();
+	int nCPUs = boost::thread::hardware_concurrency();
+	if (nCPUs < 1) nCPUs = 1;
+	if (num_recs < 1000) nCPUs = 1;
 	
-	gRecords = main.records.size();
-	double shp_min_x = (double)main.header.bbox_x_min;
-	double shp_max_x = (double)main.header.bbox_x_max;
-	double shp_min_y = (double)main.header.bbox_y_min;
-	double shp_max_y = (double)main.header.bbox_y_max;
+	// around 20000 polygons per tile keeps the hash tables of a tile small
+	int num_tiles = std::max(4*nCPUs, num_recs/20000 + 1);
+	if (nCPUs == 1) num_tiles = 1;
+	ContiguityTiles tiles(polys, min_x, min_y, max_x, max_y, num_tiles, tol);
+	
+	std::vector<std::vector<std::pair<int, int> > > pairs(nCPUs);
+	{
+		boost::thread_group threadPool;
+		for (int t=0; t<nCPUs; t++) {
+			if (t == nCPUs-1) {
+				ContiguityTileWorker(&polys, &tiles, is_queen, tol, t, nCPUs,
+									 &pairs[t]);
+			} else {
+				threadPool.create_thread(boost::bind(ContiguityTileWorker,
+													 &polys, &tiles, is_queen,
+													 tol, t, nCPUs, &pairs[t]));
+			}
+		}
+		threadPool.join_all();
+	}
+	
+	// pairs spanning several tiles are found more than once
+	std::vector<size_t> nbr_start(num_recs+1, 0);
+	for (int t=0; t<nCPUs; t++) {
+		for (size_t p=0, sz=pairs[t].size(); p<sz; p++) {
+			nbr_start[pairs[t][p].first+1]++;
+			nbr_start[pairs[t][p].second+1]++;
+		}
+	}
+	for (int i=0; i<num_recs; i++) nbr_start[i+1] += nbr_start[i];
+	std::vector<int> nbrs(nbr_start[num_recs]);
+	{
+		std::vector<size_t> pos(nbr_start);
+		for (int t=0; t<nCPUs; t++) {
+			for (size_t p=0, sz=pairs[t].size(); p<sz; p++) {
+				int i = pairs[t][p].first, j = pairs[t][p].second;
+				nbrs[pos[i]++] = j;
+				nbrs[pos[j]++] = i;
+			}
+			std::vector<std::pair<int, int> >().swap(pairs[t]);
+		}
+	}
+	
+	GalElement* gl = new GalElement[num_recs];
+	boost::thread_group threadPool;
+	for (int t=0; t<nCPUs; t++) {
+		int start = (int) (((long long) num_recs * t) / nCPUs);
+		int end = (int) (((long long) num_recs * (t+1)) / nCPUs);
+		if (t == nCPUs-1) {
+			ContiguityRowWorker(start, end, &nbr_start, &nbrs, gl);
+		} else {
+			threadPool.create_thread(boost::bind(ContiguityRowWorker,
+												 start, end, &nbr_start,
+												 &nbrs, gl));
+		}
+	}
+	threadPool.join_all();
+	return gl;
+}
+
+/** Contiguity by sweeping the polygons through the global partitions */
+static GalElement* MakeContiguitySweep(const std::vector<PolygonView>& polys,
+									   double shp_min_x, double shp_min_y,
+									   double shp_max_x, double shp_max_y,
+									   bool is_queen,
+									   double precision_threshold)
+{
+	gRecords = polys.size();
 	double shp_x_len = shp_max_x - shp_min_x;
 	double shp_y_len = shp_max_y - shp_min_y;
 	
@@ -1241,20 +1640,16 @@ GalElement* PolysToContigWeights(Shapefile::Main& main, bool is_queen,
 	gMaxX.alloc(gRecords, gx, shp_x_len );
 	
 	for (cnt= 0; cnt < gRecords; ++cnt) {
-		PolygonContents* ply = dynamic_cast<PolygonContents*> (
-																					main.records[cnt].contents_p);
-		
-		gMinX.include( cnt, ply->box[0] - shp_min_x );
-		gMaxX.include( cnt, ply->box[2] - shp_min_x );
+		gMinX.include( cnt, polys[cnt].box[0] - shp_min_x );
+		gMaxX.include( cnt, polys[cnt].box[2] - shp_min_x );
 	}
 	
 	gy= (int)(sqrt((long double)gRecords) + 2);
 	do {
 		gY= new PartitionM(gRecords, gy, shp_y_len );
 		for (cnt= 0; cnt < gRecords; ++cnt) {
-			PolygonContents* ply = dynamic_cast<PolygonContents*> (
-																				main.records[cnt].contents_p);
-			gY->initIx( cnt, ply->box[1] - shp_min_y, ply->box[3] - shp_min_y );
+			gY->initIx( cnt, polys[cnt].box[1] - shp_min_y,
+					   polys[cnt].box[3] - shp_min_y );
 		}
 		total= gY->Sum();
 		if (total > gRecords * 8) {
@@ -1264,7 +1659,7 @@ GalElement* PolysToContigWeights(Shapefile::Main& main, bool is_queen,
 		}
 	} while ( total == 0);
 	
-	GalElement * gl= MakeContiguity(main, is_queen, precision_threshold);
+	GalElement * gl= MakeContiguity(polys, is_queen, precision_threshold);
 	
 	if (gY) delete gY; gY = 0;
 	if (gOffset) delete [] gOffset; gOffset = 0;
@@ -1274,6 +1669,110 @@ GalElement* PolysToContigWeights(Shapefile::Main& main, bool is_queen,
 	return gl;
 }
 
+static GalElement* PolysToContigWeights(const std::vector<PolygonView>& polys,
+										double shp_min_x, double shp_min_y,
+										double shp_max_x, double shp_max_y,
+										bool is_queen,
+										double precision_threshold)
+{
+	// the sweep is only left for thresholds too small to number the cells
+	// of a SnapGrid over the map
+	double max_abs = std::max(std::max(fabs(shp_min_x), fabs(shp_max_x)),
+							  std::max(fabs(shp_min_y), fabs(shp_max_y)));
+	if (precision_threshold <= 0 || max_abs / precision_threshold < 1e15) {
+		return MakeContiguityParallel(polys, shp_min_x, shp_min_y,
+									  shp_max_x, shp_max_y, is_queen,
+									  precision_threshold);
+	}
+	return MakeContiguitySweep(polys, shp_min_x, shp_min_y,
+							   shp_max_x, shp_max_y, is_queen,
+							   precision_threshold);
+}
+
+/** The polygons are read in place from the records of main. */
+GalElement* PolysToContigWeights(Shapefile::Main& main, bool is_queen,
+                    double precision_threshold)
+{
+	using namespace Shapefile;
+	
+	// records without a polygon get an empty box in the corner of the map
+	double no_box[4] = { main.header.bbox_x_min, main.header.bbox_y_min,
+		main.header.bbox_x_min, main.header.bbox_y_min };
+	int num_recs = main.records.size();
+	std::vector<PolygonView> polys(num_recs);
+	for (int i=0; i<num_recs; i++) {
+		PolygonContents* ply = dynamic_cast<PolygonContents*> (
+													main.records[i].contents_p);
+		PolygonView& v = polys[i];
+		v.box = no_box;
+		if (!ply) continue;
+		v.box = &ply->box[0];
+		v.num_parts = ply->num_parts;
+		v.num_points = ply->num_points;
+		if (ply->num_parts > 0) v.parts = &ply->parts[0];
+		if (ply->num_points > 0) {
+			// Point is a pair of doubles: x and y of point k are 2k apart
+			v.x = &ply->points[0].x;
+			v.y = &ply->points[0].y;
+			v.stride = sizeof(Point) / sizeof(double);
+		}
+	}
+	return PolysToContigWeights(polys,
+								main.header.bbox_x_min, main.header.bbox_y_min,
+								main.header.bbox_x_max, main.header.bbox_y_max,
+								is_queen, precision_threshold);
+}
+
+static GalElement* BufferToContigWeights(const Shapefile::PolygonBuffer& buf,
+										 bool is_queen,
+										 double precision_threshold,
+										 bool sweep)
+{
+	int num_recs = buf.GetNumRecords();
+	std::vector<PolygonView> polys(num_recs);
+	double min_x = 0, min_y = 0, max_x = 0, max_y = 0;
+	bool first = true;
+	for (int i=0; i<num_recs; i++) {
+		PolygonView& v = polys[i];
+		v.box = buf.GetBox(i);
+		v.num_parts = buf.GetNumParts(i);
+		v.num_points = buf.GetNumPoints(i);
+		v.parts = buf.GetParts(i);
+		v.x = buf.GetX(i);
+		v.y = buf.GetY(i);
+		if (v.num_points == 0) continue;
+		if (first || v.box[0] < min_x) min_x = v.box[0];
+		if (first || v.box[1] < min_y) min_y = v.box[1];
+		if (first || v.box[2] > max_x) max_x = v.box[2];
+		if (first || v.box[3] > max_y) max_y = v.box[3];
+		first = false;
+	}
+	// null records get an empty box in the corner of the map
+	double no_box[4] = { min_x, min_y, min_x, min_y };
+	for (int i=0; i<num_recs; i++) {
+		if (polys[i].num_points == 0) polys[i].box = no_box;
+	}
+	if (sweep) {
+		return MakeContiguitySweep(polys, min_x, min_y, max_x, max_y,
+								   is_queen, precision_threshold);
+	}
+	return PolysToContigWeights(polys, min_x, min_y, max_x, max_y,
+								is_queen, precision_threshold);
+}
+
+GalElement* PolysToContigWeights(const Shapefile::PolygonBuffer& buf,
+								 bool is_queen, double precision_threshold)
+{
+	return BufferToContigWeights(buf, is_queen, precision_threshold, false);
+}
+
+GalElement* PolysToContigWeightsSweep(const Shapefile::PolygonBuffer& buf,
+									  bool is_queen,
+									  double precision_threshold)
+{
+	return BufferToContigWeights(buf, is_queen, precision_threshold, true);
+}
+
 
 
 
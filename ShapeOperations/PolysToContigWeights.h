@@ -30,6 +30,18 @@
 GalElement* PolysToContigWeights(Shapefile::Main& main,
 																 bool is_queen,
 																 double precision_threshold=0.0);
+/** Same as above for polygons held in a flat coordinate buffer, for
+ example one filled by Shapefile::MappedMain::FillPolygonBuffer. */
+GalElement* PolysToContigWeights(const Shapefile::PolygonBuffer& buf,
+																 bool is_queen,
+																 double precision_threshold=0.0);
+/** The sweep through global partitions that the tiled builder replaced.
+ PolysToContigWeights still falls back to it for precision thresholds too
+ small for a snap grid; it is exposed to check the tiled builder in
+ Tests/TestContiguity.cpp. */
+GalElement* PolysToContigWeightsSweep(const Shapefile::PolygonBuffer& buf,
+																			bool is_queen,
+																			double precision_threshold=0.0);
 
 
 #endif
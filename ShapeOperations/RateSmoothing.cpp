@@ -177,7 +177,7 @@ bool GdaAlgs::RateSmoother_SEBS(int obs, WeightsManInterface* w_man_int,
 	if (undefined.size() != obs) undefined.resize(obs);
 	for (int i=0; i<obs; i++) undefined[i] = false;
 	bool has_undefined = false;
-	GalElement* gal = w_man_int->GetGal(weights_id)->gal;
+	const CsrWeight* w = w_man_int->GetGal(weights_id)->GetCsr();
 	
 	double* pi_raw = new double[obs];
 	for (int i=0; i<obs; i++) {
@@ -191,8 +191,8 @@ bool GdaAlgs::RateSmoother_SEBS(int obs, WeightsManInterface* w_man_int,
 	
 	for (int i=0; i<obs; i++) {
 		if (undefined[i]) continue;
-		int  nbrs = gal[i].Size();
-		GalElement& elt_i = gal[i];
+		const CsrWeight::Row elt_i = w->GetRow(i);
+		int  nbrs = elt_i.Size();
 		
 		double SP=P[i], SE=E[i];
 		
@@ -243,12 +243,12 @@ bool GdaAlgs::RateSmoother_SRS(int obs, WeightsManInterface* w_man_int,
 	if (undefined.size() != obs) undefined.resize(obs);
 	for (int i=0; i<obs; i++) undefined[i] = false;
 	bool has_undefined = false;
-	GalElement* gal = w_man_int->GetGal(weights_id)->gal;
+	const CsrWeight* w = w_man_int->GetGal(weights_id)->GetCsr();
 	
 	double SE = 0, SP=0;
 	for (int i=0; i<obs; i++) {
 		SE = 0; SP=0;
-		const GalElement& elm_i = gal[i];
+		const CsrWeight::Row elm_i = w->GetRow(i);
 		for (int j=0, sz=elm_i.Size(); j<sz; j++) {
 			SE += E[elm_i[j]];
 			SP += P[elm_i[j]];
@@ -259,7 +259,7 @@ bool GdaAlgs::RateSmoother_SRS(int obs, WeightsManInterface* w_man_int,
 		} else {
 			undefined[i] = true;
 		}
-		if (gal[i].Size() <= 0) {
+		if (elm_i.Size() <= 0) {
 			undefined[i] = true;
 			results[i] = 0;
 		}
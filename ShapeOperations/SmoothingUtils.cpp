@@ -262,29 +262,36 @@ void SmoothingUtils::CalcRegressionSelOrExcl(const SampleStatistics& ss_X,
 	if (ss_X.sample_size != ss_Y.sample_size || ss_X.sample_size < 2 ||
 			ss_X.var_without_bessel <= 4*DBL_MIN ) return;
 	
-	int n=0;
 	double expectXY = 0;
 	double sum_x_squared = 0;
-	if (selected) {
-		for (int i=0, iend=X.size(); i<iend; i++) {
-			if (hl[i]) {
-				expectXY += X[i]*Y[i];
-				sum_x_squared += X[i] * X[i];
-				n++;
-			}
-		}
-	} else {
-		for (int i=0, iend=X.size(); i<iend; i++) {
-			if (!hl[i]) {
-				expectXY += X[i]*Y[i];
-				sum_x_squared += X[i] * X[i];
-				n++;
-			}
+	for (int i=0, iend=X.size(); i<iend; i++) {
+		if (hl[i] == selected) {
+			expectXY += X[i]*Y[i];
+			sum_x_squared += X[i] * X[i];
 		}
 	}
 	expectXY /= (double) ss_X.sample_size;
 	
-	r.covariance = expectXY - ss_X.mean * ss_Y.mean;
+	CalcRegressionFromMoments(ss_X, ss_Y, expectXY - ss_X.mean * ss_Y.mean, r);
+	
+	double SS_err = 0;
+	double err=0;
+	for (int i=0, iend=Y.size(); i<iend; i++) {
+		if (hl[i] == selected) {
+			err = Y[i] - (r.alpha + r.beta * X[i]);
+			SS_err += err * err;
+		}
+	}
+	ss_error = SS_err;
+	CalcRegressionErrors(ss_X, ss_Y, SS_err, sum_x_squared, r);
+}
+
+void SmoothingUtils::CalcRegressionFromMoments(const SampleStatistics& ss_X,
+											   const SampleStatistics& ss_Y,
+											   double covariance,
+											   SimpleLinearRegression& r)
+{
+	r.covariance = covariance;
 	r.beta = r.covariance / ss_X.var_without_bessel;
 	double d = ss_X.sd_without_bessel * ss_Y.sd_without_bessel;
 	if (d > 4*DBL_MIN) {
@@ -296,27 +303,15 @@ void SmoothingUtils::CalcRegressionSelOrExcl(const SampleStatistics& ss_X,
 	
 	r.alpha = ss_Y.mean - r.beta * ss_X.mean;
 	r.valid = true;
-	
+}
+
+void SmoothingUtils::CalcRegressionErrors(const SampleStatistics& ss_X,
+										  const SampleStatistics& ss_Y,
+										  double SS_err, double sum_x_squared,
+										  SimpleLinearRegression& r)
+{
+	int n = ss_X.sample_size;
 	double SS_tot = ss_Y.var_without_bessel * ss_Y.sample_size;
-	double SS_err = 0;
-	double err=0;
-	if (selected) {
-		for (int i=0, iend=Y.size(); i<iend; i++) {
-			if (hl[i]) {
-				err = Y[i] - (r.alpha + r.beta * X[i]);
-				SS_err += err * err;
-			}
-		}
-		ss_error = SS_err;
-	} else {
-		for (int i=0, iend=Y.size(); i<iend; i++) {
-			if (!hl[i]) {
-				err = Y[i] - (r.alpha + r.beta * X[i]);
-				SS_err += err * err;
-			}
-		}
-		ss_error = SS_err;
-	}
 	if (SS_err < 16*DBL_MIN) {
 		r.r_squared = 1;
 	} else {
@@ -364,6 +359,228 @@ void SmoothingUtils::CalcVarSdFromSumSquares(SampleStatistics& ss,
 	}
 }
 
+void SmoothingUtils::RankCounts::Init(const std::vector<double>& v,
+									  const std::vector<bool>& hl)
+{
+	int n = v.size();
+	std::vector<std::pair<double, int> > srt(n);
+	for (int i=0; i<n; i++) srt[i] = std::make_pair(v[i], i);
+	std::sort(srt.begin(), srt.end());
+	sorted.resize(n);
+	rank.resize(n);
+	for (int i=0; i<n; i++) {
+		sorted[i] = srt[i].first;
+		rank[srt[i].second] = i;
+	}
+	sel_bits = hl;
+	inverted = false;
+	num_sel = 0;
+	// build the tree bottom up in O(n)
+	tree.assign(n+1, 0);
+	for (int i=0; i<n; i++) {
+		if (hl[i]) {
+			tree[rank[i]+1]++;
+			num_sel++;
+		}
+	}
+	for (int i=1; i<=n; i++) {
+		int parent = i + (i & -i);
+		if (parent <= n) tree[parent] += tree[i];
+	}
+}
+
+bool SmoothingUtils::RankCounts::Set(int obs, bool selected)
+{
+	bool bit = (selected != inverted);
+	if (sel_bits[obs] == bit) return false;
+	sel_bits[obs] = bit;
+	int d = bit ? 1 : -1;
+	num_sel += d;
+	for (int i=rank[obs]+1, n=sorted.size(); i<=n; i += (i & -i)) tree[i] += d;
+	return true;
+}
+
+int SmoothingUtils::RankCounts::FindNth(bool bit, int k) const
+{
+	int n = sorted.size();
+	int step = 1;
+	while (step*2 <= n) step *= 2;
+	int pos = 0;
+	for (; step > 0; step /= 2) {
+		if (pos + step > n) continue;
+		// tree[pos+step] counts the set bits in (pos, pos+step]
+		int cnt = bit ? tree[pos+step] : step - tree[pos+step];
+		if (cnt < k) {
+			pos += step;
+			k -= cnt;
+		}
+	}
+	return pos;
+}
+
+bool SmoothingUtils::RankCounts::GetMinMax(bool selected, double& min,
+										   double& max) const
+{
+	bool bit = (selected != inverted);
+	int cnt = bit ? num_sel : (int) sorted.size() - num_sel;
+	if (cnt == 0) return false;
+	min = sorted[FindNth(bit, 1)];
+	max = sorted[FindNth(bit, cnt)];
+	return true;
+}
+
+void SmoothingUtils::RegimeStats::Init(const std::vector<double>& X,
+									   const std::vector<double>& Y,
+									   const std::vector<bool>& hl)
+{
+	int n = X.size();
+	x0 = 0;
+	y0 = 0;
+	for (int i=0; i<n; i++) {
+		x0 += X[i];
+		y0 += Y[i];
+	}
+	if (n > 0) {
+		x0 /= n;
+		y0 /= n;
+	}
+	sel = Sums();
+	excl = Sums();
+	for (int i=0; i<n; i++) {
+		if (hl[i]) sel.Add(X[i]-x0, Y[i]-y0, 1);
+		else excl.Add(X[i]-x0, Y[i]-y0, 1);
+	}
+	x_ranks.Init(X, hl);
+	y_ranks.Init(Y, hl);
+	moves = 0;
+	is_init = true;
+}
+
+void SmoothingUtils::RegimeStats::Move(const std::vector<double>& X,
+									   const std::vector<double>& Y,
+									   int obs, bool selected)
+{
+	if (!x_ranks.Set(obs, selected)) return;
+	y_ranks.Set(obs, selected);
+	double dx = X[obs]-x0, dy = Y[obs]-y0;
+	if (selected) {
+		excl.Add(dx, dy, -1);
+		sel.Add(dx, dy, 1);
+	} else {
+		sel.Add(dx, dy, -1);
+		excl.Add(dx, dy, 1);
+	}
+	moves++;
+}
+
+void SmoothingUtils::RegimeStats::Update(const std::vector<double>& X,
+										 const std::vector<double>& Y,
+										 const std::vector<bool>& hl,
+										 const std::vector<int>& newly_hl,
+										 int num_hl,
+										 const std::vector<int>& newly_unhl,
+										 int num_unhl)
+{
+	if (!is_init || moves + num_hl + num_unhl > (int) X.size()) {
+		Init(X, Y, hl);
+		return;
+	}
+	for (int i=0; i<num_hl; i++) Move(X, Y, newly_hl[i], true);
+	for (int i=0; i<num_unhl; i++) Move(X, Y, newly_unhl[i], false);
+}
+
+void SmoothingUtils::RegimeStats::Invert()
+{
+	std::swap(sel, excl);
+	x_ranks.Invert();
+	y_ranks.Invert();
+}
+
+/** The same statistics as CalcStatsRegimes and CalcRegressionSelOrExcl,
+ from the sums of the values relative to x0 and y0. */
+void SmoothingUtils::RegimeStats::CalcRegime(const Sums& s, bool selected,
+											 SampleStatistics& ssX,
+											 SampleStatistics& ssY,
+											 SimpleLinearRegression& r,
+											 double& ss_error) const
+{
+	double n = s.n;
+	double mx = s.x/n, my = s.y/n;
+	ssX.sample_size = s.n;
+	ssY.sample_size = s.n;
+	ssX.mean = x0 + mx;
+	ssY.mean = y0 + my;
+	x_ranks.GetMinMax(selected, ssX.min, ssX.max);
+	y_ranks.GetMinMax(selected, ssY.min, ssY.max);
+	// CalcVarSdFromSumSquares, shifted by x0 and y0
+	SampleStatistics* ss[2] = { &ssX, &ssY };
+	double var[2] = { s.xx/n - mx*mx, s.yy/n - my*my };
+	for (int i=0; i<2; i++) {
+		ss[i]->var_without_bessel = var[i];
+		ss[i]->sd_without_bessel = sqrt(var[i]);
+		if (s.n == 1) {
+			ss[i]->var_with_bessel = ss[i]->var_without_bessel;
+			ss[i]->sd_with_bessel = ss[i]->sd_without_bessel;
+		} else {
+			ss[i]->var_with_bessel = (n/(n-1)) * ss[i]->var_without_bessel;
+			ss[i]->sd_with_bessel = sqrt(ss[i]->var_with_bessel);
+		}
+	}
+	
+	if (s.n < 2 || ssX.var_without_bessel <= 4*DBL_MIN) return;
+	double cov = s.xy/n - mx*my;
+	CalcRegressionFromMoments(ssX, ssY, cov, r);
+	// sum of (y - alpha - beta x)^2 in terms of the variances
+	double sse = n * (ssY.var_without_bessel - 2*r.beta*cov +
+					  r.beta*r.beta*ssX.var_without_bessel);
+	if (sse < 0) sse = 0;
+	ss_error = sse;
+	double sum_x_squared = n * (ssX.var_without_bessel + ssX.mean*ssX.mean);
+	CalcRegressionErrors(ssX, ssY, sse, sum_x_squared, r);
+}
+
+void SmoothingUtils::RegimeStats::CalcStats(const SampleStatistics& statsX,
+								const SampleStatistics& statsY,
+								const SimpleLinearRegression& regressionXY,
+								SampleStatistics& statsXselected,
+								SampleStatistics& statsYselected,
+								SampleStatistics& statsXexcluded,
+								SampleStatistics& statsYexcluded,
+								SimpleLinearRegression& regressionXYselected,
+								SimpleLinearRegression& regressionXYexcluded,
+								double& sse_sel,
+								double& sse_unsel) const
+{
+	statsXselected = SampleStatistics();
+	statsYselected = SampleStatistics();
+	statsXexcluded = SampleStatistics();
+	statsYexcluded = SampleStatistics();
+	regressionXYselected = SimpleLinearRegression();
+	regressionXYexcluded = SimpleLinearRegression();
+	if (sel.n == 0) {
+		statsXexcluded = statsX;
+		statsYexcluded = statsY;
+		regressionXYexcluded = regressionXY;
+		statsXselected.min = std::numeric_limits<double>::max();
+		statsYselected.min = std::numeric_limits<double>::max();
+		statsXselected.max = -std::numeric_limits<double>::max();
+		statsYselected.max = -std::numeric_limits<double>::max();
+	} else if (excl.n == 0) {
+		statsXselected = statsX;
+		statsYselected = statsY;
+		regressionXYselected = regressionXY;
+		statsXexcluded.min = std::numeric_limits<double>::max();
+		statsYexcluded.min = std::numeric_limits<double>::max();
+		statsXexcluded.max = -std::numeric_limits<double>::max();
+		statsYexcluded.max = -std::numeric_limits<double>::max();
+	} else {
+		CalcRegime(sel, true, statsXselected, statsYselected,
+				   regressionXYselected, sse_sel);
+		CalcRegime(excl, false, statsXexcluded, statsYexcluded,
+				   regressionXYexcluded, sse_unsel);
+	}
+}
+
 bool SmoothingUtils::ExtendEndpointsToBB(const std::vector<double>& X,
 										 const std::vector<double>& Y,
 										 double bb_min_x, double bb_min_y,
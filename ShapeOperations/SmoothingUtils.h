@@ -79,6 +79,116 @@ namespace SmoothingUtils {
 	
 	void CalcVarSdFromSumSquares(SampleStatistics& ss, double sum_squares);
 	
+	/** Sets covariance, beta, alpha and correlation of r from the
+	 statistics of X and Y and their covariance. */
+	void CalcRegressionFromMoments(const SampleStatistics& ss_X,
+								   const SampleStatistics& ss_Y,
+								   double covariance,
+								   SimpleLinearRegression& r);
+	/** Sets r_squared and the standard errors, t scores and p values of r
+	 from the error sum of squares of the regression and the sum of X^2 */
+	void CalcRegressionErrors(const SampleStatistics& ss_X,
+							  const SampleStatistics& ss_Y,
+							  double ss_error, double sum_x_squared,
+							  SimpleLinearRegression& r);
+	
+	/**
+	 Counts of the selected observations in the sorted order of a variable,
+	 kept in a Fenwick tree so that changing the state of an observation
+	 and finding the smallest and largest value of either the selected or
+	 the excluded observations take O(log n).  Invert swaps the selected and
+	 excluded observations in O(1).
+	 */
+	class RankCounts {
+	public:
+		RankCounts() : num_sel(0), inverted(false) {}
+		void Init(const std::vector<double>& v, const std::vector<bool>& hl);
+		bool IsSelected(int obs) const { return sel_bits[obs] != inverted; }
+		/** Returns false if obs was already in the regime */
+		bool Set(int obs, bool selected);
+		void Invert() { inverted = !inverted; }
+		int GetNumSelected() const {
+			return inverted ? (int) sorted.size() - num_sel : num_sel; }
+		/** Returns false if the regime is empty */
+		bool GetMinMax(bool selected, double& min, double& max) const;
+		
+	private:
+		/** Sorted position of the k-th, 1-based, observation whose bit is
+		 set (bit = true) or not set in sel_bits */
+		int FindNth(bool bit, int k) const;
+		
+		std::vector<double> sorted;
+		std::vector<int> rank; // position of each observation in sorted
+		std::vector<int> tree; // 1-based Fenwick tree over sorted
+		std::vector<bool> sel_bits;
+		int num_sel; // number of bits set
+		bool inverted;
+	};
+	
+	/**
+	 Running sums of X, Y, X^2, Y^2 and XY over the selected and the
+	 excluded observations, from which CalcStats computes what
+	 CalcStatsRegimes computes by rescanning all the data.  Once Init is
+	 called, Update only moves the observations whose highlight state
+	 changed between the two regimes, and the smallest and largest values
+	 come from a RankCounts per variable.  The values are summed relative to
+	 the overall means to limit cancellation, and the sums are recounted
+	 from scratch once as many observations as there are in total have
+	 moved, so that rounding errors do not build up.
+	 */
+	class RegimeStats {
+	public:
+		RegimeStats() : is_init(false), x0(0), y0(0), moves(0) {}
+		void Init(const std::vector<double>& X, const std::vector<double>& Y,
+				  const std::vector<bool>& hl);
+		bool IsInit() const { return is_init; }
+		/** X or Y changed: the next Update will call Init */
+		void Clear() { is_init = false; }
+		/** Applies the first num_hl observations of newly_hl and the first
+		 num_unhl of newly_unhl, as listed by HLStateInt for a delta event.
+		 hl is the highlight state after the event. */
+		void Update(const std::vector<double>& X, const std::vector<double>& Y,
+					const std::vector<bool>& hl,
+					const std::vector<int>& newly_hl, int num_hl,
+					const std::vector<int>& newly_unhl, int num_unhl);
+		/** All selected observations become excluded and vice versa */
+		void Invert();
+		/** Same results as CalcStatsRegimes */
+		void CalcStats(const SampleStatistics& statsX,
+					   const SampleStatistics& statsY,
+					   const SimpleLinearRegression& regressionXY,
+					   SampleStatistics& statsXselected,
+					   SampleStatistics& statsYselected,
+					   SampleStatistics& statsXexcluded,
+					   SampleStatistics& statsYexcluded,
+					   SimpleLinearRegression& regressionXYselected,
+					   SimpleLinearRegression& regressionXYexcluded,
+					   double& sse_sel,
+					   double& sse_unsel) const;
+		
+	private:
+		struct Sums {
+			Sums() : n(0), x(0), y(0), xx(0), yy(0), xy(0) {}
+			void Add(double dx, double dy, int sign) {
+				n += sign; x += sign*dx; y += sign*dy;
+				xx += sign*dx*dx; yy += sign*dy*dy; xy += sign*dx*dy;
+			}
+			int n;
+			double x, y, xx, yy, xy;
+		};
+		void Move(const std::vector<double>& X, const std::vector<double>& Y,
+				  int obs, bool selected);
+		void CalcRegime(const Sums& s, bool selected, SampleStatistics& ssX,
+						SampleStatistics& ssY, SimpleLinearRegression& r,
+						double& ss_error) const;
+		
+		bool is_init;
+		double x0, y0; // means of X and Y
+		Sums sel, excl;
+		RankCounts x_ranks, y_ranks;
+		int moves; // observations moved since Init
+	};
+	
 	/** Attempt to extend the endpoints of a regression line/curve
 	 out the nearest Bounding Box boundary using linear interpolation.
 	 The input points are assumed to be sorted by X/Y coordinates.
@@ -34,6 +34,7 @@
 #include "WeightUtils.h"
 #include "WeightsManager.h"
 #include "../Project.h"
+#include "../Regression/LogDetCache.h"
 #include "../SaveButtonManager.h"
 #include "../logger.h"
 #include "../VarCalc/GdaLexer.h"
@@ -50,6 +51,7 @@ WeightsNewManager::~WeightsNewManager()
     
 	for (EmTypeCItr it=entry_map.begin(); it != entry_map.end(); ++it) {
         Entry e = it->second;
+        if (e.logdet_cache) delete e.logdet_cache;
         if (e.gal_weight) {
             delete e.gal_weight;
             e.gal_weight = NULL;
@@ -112,10 +114,14 @@ bool WeightsNewManager::AssociateGal(boost::uuids::uuid w_uuid, GalWeight* gw)
 {
 	EmType::iterator it = entry_map.find(w_uuid);
 	if (it == entry_map.end()) return false;
+	if (it->second.logdet_cache != 0) {
+		delete it->second.logdet_cache; it->second.logdet_cache = 0;
+	}
 	if (it->second.gal_weight != 0) {
 		delete it->second.gal_weight; it->second.gal_weight = 0;
 	}
 	it->second.gal_weight = gw;
+	ResetLogDetCache(it->second);
 	if (w_man_state) w_man_state->notifyObservers();
 	return true;
 }
@@ -255,19 +261,20 @@ bool WeightsNewManager::Lag(boost::uuids::uuid w_uuid, const GdaFlexValue& data,
 		return true;
 	}
 	GalWeight* gw = GetGal(w_uuid);
-	if (!gw || !gw->gal || !(gw->num_obs = data.GetObs())) {
+	if (!gw || !gw->gal || gw->num_obs != data.GetObs()) {
 		return false;
 	}
-	GalElement* W = gw->gal;
+	const CsrWeight* W = gw->GetCsr();
 	const std::valarray<double>& x = data.GetConstValArrayRef();
 	result.SetSize(data.GetObs(), data.GetTms());
 	std::valarray<double>& y = result.GetValArrayRef();
-	for (size_t t=0, tms=data.GetTms(); t<tms; ++t) {
-		for (size_t i=0, obs=data.GetObs(); i<obs; ++i) {
+	for (size_t i=0, obs=data.GetObs(); i<obs; ++i) {
+		const CsrWeight::Row W_i = W->GetRow(i);
+		const size_t nbrs = W_i.Size();
+		for (size_t t=0, tms=data.GetTms(); t<tms; ++t) {
 			double s = 0;
-			size_t nbrs = W[i].Size();
 			for (size_t n=0; n<nbrs; ++n) {
-				s += x[W[i][n]*tms+t];
+				s += x[W_i[n]*tms+t];
 			}
 			y[i*tms+t] = s / ((double) nbrs);
 		}
@@ -314,6 +321,7 @@ void WeightsNewManager::Remove(boost::uuids::uuid w_uuid)
 {
 	EmType::iterator it = entry_map.find(w_uuid);
 	if (it == entry_map.end()) return;
+	if (it->second.logdet_cache) delete it->second.logdet_cache;
 	if (it->second.gal_weight) delete it->second.gal_weight;
 	entry_map.erase(it);
 	for (std::list<boost::uuids::uuid>::iterator it=uuid_order.begin();
@@ -373,10 +381,20 @@ GalWeight* WeightsNewManager::GetGal(boost::uuids::uuid w_uuid)
 		w->title = e.wpte.title;
 		w->gal = gal;
 		e.gal_weight = w;
+		ResetLogDetCache(e);
 	}
 	return e.gal_weight;
 }
 
+/** Cached eigenvalues and log-Jacobian data for the ML spatial regressions.
+ Loads the weights if needed.  The cache is owned by WeightsNewManager and
+ is valid until the weights are removed or replaced. */
+LogDetCache* WeightsNewManager::GetLogDetCache(boost::uuids::uuid w_uuid)
+{
+	if (!GetGal(w_uuid)) return 0;
+	return entry_map[w_uuid].logdet_cache;
+}
+
 GeoDaWeight* WeightsNewManager::GetWeights(boost::uuids::uuid w_uuid)
 {
 	EmType::iterator it = entry_map.find(w_uuid);
@@ -512,6 +530,18 @@ boost::uuids::uuid WeightsNewManager::FindUuid(const WeightsMetaInfo& wmi) const
 	return boost::uuids::nil_uuid();
 }
 
+/** Replaces the LogDetCache of e with a new one for e.gal_weight and starts
+ its background computation. */
+void WeightsNewManager::ResetLogDetCache(Entry& e)
+{
+	if (e.logdet_cache) delete e.logdet_cache;
+	e.logdet_cache = 0;
+	if (!e.gal_weight || !e.gal_weight->gal) return;
+	e.logdet_cache = new LogDetCache(e.gal_weight->gal,
+									 e.gal_weight->num_obs);
+	e.logdet_cache->StartBackground();
+}
+
 GalElement* WeightsNewManager::GetGalElemArray(boost::uuids::uuid w_uuid)
 {
 	GalWeight* gw = GetGal(w_uuid);
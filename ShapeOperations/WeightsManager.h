@@ -30,6 +30,7 @@ class GalWeight;
 class GwtWeight;
 class GalElement;
 class GwtElement;
+class LogDetCache;
 class ProgressDlg;
 class TableInterface;
 class WeightsManState;
@@ -70,6 +71,7 @@ public:
 	virtual void Remove(boost::uuids::uuid w_uuid);
 	virtual wxString RecNumToId(boost::uuids::uuid w_uuid, long rec_num);
 	virtual GalWeight* GetGal(boost::uuids::uuid w_uuid);
+	virtual LogDetCache* GetLogDetCache(boost::uuids::uuid w_uuid);
 	virtual GeoDaWeight* GetWeights(boost::uuids::uuid w_uuid);
 	virtual boost::uuids::uuid GetDefault() const;
 	virtual void MakeDefault(boost::uuids::uuid w_uuid);
@@ -81,11 +83,14 @@ public:
 	
 private:
 	struct Entry {
-		Entry() : gal_weight(0), geoda_weight(0) {}
-		Entry(const WeightsPtreeEntry& e) : gal_weight(0), geoda_weight(0), wpte(e) {}
+		Entry() : gal_weight(0), geoda_weight(0), logdet_cache(0) {}
+		Entry(const WeightsPtreeEntry& e) : gal_weight(0), geoda_weight(0),
+			logdet_cache(0), wpte(e) {}
 		WeightsPtreeEntry wpte;
 		GalWeight* gal_weight;
         GeoDaWeight* geoda_weight;
+		// regression quantities that depend only on gal_weight
+		LogDetCache* logdet_cache;
 		std::vector<wxString> rec_num_to_id;
 	};
 	typedef std::map<boost::uuids::uuid, Entry> EmType;
@@ -96,6 +101,7 @@ private:
 	
 	boost::uuids::uuid FindUuid(const WeightsMetaInfo& wmi) const;
 	GalElement* GetGalElemArray(boost::uuids::uuid w_uuid);
+	void ResetLogDetCache(Entry& e);
 	bool InitRecNumToIdMap(boost::uuids::uuid w_uuid);
 	TableInterface* table_int;
 	WeightsManState* w_man_state;
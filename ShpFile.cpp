@@ -943,6 +943,65 @@ bool Shapefile::populateMain(const Index& index_s, const wxString& fname,
 	return success;
 }
 
+void Shapefile::PolygonBuffer::Clear()
+{
+	x.clear();
+	y.clear();
+	parts.clear();
+	rec_parts.assign(1, 0);
+	rec_points.assign(1, 0);
+	box.clear();
+}
+
+bool Shapefile::populatePolygonBuffer(const Main& main_s, PolygonBuffer& buf)
+{
+	buf.Clear();
+	if (main_s.header.shape_type != POLYGON &&
+		main_s.header.shape_type != POLY_LINE) return false;
+	
+	int num_recs = main_s.records.size();
+	size_t tot_parts = 0, tot_points = 0;
+	for (int i=0; i<num_recs; i++) {
+		RecordContents* rc = main_s.records[i].contents_p;
+		if (PolygonContents* pc = dynamic_cast<PolygonContents*>(rc)) {
+			tot_parts += pc->parts.size();
+			tot_points += pc->points.size();
+		} else if (PolyLineContents* pc=dynamic_cast<PolyLineContents*>(rc)) {
+			tot_parts += pc->parts.size();
+			tot_points += pc->points.size();
+		}
+	}
+	buf.x.reserve(tot_points);
+	buf.y.reserve(tot_points);
+	buf.parts.reserve(tot_parts);
+	buf.rec_parts.reserve(num_recs+1);
+	buf.rec_points.reserve(num_recs+1);
+	buf.box.resize(4*num_recs, 0);
+	
+	for (int i=0; i<num_recs; i++) {
+		RecordContents* rc = main_s.records[i].contents_p;
+		const std::vector<wxFloat64>* box = 0;
+		const std::vector<wxInt32>* parts = 0;
+		const std::vector<Point>* points = 0;
+		if (PolygonContents* pc = dynamic_cast<PolygonContents*>(rc)) {
+			box = &pc->box; parts = &pc->parts; points = &pc->points;
+		} else if (PolyLineContents* pc=dynamic_cast<PolyLineContents*>(rc)) {
+			box = &pc->box; parts = &pc->parts; points = &pc->points;
+		}
+		if (box && !points->empty()) {
+			for (int j=0; j<4; j++) buf.box[4*i+j] = (*box)[j];
+			buf.parts.insert(buf.parts.end(), parts->begin(), parts->end());
+			for (size_t k=0, sz=points->size(); k<sz; k++) {
+				buf.x.push_back((*points)[k].x);
+				buf.y.push_back((*points)[k].y);
+			}
+		}
+		buf.rec_parts.push_back(buf.parts.size());
+		buf.rec_points.push_back(buf.x.size());
+	}
+	return true;
+}
+
 /** The following could define a run-time and relatively robust endianess test */
 //bool isBigEndian() {
 //  const int i = 1;
@@ -192,6 +192,39 @@ namespace Shapefile {
 		std::vector<MainRecord> records;
 	};
 	
+	/**
+	 The coordinates of all the records of a poly line or polygon layer in a
+	 few flat arrays (structure of arrays) instead of one PolygonContents per
+	 record.  The points of record i are x[k], y[k] for k in
+	 [rec_points[i], rec_points[i+1]) and its parts are the entries
+	 [rec_parts[i], rec_parts[i+1]) of parts.  As in PolygonContents, part
+	 indexes are relative to the first point of the record.  Null records
+	 have no parts, no points and an all zero box.
+	 */
+	struct PolygonBuffer {
+		PolygonBuffer() : rec_parts(1, 0), rec_points(1, 0) {}
+		void Clear();
+		int GetNumRecords() const { return (int) rec_points.size() - 1; }
+		int GetNumParts(int i) const { return rec_parts[i+1]-rec_parts[i]; }
+		int GetNumPoints(int i) const {
+			return rec_points[i+1]-rec_points[i]; }
+		const wxInt32* GetParts(int i) const {
+			return parts.empty() ? 0 : &parts[0] + rec_parts[i]; }
+		const wxFloat64* GetX(int i) const {
+			return x.empty() ? 0 : &x[0] + rec_points[i]; }
+		const wxFloat64* GetY(int i) const {
+			return y.empty() ? 0 : &y[0] + rec_points[i]; }
+		/** min x, min y, max x, max y of record i */
+		const wxFloat64* GetBox(int i) const { return &box[4*i]; }
+		
+		std::vector<wxFloat64> x;
+		std::vector<wxFloat64> y;
+		std::vector<wxInt32> parts;
+		std::vector<wxInt32> rec_parts; // num records + 1
+		std::vector<wxInt32> rec_points; // num records + 1
+		std::vector<wxFloat64> box; // 4 per record
+	};
+	
 	struct IndexRecord {
 		IndexRecord() : offset(0), content_length(0) {}
 		/** offset of a record is the number of 16-bit words from the start of
@@ -224,6 +257,8 @@ namespace Shapefile {
 	bool populateIndex(const wxString& fname, Index& index_s);
 	bool populateMain(const Index& index_s, const wxString& fname,
 					  Main& main_s);
+	/** Copies the poly line or polygon records of main_s into buf. */
+	bool populatePolygonBuffer(const Main& main_s, PolygonBuffer& buf);
 	
 	bool writeHeader(std::ofstream& out_file,
 					 const Shapefile::Header& header,
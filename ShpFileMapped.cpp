@@ -0,0 +1,238 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <wx/filename.h>
+#include "GenUtils.h"
+#include "ShpFileMapped.h"
+
+using namespace Shapefile;
+namespace bip = boost::interprocess;
+
+MappedMain::MappedMain()
+: shp_file(0), shp_region(0), shx_file(0), shx_region(0), shp(0), shx(0),
+shp_size(0), shape_type(NULL_SHAPE), num_records(0)
+{
+}
+
+MappedMain::~MappedMain()
+{
+	Close();
+}
+
+void MappedMain::Close()
+{
+	if (shp_region) delete shp_region; shp_region = 0;
+	if (shp_file) delete shp_file; shp_file = 0;
+	if (shx_region) delete shx_region; shx_region = 0;
+	if (shx_file) delete shx_file; shx_file = 0;
+	shp = 0;
+	shx = 0;
+	shp_size = 0;
+	header = Header();
+	shape_type = NULL_SHAPE;
+	num_records = 0;
+}
+
+bool MappedMain::Open(const wxString& fname)
+{
+	Close();
+	wxFileName shx_fn(fname);
+	shx_fn.SetExt(shx_fn.GetExt() == "SHP" ? "SHX" : "shx");
+	if (!shx_fn.FileExists()) {
+		shx_fn.SetExt(shx_fn.GetExt() == "SHX" ? "shx" : "SHX");
+	}
+	wxString shx_fname = shx_fn.GetFullPath();
+
+	size_t shx_size = 0;
+	try {
+		shp_file = new bip::file_mapping(GET_ENCODED_FILENAME(fname),
+										 bip::read_only);
+		shp_region = new bip::mapped_region(*shp_file, bip::read_only);
+		shx_file = new bip::file_mapping(GET_ENCODED_FILENAME(shx_fname),
+										 bip::read_only);
+		shx_region = new bip::mapped_region(*shx_file, bip::read_only);
+	} catch (bip::interprocess_exception& e) {
+		Close();
+		return false;
+	}
+	shp = (const char*) shp_region->get_address();
+	shp_size = shp_region->get_size();
+	shx = (const char*) shx_region->get_address();
+	shx_size = shx_region->get_size();
+
+	if (shp_size < 100 || shx_size < 100 ||
+		readInt32BE(shp) != 9994 || readInt32BE(shx) != 9994) {
+		Close();
+		return false;
+	}
+
+	header.file_code = readInt32BE(shp);
+	header.file_length = readInt32BE(shp+24);
+	header.version = readInt32LE(shp+28);
+	header.shape_type = readInt32LE(shp+32);
+	header.bbox_x_min = readFloat64LE(shp+36);
+	header.bbox_y_min = readFloat64LE(shp+44);
+	header.bbox_x_max = readFloat64LE(shp+52);
+	header.bbox_y_max = readFloat64LE(shp+60);
+	header.bbox_z_min = readFloat64LE(shp+68);
+	header.bbox_z_max = readFloat64LE(shp+76);
+	header.bbox_m_min = readFloat64LE(shp+84);
+	header.bbox_m_max = readFloat64LE(shp+92);
+
+	switch (header.shape_type) {
+		case POINT_TYP: case POINT_Z: case POINT_M:
+			shape_type = POINT_TYP;
+			break;
+		case POLY_LINE: case POLY_LINE_Z: case POLY_LINE_M:
+			shape_type = POLY_LINE;
+			break;
+		case POLYGON: case POLYGON_Z: case POLYGON_M:
+			shape_type = POLYGON;
+			break;
+		default:
+			Close();
+			return false;
+	}
+
+	Header shx_header;
+	shx_header.file_length = readInt32BE(shx+24);
+	num_records = calcNumIndexHeaderRecords(shx_header);
+	if (num_records < 0) num_records = 0;
+	if ((size_t) num_records > (shx_size-100)/8) {
+		num_records = (shx_size-100)/8;
+	}
+
+	if (!CheckRecords()) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+/** Every record must lie within the .shp file and be a null record or of
+ the type of the file, and every part must start within its record. */
+bool MappedMain::CheckRecords() const
+{
+	for (int i=0; i<num_records; i++) {
+		wxInt32 offset = readInt32BE(shx + 100 + 8*i);
+		if (offset < 50) return false;
+		wxUint64 start = 2*(wxUint64) offset + 8;
+		if (start + 4 > shp_size) return false;
+		wxInt32 st = readInt32LE(shp + start);
+		if (st == NULL_SHAPE) continue;
+		if (st != header.shape_type) return false;
+		if (shape_type == POINT_TYP) {
+			if (start + 20 > shp_size) return false;
+			continue;
+		}
+		if (start + 44 > shp_size) return false;
+		wxInt32 num_parts = readInt32LE(shp + start + 36);
+		wxInt32 num_points = readInt32LE(shp + start + 40);
+		if (num_parts < 0 || num_points < 0) return false;
+		if (start + 44 + 4*(wxUint64) num_parts + 16*(wxUint64) num_points
+			> shp_size) return false;
+		for (int j=0; j<num_parts; j++) {
+			wxInt32 part = readInt32LE(shp + start + 44 + 4*j);
+			if (part < 0 || part >= num_points) return false;
+		}
+	}
+	return true;
+}
+
+template <class T>
+static void fillPolyContents(const MappedMain& m, int i, T* pc)
+{
+	for (int j=0; j<4; j++) pc->box[j] = m.GetBox(i, j);
+	pc->num_parts = m.GetNumParts(i);
+	pc->num_points = m.GetNumPoints(i);
+	pc->parts.resize(pc->num_parts);
+	for (int j=0; j<pc->num_parts; j++) pc->parts[j] = m.GetPart(i, j);
+	pc->points.resize(pc->num_points);
+	for (int k=0; k<pc->num_points; k++) {
+		pc->points[k].x = m.GetX(i, k);
+		pc->points[k].y = m.GetY(i, k);
+	}
+}
+
+/** Null records are returned as empty contents of the file type, with
+ shape_type NULL_SHAPE, since the code using Main casts the contents to the
+ type of the file. */
+RecordContents* MappedMain::NewRecordContents(int i) const
+{
+	bool is_null = IsNull(i);
+	if (shape_type == POINT_TYP) {
+		PointContents* pc = new PointContents();
+		if (is_null) {
+			pc->shape_type = NULL_SHAPE;
+		} else {
+			pc->x = GetPointX(i);
+			pc->y = GetPointY(i);
+		}
+		return pc;
+	} else if (shape_type == POLY_LINE) {
+		PolyLineContents* pc = new PolyLineContents();
+		if (is_null) pc->shape_type = NULL_SHAPE;
+		else fillPolyContents(*this, i, pc);
+		return pc;
+	} else if (shape_type == POLYGON) {
+		PolygonContents* pc = new PolygonContents();
+		if (is_null) pc->shape_type = NULL_SHAPE;
+		else fillPolyContents(*this, i, pc);
+		return pc;
+	}
+	return new NullShapeContents();
+}
+
+bool MappedMain::FillPolygonBuffer(PolygonBuffer& buf) const
+{
+	buf.Clear();
+	if (shape_type != POLY_LINE && shape_type != POLYGON) return false;
+
+	size_t tot_parts = 0, tot_points = 0;
+	for (int i=0; i<num_records; i++) {
+		tot_parts += GetNumParts(i);
+		tot_points += GetNumPoints(i);
+	}
+	buf.x.resize(tot_points);
+	buf.y.resize(tot_points);
+	buf.parts.resize(tot_parts);
+	buf.rec_parts.resize(num_records+1);
+	buf.rec_points.resize(num_records+1);
+	buf.box.resize(4*num_records);
+
+	size_t part = 0, point = 0;
+	for (int i=0; i<num_records; i++) {
+		buf.rec_parts[i] = part;
+		buf.rec_points[i] = point;
+		for (int j=0; j<4; j++) buf.box[4*i+j] = GetBox(i, j);
+		for (int j=0, np=GetNumParts(i); j<np; j++) {
+			buf.parts[part++] = GetPart(i, j);
+		}
+		const char* p = IsNull(i) ? 0 : Points(i);
+		for (int k=0, np=GetNumPoints(i); k<np; k++, p+=16) {
+			buf.x[point] = readFloat64LE(p);
+			buf.y[point++] = readFloat64LE(p+8);
+		}
+	}
+	buf.rec_parts[num_records] = part;
+	buf.rec_points[num_records] = point;
+	return true;
+}
@@ -0,0 +1,146 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_SHP_FILE_MAPPED_H__
+#define __GEODA_CENTER_SHP_FILE_MAPPED_H__
+
+#include <cstring>
+#include <wx/string.h>
+#include "ShpFile.h"
+
+namespace boost { namespace interprocess {
+	class file_mapping;
+	class mapped_region;
+} }
+
+namespace Shapefile {
+
+	/** Decode a value stored at p with the given byte order.  p does not
+	 need to be aligned. */
+	inline wxInt32 readInt32LE(const char* p) {
+		wxInt32 x;
+		memcpy(&x, p, 4);
+#ifdef WORDS_BIGENDIAN
+		x = myINT_SWAP_ON_BE(x);
+#endif
+		return x;
+	}
+	inline wxInt32 readInt32BE(const char* p) {
+		wxInt32 x;
+		memcpy(&x, p, 4);
+#ifndef WORDS_BIGENDIAN
+		x = myINT_SWAP_ON_LE(x);
+#endif
+		return x;
+	}
+	inline wxFloat64 readFloat64LE(const char* p) {
+		wxFloat64 x;
+		memcpy(&x, p, 8);
+#ifdef WORDS_BIGENDIAN
+		x = myDOUBLE_SWAP_ON_BE(x);
+#endif
+		return x;
+	}
+
+	/**
+	 Read-only access to a .shp file and its .shx index mapped into memory.
+	 Opening the files copies nothing: records are located through their
+	 .shx offsets and values are decoded in place when requested, so byte
+	 swapping is only done for the values that are actually read, and only
+	 on big endian hosts.  Z and M records are read as their 2D shape type.
+
+	 Open checks that every record lies within the .shp file, so the
+	 accessors do no bounds checking.  Point accessors are for POINT_TYP
+	 files, the others for POLY_LINE and POLYGON files.  Null records have
+	 no parts and no points.
+	 */
+	class MappedMain {
+	public:
+		MappedMain();
+		virtual ~MappedMain();
+
+		/** fname is the .shp file.  The .shx file next to it is mapped as
+		 well.  Returns false if either file can not be mapped or is not a
+		 point, poly line or polygon shapefile. */
+		bool Open(const wxString& fname);
+		void Close();
+		bool IsOpen() const { return shp != 0; }
+
+		/** Header of the .shp file as stored */
+		const Header& GetHeader() const { return header; }
+		/** POINT_TYP, POLY_LINE or POLYGON */
+		ShapeType GetShapeType() const { return shape_type; }
+		int GetNumRecords() const { return num_records; }
+
+		/** Number of 16-bit words in the contents of record i */
+		wxInt32 GetContentLength(int i) const {
+			return readInt32BE(shx + 100 + 8*i + 4); }
+		bool IsNull(int i) const { return readInt32LE(Rec(i)) == NULL_SHAPE; }
+
+		wxFloat64 GetPointX(int i) const { return readFloat64LE(Rec(i)+4); }
+		wxFloat64 GetPointY(int i) const { return readFloat64LE(Rec(i)+12); }
+
+		/** min x, min y, max x, max y of record i */
+		wxFloat64 GetBox(int i, int j) const {
+			return IsNull(i) ? 0 : readFloat64LE(Rec(i)+4+8*j); }
+		wxInt32 GetNumParts(int i) const {
+			return IsNull(i) ? 0 : readInt32LE(Rec(i)+36); }
+		wxInt32 GetNumPoints(int i) const {
+			return IsNull(i) ? 0 : readInt32LE(Rec(i)+40); }
+		/** Index of the first point of part j of record i */
+		wxInt32 GetPart(int i, int j) const {
+			return readInt32LE(Rec(i)+44+4*j); }
+		wxFloat64 GetX(int i, int k) const {
+			return readFloat64LE(Points(i)+16*k); }
+		wxFloat64 GetY(int i, int k) const {
+			return readFloat64LE(Points(i)+16*k+8); }
+
+		/** Record i as a new PointContents, PolyLineContents or
+		 PolygonContents, or NullShapeContents for a null record.  The caller
+		 owns the result. */
+		RecordContents* NewRecordContents(int i) const;
+		/** Copies the coordinates of all the poly line or polygon records
+		 into buf. */
+		bool FillPolygonBuffer(PolygonBuffer& buf) const;
+
+	private:
+		MappedMain(const MappedMain&);
+		MappedMain& operator=(const MappedMain&);
+
+		/** Start of the contents of record i, after its record header */
+		const char* Rec(int i) const {
+			return shp + 2*(size_t) readInt32BE(shx + 100 + 8*i) + 8; }
+		const char* Points(int i) const {
+			return Rec(i) + 44 + 4*(size_t) readInt32LE(Rec(i)+36); }
+		bool CheckRecords() const;
+
+		boost::interprocess::file_mapping* shp_file;
+		boost::interprocess::mapped_region* shp_region;
+		boost::interprocess::file_mapping* shx_file;
+		boost::interprocess::mapped_region* shx_region;
+		const char* shp;
+		const char* shx;
+		size_t shp_size;
+		Header header;
+		ShapeType shape_type;
+		int num_records;
+	};
+}
+
+#endif
@@ -18,6 +18,8 @@
  */
 
 #include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <boost/random.hpp>
 #include <boost/random/uniform_01.hpp>
 #include <boost/random/normal_distribution.hpp>
@@ -32,6 +34,250 @@
 #include "VarCalc/NumericTests.h"
 #include "logger.h"
 
+namespace {
+	/** Work queue shared by the batch_query worker threads.  Blocks are
+	 contiguous runs of vals, which come out of the packed rtree in
+	 spatial order, so each thread works on a compact region. */
+	template <class Val>
+	struct BatchQueryJob {
+		const std::vector<Val>* vals;
+		GwtElement* gwt;
+		size_t block_size;
+		size_t next;
+		boost::mutex next_mutex;
+		
+		bool GetNextBlock(size_t& start, size_t& end) {
+			boost::mutex::scoped_lock lock(next_mutex);
+			if (next >= vals->size()) return false;
+			start = next;
+			end = std::min(vals->size(), next + block_size);
+			next = end;
+			return true;
+		}
+	};
+	
+	template <class Val, class Op>
+	void batch_query_worker(BatchQueryJob<Val>* job, const Op* op,
+							size_t* cnt)
+	{
+		size_t start, end;
+		size_t c = 0;
+		while (job->GetNextBlock(start, end)) {
+			for (size_t i=start; i<end; ++i) {
+				const Val& v = (*job->vals)[i];
+				c += (*op)(v, job->gwt[v.second]);
+			}
+		}
+		*cnt = c;
+	}
+	
+	/** Run op on every point of rtree in parallel.  The rtree is only read,
+	 and op fills the GwtElement of the point it is given, so no two threads
+	 ever write to the same element.  Returns the total number of neighbors
+	 reported by op. */
+	template <class Rtree, class Val, class Op>
+	size_t batch_query(const Rtree& rtree, GwtElement* gwt, const Op& op)
+	{
+		std::vector<Val> vals;
+		vals.reserve(rtree.size());
+		rtree.query(bgi::intersects(rtree.bounds()), std::back_inserter(vals));
+		
+		BatchQueryJob<Val> job;
+		job.vals = &vals;
+		job.gwt = gwt;
+		job.next = 0;
+		
+		int nCPUs = boost::thread::hardware_concurrency();
+		if (nCPUs < 1) nCPUs = 1;
+		job.block_size = vals.size() / (nCPUs * 16);
+		if (job.block_size < 64) job.block_size = 64;
+		if (job.block_size > 4096) job.block_size = 4096;
+		
+		std::vector<size_t> cnts(nCPUs, 0);
+		if (nCPUs == 1 || vals.size() <= job.block_size) {
+			batch_query_worker(&job, &op, &cnts[0]);
+		} else {
+			boost::thread_group threadPool;
+			for (int t=0; t<nCPUs; t++) {
+				threadPool.create_thread(boost::bind(&batch_query_worker<Val, Op>,
+													 &job, &op, &cnts[t]));
+			}
+			threadPool.join_all();
+		}
+		size_t cnt = 0;
+		for (int t=0; t<nCPUs; t++) cnt += cnts[t];
+		return cnt;
+	}
+	
+	/** Replace the contents of an empty rtree with a packed (STR) bulk load
+	 of vals.  A non-empty rtree falls back to incremental inserts. */
+	template <class Rtree, class Val>
+	void bulk_fill(Rtree& rtree, const std::vector<Val>& vals)
+	{
+		if (rtree.empty()) {
+			Rtree packed(vals.begin(), vals.end());
+			rtree.swap(packed);
+		} else {
+			rtree.insert(vals.begin(), vals.end());
+		}
+	}
+	
+	struct KnnPt2dOp {
+		KnnPt2dOp(const rtree_pt_2d_t& rtree_, int k_)
+		: rtree(rtree_), k(k_) {}
+		size_t operator()(const pt_2d_val& v, GwtElement& e) const {
+			std::vector<pt_2d_val> q;
+			rtree.query(bgi::nearest(v.first, k), std::back_inserter(q));
+			e.alloc(q.size());
+			BOOST_FOREACH(pt_2d_val const& w, q) {
+				if (w.second == v.second) continue;
+				GwtNeighbor neigh;
+				neigh.nbx = w.second;
+				neigh.weight = bg::distance(v.first, w.first);
+				e.Push(neigh);
+			}
+			return e.Size();
+		}
+		const rtree_pt_2d_t& rtree;
+		int k;
+	};
+	
+	struct KnnPt3dOp {
+		KnnPt3dOp(const rtree_pt_3d_t& rtree_, int k_, bool is_arc_,
+				  bool is_mi_)
+		: rtree(rtree_), k(k_), is_arc(is_arc_), is_mi(is_mi_) {}
+		size_t operator()(const pt_3d_val& v, GwtElement& e) const {
+			using namespace GenGeomAlgs;
+			std::vector<pt_3d_val> q;
+			rtree.query(bgi::nearest(v.first, k), std::back_inserter(q));
+			e.alloc(q.size());
+			double lon_v, lat_v;
+			double x_v, y_v;
+			if (is_arc) {
+				UnitToLongLatDeg(bg::get<0>(v.first), bg::get<1>(v.first),
+								 bg::get<2>(v.first), lon_v, lat_v);
+			} else {
+				x_v = bg::get<0>(v.first);
+				y_v = bg::get<1>(v.first);
+			}
+			BOOST_FOREACH(pt_3d_val const& w, q) {
+				if (w.second == v.second) continue;
+				GwtNeighbor neigh;
+				neigh.nbx = w.second;
+				if (is_arc) {
+					double lon_w, lat_w;
+					UnitToLongLatDeg(bg::get<0>(w.first), bg::get<1>(w.first),
+									 bg::get<2>(w.first), lon_w, lat_w);
+					if (is_mi) {
+						neigh.weight = ComputeArcDistMi(lon_v, lat_v,
+														lon_w, lat_w);
+					} else {
+						neigh.weight = ComputeArcDistKm(lon_v, lat_v,
+														lon_w, lat_w);
+					}
+				} else {
+					neigh.weight = ComputeEucDist(x_v, y_v,
+												  bg::get<0>(w.first),
+												  bg::get<1>(w.first));
+				}
+				e.Push(neigh);
+			}
+			return e.Size();
+		}
+		const rtree_pt_3d_t& rtree;
+		int k;
+		bool is_arc;
+		bool is_mi;
+	};
+	
+	struct KnnPtLonLatOp {
+		KnnPtLonLatOp(const rtree_pt_lonlat_t& rtree_, int k_)
+		: rtree(rtree_), k(k_) {}
+		size_t operator()(const pt_lonlat_val& v, GwtElement& e) const {
+			std::vector<pt_lonlat_val> q;
+			rtree.query(bgi::nearest(v.first, k), std::back_inserter(q));
+			e.alloc(q.size());
+			BOOST_FOREACH(const pt_lonlat_val& w, q) {
+				if (w.second == v.second) continue;
+				GwtNeighbor neigh;
+				neigh.nbx = w.second;
+				neigh.weight = bg::distance(v.first, w.first);
+				e.Push(neigh);
+			}
+			return e.Size();
+		}
+		const rtree_pt_lonlat_t& rtree;
+		int k;
+	};
+	
+	struct ThreshPt2dOp {
+		ThreshPt2dOp(const rtree_pt_2d_t& rtree_, double th_)
+		: rtree(rtree_), th(th_) {}
+		size_t operator()(const pt_2d_val& v, GwtElement& e) const {
+			double x = v.first.get<0>();
+			double y = v.first.get<1>();
+			box_2d b(pt_2d(x-th, y-th), pt_2d(x+th, y+th));
+			std::vector<pt_2d_val> q;
+			rtree.query(bgi::intersects(b), std::back_inserter(q));
+			std::vector<GwtNeighbor> l;
+			BOOST_FOREACH(pt_2d_val const& w, q) {
+				if (w.second == v.second) continue;
+				double d = bg::distance(v.first, w.first);
+				if (d <= th) l.push_back(GwtNeighbor(w.second, d));
+			}
+			e.alloc(l.size());
+			// same neighbor order as the former list based version
+			for (size_t i=l.size(); i>0; --i) e.Push(l[i-1]);
+			return e.Size();
+		}
+		const rtree_pt_2d_t& rtree;
+		double th;
+	};
+	
+	struct ThreshPt3dOp {
+		ThreshPt3dOp(const rtree_pt_3d_t& rtree_, double th_, bool is_mi_)
+		: rtree(rtree_), th(th_), is_mi(is_mi_) {}
+		size_t operator()(const pt_3d_val& v, GwtElement& e) const {
+			using namespace GenGeomAlgs;
+			double vx = v.first.get<0>();
+			double vy = v.first.get<1>();
+			double vz = v.first.get<2>();
+			double lon_v, lat_v;
+			UnitToLongLatDeg(vx, vy, vz, lon_v, lat_v);
+			box_3d b(pt_3d(vx-th, vy-th, vz-th), pt_3d(vx+th, vy+th, vz+th));
+			std::vector<pt_3d_val> q;
+			rtree.query(bgi::intersects(b), std::back_inserter(q));
+			std::vector<const pt_3d_val*> l;
+			BOOST_FOREACH(pt_3d_val const& w, q) {
+				if (w.second != v.second &&
+					bg::distance(v.first, w.first) <= th)
+				{
+					l.push_back(&w);
+				}
+			}
+			e.alloc(l.size());
+			// same neighbor order as the former list based version
+			for (size_t i=l.size(); i>0; --i) {
+				const pt_3d_val& w = *l[i-1];
+				double lon_w, lat_w;
+				UnitToLongLatDeg(w.first.get<0>(), w.first.get<1>(),
+								 w.first.get<2>(), lon_w, lat_w);
+				double d;
+				if (is_mi) {
+					d = ComputeArcDistMi(lon_v, lat_v, lon_w, lat_w);
+				} else {
+					d = ComputeArcDistKm(lon_v, lat_v, lon_w, lat_w);
+				}
+				e.Push(GwtNeighbor(w.second, d));
+			}
+			return e.Size();
+		}
+		const rtree_pt_3d_t& rtree;
+		double th;
+		bool is_mi;
+	};
+}
+
 void SpatialIndAlgs::get_centroids(std::vector<pt_2d>& centroids,
 				   const Shapefile::Main& main_data)
 {
@@ -377,27 +623,8 @@ GwtWeight* SpatialIndAlgs::knn_build(const rtree_pt_2d_t& rtree, int nn)
 	Wp->symmetry_checked = true;
 	Wp->gwt = new GwtElement[Wp->num_obs];
 	
-	int cnt=0;
-	const int k=nn+1;
-	for (rtree_pt_2d_t::const_query_iterator it =
-			 rtree.qbegin(bgi::intersects(rtree.bounds()));
-		 it != rtree.qend() ; ++it)
-	{
-		const pt_2d_val& v = *it;
-		size_t obs = v.second;		
-		vector<pt_2d_val> q;
-		rtree.query(bgi::nearest(v.first, k), std::back_inserter(q));
-		GwtElement& e = Wp->gwt[obs];
-		e.alloc(q.size());
-		BOOST_FOREACH(pt_2d_val const& w, q) {
-			if (w.second == v.second) continue;
-			GwtNeighbor neigh;
-			neigh.nbx = w.second;
-			neigh.weight = bg::distance(v.first, w.first);
-			e.Push(neigh);
-			++cnt;
-		}
-	}
+	size_t cnt = batch_query<rtree_pt_2d_t, pt_2d_val>(rtree, Wp->gwt,
+								KnnPt2dOp(rtree, nn+1));
 
 	stringstream ss;
 	ss << "Time to create " << nn << "-NN GwtWeight "
@@ -420,49 +647,8 @@ GwtWeight* SpatialIndAlgs::knn_build(const rtree_pt_3d_t& rtree, int nn,
 	Wp->symmetry_checked = true;
 	Wp->gwt = new GwtElement[Wp->num_obs];
 	
-	int cnt=0;
-	const int k=nn+1;
-	for (rtree_pt_3d_t::const_query_iterator it =
-			 rtree.qbegin(bgi::intersects(rtree.bounds()));
-		 it != rtree.qend() ; ++it)
-	{
-		const pt_3d_val& v = *it;
-		size_t obs = v.second;		
-		vector<pt_3d_val> q;
-		rtree.query(bgi::nearest(v.first, k), std::back_inserter(q));
-		GwtElement& e = Wp->gwt[obs];
-		e.alloc(q.size());
-		double lon_v, lat_v;
-		double x_v, y_v;
-		if (is_arc) {
-			UnitToLongLatDeg(bg::get<0>(v.first), bg::get<1>(v.first),
-							 bg::get<2>(v.first), lon_v, lat_v);
-		} else {
-			x_v = bg::get<0>(v.first);
-			y_v = bg::get<1>(v.first);
-		}
-		BOOST_FOREACH(pt_3d_val const& w, q) {
-			if (w.second == v.second) continue;
-			GwtNeighbor neigh;
-			neigh.nbx = w.second;
-			if (is_arc) {
-				double lon_w, lat_w;
-				UnitToLongLatDeg(bg::get<0>(w.first), bg::get<1>(w.first),
-								 bg::get<2>(w.first), lon_w, lat_w);
-				if (is_mi) {
-					neigh.weight = ComputeArcDistMi(lon_v, lat_v, lon_w, lat_w);
-				} else {
-					neigh.weight = ComputeArcDistKm(lon_v, lat_v, lon_w, lat_w);
-				}
-			} else {
-				//neigh.weight = bg::distance(v.first, w.first);
-				neigh.weight = ComputeEucDist(x_v, y_v,
-											  bg::get<0>(w.first), bg::get<1>(w.first));
-			}
-			e.Push(neigh);
-			++cnt;
-		}
-	}
+	size_t cnt = batch_query<rtree_pt_3d_t, pt_3d_val>(rtree, Wp->gwt,
+								KnnPt3dOp(rtree, nn+1, is_arc, is_mi));
 
 	stringstream ss;
 	ss << "Time to create 3D " << (is_arc ? " arc " : "")
@@ -735,38 +921,8 @@ GwtWeight* SpatialIndAlgs::thresh_build(const rtree_pt_2d_t& rtree, double th)
 	Wp->symmetry_checked = true;
 	Wp->gwt = new GwtElement[Wp->num_obs];
 	
-	int cnt=0;
-	for (rtree_pt_2d_t::const_query_iterator it =
-			 rtree.qbegin(bgi::intersects(rtree.bounds()));
-		 it != rtree.qend() ; ++it)
-	{
-		const pt_2d_val& v = *it;
-		double x = v.first.get<0>();
-		double y = v.first.get<1>();
-		box_2d b(pt_2d(x-th, y-th), pt_2d(x+th, y+th));
-		size_t obs = v.second;		
-		vector<pt_2d_val> q;
-		rtree.query(bgi::intersects(b), std::back_inserter(q));
-		size_t lcnt = 0;
-		list<pt_2d_val> l;
-		BOOST_FOREACH(pt_2d_val const& w, q) {
-			if (w.second != v.second &&
-				bg::distance(v.first, w.first) <= th)
-			{
-				l.push_front(w);
-				++lcnt;
-			}
-		}
-		GwtElement& e = Wp->gwt[obs];
-		e.alloc(lcnt);
-		BOOST_FOREACH(pt_2d_val const& w, l) {
-			GwtNeighbor neigh;
-			neigh.nbx = w.second;
-			neigh.weight = bg::distance(v.first, w.first);
-			e.Push(neigh);
-			++cnt;
-		}
-	}
+	size_t cnt = batch_query<rtree_pt_2d_t, pt_2d_val>(rtree, Wp->gwt,
+								ThreshPt2dOp(rtree, th));
 
 	stringstream ss;
 	ss << "Time to create " << th << " threshold GwtWeight,"
@@ -840,52 +996,8 @@ GwtWeight* SpatialIndAlgs::thresh_build(const rtree_pt_3d_t& rtree, double th, b
 		ss << "Input th (earth mi): " << EarthRadToMi(r);	
 		LOG_MSG(ss.str());
 	}
-	int cnt=0;
-	for (rtree_pt_3d_t::const_query_iterator it =
-			 rtree.qbegin(bgi::intersects(rtree.bounds()));
-		 it != rtree.qend() ; ++it)
-	{
-		const pt_3d_val& v = *it;
-		double vx = v.first.get<0>();
-		double vy = v.first.get<1>();
-		double vz = v.first.get<2>();
-		double lon_v, lat_v;
-		UnitToLongLatDeg(vx, vy, vz, lon_v, lat_v);
-		box_3d b(pt_3d(vx-th, vy-th, vz-th), pt_3d(vx+th, vy+th, vz+th));
-		size_t obs = v.second;
-		vector<pt_3d_val> q;
-		rtree.query(bgi::intersects(b), std::back_inserter(q));
-		size_t lcnt = 0;
-		list<pt_3d_val> l;
-		BOOST_FOREACH(pt_3d_val const& w, q) {
-			if (w.second != v.second &&
-				bg::distance(v.first, w.first) <= th)
-			{
-				l.push_front(w);
-				++lcnt;
-			}
-		}
-		GwtElement& e = Wp->gwt[obs];
-		e.alloc(lcnt);
-		BOOST_FOREACH(pt_3d_val const& w, l) {
-			GwtNeighbor neigh;
-			neigh.nbx = w.second;
-			double wx = w.first.get<0>();
-			double wy = w.first.get<1>();
-			double wz = w.first.get<2>();
-			double lon_w, lat_w;
-			double d;
-			UnitToLongLatDeg(wx, wy, wz, lon_w, lat_w);
-			if (is_mi) {
-				d = ComputeArcDistMi(lon_v, lat_v, lon_w, lat_w);
-			} else {
-				d = ComputeArcDistKm(lon_v, lat_v, lon_w, lat_w);
-			}
-			neigh.weight = d;
-			e.Push(neigh);
-			++cnt;
-		}
-	}
+	size_t cnt = batch_query<rtree_pt_3d_t, pt_3d_val>(rtree, Wp->gwt,
+								ThreshPt3dOp(rtree, th, is_mi));
 
 	stringstream ss;
 	ss << "Time to create arc " << th << " threshold GwtWeight,"
@@ -1036,27 +1148,8 @@ GwtWeight* SpatialIndAlgs::knn_build(const rtree_pt_lonlat_t& rtree, int nn)
 	Wp->symmetry_checked = true;
 	Wp->gwt = new GwtElement[Wp->num_obs];
 	
-	int cnt=0;
-	const int k=nn+1;
-	for (rtree_pt_lonlat_t::const_query_iterator it =
-			 rtree.qbegin(bgi::intersects(rtree.bounds()));
-		 it != rtree.qend() ; ++it)
-	{
-		const pt_lonlat_val& v = *it;
-		size_t obs = v.second;		
-		vector<pt_lonlat_val> q;
-		rtree.query(bgi::nearest(v.first, k), std::back_inserter(q));
-		GwtElement& e = Wp->gwt[obs];
-		e.alloc(q.size());
-		BOOST_FOREACH(const pt_lonlat_val& w, q) {
-			if (w.second == v.second) continue;
-			GwtNeighbor neigh;
-			neigh.nbx = w.second;
-			neigh.weight = bg::distance(v.first, w.first);
-			e.Push(neigh);
-			++cnt;
-		}
-	}
+	size_t cnt = batch_query<rtree_pt_lonlat_t, pt_lonlat_val>(rtree, Wp->gwt,
+								KnnPtLonLatOp(rtree, nn+1));
 
 	stringstream ss;
 	ss << "Time to create " << nn << "-NN arc-distance GwtWeight "
@@ -1141,6 +1234,7 @@ void SpatialIndAlgs::fill_box_rtree(rtree_box_2d_t& rtree,
 	namespace sf = Shapefile;
 	size_t obs = main_data.records.size();
 	sf::PolygonContents* p;
+	vector<box_2d_val> vals(obs);
 	for (size_t i=0; i<obs; ++i) {
 		p = (sf::PolygonContents*) main_data.records[i].contents_p;
 		// p->box bounding box order: xmin, ymin, xmax, ymax
@@ -1149,8 +1243,9 @@ void SpatialIndAlgs::fill_box_rtree(rtree_box_2d_t& rtree,
 		double xmin, ymin, xmax, ymax;
 		get_shp_bb(p, xmin, ymin, xmax, ymax);
 		box_2d b(pt_2d(xmin, ymin), pt_2d(xmax, ymax));
-		rtree.insert(std::make_pair(b, i));
+		vals[i] = std::make_pair(b, i);
 	}
+	bulk_fill(rtree, vals);
 	 // create some values
 	/*
     for ( unsigned i = 0 ; i < obs ; ++i ) {
@@ -1172,9 +1267,9 @@ void SpatialIndAlgs::fill_pt_rtree(rtree_pt_2d_t& rtree,
 	using namespace std;
 	wxStopWatch sw;
 	size_t obs = pts.size();
-	for (size_t i=0; i<obs; ++i) {
-		rtree.insert(make_pair(pts[i], i));
-	}
+	vector<pt_2d_val> vals(obs);
+	for (size_t i=0; i<obs; ++i) vals[i] = make_pair(pts[i], i);
+	bulk_fill(rtree, vals);
 
 	stringstream ss;
 	ss << "Time to insert " << rtree.size()
@@ -1188,9 +1283,9 @@ void SpatialIndAlgs::fill_pt_rtree(rtree_pt_lonlat_t& rtree,
 	using namespace std;
 	wxStopWatch sw;
 	size_t obs = pts.size();
-	for (size_t i=0; i<obs; ++i) {
-		rtree.insert(make_pair(pts[i], i));
-	}
+	vector<pt_lonlat_val> vals(obs);
+	for (size_t i=0; i<obs; ++i) vals[i] = make_pair(pts[i], i);
+	bulk_fill(rtree, vals);
 
 	stringstream ss;
 	ss << "Time to insert " << rtree.size()
@@ -1204,9 +1299,9 @@ void SpatialIndAlgs::fill_pt_rtree(rtree_pt_3d_t& rtree,
 	using namespace std;
 	wxStopWatch sw;
 	size_t obs = pts.size();
-	for (size_t i=0; i<obs; ++i) {
-		rtree.insert(make_pair(pts[i], i));
-	}
+	vector<pt_3d_val> vals(obs);
+	for (size_t i=0; i<obs; ++i) vals[i] = make_pair(pts[i], i);
+	bulk_fill(rtree, vals);
 
 	stringstream ss;
 	ss << "Time to insert " << rtree.size()
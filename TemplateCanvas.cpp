@@ -18,6 +18,7 @@
  */
 
 
+#include <algorithm>
 #include <limits>
 #include <math.h>
 #include <map>
@@ -32,6 +33,7 @@
 #include <wx/menu.h>
 #include <wx/dcbuffer.h>
 #include <wx/graphics.h>
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/array.hpp>
 #include <boost/geometry/geometry.hpp>
@@ -53,6 +55,8 @@
 #include "logger.h"
 #include "TemplateCanvas.h"
 #include "TemplateFrame.h"
+#include "TileRenderer.h"
+#include "ShapeOperations/PolygonLod.h"
 #include "GdaConst.h"
 
 BOOST_GEOMETRY_REGISTER_C_ARRAY_CS(boost::geometry::cs::cartesian)
@@ -118,7 +122,10 @@ TemplateCanvas::TemplateCanvas(wxWindow* parent,
     basemap(0),
 	basemap_bm(0), layer0_bm(0), layer1_bm(0), layer2_bm(0), final_bm(0),
 	layerbase_valid(true), layer0_valid(false),
-    layer1_valid(false), layer2_valid(false),
+    layer1_valid(false), layer2_valid(false), layer1_hl_epoch(0),
+	sel_rtree_valid(false), sel_rtree_size(0), sel_rtree_max_radius(0),
+	brush_stamp_cnt(0), sel_list_epoch(0), sel_list_valid(false),
+	tile_renderer(0), tile_compose(false),
 	total_hover_obs(0), max_hover_obs(11), hover_obs(11),
 	is_pan_zoom(false), is_scrolled(false), prev_scroll_pos_x(0),
 	prev_scroll_pos_y(0),
@@ -145,6 +152,8 @@ TemplateCanvas::TemplateCanvas(wxWindow* parent,
 TemplateCanvas::~TemplateCanvas()
 {
 	LOG_MSG("Entering TemplateCanvas::~TemplateCanvas()");
+	// wait for the workers, which may still post to this canvas
+	if (tile_renderer) delete tile_renderer;
 	BOOST_FOREACH( GdaShape* shp, background_shps ) delete shp;
 	BOOST_FOREACH( GdaShape* shp, selectable_shps ) delete shp;
 	BOOST_FOREACH( GdaShape* shp, foreground_shps ) delete shp;
@@ -405,6 +414,7 @@ void TemplateCanvas::ResizeSelectableShps(int virtual_scrn_w,
         layer0_valid = false;
         layer1_valid = false;
         layer2_valid = false;
+        sel_rtree_valid = false;
         return;
 	}
 	// NOTE: we do not support both fixed_aspect_ratio_mode
@@ -507,6 +517,7 @@ void TemplateCanvas::ResizeSelectableShps(int virtual_scrn_w,
     layer0_valid = false;
     layer1_valid = false;
     layer2_valid = false;
+    sel_rtree_valid = false;
 }
 
 void TemplateCanvas::ResetShapes()
@@ -661,12 +672,24 @@ void TemplateCanvas::CreateSelShpsFromProj(
 	if (selectable_shps.size() > 0) return;
 	int num_recs = project->GetNumRecords();
 	selectable_shps.resize(num_recs);
+	UpdateSelShpsFromProj(selectable_shps, project, 0, num_recs);
+}
+
+void TemplateCanvas::UpdateSelShpsFromProj(
+							std::vector<GdaShape*>& selectable_shps,
+							Project* project, int start, int end)
+{
+	using namespace Shapefile;
+	
 	std::vector<MainRecord>& records = project->main_data.records;
 	Header& hdr = project->main_data.header;
+	for (int i=start; i<end; i++) {
+		if (selectable_shps[i]) delete selectable_shps[i];
+	}
 	
 	if (hdr.shape_type == Shapefile::POINT_TYP) {
 		PointContents* pc = 0;
-		for (int i=0; i<num_recs; i++) {
+		for (int i=start; i<end; i++) {
 			pc = (PointContents*) records[i].contents_p;
 			if (pc->shape_type == 0) {
 				selectable_shps[i] = new GdaPoint();
@@ -687,7 +710,7 @@ void TemplateCanvas::CreateSelShpsFromProj(
 		// create the rtree using default constructor
 		//bgi::rtree< value, bgi::rstar<16, 4> > rtree;
 		PolygonContents* pc = 0;
-		for (int i=0; i<num_recs; i++) {
+		for (int i=start; i<end; i++) {
 			pc = (PolygonContents*) records[i].contents_p;
 			selectable_shps[i] = new GdaPolygon(pc);
 			//box b(point(pc->box[0],pc->box[1]), point(pc->box[2],pc->box[3]));
@@ -696,7 +719,7 @@ void TemplateCanvas::CreateSelShpsFromProj(
 	} else if (hdr.shape_type == Shapefile::POLY_LINE) {
 		PolyLineContents* pc = 0;
 		wxPen pen(GdaConst::selectable_fill_color, 1, wxSOLID);
-		for (int i=0; i<num_recs; i++) {
+		for (int i=start; i<end; i++) {
 			pc = (PolyLineContents*) records[i].contents_p;
 			selectable_shps[i] = new GdaPolyLine(pc);
 		}
@@ -832,6 +855,44 @@ void TemplateCanvas::update(HLStateInt* o)
 	int nh_cnt = o->GetTotalNewlyHighlighted();
 	int nuh_cnt = o->GetTotalNewlyUnhighlighted();
     
+	// A small delta that only adds to the selection made right after the
+	// state layer1_bm was drawn for can be painted on top of layer1_bm
+	// directly, without redrawing every highlighted shape.
+	if (nuh_cnt == 0 && layer1_valid && layer1_bm &&
+		o->IsSparseDeltaFrom(layer1_hl_epoch) &&
+		selectable_shps.size() == o->GetHighlightSize())
+	{
+		LOG_MSG("processing sparse HLStateInt::delta");
+		{
+			wxMemoryDC dc(*layer1_bm);
+			DrawNewSelShapes(dc);
+		}
+		layer1_hl_epoch = o->GetEpoch();
+		DrawLayer2();
+		isRepaint = true;
+		Refresh();
+		UpdateStatusBar();
+		LOG_MSG("Exiting TemplateCanvas::update");
+		return;
+	}
+	
+	// Any other small delta is repainted in the box around the changed
+	// shapes only.
+	if (layer1_valid && layer1_bm && layer0_valid &&
+		o->IsSparseDeltaFrom(layer1_hl_epoch) &&
+		selectable_shps.size() == o->GetHighlightSize() &&
+		RepaintHighlightDelta())
+	{
+		LOG_MSG("processing sparse HLStateInt::delta in a box");
+		layer1_hl_epoch = o->GetEpoch();
+		DrawLayer2();
+		isRepaint = true;
+		Refresh();
+		UpdateStatusBar();
+		LOG_MSG("Exiting TemplateCanvas::update");
+		return;
+	}
+	
 	HLStateInt::EventType type = highlight_state->GetEventType();
 	if (type == HLStateInt::delta) {
 		LOG_MSG("processing HLStateInt::delta");
@@ -924,6 +985,7 @@ void TemplateCanvas::DrawLayer0()
     
     layer0_valid = true;
     layer1_valid = false;
+    sel_rtree_valid = false;
 }
 
 
@@ -937,6 +999,7 @@ void TemplateCanvas::DrawLayer1()
     dc.DrawBitmap(*layer0_bm, 0, 0);
     if (!draw_sel_shps_by_z_val)
         DrawHighlightedShapes(dc);
+    layer1_hl_epoch = highlight_state->GetEpoch();
     layer1_valid = true;
     layer2_valid = false;
 }
@@ -1097,6 +1160,12 @@ void TemplateCanvas::DrawSelectableShapes(wxMemoryDC &dc)
 {
 	//LOG_MSG("In TemplateCanvas::DrawSelectableShapes");
 	if (selectable_shps.size() == 0) return;
+	if (UseTileRenderer()) {
+		if (tile_compose) DrawRenderedTiles(dc);
+		else StartTileRender();
+		return;
+	}
+	if (tile_renderer) tile_renderer->Cancel();
 	wxStopWatch sw;
 	if (use_category_brushes) {
 #ifdef __WXMAC__
@@ -1113,6 +1182,112 @@ void TemplateCanvas::DrawSelectableShapes(wxMemoryDC &dc)
 							 "%ld ms", sw.Time()));
 }
 
+/** Large layers of polygons, points or circles coloured by category are
+ rasterized by a TileRenderer, except over a basemap, which needs the
+ transparency of DrawSelectableShapes_gc. */
+bool TemplateCanvas::UseTileRenderer()
+{
+	if (!use_category_brushes || draw_sel_shps_by_z_val || isDrawBasemap) {
+		return false;
+	}
+	if (selectable_shps_type != points && selectable_shps_type != polygons &&
+		selectable_shps_type != circles) return false;
+	return (int) selectable_shps.size() >= GdaConst::tile_render_min_shps;
+}
+
+/** Copies the selectable shapes into a RenderScene with the colours of
+ DrawSelectableShapes_gc and starts rendering it.  Layer 0 is left without
+ the shapes until OnTilesRendered draws the first tiles. */
+void TemplateCanvas::StartTileRender()
+{
+	int w = layer0_bm->GetWidth();
+	int h = layer0_bm->GetHeight();
+	RenderScene* scene = new RenderScene(w, h);
+	int cc_ts = cat_data.curr_canvas_tm_step;
+	int num_cats = cat_data.GetNumCategories(cc_ts);
+	double r = GdaConst::my_point_click_radius;
+	if (w < 150 || h < 150) r *= 0.66;
+	if (selectable_shps.size() > 100 && (w < 80 || h < 80)) r = 0.2;
+	PolygonLod* lod = project ? project->GetPolygonLod() : 0;
+	for (int cat=0; cat<num_cats; cat++) {
+		std::vector<int>& ids = cat_data.GetIdsRef(cc_ts, cat);
+		if (selectable_shps_type == points) {
+			wxColour clr = cat_data.GetCategoryColor(cc_ts, cat);
+			scene->SetStyle(clr, false, clr, true);
+			for (int i=0, iend=ids.size(); i<iend; i++) {
+				GdaPoint* p = (GdaPoint*) selectable_shps[ids[i]];
+				if (p->isNull()) continue;
+				scene->AddCircle(p->center.x, p->center.y, r);
+			}
+			continue;
+		}
+		wxPen pen = cat_data.GetCategoryPen(cc_ts, cat);
+		wxBrush br = cat_data.GetCategoryBrush(cc_ts, cat);
+		wxColour fill = br.IsOk() ? br.GetColour() : selectable_fill_color;
+		bool fill_on = !br.IsOk() || !br.IsTransparent();
+		bool line_on = (selectable_outline_visible && pen.IsOk() &&
+						!pen.IsTransparent());
+		scene->SetStyle(fill, fill_on, pen.GetColour(), line_on);
+		for (int i=0, iend=ids.size(); i<iend; i++) {
+			GdaShape* s = selectable_shps[ids[i]];
+			if (s == NULL || s->isNull()) continue;
+			if (selectable_shps_type == polygons) {
+				scene->AddPolygon((GdaPolygon*) s, lod, ids[i]);
+			} else {
+				GdaCircle* c = (GdaCircle*) s;
+				scene->AddCircle(c->center.x, c->center.y, c->radius);
+			}
+		}
+	}
+	scene->Finish(TileRenderer::tile_size);
+	if (!tile_renderer) tile_renderer = new TileRenderer();
+	tile_renderer->Start(scene,
+						 boost::bind(&TemplateCanvas::NotifyTilesRendered, this));
+}
+
+void TemplateCanvas::DrawRenderedTiles(wxDC &dc)
+{
+	int w = tile_renderer->GetWidth();
+	int h = tile_renderer->GetHeight();
+	if (w <= 0 || h <= 0) return;
+	const std::vector<unsigned char>& px = tile_renderer->GetPixels();
+	wxImage image(w, h, false);
+	image.InitAlpha();
+	unsigned char* rgb = image.GetData();
+	unsigned char* alpha = image.GetAlpha();
+	for (size_t i=0, n=(size_t) w*h; i<n; i++) {
+		rgb[3*i] = px[4*i];
+		rgb[3*i+1] = px[4*i+1];
+		rgb[3*i+2] = px[4*i+2];
+		alpha[i] = px[4*i+3];
+	}
+	dc.DrawBitmap(wxBitmap(image, 32), 0, 0, true);
+}
+
+void TemplateCanvas::NotifyTilesRendered()
+{
+	CallAfter(&TemplateCanvas::OnTilesRendered);
+}
+
+/** Repaints layer 0 with the tiles rendered so far.  Nothing is done if
+ layer 0 is to be redrawn anyway, which starts a new render. */
+void TemplateCanvas::OnTilesRendered()
+{
+	if (!tile_renderer || !layer0_bm || !layer0_valid) return;
+	if (!tile_renderer->Collect()) return;
+	if (tile_renderer->GetWidth() != layer0_bm->GetWidth() ||
+		tile_renderer->GetHeight() != layer0_bm->GetHeight()) return;
+	// the shapes did not change, so neither did their index
+	bool rtree_valid = sel_rtree_valid;
+	tile_compose = true;
+	DrawLayer0();
+	tile_compose = false;
+	sel_rtree_valid = rtree_valid;
+	layer1_valid = false;
+	layer2_valid = false;
+	DrawLayers();
+}
+
 // draw unhighlighted selectable shapes with wxGraphicsContext
 void TemplateCanvas::DrawSelectableShapes_gc(wxMemoryDC &dc)
 {
@@ -1163,6 +1338,8 @@ void TemplateCanvas::DrawSelectableShapes_gc(wxMemoryDC &dc)
 		int dirty_cnt = 0;
 		int poly_pts_cnt = 0;
 		GdaPolygon* p;
+		// the simplified rings are only drawn, hit testing uses p->points
+		PolygonLod* lod = project ? project->GetPolygonLod() : 0;
 		if (!selectable_outline_visible) 
 			gc->SetAntialiasMode(wxANTIALIAS_NONE);
 		for (int cat=0; cat<num_cats; cat++) {
@@ -1186,8 +1363,24 @@ void TemplateCanvas::DrawSelectableShapes_gc(wxMemoryDC &dc)
 				wxGraphicsPath path = gc->CreatePath();
 				p = (GdaPolygon*) selectable_shps[ids[i]];
 				if (p==NULL || p->isNull()) continue;
+				int level = -1;
+				if (lod && lod->Matches(ids[i], p->pc)) {
+					level = lod->ChooseLevel(p->points_scale);
+				}
 				if (p->all_points_same) {
                     path.AddCircle(p->center.x, p->center.y, 0.2);
+				} else if (level >= 0) {
+					for (int j=0, nr=lod->GetNumRings(level, ids[i]); j<nr;
+						 j++) {
+						const int* r = lod->RingBegin(level, ids[i], j);
+						const int* r_end = lod->RingEnd(level, ids[i], j);
+						path.MoveToPoint(p->points[*r]);
+						for (r++; r<r_end; r++) {
+							path.AddLineToPoint(p->points[*r]);
+							poly_pts_cnt++;
+						}
+						path.CloseSubpath();
+					}
 				} else {
 					for (int c=0, s=0, t=p->count[0]; c<p->n_count; c++) {
 						path.MoveToPoint(p->points[s]);
@@ -1683,9 +1876,17 @@ void TemplateCanvas::DrawNewSelShapes(wxMemoryDC &dc)
 }
 
 void TemplateCanvas::DrawNewSelShapes_gc(wxMemoryDC &dc)
+{
+	DrawSelShapeList_gc(dc, GetNewlySelList(), GetNumNewlySel());
+}
+
+void TemplateCanvas::DrawSelShapeList_gc(wxMemoryDC &dc,
+										 const std::vector<int>& nh,
+										 int total, const wxRect* clip)
 {
 	wxGraphicsContext* gc = wxGraphicsContext::Create(dc);
 	if (!gc) return;
+	if (clip) gc->Clip(clip->x, clip->y, clip->width, clip->height);
 	
 	wxBrush hc_brush(wxBrush(highlight_color, wxBRUSHSTYLE_CROSSDIAG_HATCH));
 	wxPen hc_pen(highlight_color);
@@ -1700,9 +1901,6 @@ void TemplateCanvas::DrawNewSelShapes_gc(wxMemoryDC &dc)
 	int w = layer0_bm->GetWidth();
 	int h = layer0_bm->GetHeight();
 	
-	int total = GetNumNewlySel();
-	std::vector<int>& nh = GetNewlySelList();
-	
 	if (selectable_shps_type == points) {
 		//std::vector<bool> dirty(w*h, false);
 		GdaPoint* p;
@@ -1777,6 +1975,9 @@ void TemplateCanvas::DrawNewSelShapes_gc(wxMemoryDC &dc)
 				if (c->isNull()) continue;
 				wxGraphicsPath path = gc->CreatePath();
 				path.AddCircle(c->center.x, c->center.y, c->radius);
+				gc->SetBrush(c->getBrush());
+				gc->FillPath(path, wxWINDING_RULE);
+				gc->SetBrush(hc_brush);
 				gc->FillPath(path, wxWINDING_RULE);
 				gc->StrokePath(path);
 			}
@@ -1791,6 +1992,9 @@ void TemplateCanvas::DrawNewSelShapes_gc(wxMemoryDC &dc)
 				if (c->isNull()) continue;
 				wxGraphicsPath path = gc->CreatePath();
 				path.AddCircle(c->center.x, c->center.y, c->radius);
+				gc->SetBrush(c->getBrush());
+				gc->FillPath(path, wxWINDING_RULE);
+				gc->SetBrush(hc_brush);
 				gc->FillPath(path, wxWINDING_RULE);
 			}
 		}
@@ -1813,6 +2017,98 @@ void TemplateCanvas::DrawNewSelShapes_gc(wxMemoryDC &dc)
 	delete gc;	
 }
 
+bool TemplateCanvas::RepaintHighlightDelta()
+{
+	if (selectable_shps.size() == 0) return false;
+	int w = layer1_bm->GetWidth();
+	int h = layer1_bm->GetHeight();
+	wxRect box;
+	int nh_cnt = GetNumNewlySel();
+	std::vector<int>& nh = GetNewlySelList();
+	int nuh_cnt = GetNumNewlyUnsel();
+	std::vector<int>& nuh = GetNewlyUnselList();
+	for (int i=0; i<nh_cnt+nuh_cnt; i++) {
+		wxRect r;
+		if (!GetHighlightBox(i < nh_cnt ? nh[i] : nuh[i-nh_cnt], r)) {
+			return false;
+		}
+		box.Union(r);
+	}
+	box.Intersect(wxRect(0, 0, w, h));
+	if (box.IsEmpty()) return true;
+	if ((double) box.width * box.height * 100 >
+		(double) w * h * GdaConst::highlight_repaint_max_pct) return false;
+	
+	// every highlighted shape that paints into box, in the order of
+	// DrawHighlightedShapes
+	std::vector<bool>& hs = GetSelBitVec();
+	QuerySelRtree(box.GetTopLeft(), box.GetBottomRight(), 2);
+	repaint_hl.clear();
+	for (size_t k=0, kend=brush_cands.size(); k<kend; k++) {
+		if (hs[brush_cands[k]]) repaint_hl.push_back(brush_cands[k]);
+	}
+	std::sort(repaint_hl.begin(), repaint_hl.end());
+	
+	RestoreLayer1Rect(box);
+	wxMemoryDC dc(*layer1_bm);
+	if (use_category_brushes) {
+		DrawSelShapeList_gc(dc, repaint_hl, repaint_hl.size(), &box);
+	} else {
+		dc.SetClippingRegion(box);
+		for (size_t k=0, kend=repaint_hl.size(); k<kend; k++) {
+			selectable_shps[repaint_hl[k]]->paintSelf(dc);
+		}
+		dc.DestroyClippingRegion();
+	}
+	return true;
+}
+
+/** The box is grown by 2 pixels for outlines and anti-aliasing, which is
+ also the padding RepaintHighlightDelta adds to its sel_rtree query. */
+bool TemplateCanvas::GetHighlightBox(int i, wxRect& r)
+{
+	GdaShape* shp = selectable_shps[i];
+	if (shp == NULL || shp->isNull()) {
+		r = wxRect();
+		return true;
+	}
+	int xmin = shp->center.x, xmax = xmin;
+	int ymin = shp->center.y, ymax = ymin;
+	int pad = 2;
+	if (selectable_shps_type == points) {
+		pad += GdaConst::my_point_click_radius + 1;
+	} else if (selectable_shps_type == circles) {
+		pad += (int) ceil(((GdaCircle*) shp)->radius);
+	} else if (selectable_shps_type == polygons) {
+		GdaPolygon* p = (GdaPolygon*) shp;
+		for (int j=0; j<p->n && !p->all_points_same; j++) {
+			xmin = std::min(xmin, p->points[j].x);
+			xmax = std::max(xmax, p->points[j].x);
+			ymin = std::min(ymin, p->points[j].y);
+			ymax = std::max(ymax, p->points[j].y);
+		}
+	} else if (selectable_shps_type == polylines) {
+		GdaPolyLine* p = (GdaPolyLine*) shp;
+		for (int j=0; j<p->n; j++) {
+			xmin = std::min(xmin, p->points[j].x);
+			xmax = std::max(xmax, p->points[j].x);
+			ymin = std::min(ymin, p->points[j].y);
+			ymax = std::max(ymax, p->points[j].y);
+		}
+	} else {
+		return false;
+	}
+	r = wxRect(wxPoint(xmin-pad, ymin-pad), wxPoint(xmax+pad, ymax+pad));
+	return true;
+}
+
+void TemplateCanvas::RestoreLayer1Rect(const wxRect& r)
+{
+	wxMemoryDC dc0(*layer0_bm);
+	wxMemoryDC dc(*layer1_bm);
+	dc.Blit(r.x, r.y, r.width, r.height, &dc0, r.x, r.y);
+}
+
 void TemplateCanvas::DrawNewSelShapes_dc(wxMemoryDC &dc)
 {
 	wxBrush hc_brush(wxBrush(highlight_color, wxBRUSHSTYLE_CROSSDIAG_HATCH));
@@ -2563,8 +2859,8 @@ void TemplateCanvas::UpdateSelectRegion(bool translate, wxPoint diff)
 	 */
 }
 
-// This is a good candidate for parallelization in the future.  Could
-// also use an r-tree to greatly reduce number of comparisons needed.
+// Candidate shapes for every brush come from the screen-space r-tree
+// sel_rtree, so only shapes near the brush are tested exactly.
 // For efficency sake, will make this default solution assume that
 // selectable shapes and highlight state are in a one-to-one
 // correspondence.  Special views such as histogram, or perhaps
@@ -2592,86 +2888,32 @@ void TemplateCanvas::UpdateSelectionPoints(bool shiftdown, bool pointsel)
 	LOG_MSG("Entering TemplateCanvas::UpdateSelectionPoints");
 	int hl_size = GetSelBitVec().size();
 	if (hl_size != selectable_shps.size()) return;
-    
-	std::vector<bool>& hs = GetSelBitVec();
-    bool selection_changed = false;
-    
+	
+	brush_hits.clear();
 	if (pointsel) { // a point selection
-		for (int i=0; i<hl_size; i++) {
-            if (selectable_shps[i] == NULL)
-                continue;
-			if (selectable_shps[i]->pointWithin(sel1)) {
-				if (hs[i]) {
-                    hs[i] = false;
-                    selection_changed = true;
-				} else {
-                    hs[i] = true;
-                    selection_changed = true;
-				}
-			} else {
-				if (!shiftdown && hs[i]) {
-                    hs[i] = false;
-                    selection_changed = true;
-				}
-			}			
+		QuerySelRtree(sel1, sel1, 0);
+		for (size_t k=0, kend=brush_cands.size(); k<kend; k++) {
+			int i = brush_cands[k];
+			if (selectable_shps[i]->pointWithin(sel1)) brush_hits.push_back(i);
 		}
 	} else { // determine which obs intersect the selection region.
 		if (brushtype == rectangle) {
 			wxRegion rect(wxRect(sel1, sel2));
-			for (int i=0; i<hl_size; i++) {
-                if (selectable_shps[i] == NULL)
-                    continue;
-				bool contains = (rect.Contains(selectable_shps[i]->center) !=
-								 wxOutRegion);
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i]) {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i]) {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
+			QuerySelRtree(sel1, sel2, 0);
+			for (size_t k=0, kend=brush_cands.size(); k<kend; k++) {
+				int i = brush_cands[k];
+				if (rect.Contains(selectable_shps[i]->center) != wxOutRegion) {
+					brush_hits.push_back(i);
 				}
 			}
-			
 		} else if (brushtype == circle) {
-			// using quad-tree to do pre-selection
-			
-			
 			double radius = GenUtils::distance(sel1, sel2);
 			// determine if each center is within radius of sel1
-			for (int i=0; i<hl_size; i++) {
-                if (selectable_shps[i] == NULL)
-                    continue;
-				bool contains = (GenUtils::distance(sel1, selectable_shps[i]->center)
-								 <= radius);
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i]) {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i]) {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
+			QuerySelRtree(sel1, sel1, radius);
+			for (size_t k=0, kend=brush_cands.size(); k<kend; k++) {
+				int i = brush_cands[k];
+				if (GenUtils::distance(sel1, selectable_shps[i]->center)
+					<= radius) brush_hits.push_back(i);
 			}
 		} else if (brushtype == line) {
 			wxRegion rect(wxRect(sel1, sel2));
@@ -2689,44 +2931,21 @@ void TemplateCanvas::UpdateSelectionPoints(bool shiftdown, bool pointsel)
 			double p2yMp1y = p2y - p1y;
 			double dp1p2 = GenUtils::distance(sel1, sel2);
 			double delta = 3.0 * dp1p2;
-			for (int i=0; i<hl_size; i++) {
-                if (selectable_shps[i] == NULL)
-                    continue;
-				bool contains = (rect.Contains(selectable_shps[i]->center) !=
-								 wxOutRegion);
-				if (contains) {
-					double p0x = selectable_shps[i]->center.x;
-					double p0y = selectable_shps[i]->center.y;
-					// determine if selectable_shps[i]->center is within
-					// distance 3.0 of line passing through sel1 and sel2
-					if (abs(p2xMp1x * (p1y-p0y) - (p1x-p0x) * p2yMp1y) >
-						delta ) contains = false;
-				}
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i]) {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i]) {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
+			QuerySelRtree(sel1, sel2, 0);
+			for (size_t k=0, kend=brush_cands.size(); k<kend; k++) {
+				int i = brush_cands[k];
+				if (rect.Contains(selectable_shps[i]->center) == wxOutRegion)
+					continue;
+				double p0x = selectable_shps[i]->center.x;
+				double p0y = selectable_shps[i]->center.y;
+				// determine if selectable_shps[i]->center is within
+				// distance 3.0 of line passing through sel1 and sel2
+				if (abs(p2xMp1x * (p1y-p0y) - (p1x-p0x) * p2yMp1y) <=
+					delta ) brush_hits.push_back(i);
 			}
 		}
 	}
-	if ( selection_changed ) {
-		highlight_state->SetEventType(HLStateInt::delta);
-		highlight_state->notifyObservers();
-	}
+	ApplyBrushHits(shiftdown, pointsel);
 	LOG_MSG("Exiting TemplateCanvas::UpdateSelectionPoints");
 }
 
@@ -2737,28 +2956,16 @@ void TemplateCanvas::UpdateSelectionCircles(bool shiftdown, bool pointsel)
 	LOG_MSG("Entering TemplateCanvas::UpdateSelectionCircles");
 	int hl_size = GetSelBitVec().size();
 	if (hl_size != selectable_shps.size()) return;
-    
-	std::vector<bool>& hs = GetSelBitVec();
-    bool selection_changed = false;
 	
+	brush_hits.clear();
 	if (pointsel) { // a point selection
-		for (int i=0; i<hl_size; i++) {
+		QuerySelRtree(sel1, sel1, 0);
+		for (size_t k=0, kend=brush_cands.size(); k<kend; k++) {
+			int i = brush_cands[k];
 			GdaCircle* s = (GdaCircle*) selectable_shps[i];
-			if (s->isNull()) continue;
 			if (GenUtils::distance(s->center, sel1) <= s->radius) {
-				if (hs[i]) {
-                    hs[i] = false;
-                    selection_changed = true;
-				} else {
-                    hs[i] = true;
-                    selection_changed = true;
-				}
-			} else {
-				if (!shiftdown && hs[i]) {
-                    hs[i] = false;
-                    selection_changed = true;
-				}
-			}			
+				brush_hits.push_back(i);
+			}
 		}
 	} else {
 		if (brushtype == rectangle) {
@@ -2767,9 +2974,10 @@ void TemplateCanvas::UpdateSelectionCircles(bool shiftdown, bool pointsel)
 			double rect_y = rect.GetPosition().y;
 			double half_rect_w = fabs((double) (sel1.x - sel2.x))/2.0;
 			double half_rect_h = fabs((double) (sel1.y - sel2.y))/2.0;
-			for (int i=0; i<hl_size; i++) {
+			QuerySelRtree(sel1, sel2, 0);
+			for (size_t k=0, kend=brush_cands.size(); k<kend; k++) {
+				int i = brush_cands[k];
 				GdaCircle* s = (GdaCircle*) selectable_shps[i];
-				if (s->isNull()) continue;
 				double cdx = fabs((s->center.x - rect_x) - half_rect_w);
 				double cdy = fabs((s->center.y - rect_y) - half_rect_h);
 				bool contains = true;
@@ -2785,89 +2993,36 @@ void TemplateCanvas::UpdateSelectionCircles(bool shiftdown, bool pointsel)
 					double corner_dist_sq = t1*t1 + t2*t2;
 					contains = corner_dist_sq <= (s->radius)*(s->radius); 
 				}
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i])  {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i]) {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
+				if (contains) brush_hits.push_back(i);
 			}
 		} else if (brushtype == circle) {
 			double radius = GenUtils::distance(sel1, sel2);
 			// determine if circles overlap
-			for (int i=0; i<hl_size; i++) {
+			QuerySelRtree(sel1, sel1, radius);
+			for (size_t k=0, kend=brush_cands.size(); k<kend; k++) {
+				int i = brush_cands[k];
 				GdaCircle* s = (GdaCircle*) selectable_shps[i];
-				if (s->isNull()) continue;
-				bool contains = (radius + s->radius >=
-								 GenUtils::distance(sel1, s->center));
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i]) {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i])  {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
+				if (radius + s->radius >= GenUtils::distance(sel1, s->center)) {
+					brush_hits.push_back(i);
 				}
 			}
 		} else if (brushtype == line) {
 			wxRealPoint hp((sel1.x+sel2.x)/2.0, (sel1.y+sel2.y)/2.0);
 			double hp_rad = GenUtils::distance(sel1, sel2)/2.0;
-			for (int i=0; i<hl_size; i++) {
+			// a circle of radius r can be hit from up to r*sqrt(2) away
+			// from the segment, half of the largest radius covers that
+			QuerySelRtree(sel1, sel2, sel_rtree_max_radius/2.0);
+			for (size_t k=0, kend=brush_cands.size(); k<kend; k++) {
+				int i = brush_cands[k];
 				GdaCircle* s = (GdaCircle*) selectable_shps[i];
-				if (s->isNull()) continue;
-				bool contains = ((GenUtils::pointToLineDist(s->center,
-														   sel1, sel2) <=
-								 s->radius) &&
-								 (GenUtils::distance(hp, s->center) <=
-								  hp_rad + s->radius));
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i]) {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i])  {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
+				if ((GenUtils::pointToLineDist(s->center, sel1, sel2) <=
+					 s->radius) &&
+					(GenUtils::distance(hp, s->center) <=
+					 hp_rad + s->radius)) brush_hits.push_back(i);
 			}
 		}
 	}
-
-	if ( selection_changed ) {
-		highlight_state->SetEventType(HLStateInt::delta);
-		highlight_state->notifyObservers();
-	}
+	ApplyBrushHits(shiftdown, pointsel);
 	LOG_MSG("Exiting TemplateCanvas::UpdateSelectionCircles");	
 }
 
@@ -2878,19 +3033,17 @@ void TemplateCanvas::UpdateSelectionPolylines(bool shiftdown, bool pointsel)
 	LOG_MSG("Entering TemplateCanvas::UpdateSelectionPolylines");
 	int hl_size = GetSelBitVec().size();
 	if (hl_size != selectable_shps.size()) return;
-    
-	std::vector<bool>& hs = GetSelBitVec();
-    bool selection_changed = false;
 	
+	brush_hits.clear();
 	GdaPolyLine* p;
 	if (pointsel) { // a point selection
 		double radius = 3.0;
 		wxRealPoint hp;
 		double hp_rad;
-		for (int i=0; i<hl_size; i++) {
+		QuerySelRtree(sel1, sel1, 0);
+		for (size_t k=0, kend=brush_cands.size(); k<kend; k++) {
+			int i = brush_cands[k];
 			p = (GdaPolyLine*) selectable_shps[i];
-			if (p->isNull()) continue;
-			bool contains = false;
 			for (int j=0, its=p->n-1; j<its; j++) {
 				hp.x = (p->points[j].x + p->points[j+1].x)/2.0;
 				hp.y = (p->points[j].y + p->points[j+1].y)/2.0;
@@ -2903,24 +3056,10 @@ void TemplateCanvas::UpdateSelectionPolylines(bool shiftdown, bool pointsel)
 					 radius) &&
 					(GenUtils::distance(hp, sel1) <= hp_rad + radius))
 				{
-					contains = true;
+					brush_hits.push_back(i);
 					break;
 				}
 			}
-			if (contains) {
-				if (hs[i]) {
-                    hs[i] = false;
-                    selection_changed = true;
-				} else {
-                    hs[i] = true;
-                    selection_changed = true;
-				}
-			} else {
-				if (!shiftdown && hs[i]) {
-                    hs[i] = false;
-                    selection_changed = true;
-				}
-			}
 		}
 	} else { // determine which obs intersect the selection region.
 		if (brushtype == rectangle) {
@@ -2933,10 +3072,10 @@ void TemplateCanvas::UpdateSelectionPolylines(bool shiftdown, bool pointsel)
 			uleft.y = uright.y;
 			lright.x = uright.x;
 			lright.y = lleft.y;
-			for (int i=0; i<hl_size; i++) {
+			QuerySelRtree(sel1, sel2, 0);
+			for (size_t k=0, kend=brush_cands.size(); k<kend; k++) {
+				int i = brush_cands[k];
 				p = (GdaPolyLine*) selectable_shps[i];
-				if (p->isNull()) continue;
-				bool contains = false;
 				for (int j=0, its=p->n-1; j<its; j++) {
 					if (GenGeomAlgs::LineSegsIntersect(p->points[j],
 													p->points[j+1],
@@ -2951,70 +3090,35 @@ void TemplateCanvas::UpdateSelectionPolylines(bool shiftdown, bool pointsel)
 													p->points[j+1],
 													lright, lleft))
 					{
-						contains = true;
+						brush_hits.push_back(i);
 						break;
 					}
 				}
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i])  {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i]) {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
 			}
 		} else if (brushtype == line) {
-			for (int i=0; i<hl_size; i++) {
+			QuerySelRtree(sel1, sel2, 0);
+			for (size_t k=0, kend=brush_cands.size(); k<kend; k++) {
+				int i = brush_cands[k];
 				p = (GdaPolyLine*) selectable_shps[i];
-				if (p->isNull()) continue;
-				bool contains = false;
 				for (int j=0, its=p->n-1; j<its; j++) {
 					if (GenGeomAlgs::LineSegsIntersect(p->points[j],
 													p->points[j+1],
 													sel1, sel2))
 					{
-						contains = true;
+						brush_hits.push_back(i);
 						break;
 					}
 				}
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i]) {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i])  {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
 			}	
 		} else if (brushtype == circle) {
 			double radius = GenUtils::distance(sel1, sel2);
 			wxRealPoint hp;
 			double hp_rad;
-			for (int i=0; i<hl_size; i++) {
+			// segments can be hit from up to radius*sqrt(2) away
+			QuerySelRtree(sel1, sel1, radius*1.5);
+			for (size_t k=0, kend=brush_cands.size(); k<kend; k++) {
+				int i = brush_cands[k];
 				p = (GdaPolyLine*) selectable_shps[i];
-				if (p->isNull()) continue;
-				bool contains = false;
 				for (int j=0, its=p->n-1; j<its; j++) {
 					hp.x = (p->points[j].x + p->points[j+1].x)/2.0;
 					hp.y = (p->points[j].y + p->points[j+1].y)/2.0;
@@ -3027,36 +3131,172 @@ void TemplateCanvas::UpdateSelectionPolylines(bool shiftdown, bool pointsel)
 						 radius) &&
 						(GenUtils::distance(hp, sel1) <= hp_rad + radius))
 					{
-						contains = true;
+						brush_hits.push_back(i);
 						break;
 					}
 				}
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i])  {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i])  {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
 			}
 		}
 	}
-	if ( selection_changed ) {
+	ApplyBrushHits(shiftdown, pointsel);
+	LOG_MSG("Exiting TemplateCanvas::UpdateSelectionPolylines");
+}
+
+/** Rebuild sel_rtree from the current screen coordinates of
+ selectable_shps.  Every non-null shape is stored with a box that contains
+ its center and every screen point at which one of the UpdateSelection*
+ functions could consider it hit.  Shapes of a type whose extent is not
+ known here are kept in sel_unindexed and tested on every query. */
+void TemplateCanvas::BuildSelRtree()
+{
+	LOG_MSG("Entering TemplateCanvas::BuildSelRtree");
+	std::vector<box_2d_val> vals;
+	vals.reserve(selectable_shps.size());
+	sel_unindexed.clear();
+	sel_rtree_max_radius = 0;
+	for (int i=0, iend=selectable_shps.size(); i<iend; i++) {
+		GdaShape* shp = selectable_shps[i];
+		if (shp == NULL || shp->isNull()) continue;
+		double xmin = shp->center.x, xmax = xmin;
+		double ymin = shp->center.y, ymax = ymin;
+		double pad = 0;
+		if (GdaCircle* c = dynamic_cast<GdaCircle*>(shp)) {
+			pad = c->radius;
+			if (c->radius > sel_rtree_max_radius) {
+				sel_rtree_max_radius = c->radius;
+			}
+		} else if (GdaPolygon* p = dynamic_cast<GdaPolygon*>(shp)) {
+			for (int j=0; j<p->n; j++) {
+				if (p->points[j].x < xmin) xmin = p->points[j].x;
+				if (p->points[j].x > xmax) xmax = p->points[j].x;
+				if (p->points[j].y < ymin) ymin = p->points[j].y;
+				if (p->points[j].y > ymax) ymax = p->points[j].y;
+			}
+		} else if (GdaPolyLine* p = dynamic_cast<GdaPolyLine*>(shp)) {
+			for (int j=0; j<p->n; j++) {
+				if (p->points[j].x < xmin) xmin = p->points[j].x;
+				if (p->points[j].x > xmax) xmax = p->points[j].x;
+				if (p->points[j].y < ymin) ymin = p->points[j].y;
+				if (p->points[j].y > ymax) ymax = p->points[j].y;
+			}
+			pad = 5; // GdaPolyLine::pointWithin radius 3, times sqrt(2)
+		} else if (GdaRectangle* r = dynamic_cast<GdaRectangle*>(shp)) {
+			xmin = std::min<double>(xmin, std::min(r->lower_left.x,
+												   r->upper_right.x));
+			xmax = std::max<double>(xmax, std::max(r->lower_left.x,
+												   r->upper_right.x));
+			ymin = std::min<double>(ymin, std::min(r->lower_left.y,
+												   r->upper_right.y));
+			ymax = std::max<double>(ymax, std::max(r->lower_left.y,
+												   r->upper_right.y));
+		} else if (dynamic_cast<GdaPoint*>(shp)) {
+			pad = 3; // GdaPoint::pointWithin radius
+		} else {
+			sel_unindexed.push_back(i);
+			continue;
+		}
+		box_2d b(pt_2d(xmin-pad, ymin-pad), pt_2d(xmax+pad, ymax+pad));
+		vals.push_back(std::make_pair(b, (unsigned) i));
+	}
+	// the packing constructor bulk loads a much better tree than inserts
+	rtree_box_2d_t rtree(vals.begin(), vals.end());
+	sel_rtree.swap(rtree);
+	sel_rtree_size = selectable_shps.size();
+	sel_rtree_valid = true;
+	LOG_MSG("Exiting TemplateCanvas::BuildSelRtree");
+}
+
+/** Fill brush_cands with every indexed shape whose box intersects the
+ box spanned by p1 and p2 grown by pad on each side, followed by all
+ of sel_unindexed. */
+void TemplateCanvas::QuerySelRtree(const wxPoint& p1, const wxPoint& p2,
+								   double pad)
+{
+	if (!sel_rtree_valid || !layer0_valid ||
+		sel_rtree_size != selectable_shps.size()) {
+		BuildSelRtree();
+	}
+	brush_cands.clear();
+	box_2d q(pt_2d(std::min(p1.x, p2.x) - pad, std::min(p1.y, p2.y) - pad),
+			 pt_2d(std::max(p1.x, p2.x) + pad, std::max(p1.y, p2.y) + pad));
+	std::vector<box_2d_val> found;
+	sel_rtree.query(bgi::intersects(q), std::back_inserter(found));
+	for (size_t k=0, kend=found.size(); k<kend; k++) {
+		brush_cands.push_back(found[k].second);
+	}
+	brush_cands.insert(brush_cands.end(), sel_unindexed.begin(),
+					   sel_unindexed.end());
+}
+
+/** Apply the result of a brush to the selection.  brush_hits holds the
+ shapes under the brush.  For a point selection these are toggled,
+ otherwise they are highlighted.  Unless shiftdown is set, every other
+ highlighted obs is unhighlighted.  The highlighted obs are tracked in
+ sel_list, so while nobody else changes the selection the work here is
+ proportional to the size of the old and new selections rather than to
+ the number of observations. */
+void TemplateCanvas::ApplyBrushHits(bool shiftdown, bool pointsel)
+{
+	std::vector<bool>& hs = GetSelBitVec();
+	int hl_size = hs.size();
+	if (!sel_list_valid || sel_list_epoch != highlight_state->GetEpoch() ||
+		brush_stamp.size() != hl_size) {
+		sel_list.clear();
+		for (int i=0; i<hl_size; i++) if (hs[i]) sel_list.push_back(i);
+		brush_stamp.assign(hl_size, 0);
+		brush_stamp_cnt = 0;
+	}
+	if (++brush_stamp_cnt == 0) {
+		std::fill(brush_stamp.begin(), brush_stamp.end(), 0);
+		brush_stamp_cnt = 1;
+	}
+	for (size_t k=0, kend=brush_hits.size(); k<kend; k++) {
+		brush_stamp[brush_hits[k]] = brush_stamp_cnt;
+	}
+	
+	std::vector<int>& nh = GetNewlySelList();
+	std::vector<int>& nuh = GetNewlyUnselList();
+	int nh_cnt = 0;
+	int nuh_cnt = 0;
+	for (size_t k=0, kend=brush_hits.size(); k<kend; k++) {
+		int i = brush_hits[k];
+		if (pointsel && hs[i]) {
+			hs[i] = false;
+			nuh[nuh_cnt++] = i;
+		} else if (!hs[i]) {
+			hs[i] = true;
+			nh[nh_cnt++] = i;
+		}
+	}
+	// do not unhighlight if not in intersection region when shiftdown
+	if (!shiftdown) {
+		for (size_t k=0, kend=sel_list.size(); k<kend; k++) {
+			int i = sel_list[k];
+			if (brush_stamp[i] != brush_stamp_cnt && hs[i]) {
+				hs[i] = false;
+				nuh[nuh_cnt++] = i;
+			}
+		}
+	}
+	
+	size_t sz = 0;
+	for (size_t k=0, kend=sel_list.size(); k<kend; k++) {
+		int i = sel_list[k];
+		if (hs[i] && brush_stamp[i] != brush_stamp_cnt) sel_list[sz++] = i;
+	}
+	sel_list.resize(sz);
+	for (size_t k=0, kend=brush_hits.size(); k<kend; k++) {
+		if (hs[brush_hits[k]]) sel_list.push_back(brush_hits[k]);
+	}
+	
+	if (nh_cnt > 0 || nuh_cnt > 0) {
+		SetNumNewlySel(nh_cnt);
+		SetNumNewlyUnsel(nuh_cnt);
 		highlight_state->SetEventType(HLStateInt::delta);
 		highlight_state->notifyObservers();
 	}
-	LOG_MSG("Exiting TemplateCanvas::UpdateSelectionPolylines");
+	sel_list_epoch = highlight_state->GetEpoch();
+	sel_list_valid = true;
 }
 
 void TemplateCanvas::SelectAllInCategory(int category,
@@ -35,6 +35,7 @@
 #include "HLStateInt.h"
 #include "HighlightStateObserver.h"
 #include "GdaShape.h"
+#include "SpatialIndTypes.h"
 
 typedef boost::multi_array<GdaShape*, 2> shp_array_type;
 typedef boost::multi_array<int, 2> i_array_type;
@@ -42,6 +43,7 @@ typedef boost::multi_array<int, 2> i_array_type;
 class CatClassifManager;
 class Project;
 class TemplateFrame;
+class TileRenderer;
 
 /** TemplateCanvas is a base class that implements most of the
  functionality associated with selecting polygons.  It is the base
@@ -210,6 +212,13 @@ public:
 										bool pointsel = false);
 	virtual void UpdateSelectionPolylines(bool shiftdown = false,
 										  bool pointsel = false);
+	/** Build the screen-space index sel_rtree over selectable_shps. */
+	void BuildSelRtree();
+	/** Candidate shapes near the box spanned by p1 and p2 into brush_cands,
+	 rebuilding sel_rtree first if the shapes have moved. */
+	void QuerySelRtree(const wxPoint& p1, const wxPoint& p2, double pad);
+	/** Select brush_hits and notify highlight_state of the changes. */
+	void ApplyBrushHits(bool shiftdown, bool pointsel);
 	
 	virtual void UpdateSelectRegion(bool translate = false,
 									wxPoint diff = wxPoint(0,0) );
@@ -278,6 +287,10 @@ public:
 	    screen size. */
 	static void CreateSelShpsFromProj(std::vector<GdaShape*>& selectable_shps,
                                Project* project);
+	/** Replaces the selectable shapes of records start to end-1 with
+	    shapes built from the current records of the project. */
+	static void UpdateSelShpsFromProj(std::vector<GdaShape*>& selectable_shps,
+									  Project* project, int start, int end);
 	
 	/** convert mouse coordiante point to original observation-coordinate
 	 points.  This is an inverse of the affine transformation that converts
@@ -382,6 +395,30 @@ protected:
 	bool layer0_valid; // if false, then needs to be redrawn
 	bool layer1_valid; // if false, then needs to be redrawn
 	bool layer2_valid; // if flase, then needs to be redrawn
+	// highlight_state epoch that layer1_bm currently reflects
+	unsigned long layer1_hl_epoch;
+	
+	// screen-space index over selectable_shps, rebuilt lazily whenever the
+	// shapes are resized, zoomed or panned
+	rtree_box_2d_t sel_rtree;
+	bool sel_rtree_valid;
+	size_t sel_rtree_size;
+	double sel_rtree_max_radius; // largest GdaCircle radius in sel_rtree
+	std::vector<int> sel_unindexed; // shapes of unknown extent
+	std::vector<int> brush_cands; // result of QuerySelRtree
+	std::vector<int> brush_hits; // shapes under the current brush
+	std::vector<int> repaint_hl; // highlighted shapes to repaint in a box
+	std::vector<unsigned int> brush_stamp; // marks brush_hits members
+	unsigned int brush_stamp_cnt;
+	// obs highlighted as of highlight_state epoch sel_list_epoch
+	std::vector<int> sel_list;
+	unsigned long sel_list_epoch;
+	bool sel_list_valid;
+	
+	// draws the selectable shapes of large layers on worker threads
+	TileRenderer* tile_renderer;
+	// true while OnTilesRendered repaints layer0 with the tiles done
+	bool tile_compose;
 	
 public:
 	void RenderToDC(wxDC &dc, bool disable_crosshatch_brush = true);
@@ -408,6 +445,12 @@ public:
 	void DrawSelectableShapes_gc(wxMemoryDC &dc);
 	void DrawSelectableShapes_dc(wxMemoryDC &dc);
 	void DrawSelectableShapes_gen_dc(wxDC &dc);
+	bool UseTileRenderer();
+	void StartTileRender();
+	void DrawRenderedTiles(wxDC &dc);
+	// called on a worker thread of tile_renderer
+	void NotifyTilesRendered();
+	void OnTilesRendered();
 	// draw highlighted sel shapes
 	virtual void DrawHighlightedShapes(wxMemoryDC &dc);
 	void DrawHighlightedShapes_gc(wxMemoryDC &dc);
@@ -417,6 +460,19 @@ public:
 	virtual void DrawNewSelShapes(wxMemoryDC &dc);
 	void DrawNewSelShapes_gc(wxMemoryDC &dc);
 	void DrawNewSelShapes_dc(wxMemoryDC &dc);
+	// draw the highlighted look of the first total shapes of ids, clipped
+	// to clip if given
+	void DrawSelShapeList_gc(wxMemoryDC &dc, const std::vector<int>& ids,
+							 int total, const wxRect* clip = 0);
+	/** Repaint layer1_bm for the current sparse highlight delta in the box
+	 around the newly highlighted and unhighlighted shapes only.  Returns
+	 false, without drawing, if the box is too large. */
+	bool RepaintHighlightDelta();
+	/** Screen box of what the highlight of shape i paints.  False if the
+	 extent of the shape is not known. */
+	bool GetHighlightBox(int i, wxRect& r);
+	// restore r in layer1_bm to how it is without highlighted shapes
+	virtual void RestoreLayer1Rect(const wxRect& r);
 	virtual void EraseNewUnSelShapes(wxMemoryDC &dc);
 	void EraseNewUnSelShapes_gc(wxMemoryDC &dc);
 	void EraseNewUnSelShapes_dc(wxMemoryDC &dc);
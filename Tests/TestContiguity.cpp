@@ -0,0 +1,167 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ The tiled contiguity builder of PolysToContigWeights against the
+ PolygonPartition sweep it replaced, PolysToContigWeightsSweep.
+ */
+
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include "../ShpFile.h"
+#include "../ShapeOperations/GalWeight.h"
+#include "../ShapeOperations/PolysToContigWeights.h"
+
+/** Quadrilaterals of a rows x cols grid whose vertices are moved at random
+ by up to 0.3 of a cell, so that no two edges are parallel.  Every null_every
+ record, if not 0, is left empty, and every two_parts record gets a small
+ triangle inside it as a second part.  With noise, every record gets its own
+ copy of the shared vertices moved by up to noise, and its box is grown by
+ 4*noise.  The sweep only looks for guest vertices inside the box of the
+ host, and would miss a shared vertex moved out of it. */
+static void jittered_grid(int rows, int cols, int null_every, int two_parts,
+						  double noise, Shapefile::PolygonBuffer& buf)
+{
+	std::vector<double> gx((rows+1)*(cols+1)), gy((rows+1)*(cols+1));
+	unsigned int seed = 17;
+	for (size_t v=0; v<gx.size(); v++) {
+		seed = seed * 1103515245 + 12345;
+		gx[v] = (double) (v % (cols+1)) + ((seed >> 16) % 600) / 1000.0 - 0.3;
+		seed = seed * 1103515245 + 12345;
+		gy[v] = (double) (v / (cols+1)) + ((seed >> 16) % 600) / 1000.0 - 0.3;
+	}
+	buf.Clear();
+	for (int r=0; r<rows; r++) {
+		for (int c=0; c<cols; c++) {
+			int rec = r*cols + c;
+			if (null_every == 0 || rec % null_every != 0) {
+				// closed clockwise ring
+				int ring[] = { r*(cols+1)+c, (r+1)*(cols+1)+c,
+					(r+1)*(cols+1)+c+1, r*(cols+1)+c+1, r*(cols+1)+c };
+				double x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+				buf.parts.push_back(0);
+				for (int k=0; k<5; k++) {
+					double x = gx[ring[k]], y = gy[ring[k]];
+					if (noise > 0 && k < 4) {
+						seed = seed * 1103515245 + 12345;
+						x += noise * (((seed >> 16) % 2001) / 1000.0 - 1.0);
+						seed = seed * 1103515245 + 12345;
+						y += noise * (((seed >> 16) % 2001) / 1000.0 - 1.0);
+					} else if (k == 4) {
+						// the ring stays closed
+						x = buf.x[buf.x.size()-4];
+						y = buf.y[buf.y.size()-4];
+					}
+					buf.x.push_back(x);
+					buf.y.push_back(y);
+					if (k == 0) { x0 = x1 = x; y0 = y1 = y; }
+					x0 = std::min(x0, x); y0 = std::min(y0, y);
+					x1 = std::max(x1, x); y1 = std::max(y1, y);
+				}
+				if (two_parts > 0 && rec % two_parts == 0) {
+					buf.parts.push_back(5);
+					double cx = c + 0.5, cy = r + 0.5;
+					double tx[] = { cx, cx+0.05, cx+0.1, cx };
+					double ty[] = { cy, cy+0.1, cy, cy };
+					for (int k=0; k<4; k++) {
+						buf.x.push_back(tx[k]);
+						buf.y.push_back(ty[k]);
+					}
+				}
+				buf.box.push_back(x0 - 4*noise);
+				buf.box.push_back(y0 - 4*noise);
+				buf.box.push_back(x1 + 4*noise);
+				buf.box.push_back(y1 + 4*noise);
+			} else {
+				for (int k=0; k<4; k++) buf.box.push_back(0);
+			}
+			buf.rec_parts.push_back(buf.parts.size());
+			buf.rec_points.push_back(buf.x.size());
+		}
+	}
+}
+
+static int compare(const char* name, const Shapefile::PolygonBuffer& buf,
+				   bool is_queen, double precision_threshold)
+{
+	int n = buf.GetNumRecords();
+	GalElement* tiled = PolysToContigWeights(buf, is_queen,
+											 precision_threshold);
+	GalElement* sweep = PolysToContigWeightsSweep(buf, is_queen,
+												  precision_threshold);
+	int failed = 0;
+	long links = 0;
+	for (int i=0; i<n; i++) {
+		std::vector<long> a(tiled[i].GetNbrs()), b(sweep[i].GetNbrs());
+		std::sort(a.begin(), a.end());
+		std::sort(b.begin(), b.end());
+		links += b.size();
+		if (a != b) {
+			if (failed == 0) {
+				printf("%s, %s: %d has %d neighbors, expected %d\n", name,
+					   is_queen ? "queen" : "rook", i, (int) a.size(),
+					   (int) b.size());
+			}
+			failed++;
+		}
+	}
+	delete [] tiled;
+	delete [] sweep;
+	if (links == 0) {
+		printf("%s: no neighbors at all\n", name);
+		failed++;
+	}
+	return failed ? 1 : 0;
+}
+
+int main()
+{
+	int failed = 0;
+	Shapefile::PolygonBuffer buf;
+	for (int q=0; q<2; q++) {
+		bool is_queen = (q == 1);
+		jittered_grid(5, 7, 0, 0, 0, buf);
+		failed += compare("grid 5x7", buf, is_queen, 0);
+		jittered_grid(9, 6, 4, 3, 0, buf);
+		failed += compare("grid 9x6 with null records and parts", buf,
+						  is_queen, 0);
+		jittered_grid(1, 20, 0, 0, 0, buf);
+		failed += compare("strip 1x20", buf, is_queen, 0);
+		// enough polygons for several tiles and threads
+		jittered_grid(40, 45, 97, 13, 0, buf);
+		failed += compare("grid 40x45", buf, is_queen, 0);
+
+		// shared vertices that only match within the precision threshold,
+		// which is small next to the partition cells of the sweep
+		jittered_grid(5, 7, 0, 0, 2.5e-8, buf);
+		failed += compare("perturbed grid 5x7", buf, is_queen, 1e-7);
+		jittered_grid(9, 6, 4, 3, 2.5e-8, buf);
+		failed += compare("perturbed grid 9x6", buf, is_queen, 1e-7);
+		jittered_grid(40, 45, 97, 13, 2.5e-8, buf);
+		failed += compare("perturbed grid 40x45", buf, is_queen, 1e-7);
+	}
+
+	if (failed) {
+		printf("TestContiguity: %d checks failed\n", failed);
+		return 1;
+	}
+	printf("TestContiguity: ok\n");
+	return 0;
+}
@@ -0,0 +1,165 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ CsrWeight::TraceWtWPlusWW against the dense T of the LM diagnostics and
+ the hash map sum of Compute_MoranZ in smile2.cpp that it replaced.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+#include <boost/unordered_map.hpp>
+#include "../ShapeOperations/GalWeight.h"
+#include "../ShapeOperations/CsrWeight.h"
+#include "../Regression/mix.h"
+#include "../Regression/SparseMatrix.h"
+
+/** T as it was in smile2.cpp: tr(W'W+WW) of the row standardized weights,
+ summed over all n x n pairs. */
+static double dense_T(GalElement *g, int dim)
+{
+	double sum = 0;
+	int i=0, j=0;
+	for (i = 0; i < dim; ++i) {
+		for (j = 0; j < dim; ++j) {
+			sum += g[i].GetRW(j) * g[j].GetRW(i);
+		}
+	}
+	for (i = 0; i < dim; ++i) {
+		for (j = 0; j < dim; ++j) {
+			sum += g[j].GetRW(i) * g[j].GetRW(i);
+		}
+	}
+	return sum;
+}
+
+/** The sum s of Compute_MoranZ, on the binary row standardized W */
+static double moran_s(GalElement *g, int n)
+{
+	SparseMatrix W(g, n);
+	W.rowStandardize();
+
+	double s = 0.0;
+	std::vector< boost::unordered_map<int, double> > W_map(n);   // W
+	std::vector< std::map<int, bool> > B(n); // union of pattern of W and W'
+	for (int i=0; i<n; i++) {
+		Link *r = W.getRow(i).getNb();
+		for (int nb=0, nb_sz=W.getRow(i).getSize(); nb<nb_sz; nb++) {
+			int j=r[nb].getIx();
+			double Wij = r[nb].getWeight();
+			W_map[i][j] = Wij;
+			B[i][j] = true;
+			B[j][i] = true;
+		}
+	}
+	for (int i=0; i<n; i++) {
+		boost::unordered_map<int, double>::iterator it;
+		for (std::map<int, bool>::iterator B_it = B[i].begin();
+			 B_it != B[i].end(); ++B_it) {
+			int j = B_it->first;
+			it = W_map[i].find(j);
+			double Wij = (it != W_map[i].end()) ? it->second : 0;
+			it = W_map[j].find(i);
+			double Wji = (it != W_map[j].end()) ? it->second : 0;
+			s += (Wij + Wji) * (Wij + Wji);
+		}
+	}
+	return 0.5 * s;
+}
+
+/** k nearest neighbors of n random points, which is not symmetric.  With
+ weighted, the weights are inverse distances.  Every skip-th observation
+ is left without neighbors when skip > 0. */
+static GalElement* knn_gal(int n, int k, bool weighted, int skip)
+{
+	std::vector<double> x(n), y(n);
+	unsigned int seed = 2015;
+	for (int i=0; i<n; i++) {
+		seed = seed * 1103515245 + 12345;
+		x[i] = (seed >> 16) % 10000 / 100.0;
+		seed = seed * 1103515245 + 12345;
+		y[i] = (seed >> 16) % 10000 / 100.0;
+	}
+	GalElement* gal = new GalElement[n];
+	for (int i=0; i<n; i++) {
+		if (skip > 0 && i % skip == 0) continue;
+		std::vector<std::pair<double, int> > d;
+		for (int j=0; j<n; j++) {
+			if (j == i) continue;
+			double dx = x[i]-x[j], dy = y[i]-y[j];
+			d.push_back(std::make_pair(sqrt(dx*dx + dy*dy), j));
+		}
+		std::partial_sort(d.begin(), d.begin()+k, d.end());
+		gal[i].SetSizeNbrs(k);
+		for (int t=0; t<k; t++) {
+			// neighbors in decreasing order, so that rows come unsorted
+			const std::pair<double, int>& p = d[k-1-t];
+			if (weighted) {
+				gal[i].SetNbr(t, p.second, 1.0 / (p.first + 0.01));
+			} else {
+				gal[i].SetNbr(t, p.second);
+			}
+		}
+	}
+	return gal;
+}
+
+static bool near(double a, double b)
+{
+	return fabs(a-b) <= 1e-10 * (fabs(b) > 1 ? fabs(b) : 1);
+}
+
+static int check(const char* name, int n, int k, bool weighted, int skip)
+{
+	GalElement* gal = knn_gal(n, k, weighted, skip);
+	CsrWeight csr(gal, n);
+	double t = csr.TraceWtWPlusWW();
+	double t_binary = csr.TraceWtWPlusWW(true);
+	double old_t = dense_T(gal, n);
+	double old_s = moran_s(gal, n);
+	delete [] gal;
+	if (!near(t, old_t) || !near(t_binary, old_s)) {
+		printf("%s: trace %.12g and %.12g, expected %.12g and %.12g\n", name,
+			   t, t_binary, old_t, old_s);
+		return 1;
+	}
+	return 0;
+}
+
+int main()
+{
+	int failed = 0;
+	failed += check("knn 4", 30, 4, false, 0);
+	failed += check("knn 6 weighted", 50, 6, true, 0);
+	failed += check("knn 3 with isolates", 40, 3, false, 7);
+	failed += check("knn 5 weighted with isolates", 45, 5, true, 9);
+	// enough rows for several threads
+	failed += check("knn 8", 2000, 8, true, 0);
+
+	if (failed) {
+		printf("TestCsrTrace: %d checks failed\n", failed);
+		return 1;
+	}
+	printf("TestCsrTrace: ok\n");
+	return 0;
+}
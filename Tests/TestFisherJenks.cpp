@@ -0,0 +1,159 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ CatClassification::FindNaturalBreaks against the measure the random
+ search it replaced maximized: the goodness of variance fit of calc_gvf,
+ here maximized over every set of breaks between unique values.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "../GenUtils.h"
+#include "../Explore/CatClassification.h"
+
+/** calc_gvf as it was before Fisher-Jenks.  b are the indices into the
+ sorted v of the first values of categories 2 and up. */
+static double calc_gvf(const std::vector<int>& b, const std::vector<double>& v,
+					   double gssd)
+{
+	int N = v.size();
+	int num_cats = b.size()+1;
+	double tssd=0; // total sum of local sums of squared differences
+	for (int i=0; i<num_cats; i++) {
+		int s = (i == 0) ? 0 : b[i-1];
+		int t = (i == num_cats-1) ? N : b[i];
+
+		double m=0; // local mean
+		double ssd=0; // local sum of squared differences (variance)
+		for (int j=s; j<t; j++) m += v[j];
+		m /= ((double) t-s);
+		for (int j=s; j<t; j++) ssd += (v[j]-m)*(v[j]-m);
+		tssd += ssd;
+	}
+
+	return 1-(tssd/gssd);
+}
+
+/** Largest gvf over all choices of num_cats-1 breaks among the starts of
+ runs of equal values u_starts. */
+static double best_gvf(const std::vector<double>& v,
+					   const std::vector<int>& u_starts, int num_cats,
+					   double gssd)
+{
+	int U = u_starts.size();
+	std::vector<int> c(num_cats-1); // combination of [1, U)
+	for (int i=0; i<num_cats-1; i++) c[i] = i+1;
+	std::vector<int> b(num_cats-1);
+	double best = -1;
+	while (true) {
+		for (int i=0; i<num_cats-1; i++) b[i] = u_starts[c[i]];
+		best = std::max(best, calc_gvf(b, v, gssd));
+		int i = num_cats-2;
+		while (i >= 0 && c[i] == U-(num_cats-1)+i) --i;
+		if (i < 0) break;
+		++c[i];
+		for (int j=i+1; j<num_cats-1; j++) c[j] = c[j-1]+1;
+	}
+	return best;
+}
+
+static int check(const char* name, std::vector<double> v, int num_cats)
+{
+	std::sort(v.begin(), v.end());
+	int N = v.size();
+	Gda::dbl_int_pair_vec_type var(N);
+	for (int i=0; i<N; i++) var[i] = std::make_pair(v[i], i);
+	std::vector<int> u_starts;
+	for (int i=0; i<N; i++) if (i == 0 || v[i] != v[i-1]) u_starts.push_back(i);
+	int t_cats = std::min<int>(num_cats, u_starts.size());
+
+	std::vector<double> nat_breaks;
+	CatClassification::FindNaturalBreaks(num_cats, var, nat_breaks);
+	if ((int) nat_breaks.size() != t_cats-1) {
+		printf("%s, %d cats: %d breaks, expected %d\n", name, num_cats,
+			   (int) nat_breaks.size(), t_cats-1);
+		return 1;
+	}
+	// a break is the first value of its category, so equal values can
+	// not be split
+	std::vector<int> b(nat_breaks.size());
+	for (size_t i=0; i<nat_breaks.size(); i++) {
+		b[i] = std::lower_bound(v.begin(), v.end(), nat_breaks[i]) - v.begin();
+		if (b[i] == 0 || (i > 0 && b[i] <= b[i-1])) {
+			printf("%s, %d cats: break %d is not increasing\n", name,
+				   num_cats, (int) i);
+			return 1;
+		}
+	}
+	if (t_cats <= 1) return 0;
+
+	double mean = 0;
+	for (int i=0; i<N; i++) mean += v[i];
+	mean /= (double) N;
+	double gssd = 0;
+	for (int i=0; i<N; i++) gssd += (v[i]-mean)*(v[i]-mean);
+	double gvf = calc_gvf(b, v, gssd);
+	double best = best_gvf(v, u_starts, t_cats, gssd);
+	if (fabs(gvf - best) > 1e-9) {
+		printf("%s, %d cats: gvf %.12f, best %.12f\n", name, num_cats,
+			   gvf, best);
+		return 1;
+	}
+	return 0;
+}
+
+int main()
+{
+	int failed = 0;
+
+	const double a[] = { 1, 2, 2, 3, 10, 11, 11, 12, 30, 31, 50, 50, 50 };
+	std::vector<double> fixed(a, a + sizeof(a)/sizeof(double));
+	for (int k=1; k<=8; k++) failed += check("fixed", fixed, k);
+
+	std::vector<double> ties(9, 4.0);
+	ties.push_back(7.0);
+	for (int k=1; k<=4; k++) failed += check("ties", ties, k);
+
+	// large offset, where plain sums of squares lose the differences
+	std::vector<double> offset(fixed);
+	for (size_t i=0; i<offset.size(); i++) offset[i] += 1e7;
+	for (int k=2; k<=5; k++) failed += check("offset", offset, k);
+
+	unsigned int seed = 12345;
+	for (int r=0; r<40; r++) {
+		int n = 5 + r % 12;
+		std::vector<double> v(n);
+		for (int i=0; i<n; i++) {
+			seed = seed * 1103515245 + 12345;
+			// few distinct values, so that there are ties
+			v[i] = (double) ((seed >> 16) % (4 + r)) * 0.5;
+		}
+		for (int k=2; k<=6; k++) failed += check("random", v, k);
+	}
+
+	if (failed) {
+		printf("TestFisherJenks: %d checks failed\n", failed);
+		return 1;
+	}
+	printf("TestFisherJenks: ok\n");
+	return 0;
+}
@@ -0,0 +1,321 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ NormalEquations against the SVD solution of ordinaryLS and the dspev
+ eigenvalues of MC_Condition_Number that it replaced, and WhiteDesignRows
+ against the regressors WhiteTest used to store.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "../Regression/NormalEquations.h"
+
+// use __WXMAC__ to call vecLib
+#ifdef __WXMAC__MMM
+    #include <vecLib/vecLib.h>
+#else
+	#include "../Regression/blaswrap.h"
+	#include "../Regression/f2c.h"
+
+    extern "C" int dgesvd_(char *jobu, char *jobvt, integer *m, integer *n,
+        doublereal *a, integer *lda, doublereal *s, doublereal *u,
+        integer *ldu, doublereal *vt, integer *ldvt, doublereal *work,
+        integer *lwork, integer *info);
+    extern "C" int dspev_(char *jobz, char *uplo, integer *n, doublereal *ap,
+        doublereal *w, doublereal *z__, integer *ldz, doublereal *work,
+        integer *info);
+#endif
+
+/** The SVD part of ordinaryLS.  Singular values up to drop_tol times the
+ largest are left out, which ordinaryLS did not do (drop_tol = 0). */
+static bool svd_ls(const std::vector<const double*>& X, int obs,
+				   const double* y, double drop_tol,
+				   std::vector<double>& ols,
+				   std::vector<std::vector<double> >& cov,
+				   std::vector<double>& resid)
+{
+	const int vars = X.size();
+	int row = 0, column = 0;
+	std::vector<double> temp(vars, 0);
+	for (row = 0; row < vars; row++) {
+		for (int i = 0; i < obs; i++) temp[row] += y[i] * X[row][i];
+	}
+
+	char jobu = 'S', jobvt = 'S';
+	long int m = obs, n = vars;
+	long int lda = obs, ldu = obs, ldvt = vars, lwork = 5 * obs, info = 0;
+	std::vector<double> a(obs * vars), s(vars), u(ldu * vars),
+		vt(ldvt * vars), work(lwork);
+	for (row = 0; row < obs; row++) {
+		for (column = 0; column < vars; column++) {
+			a[row + obs * column] = X[column][row];
+		}
+	}
+#ifdef __WXMAC__MMM
+	dgesvd_(&jobu, &jobvt, &m, &n, &a[0], &lda, &s[0], &u[0], &ldu,
+			&vt[0], &ldvt, &work[0], &lwork, &info);
+#else
+	dgesvd_(&jobu, &jobvt, (integer*)&m, (integer*)&n, (doublereal*)&a[0],
+			(integer*)&lda, (doublereal*)&s[0], (doublereal*)&u[0],
+			(integer*)&ldu, (doublereal*)&vt[0], (integer*)&ldvt,
+			(doublereal*)&work[0], (integer*)&lwork, (integer*)&info);
+#endif
+	if (info) return false;
+
+	cov.assign(vars, std::vector<double>(vars, 0));
+	for (row = 0; row < vars; row++) {
+		for (column = 0; column < vars; column++) {
+			for (int c = 0; c < vars; c++) {
+				if (s[c] <= drop_tol * s[0]) continue;
+				cov[row][column] += (vt[row * vars + c] * vt[c + column * vars])
+					/ (s[c] * s[c]);
+			}
+		}
+	}
+	ols.assign(vars, 0);
+	for (row = 0; row < vars; row++) {
+		for (column = 0; column < vars; column++) {
+			ols[row] += cov[row][column] * temp[column];
+		}
+	}
+	resid.resize(obs);
+	for (column = 0; column < obs; column++) {
+		double tempr = y[column];
+		for (row = 0; row < vars; row++) {
+			tempr -= ols[row] * X[row][column];
+		}
+		resid[column] = tempr;
+	}
+	return true;
+}
+
+/** The eigenvalue part of MC_Condition_Number */
+static double dspev_condition_number(const std::vector<const double*>& X,
+									 int dim)
+{
+	const int expl = X.size();
+	std::vector<std::vector<double> > x(expl, std::vector<double>(dim));
+	for (int i = 0; i < expl; i++) {
+		double xn = 0;
+		for (int j = 0; j < dim; j++) xn += X[i][j] * X[i][j];
+		for (int j = 0; j < dim; j++) x[i][j] = X[i][j] / sqrt(xn);
+	}
+	char jobz = 'N', uplo = 'U';
+	long int n = expl;
+	long int ldz = expl, info = 0;
+	std::vector<double> a(expl * (expl + 1) / 2), s(expl), work(3 * expl);
+	double* z = NULL;
+	for (int row = 0; row < expl; row++) {
+		for (int column = row; column < expl; column++) {
+			double p = 0;
+			for (int j = 0; j < dim; j++) p += x[row][j] * x[column][j];
+			a[row + column * (column + 1) / 2] = p;
+		}
+	}
+#ifdef __WXMAC__MMM
+	dspev_(&jobz, &uplo, &n, &a[0], &s[0], z, &ldz, &work[0], &info);
+#else
+	dspev_(&jobz, &uplo, (integer*)&n, (doublereal*)&a[0], (doublereal*)&s[0],
+		   (doublereal*)z, (integer*)&ldz, (doublereal*)&work[0],
+		   (integer*)&info);
+#endif
+	if (info) return -1;
+	return sqrt(s[expl - 1] / s[0]);
+}
+
+static bool near(double a, double b, double rel_tol)
+{
+	return fabs(a-b) <= rel_tol * (fabs(b) > 1 ? fabs(b) : 1);
+}
+
+/** Columns of a design with a constant, num_vars-1 variables and, with
+ collinear, a last variable that is the sum of the two before it. */
+static void make_design(int obs, int num_vars, bool collinear, double noise,
+						std::vector<std::vector<double> >& data,
+						std::vector<double>& y)
+{
+	data.assign(num_vars, std::vector<double>(obs));
+	y.resize(obs);
+	unsigned int seed = 99;
+	for (int i = 0; i < obs; i++) {
+		data[0][i] = 1.0;
+		for (int c = 1; c < num_vars; c++) {
+			seed = seed * 1103515245 + 12345;
+			data[c][i] = ((seed >> 16) % 20000) / 1000.0 - 10.0;
+		}
+		if (collinear) {
+			seed = seed * 1103515245 + 12345;
+			double e = ((seed >> 16) % 2000) / 1000.0 - 1.0;
+			data[num_vars-1][i] = data[num_vars-2][i] + data[num_vars-3][i] +
+				noise * e;
+		}
+		seed = seed * 1103515245 + 12345;
+		y[i] = 2.0 + 0.5 * data[1][i] + ((seed >> 16) % 1000) / 500.0;
+	}
+}
+
+static int check_ols(const char* name, int obs, int num_vars)
+{
+	std::vector<std::vector<double> > data;
+	std::vector<double> y;
+	make_design(obs, num_vars, false, 0, data, y);
+	std::vector<const double*> cols(num_vars);
+	for (int c = 0; c < num_vars; c++) cols[c] = &data[c][0];
+
+	std::vector<double> ols, resid;
+	std::vector<std::vector<double> > cov;
+	svd_ls(cols, obs, &y[0], 0, ols, cov, resid);
+
+	ColumnDesignRows rows(&cols[0], obs, num_vars);
+	NormalEquations ne(rows, &y[0]);
+	int failed = 0;
+	for (int i = 0; i < num_vars; i++) {
+		for (int j = 0; j < num_vars; j++) {
+			double xtx = 0;
+			for (int r = 0; r < obs; r++) xtx += data[i][r] * data[j][r];
+			if (!near(ne.GetXtX(i, j), xtx, 1e-12)) failed++;
+		}
+	}
+	if (!ne.Factor()) {
+		printf("%s: Factor failed\n", name);
+		return 1;
+	}
+	std::vector<double> beta(num_vars), ne_resid(obs);
+	std::vector<double> inv_data(num_vars * num_vars);
+	std::vector<double*> inv(num_vars);
+	for (int i = 0; i < num_vars; i++) inv[i] = &inv_data[i * num_vars];
+	ne.Solve(&beta[0]);
+	ne.Inverse(&inv[0]);
+	ne.Residuals(&beta[0], &ne_resid[0]);
+	for (int i = 0; i < num_vars; i++) {
+		if (!near(beta[i], ols[i], 1e-8)) failed++;
+		for (int j = 0; j < num_vars; j++) {
+			if (!near(inv[i][j], cov[i][j], 1e-8)) failed++;
+		}
+	}
+	for (int r = 0; r < obs; r++) {
+		if (!near(ne_resid[r], resid[r], 1e-8)) failed++;
+	}
+	double cn = ne.ConditionNumber();
+	if (!near(cn, dspev_condition_number(cols, obs), 1e-8)) failed++;
+	if (failed) printf("%s: %d values differ from the SVD\n", name, failed);
+	return failed ? 1 : 0;
+}
+
+/** Exactly or nearly collinear designs are left to the SVD, and the
+ minimum norm solution fits what the truncated SVD fits. */
+static int check_collinear(const char* name, double noise, bool expect_factor)
+{
+	const int obs = 300, num_vars = 5;
+	std::vector<std::vector<double> > data;
+	std::vector<double> y;
+	make_design(obs, num_vars, true, noise, data, y);
+	std::vector<const double*> cols(num_vars);
+	for (int c = 0; c < num_vars; c++) cols[c] = &data[c][0];
+
+	ColumnDesignRows rows(&cols[0], obs, num_vars);
+	NormalEquations ne(rows, &y[0]);
+	if (ne.Factor() != expect_factor) {
+		printf("%s: Factor %s\n", name, expect_factor ? "failed" :
+			   "accepted an ill-conditioned design");
+		return 1;
+	}
+	if (noise != 0) return 0;
+
+	std::vector<double> beta(num_vars), ne_resid(obs);
+	if (!ne.SolveMinNorm(&beta[0])) {
+		printf("%s: SolveMinNorm failed\n", name);
+		return 1;
+	}
+	ne.Residuals(&beta[0], &ne_resid[0]);
+	std::vector<double> ols, resid;
+	std::vector<std::vector<double> > cov;
+	svd_ls(cols, obs, &y[0], 1e-10, ols, cov, resid);
+	for (int r = 0; r < obs; r++) {
+		if (!near(ne_resid[r], resid[r], 1e-6)) {
+			printf("%s: residual %d is %g, expected %g\n", name, r,
+				   ne_resid[r], resid[r]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/** The rows of WhiteDesignRows are the columns WhiteTest used to build */
+static int check_white(bool InclConstant)
+{
+	const int obs = 50, nvar = 4;
+	std::vector<std::vector<double> > data;
+	std::vector<double> y;
+	make_design(obs, nvar, false, 0, data, y);
+	std::vector<const double*> X(nvar);
+	for (int c = 0; c < nvar; c++) X[c] = &data[c][0];
+
+	int ix = InclConstant? 0 : 1;
+	std::vector<std::vector<double> > w;
+	w.push_back(std::vector<double>(obs, 1.0));
+	for (int i = 1 - ix; i < nvar; i++) w.push_back(data[i]);
+	for (int i = 1 - ix; i < nvar; i++) {
+		for (int j = i; j < nvar; j++) {
+			std::vector<double> p(obs);
+			for (int jj = 0; jj < obs; jj++) p[jj] = X[i][jj] * X[j][jj];
+			w.push_back(p);
+		}
+	}
+
+	WhiteDesignRows rows(&X[0], obs, nvar, InclConstant);
+	const int k = rows.GetNumCols();
+	if (k != (int) w.size()) {
+		printf("White test: %d regressors, expected %d\n", k, (int) w.size());
+		return 1;
+	}
+	std::vector<double> buf(obs * (k + 1));
+	rows.GetRows(0, obs, &buf[0], k + 1);
+	for (int r = 0; r < obs; r++) {
+		for (int c = 0; c < k; c++) {
+			if (buf[r * (k + 1) + c] != w[c][r]) {
+				printf("White test: regressor %d of row %d differs\n", c, r);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+int main()
+{
+	int failed = 0;
+	failed += check_ols("small", 30, 3);
+	// enough rows for several blocks and threads
+	failed += check_ols("large", 40000, 6);
+	failed += check_collinear("collinear", 0, false);
+	failed += check_collinear("nearly collinear", 1e-5, false);
+	failed += check_collinear("noisy collinear", 1e-1, true);
+	failed += check_white(true);
+	failed += check_white(false);
+
+	if (failed) {
+		printf("TestNormalEquations: %d checks failed\n", failed);
+		return 1;
+	}
+	printf("TestNormalEquations: ok\n");
+	return 0;
+}
@@ -0,0 +1,195 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ PairsIndexer and the DistancesCalc pair kernels against the pairs bimap
+ that Project::GetSharedPairsBimap used to build and the loops over it in
+ Project::FillDistances.
+ */
+
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include <boost/bimap.hpp>
+#include "../GenGeomAlgs.h"
+#include "../Explore/DistancesCalc.h"
+
+typedef boost::bimap<int, UnOrdIntPair> pairs_bimap_type;
+typedef pairs_bimap_type::const_iterator pbt_ci;
+
+static void build_bimap(int n_obs, pairs_bimap_type& pairs_bimap)
+{
+	int cnt=0;
+	for (int i=0; i<n_obs; ++i) {
+		for (int j=i+1; j<n_obs; ++j) {
+			pairs_bimap.insert(
+				pairs_bimap_type::value_type(cnt++, UnOrdIntPair(i,j)));
+		}
+	}
+}
+
+/** Every pair of the bimap has the same index in the PairsIndexer. */
+static int check_ranks(int n)
+{
+	pairs_bimap_type pbm;
+	build_bimap(n, pbm);
+	PairsIndexer pairs(n);
+	if (pairs.size() != pbm.size() || pairs.IsSample()) {
+		printf("%d obs: %d pairs, expected %d\n", n, (int) pairs.size(),
+			   (int) pbm.size());
+		return 1;
+	}
+	for (pbt_ci it = pbm.begin(), iend = pbm.end(); it != iend; ++it) {
+		int i, j;
+		pairs.GetPair(it->left, i, j);
+		if (!(UnOrdIntPair(i, j) == it->right) ||
+			PairsIndexer::Rank(n, i, j) != (uint64_t) it->left) {
+			printf("%d obs: pair %d is (%d,%d), expected (%d,%d)\n", n,
+				   it->left, i, j, it->right.i, it->right.j);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/** Unrank inverts Rank at the ends of rows, where rounding of the closed
+ form would show, for more pairs than a bimap could hold. */
+static int check_unrank(int n)
+{
+	int rows[] = { 0, 1, 2, n/3, n/2, n-3, n-2 };
+	for (int r=0; r<7; r++) {
+		int i = rows[r];
+		int js[] = { i+1, i+2, n-2, n-1 };
+		for (int t=0; t<4; t++) {
+			int j = js[t];
+			if (j <= i || j >= n) continue;
+			int ii, jj;
+			PairsIndexer::Unrank(n, PairsIndexer::Rank(n, i, j), ii, jj);
+			if (ii != i || jj != j) {
+				printf("%d obs: (%d,%d) unranks to (%d,%d)\n", n, i, j,
+					   ii, jj);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+/** A sample has exactly max_pairs distinct pairs in rank order, and the
+ same seed gives the same sample. */
+static int check_sample(int n, size_t max_pairs)
+{
+	PairsIndexer pairs(n, max_pairs, 42);
+	PairsIndexer again(n, max_pairs, 42);
+	if (!pairs.IsSample() || pairs.size() != max_pairs) {
+		printf("sample of %d obs: %d pairs\n", n, (int) pairs.size());
+		return 1;
+	}
+	uint64_t prev = 0;
+	for (size_t k=0; k<pairs.size(); ++k) {
+		int i, j, i2, j2;
+		pairs.GetPair(k, i, j);
+		again.GetPair(k, i2, j2);
+		if (i < 0 || i >= j || j >= n || i != i2 || j != j2) {
+			printf("sample of %d obs: bad pair %d (%d,%d)\n", n, (int) k,
+				   i, j);
+			return 1;
+		}
+		uint64_t r = PairsIndexer::Rank(n, i, j);
+		if (k > 0 && r <= prev) {
+			printf("sample of %d obs: pair %d out of order\n", n, (int) k);
+			return 1;
+		}
+		prev = r;
+	}
+	return 0;
+}
+
+/** PairDistances and PairProducts give what the old loops over the bimap
+ gave, with enough pairs to run on several threads. */
+static int check_kernels(int n)
+{
+	std::vector<double> x(n), y(n), z(n);
+	unsigned int seed = 7;
+	for (int i=0; i<n; i++) {
+		seed = seed * 1103515245 + 12345;
+		x[i] = -90.0 + (seed >> 16) % 1000 / 100.0;
+		seed = seed * 1103515245 + 12345;
+		y[i] = 30.0 + (seed >> 16) % 1000 / 100.0;
+		z[i] = x[i]*y[i];
+	}
+	pairs_bimap_type pbm;
+	build_bimap(n, pbm);
+	PairsIndexer pairs(n);
+
+	std::vector<double> D_old(pbm.size()), A_old(pbm.size());
+	std::vector<double> P_old(pbm.size());
+	double mean = 0, var = 0;
+	for (int i=0; i<n; i++) mean += z[i];
+	mean /= (double) n;
+	for (int i=0; i<n; i++) var += (z[i]-mean)*(z[i]-mean);
+	var /= (double) n;
+	for (pbt_ci it = pbm.begin(), iend = pbm.end(); it != iend; ++it) {
+		size_t i = it->right.i;
+		size_t j = it->right.j;
+		D_old[it->left] = GenGeomAlgs::ComputeEucDist(x[i], y[i],
+													  x[j], y[j]);
+		A_old[it->left] = GenGeomAlgs::EarthRadToMi(
+			GenGeomAlgs::ComputeArcDistRad(x[i], y[i], x[j], y[j]));
+		P_old[it->left] = (z[i]-mean)*(z[j]-mean)/var;
+	}
+
+	std::vector<double> D, A, P;
+	double D_min, D_max, A_min, A_max, P_min, P_max;
+	DistancesCalc::PairDistances(pairs, x, y, false, false, D, D_min, D_max);
+	DistancesCalc::PairDistances(pairs, x, y, true, true, A, A_min, A_max);
+	DistancesCalc::PairProducts(pairs, z, mean, var, P, P_min, P_max);
+	if (D != D_old || A != A_old || P != P_old) {
+		printf("%d obs: pair kernels differ from the bimap loops\n", n);
+		return 1;
+	}
+	if (D_min != *std::min_element(D_old.begin(), D_old.end()) ||
+		D_max != *std::max_element(D_old.begin(), D_old.end()) ||
+		P_min != *std::min_element(P_old.begin(), P_old.end()) ||
+		P_max != *std::max_element(P_old.begin(), P_old.end())) {
+		printf("%d obs: wrong min or max\n", n);
+		return 1;
+	}
+	return 0;
+}
+
+int main()
+{
+	int failed = 0;
+	int ns[] = { 0, 1, 2, 3, 4, 7, 31, 100 };
+	for (int t=0; t<8; t++) failed += check_ranks(ns[t]);
+	int big_ns[] = { 5, 1000, 46341, 65537, 100000, 3037000, 2000000000 };
+	for (int t=0; t<7; t++) failed += check_unrank(big_ns[t]);
+	failed += check_sample(200, 1000);
+	failed += check_sample(2000, PairsIndexer::default_max_pairs);
+	failed += check_kernels(40);
+	failed += check_kernels(500);
+
+	if (failed) {
+		printf("TestPairsIndexer: %d checks failed\n", failed);
+		return 1;
+	}
+	printf("TestPairsIndexer: ok\n");
+	return 0;
+}
@@ -0,0 +1,201 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ The three TraceEstimator methods against run1, the serial conjugate
+ gradient solve per observation of ML_im.cpp that they replaced.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "../ShapeOperations/GalWeight.h"
+#include "../Regression/mix.h"
+#include "../Regression/DenseVector.h"
+#include "../Regression/SparseVector.h"
+#include "../Regression/SparseMatrix.h"
+#include "../Regression/TraceEstimator.h"
+
+static double sqr(double x) { return x*x; }
+
+/** extract and run1 as they were in ML_im.cpp, without the progress bar
+ and the convergence statistics that were never reported. */
+static void extract(const SparseVector &v, const double *scale, const int row,
+					double &trace, double &trace2, double &frobenius)
+{
+	double t2 = 0, fr = 0, t;
+	double scale2 = 0, ssq2 = 1, scalef = 0, ssqf = 1;
+	for (int cnt = 0; cnt < v.getNzEntries(); ++cnt)  {
+		int ix = v.getIx( cnt );
+		double val = fabs( v.getValue( ix ) );
+		if (scale2 < val)  {
+			t = scale2 / val;
+			ssq2 = 1.0 + ssq2 * t * t;
+			scale2 = val;
+		}  else if (val > 0.0)  {
+			t = val / scale2;
+			ssq2 += t * t;
+		};
+		double vf = val / scale[ix];
+		if (scalef < vf)  {
+			t = scalef / vf;
+			ssqf = 1.0 + ssqf * t * t;
+			scalef = vf;
+		}  else if (vf > 0.0)  {
+			t = vf / scalef;
+			ssqf += t * t;
+		};
+	};
+	t2 = scale2 * scale2 * ssq2;
+	fr = scalef * scalef * ssqf;
+
+	trace += v.getValue(row);
+	trace2 += t2;
+	frobenius += fr * sqr(scale[row]);
+}
+
+static void run1(SparseMatrix &w, const double rr, double &trace,
+				 double &trace2, double &frobenius)
+{
+	const int LIMIT = 50;
+	const double EPS = 1.0e-14;
+	const int dim = w.dim();
+	SparseVector	sol( dim ), resid( dim ), p( dim ), d( dim );
+	double rho, beta, rho_lag = 0;
+
+	trace = 0, trace2 = 0, frobenius = 0;
+	for (int ix = 0; ix < dim; ++ix) {
+		sol.reset();
+		sol.setAt( ix, 1 );
+		w.rowIminusRhoThis( rr, p, sol );			// p = Ax
+		resid.minus( sol, p );			// r = b - Ax
+		rho = resid.norm();			// rho = ss of resid
+		int it = 0;				// iteration counter
+		while (rho > EPS && it < LIMIT) {
+			++it;
+			if (it == 1) {
+				d.copy(resid);
+			} else {
+				beta = rho / rho_lag;
+				d.timesPlus(resid, beta);
+			}
+			w.rowIminusRhoThis( rr, p, d );			// p = Ad
+			double alpha = rho / d.product( p );	// alpha = rho / d'p
+			sol.addTimes( d, alpha );			// sol = sol + alpha*d
+			resid.addTimes( p, -alpha );		// resid = resid - alpha*p
+			rho_lag = rho;
+			rho = resid.norm();
+		}
+		w.rowMatrix( p, sol );				// p = (Winv(I-rW))i
+
+		extract(p, w.getScale(), ix, trace, trace2, frobenius);
+	}
+}
+
+/** Rook contiguity of a rows x cols grid, less the links of cells whose
+ index is a multiple of cut to their right neighbor. */
+static GalElement* grid_gal(int rows, int cols, int cut)
+{
+	int n = rows*cols;
+	std::vector<std::vector<long> > nbrs(n);
+	for (int r=0; r<rows; r++) {
+		for (int c=0; c<cols; c++) {
+			int i = r*cols + c;
+			if (c+1 < cols && (cut == 0 || i % cut != 0)) {
+				nbrs[i].push_back(i+1);
+				nbrs[i+1].push_back(i);
+			}
+			if (r+1 < rows) {
+				nbrs[i].push_back(i+cols);
+				nbrs[i+cols].push_back(i);
+			}
+		}
+	}
+	GalElement* gal = new GalElement[n];
+	for (int i=0; i<n; i++) {
+		gal[i].SetSizeNbrs(nbrs[i].size());
+		for (size_t k=0; k<nbrs[i].size(); k++) gal[i].SetNbr(k, nbrs[i][k]);
+	}
+	return gal;
+}
+
+static bool near(double a, double b, double rel_tol)
+{
+	return fabs(a-b) <= rel_tol * (fabs(b) > 1 ? fabs(b) : 1);
+}
+
+static int check(const char* name, int rows, int cols, int cut)
+{
+	int n = rows*cols;
+	GalElement* gal = grid_gal(rows, cols, cut);
+	// as in the lag and error models
+	SparseMatrix w(gal, n);
+	w.rowStandardize();
+	w.makeStdSymmetric();
+
+	TraceEstimator eigen(w, TraceEstimator::eigen_method);
+	TraceEstimator exact(w, TraceEstimator::exact_method);
+	TraceEstimator stoch(w, TraceEstimator::stochastic_method, 2000);
+	eigen.Prepare();
+	int failed = 0;
+	if (eigen.GetMethod() != TraceEstimator::eigen_method) {
+		printf("%s: the eigen decomposition failed\n", name);
+		failed++;
+	}
+
+	const double rhos[] = { -0.6, 0, 0.3, 0.85 };
+	for (int r=0; r<4; r++) {
+		double t, t2, fr;
+		run1(w, rhos[r], t, t2, fr);
+		TraceEstimator* ests[] = { &eigen, &exact, &stoch };
+		for (int e=0; e<3; e++) {
+			double et, et2, efr;
+			ests[e]->Compute(rhos[r], et, et2, efr);
+			// the stochastic trace is tested against its own bound, the
+			// other stochastic terms against a loose relative tolerance
+			bool is_stoch = (e == 2);
+			double tol = is_stoch ? 0.05 : 1e-7;
+			bool t_ok = is_stoch ? fabs(et-t) <= stoch.GetErrorBound() + 1e-9 :
+				near(et, t, tol);
+			if (!t_ok || !near(et2, t2, tol) || !near(efr, fr, tol)) {
+				printf("%s, %s, rho %g: trace %g %g %g, expected %g %g %g\n",
+					   name, (const char*) ests[e]->GetMethodName().mb_str(),
+					   rhos[r], et, et2, efr, t, t2, fr);
+				failed++;
+			}
+		}
+	}
+	delete [] gal;
+	return failed;
+}
+
+int main()
+{
+	int failed = 0;
+	failed += check("grid 6x5", 6, 5, 0);
+	failed += check("cut grid 9x7", 9, 7, 4);
+	failed += check("strip 1x12", 1, 12, 0);
+
+	if (failed) {
+		printf("TestTraceEstimator: %d checks failed\n", failed);
+		return 1;
+	}
+	printf("TestTraceEstimator: ok\n");
+	return 0;
+}
@@ -0,0 +1,524 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <boost/bind.hpp>
+#include "GdaShape.h"
+#include "ShapeOperations/PolygonLod.h"
+#include "TileRenderer.h"
+
+RenderScene::RenderScene(int width_s, int height_s)
+: width(width_s), height(height_s), tile_size(1), tiles_x(0), tiles_y(0)
+{
+}
+
+void RenderScene::SetStyle(const wxColour& fill, bool fill_on,
+						   const wxColour& line, bool line_on)
+{
+	Style s;
+	s.fill[0] = fill.Red();
+	s.fill[1] = fill.Green();
+	s.fill[2] = fill.Blue();
+	s.fill[3] = fill.Alpha();
+	s.line[0] = line.Red();
+	s.line[1] = line.Green();
+	s.line[2] = line.Blue();
+	s.line[3] = line.Alpha();
+	s.fill_on = fill_on && fill.IsOk() && s.fill[3] > 0;
+	s.line_on = line_on && line.IsOk() && s.line[3] > 0;
+	styles.push_back(s);
+}
+
+void RenderScene::AddPolygon(const GdaPolygon* p, const PolygonLod* lod,
+							 int rec)
+{
+	if (styles.empty() || !p || p->n <= 0) return;
+	if (p->all_points_same) {
+		AddCircle(p->center.x, p->center.y, 0.2);
+		return;
+	}
+	int level = -1;
+	if (lod && lod->Matches(rec, p->pc)) {
+		level = lod->ChooseLevel(p->points_scale);
+	}
+	Shape s;
+	s.is_circle = false;
+	s.style = styles.size()-1;
+	s.first_part = part_end.size();
+	s.num_parts = 0;
+	s.cx = s.cy = s.r = 0;
+	s.min_x = s.max_x = p->points[0].x;
+	s.min_y = s.max_y = p->points[0].y;
+	if (level >= 0) {
+		for (int j=0, nr=lod->GetNumRings(level, rec); j<nr; j++) {
+			const int* r_end = lod->RingEnd(level, rec, j);
+			for (const int* r=lod->RingBegin(level, rec, j); r<r_end; r++) {
+				AddPoint(s, p->points[*r]);
+			}
+			part_end.push_back(px.size());
+			s.num_parts++;
+		}
+	} else {
+		for (int c=0, st=0; c<p->n_count && st<p->n; c++) {
+			int t = std::min(st + p->count[c], p->n);
+			for (int pt=st; pt<t; pt++) AddPoint(s, p->points[pt]);
+			part_end.push_back(px.size());
+			s.num_parts++;
+			st = t;
+		}
+	}
+	shapes.push_back(s);
+}
+
+void RenderScene::AddPoint(Shape& s, const wxPoint& q)
+{
+	px.push_back(q.x);
+	py.push_back(q.y);
+	if (q.x < s.min_x) s.min_x = q.x;
+	if (q.x > s.max_x) s.max_x = q.x;
+	if (q.y < s.min_y) s.min_y = q.y;
+	if (q.y > s.max_y) s.max_y = q.y;
+}
+
+void RenderScene::AddCircle(double x, double y, double r)
+{
+	if (styles.empty()) return;
+	Shape s;
+	s.is_circle = true;
+	s.style = styles.size()-1;
+	s.first_part = 0;
+	s.num_parts = 0;
+	s.cx = x;
+	s.cy = y;
+	s.r = r;
+	// the outline is drawn half a pixel outside of r
+	s.min_x = x - r - 1;
+	s.max_x = x + r + 1;
+	s.min_y = y - r - 1;
+	s.max_y = y + r + 1;
+	shapes.push_back(s);
+}
+
+void RenderScene::Finish(int tile_size_s)
+{
+	tile_size = std::max(tile_size_s, 1);
+	tiles_x = (width + tile_size - 1) / tile_size;
+	tiles_y = (height + tile_size - 1) / tile_size;
+	int n_tiles = tiles_x * tiles_y;
+	tile_start.assign(n_tiles+1, 0);
+	for (int pass=0; pass<2; pass++) {
+		std::vector<size_t> pos(tile_start);
+		for (int i=0, iend=shapes.size(); i<iend; i++) {
+			const Shape& s = shapes[i];
+			// outlines reach one pixel past the points
+			int x0 = std::max((int) floor(s.min_x - 1) / tile_size, 0);
+			int x1 = std::min((int) floor(s.max_x + 1) / tile_size, tiles_x-1);
+			int y0 = std::max((int) floor(s.min_y - 1) / tile_size, 0);
+			int y1 = std::min((int) floor(s.max_y + 1) / tile_size, tiles_y-1);
+			if (s.max_x + 1 < 0 || s.max_y + 1 < 0 ||
+				s.min_x - 1 >= width || s.min_y - 1 >= height) continue;
+			for (int ty=y0; ty<=y1; ty++) {
+				for (int tx=x0; tx<=x1; tx++) {
+					if (pass == 0) tile_start[ty*tiles_x+tx+1]++;
+					else tile_shapes[pos[ty*tiles_x+tx]++] = i;
+				}
+			}
+		}
+		if (pass == 0) {
+			for (int t=0; t<n_tiles; t++) tile_start[t+1] += tile_start[t];
+			tile_shapes.resize(tile_start[n_tiles]);
+		}
+	}
+}
+
+/**
+ Region of the canvas held in an RGBA buffer, at scale pixels per
+ canvas pixel.  Pixels are sampled at their centers: pixel (x, y) of the
+ scaled canvas is covered when (x+0.5, y+0.5) is inside a shape.  No
+ anti-aliasing is done.
+ */
+struct Raster {
+	unsigned char* buf;
+	int x0, y0, w, h;
+	double scale;
+	
+	void Blend(int x, int y, const unsigned char* c) const {
+		x -= x0;
+		y -= y0;
+		if (x < 0 || y < 0 || x >= w || y >= h) return;
+		unsigned char* d = buf + 4*((size_t) y*w + x);
+		if (c[3] == 255 || d[3] == 0) {
+			d[0] = c[0]; d[1] = c[1]; d[2] = c[2]; d[3] = c[3];
+			return;
+		}
+		double sa = c[3]/255.0, da = d[3]/255.0 * (1-sa), oa = sa + da;
+		for (int k=0; k<3; k++) {
+			d[k] = (unsigned char) ((c[k]*sa + d[k]*da)/oa + 0.5);
+		}
+		d[3] = (unsigned char) (oa*255 + 0.5);
+	}
+	/** Pixels of row y whose centers are in [xa, xb) */
+	void Span(int y, double xa, double xb, const unsigned char* c) const {
+		if (y < y0 || y >= y0+h) return;
+		int a = std::max((int) ceil(xa - 0.5), x0);
+		int b = std::min((int) ceil(xb - 0.5), x0+w);
+		for (int x=a; x<b; x++) Blend(x, y, c);
+	}
+	/** Rows whose centers are in [ya, yb) */
+	int FirstRow(double ya) const {
+		return std::max((int) ceil(ya - 0.5), y0); }
+	int EndRow(double yb) const {
+		return std::min((int) ceil(yb - 0.5), y0+h); }
+};
+
+struct RasterEdge {
+	double x0, y0, x1, y1;
+	int dir;
+	bool operator<(const RasterEdge& e) const { return y0 < e.y0; }
+};
+
+static void fillPolygon(const Raster& r, const RenderScene& sc,
+						const RenderScene::Shape& s, const unsigned char* c,
+						std::vector<RasterEdge>& edges,
+						std::vector<std::pair<double, int> >& xs)
+{
+	const std::vector<int>& px = sc.GetX();
+	const std::vector<int>& py = sc.GetY();
+	edges.clear();
+	for (int part=s.first_part; part<s.first_part+s.num_parts; part++) {
+		int b = sc.PartBegin(part), e = sc.PartEnd(part);
+		for (int k=b; k<e; k++) {
+			int k2 = (k+1 < e) ? k+1 : b;
+			if (py[k] == py[k2]) continue;
+			RasterEdge ed;
+			ed.dir = (py[k2] > py[k]) ? 1 : -1;
+			int lo = (ed.dir > 0) ? k : k2, hi = (ed.dir > 0) ? k2 : k;
+			ed.x0 = px[lo] * r.scale;
+			ed.y0 = py[lo] * r.scale;
+			ed.x1 = px[hi] * r.scale;
+			ed.y1 = py[hi] * r.scale;
+			edges.push_back(ed);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	
+	// edges crossing the current row, among the edges[0, next) started
+	std::vector<int> active;
+	size_t next = 0;
+	int y_end = r.EndRow(s.max_y * r.scale);
+	for (int y=r.FirstRow(s.min_y * r.scale); y<y_end; y++) {
+		double yc = y + 0.5;
+		while (next < edges.size() && edges[next].y0 <= yc) active.push_back(next++);
+		xs.clear();
+		size_t keep = 0;
+		for (size_t i=0; i<active.size(); i++) {
+			const RasterEdge& ed = edges[active[i]];
+			if (ed.y1 <= yc) continue;
+			active[keep++] = active[i];
+			double x = ed.x0 + (yc - ed.y0) * (ed.x1 - ed.x0) / (ed.y1 - ed.y0);
+			xs.push_back(std::make_pair(x, ed.dir));
+		}
+		active.resize(keep);
+		std::sort(xs.begin(), xs.end());
+		// non-zero winding rule, as wxWINDING_RULE
+		int winding = 0;
+		for (size_t i=0; i+1<xs.size(); i++) {
+			winding += xs[i].second;
+			if (winding != 0) r.Span(y, xs[i].first, xs[i+1].first, c);
+		}
+	}
+}
+
+static void drawLine(const Raster& r, double xa, double ya, double xb,
+					 double yb, const unsigned char* c)
+{
+	// clip to the raster with a margin of one pixel (Liang-Barsky)
+	double t0 = 0, t1 = 1, dx = xb - xa, dy = yb - ya;
+	double p[4] = { -dx, dx, -dy, dy };
+	double q[4] = { xa - (r.x0-1), (r.x0+r.w+1) - xa,
+		ya - (r.y0-1), (r.y0+r.h+1) - ya };
+	for (int i=0; i<4; i++) {
+		if (p[i] == 0) {
+			if (q[i] < 0) return;
+		} else {
+			double t = q[i] / p[i];
+			if (p[i] < 0) { if (t > t1) return; if (t > t0) t0 = t; }
+			else { if (t < t0) return; if (t < t1) t1 = t; }
+		}
+	}
+	int x = (int) floor(xa + t0*dx), y = (int) floor(ya + t0*dy);
+	int x2 = (int) floor(xa + t1*dx), y2 = (int) floor(ya + t1*dy);
+	// Bresenham
+	int sx = x < x2 ? 1 : -1, sy = y < y2 ? 1 : -1;
+	int ex = abs(x2 - x), ey = -abs(y2 - y), err = ex + ey;
+	while (true) {
+		r.Blend(x, y, c);
+		if (x == x2 && y == y2) break;
+		int e2 = 2*err;
+		if (e2 >= ey) { err += ey; x += sx; }
+		if (e2 <= ex) { err += ex; y += sy; }
+	}
+}
+
+static void strokePolygon(const Raster& r, const RenderScene& sc,
+						  const RenderScene::Shape& s, const unsigned char* c)
+{
+	const std::vector<int>& px = sc.GetX();
+	const std::vector<int>& py = sc.GetY();
+	for (int part=s.first_part; part<s.first_part+s.num_parts; part++) {
+		int b = sc.PartBegin(part), e = sc.PartEnd(part);
+		for (int k=b; k<e; k++) {
+			int k2 = (k+1 < e) ? k+1 : b;
+			if (k2 == k) continue;
+			drawLine(r, px[k]*r.scale, py[k]*r.scale,
+					 px[k2]*r.scale, py[k2]*r.scale, c);
+		}
+	}
+}
+
+static void fillCircle(const Raster& r, double cx, double cy, double rad,
+					   const unsigned char* c)
+{
+	int y_end = r.EndRow(cy + rad);
+	for (int y=r.FirstRow(cy - rad); y<y_end; y++) {
+		double dy = y + 0.5 - cy;
+		double half = sqrt(std::max(rad*rad - dy*dy, 0.0));
+		r.Span(y, cx - half, cx + half, c);
+	}
+}
+
+/** Ring of one pixel centered on the circle */
+static void strokeCircle(const Raster& r, double cx, double cy, double rad,
+						 const unsigned char* c)
+{
+	double ro = rad + 0.5, ri = rad - 0.5;
+	int y_end = r.EndRow(cy + ro);
+	for (int y=r.FirstRow(cy - ro); y<y_end; y++) {
+		double dy = y + 0.5 - cy;
+		double ho = sqrt(std::max(ro*ro - dy*dy, 0.0));
+		if (ri > 0 && fabs(dy) < ri) {
+			double hi = sqrt(ri*ri - dy*dy);
+			r.Span(y, cx - ho, cx - hi, c);
+			r.Span(y, cx + hi, cx + ho, c);
+		} else {
+			r.Span(y, cx - ho, cx + ho, c);
+		}
+	}
+}
+
+TileRenderer::TileRenderer()
+: scene(0), workers(0), cancelled(false), next_task(0), notified(false),
+complete(true), width(0), height(0)
+{
+}
+
+TileRenderer::~TileRenderer()
+{
+	Cancel();
+}
+
+void TileRenderer::Cancel()
+{
+	if (workers) {
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			cancelled = true;
+		}
+		workers->join_all();
+		delete workers;
+		workers = 0;
+	}
+	if (scene) delete scene;
+	scene = 0;
+	done_tasks.clear();
+	preview.clear();
+	tiles.clear();
+}
+
+void TileRenderer::Start(RenderScene* scene_s,
+						 const boost::function<void()>& notify_s)
+{
+	Cancel();
+	scene = scene_s;
+	notify = notify_s;
+	width = scene->GetWidth();
+	height = scene->GetHeight();
+	pixels.assign((size_t) width * height * 4, 0);
+	int n_tiles = scene->GetTilesX() * scene->GetTilesY();
+	tiles.resize(n_tiles);
+	tile_copied.assign(n_tiles, false);
+	cancelled = false;
+	notified = false;
+	complete = (n_tiles == 0 || scene->GetNumShapes() == 0);
+	if (complete) return;
+	
+	// the preview is only worth it when there are more tiles than workers
+	int nCPUs = boost::thread::hardware_concurrency();
+	if (nCPUs < 1) nCPUs = 1;
+	next_task = (n_tiles > nCPUs) ? 0 : 1;
+	nCPUs = std::min(nCPUs, n_tiles);
+	workers = new boost::thread_group();
+	for (int i=0; i<nCPUs; i++) {
+		workers->create_thread(boost::bind(&TileRenderer::Worker, this));
+	}
+}
+
+bool TileRenderer::IsCancelled()
+{
+	boost::mutex::scoped_lock lock(mutex);
+	return cancelled;
+}
+
+void TileRenderer::Worker()
+{
+	int n_tasks = tiles.size() + 1;
+	while (true) {
+		int task;
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			if (cancelled || next_task >= n_tasks) return;
+			task = next_task++;
+		}
+		RenderTask(task);
+		bool do_notify = false;
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			if (cancelled) return;
+			done_tasks.push_back(task);
+			do_notify = !notified;
+			notified = true;
+		}
+		if (do_notify && notify) notify();
+	}
+}
+
+void TileRenderer::RenderTask(int task)
+{
+	Raster r;
+	const int* shp_begin = 0;
+	const int* shp_end = 0;
+	std::vector<int> all;
+	std::vector<unsigned char>* buf;
+	if (task == 0) {
+		r.x0 = r.y0 = 0;
+		r.w = (width + preview_scale - 1) / preview_scale;
+		r.h = (height + preview_scale - 1) / preview_scale;
+		r.scale = 1.0 / preview_scale;
+		all.resize(scene->GetNumShapes());
+		for (int i=0, iend=all.size(); i<iend; i++) all[i] = i;
+		shp_begin = &all[0];
+		shp_end = shp_begin + all.size();
+		buf = &preview;
+	} else {
+		int t = task-1, ts = scene->GetTileSize();
+		r.x0 = (t % scene->GetTilesX()) * ts;
+		r.y0 = (t / scene->GetTilesX()) * ts;
+		r.w = std::min(ts, width - r.x0);
+		r.h = std::min(ts, height - r.y0);
+		r.scale = 1;
+		shp_begin = scene->TileShapesBegin(t);
+		shp_end = scene->TileShapesEnd(t);
+		buf = &tiles[t];
+	}
+	buf->assign((size_t) r.w * r.h * 4, 0);
+	r.buf = &(*buf)[0];
+	
+	std::vector<RasterEdge> edges;
+	std::vector<std::pair<double, int> > xs;
+	int cnt = 0;
+	for (const int* i=shp_begin; i!=shp_end; ++i) {
+		if ((++cnt & 255) == 0 && IsCancelled()) return;
+		const RenderScene::Shape& s = scene->GetShape(*i);
+		const RenderScene::Style& st = scene->GetStyle(s);
+		// outlines would be preview_scale pixels wide in the preview
+		bool line_on = st.line_on && (task != 0 || !st.fill_on);
+		if (s.is_circle) {
+			double cx = s.cx * r.scale, cy = s.cy * r.scale, rad = s.r * r.scale;
+			if (st.fill_on) fillCircle(r, cx, cy, rad, st.fill);
+			if (line_on) strokeCircle(r, cx, cy, rad, st.line);
+			continue;
+		}
+		if ((s.max_x - s.min_x) * r.scale < 1 &&
+			(s.max_y - s.min_y) * r.scale < 1) {
+			// smaller than a pixel: sampling could miss it altogether
+			r.Blend((int) floor((s.min_x + s.max_x) / 2 * r.scale),
+					(int) floor((s.min_y + s.max_y) / 2 * r.scale),
+					st.fill_on ? st.fill : st.line);
+			continue;
+		}
+		if (st.fill_on) fillPolygon(r, *scene, s, st.fill, edges, xs);
+		if (line_on) strokePolygon(r, *scene, s, st.line);
+	}
+}
+
+bool TileRenderer::Collect()
+{
+	if (!scene) return false;
+	std::vector<int> done;
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		done.swap(done_tasks);
+		notified = false;
+	}
+	if (done.empty()) return false;
+	bool has_preview = false;
+	for (size_t i=0; i<done.size(); i++) {
+		if (done[i] == 0) has_preview = true;
+		else CopyTile(done[i]-1);
+	}
+	if (has_preview) CopyPreview();
+	complete = std::find(tile_copied.begin(), tile_copied.end(), false)
+		== tile_copied.end();
+	return true;
+}
+
+void TileRenderer::CopyTile(int t)
+{
+	int ts = scene->GetTileSize();
+	int x0 = (t % scene->GetTilesX()) * ts, y0 = (t / scene->GetTilesX()) * ts;
+	int w = std::min(ts, width - x0), h = std::min(ts, height - y0);
+	for (int y=0; y<h; y++) {
+		std::copy(tiles[t].begin() + 4*(size_t) y*w,
+				  tiles[t].begin() + 4*(size_t) (y+1)*w,
+				  pixels.begin() + 4*((size_t) (y0+y)*width + x0));
+	}
+	std::vector<unsigned char>().swap(tiles[t]);
+	tile_copied[t] = true;
+}
+
+void TileRenderer::CopyPreview()
+{
+	int ts = scene->GetTileSize();
+	int pw = (width + preview_scale - 1) / preview_scale;
+	for (int y=0; y<height; y++) {
+		for (int x=0; x<width; x++) {
+			int t = (y / ts) * scene->GetTilesX() + x / ts;
+			if (tile_copied[t]) {
+				x = (x / ts + 1) * ts - 1;
+				continue;
+			}
+			const unsigned char* s = &preview[4*((size_t) (y/preview_scale)*pw
+												 + x/preview_scale)];
+			std::copy(s, s+4, pixels.begin() + 4*((size_t) y*width + x));
+		}
+	}
+	std::vector<unsigned char>().swap(preview);
+}
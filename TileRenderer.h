@@ -0,0 +1,169 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_TILE_RENDERER_H__
+#define __GEODA_CENTER_TILE_RENDERER_H__
+
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <wx/colour.h>
+
+class GdaPolygon;
+class PolygonLod;
+class wxPoint;
+
+/**
+ Snapshot of the shapes to draw into a canvas, in screen coordinates and
+ in drawing order, with plain RGBA colours.  It holds no reference to the
+ GdaShape objects or to wx drawing objects, so that it can be rasterized
+ on worker threads while the canvas goes on changing its shapes.  Finish
+ bins the shapes by the tiles their bounding boxes overlap, which is the
+ index used to skip shapes outside a tile.
+ */
+class RenderScene {
+public:
+	RenderScene(int width, int height);
+	
+	/** Style of the shapes added next.  A transparent colour, or fill or
+	 line false, means no fill or no outline. */
+	void SetStyle(const wxColour& fill, bool fill_on,
+				  const wxColour& line, bool line_on);
+	/** Draws the simplification of lod chosen for p, when lod was built
+	 for the polygons p is record rec of. */
+	void AddPolygon(const GdaPolygon* p, const PolygonLod* lod = 0,
+					int rec = -1);
+	void AddCircle(double x, double y, double r);
+	/** Called once all shapes are added */
+	void Finish(int tile_size);
+	
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+	int GetTileSize() const { return tile_size; }
+	int GetTilesX() const { return tiles_x; }
+	int GetTilesY() const { return tiles_y; }
+	int GetNumShapes() const { return shapes.size(); }
+	
+	struct Style {
+		unsigned char fill[4]; // r, g, b, a
+		unsigned char line[4];
+		bool fill_on;
+		bool line_on;
+	};
+	struct Shape {
+		bool is_circle;
+		int style;
+		// polygon: points [part_end[first_part-1], part_end[first_part+n-1])
+		int first_part;
+		int num_parts;
+		double cx, cy, r; // circle
+		double min_x, min_y, max_x, max_y;
+	};
+	
+	const Style& GetStyle(const Shape& s) const { return styles[s.style]; }
+	const Shape& GetShape(int i) const { return shapes[i]; }
+	int PartBegin(int part) const { return part ? part_end[part-1] : 0; }
+	int PartEnd(int part) const { return part_end[part]; }
+	const std::vector<int>& GetX() const { return px; }
+	const std::vector<int>& GetY() const { return py; }
+	/** Shapes overlapping tile t, in drawing order */
+	const int* TileShapesBegin(int t) const {
+		return tile_shapes.empty() ? 0 : &tile_shapes[0] + tile_start[t]; }
+	const int* TileShapesEnd(int t) const {
+		return tile_shapes.empty() ? 0 : &tile_shapes[0] + tile_start[t+1]; }
+	
+private:
+	void AddPoint(Shape& s, const wxPoint& q);
+	
+	int width, height;
+	int tile_size, tiles_x, tiles_y;
+	std::vector<Style> styles;
+	std::vector<Shape> shapes;
+	std::vector<int> part_end;
+	std::vector<int> px, py;
+	std::vector<size_t> tile_start;
+	std::vector<int> tile_shapes;
+};
+
+/**
+ Rasterizes a RenderScene into an RGBA buffer on a pool of worker threads.
+ The canvas is cut into square tiles handed out to the workers, preceded
+ by a quarter resolution pass over the whole canvas that gives a quick
+ preview.  Starting a new scene cancels the one being rendered: workers
+ check for cancellation between shapes and the renderer waits for them.
+ 
+ notify is called on a worker thread whenever new tiles are done, and is
+ not called again until Collect has been called.  Collect, on the thread
+ owning the renderer, copies the tiles done so far into the pixels, where
+ the tiles not yet done show the preview.  Pixels not covered by any shape
+ have alpha 0.
+ */
+class TileRenderer {
+public:
+	static const int tile_size = 256;
+	static const int preview_scale = 4;
+	
+	TileRenderer();
+	virtual ~TileRenderer();
+	
+	/** Takes ownership of scene */
+	void Start(RenderScene* scene, const boost::function<void()>& notify);
+	void Cancel();
+	bool IsRunning() const { return scene != 0; }
+	
+	/** Returns true if the pixels changed since the last call */
+	bool Collect();
+	/** True once all the tiles of the current scene are in the pixels */
+	bool IsComplete() const { return complete; }
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+	/** width * height pixels of 4 bytes: r, g, b, a */
+	const std::vector<unsigned char>& GetPixels() const { return pixels; }
+	
+private:
+	TileRenderer(const TileRenderer&);
+	TileRenderer& operator=(const TileRenderer&);
+	
+	void Worker();
+	bool IsCancelled();
+	void RenderTask(int task);
+	void CopyTile(int t);
+	void CopyPreview();
+	
+	RenderScene* scene;
+	boost::function<void()> notify;
+	boost::thread_group* workers;
+	boost::mutex mutex;
+	// guarded by mutex
+	bool cancelled;
+	int next_task; // 0 is the preview, t+1 is tile t
+	std::vector<int> done_tasks;
+	bool notified;
+	
+	// task buffers, each written by one worker only
+	std::vector<unsigned char> preview;
+	std::vector<std::vector<unsigned char> > tiles;
+	
+	std::vector<bool> tile_copied;
+	bool complete;
+	int width, height;
+	std::vector<unsigned char> pixels;
+};
+
+#endif
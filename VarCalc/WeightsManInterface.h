@@ -29,6 +29,7 @@
 #include "GdaFlexValue.h"
 class GalWeight;
 class GeoDaWeight;
+class LogDetCache;
 class ProgressDlg;
 
 
@@ -62,6 +63,7 @@ public:
 	virtual void Remove(boost::uuids::uuid w_uuid) = 0;
 	virtual wxString RecNumToId(boost::uuids::uuid w_uuid, long rec_num) = 0;
 	virtual GalWeight* GetGal(boost::uuids::uuid w_uuid) = 0;
+	virtual LogDetCache* GetLogDetCache(boost::uuids::uuid w_uuid) = 0;
     virtual GeoDaWeight* GetWeights(boost::uuids::uuid w_uuid) = 0;
 	virtual boost::uuids::uuid GetDefault() const = 0;
 	virtual void MakeDefault(boost::uuids::uuid w_uuid) = 0;